@@ -12,7 +12,22 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../../../../include
 # Source files from parent project
 LOCAL_SRC_FILES := \
     ../../../../../src/crypting.cpp \
-    ../../../../../src/crypto_bridge.cpp
+    ../../../../../src/crypto_bridge.cpp \
+    ../../../../../src/crypto_arena.cpp \
+    ../../../../../src/crypto_buffer_pool.cpp \
+    ../../../../../src/crypto_parallel.cpp \
+    ../../../../../src/crypto_compress.cpp \
+    ../../../../../src/crypto_hash.cpp \
+    ../../../../../src/crypto_fs.cpp \
+    ../../../../../src/crypto_segment.cpp \
+    ../../../../../src/crypto_tree.cpp \
+    ../../../../../src/crypto_stream.cpp \
+    ../../../../../src/crypto_archive.cpp \
+    ../../../../../src/crypto_chunk_store.cpp \
+    ../../../../../src/crypto_jobs.cpp \
+    ../../../../../src/crypto_topology.cpp \
+    ../../../../../src/crypto_tuner.cpp \
+    ../../../../../src/crypto_secure_pool.cpp
 
 # Compiler flags for C++
 LOCAL_CPPFLAGS := -std=c++17 -fno-exceptions -fno-rtti -DANDROID -DCRYPTOPP_DISABLE_ASM=1
@@ -77,7 +77,10 @@ typedef enum {
     
     // Modern lightweight ciphers (placeholders - may not be in Crypto++)
     CRYPTO_ALGORITHM_SIMON = 42,
-    CRYPTO_ALGORITHM_SPECK = 43
+    CRYPTO_ALGORITHM_SPECK = 43,
+    
+    // Extended-nonce ChaCha20 (24-byte nonce, 256-bit key)
+    CRYPTO_ALGORITHM_XCHACHA20 = 44
 } CryptoBridgeAlgorithm;
 
 // Mode identifiers
@@ -87,7 +90,12 @@ typedef enum {
     CRYPTO_MODE_ECB = 3,
     CRYPTO_MODE_CFB = 4,
     CRYPTO_MODE_OFB = 5,
-    CRYPTO_MODE_CTR = 6
+    CRYPTO_MODE_CTR = 6,
+    CRYPTO_MODE_POLY1305 = 7, // ChaCha20/XChaCha20 with Poly1305 (AEAD, 16-byte tag)
+    CRYPTO_MODE_OCB = 8,      // OCB (RFC 7253), 128-bit block ciphers (AEAD, 16-byte tag)
+    CRYPTO_MODE_EAX = 9,      // EAX, 128-bit block ciphers (AEAD, 16-byte tag)
+    CRYPTO_MODE_TWEAK = 10,   // Threefish, block position as tweak (length preserving, random access)
+    CRYPTO_MODE_XTS = 11      // XTS (IEEE 1619), one data unit per sector; double-length key (length preserving)
 } CryptoBridgeMode;
 
 // Operation type
@@ -96,6 +104,65 @@ typedef enum {
     CRYPTO_OPERATION_DECRYPT = 2
 } CryptoBridgeOperation;
 
+// Buffer pool flags
+typedef enum {
+    CRYPTO_BUFFER_DEFAULT = 0,
+    CRYPTO_BUFFER_HUGE_PAGES = 1  // Back buffers of 2 MiB and up with huge pages where available
+} CryptoBridgeBufferFlags;
+
+// Context options (crypto_bridge_context_set_option)
+typedef enum {
+    CRYPTO_OPTION_GCM_TABLES = 1,    // CryptoBridgeGcmTables value
+    CRYPTO_OPTION_SECTOR_SIZE = 2,   // Bytes per sector for position-addressed modes (multiple of 16, default 4096)
+    CRYPTO_OPTION_START_SECTOR = 3,  // Sector number of the first input byte (default 0)
+    CRYPTO_OPTION_THREADS = 4,       // Worker threads for parallel modes (0 = one per core, default)
+    CRYPTO_OPTION_STREAM_OFFSET = 5, // Keystream byte offset of the first input byte, CTR mode only (default 0)
+    CRYPTO_OPTION_COMPRESSION = 6,   // CryptoBridgeCompression value; decryption follows the sealed frame
+    CRYPTO_OPTION_MAC = 7,           // CryptoBridgeMac value for CBC/ECB/CFB/OFB/CTR; set the same MAC to decrypt
+    CRYPTO_OPTION_NOTIFY_PORT = 8,   // Dart native port that receives job events (0 = none, default)
+    CRYPTO_OPTION_JOB_PRIORITY = 9,  // CryptoBridgeJobPriority of jobs submitted with the context
+    CRYPTO_OPTION_AUTOTUNE = 10,     // 1 = tune tree segment size and threads (default), 0 = fixed
+    CRYPTO_OPTION_MEMORY_BUDGET = 11 // Bytes of working buffers a tree, archive or chunk store call may hold (0 = no cap, default; else at least 8 MiB)
+} CryptoBridgeOption;
+
+// GHASH multiplication table size for GCM mode
+typedef enum {
+    CRYPTO_GCM_TABLES_AUTO = 0,  // 64K for inputs of 1 MiB and up when CLMUL/PMULL is missing, else 2K
+    CRYPTO_GCM_TABLES_2K = 1,    // Small key setup, best for short messages or with CLMUL/PMULL
+    CRYPTO_GCM_TABLES_64K = 2    // 64 KiB table per key, faster table-driven GHASH on bulk data
+} CryptoBridgeGcmTables;
+
+// Compression stage ahead of encryption (CRYPTO_OPTION_COMPRESSION)
+typedef enum {
+    CRYPTO_COMPRESSION_NONE = 0,     // Encrypt the data as is (default)
+    CRYPTO_COMPRESSION_DEFLATE = 1   // DEFLATE per 256 KiB chunk; incompressible chunks are stored raw
+} CryptoBridgeCompression;
+
+// Encrypt-then-MAC for the unauthenticated modes (CRYPTO_OPTION_MAC)
+typedef enum {
+    CRYPTO_MAC_NONE = 0,         // No integrity protection (default)
+    CRYPTO_MAC_HMAC_SHA256 = 1,  // HMAC-SHA256 over the ciphertext, 16-byte tag
+    CRYPTO_MAC_BLAKE2B = 2       // Keyed BLAKE2b over the ciphertext, 16-byte tag
+} CryptoBridgeMac;
+
+// Digest algorithms
+typedef enum {
+    CRYPTO_HASH_SHA256 = 1,    // 32-byte digest
+    CRYPTO_HASH_SHA512 = 2,    // 64-byte digest
+    CRYPTO_HASH_SHA3_256 = 3,  // 32-byte digest
+    CRYPTO_HASH_SHA3_512 = 4,  // 64-byte digest
+    CRYPTO_HASH_BLAKE2B = 5    // 64-byte digest
+} CryptoBridgeHash;
+
+// Digest construction
+typedef enum {
+    CRYPTO_HASH_MODE_PLAIN = 0,  // Standard digest of the data (matches sha256sum etc.)
+    CRYPTO_HASH_MODE_TREE = 1    // Merkle tree over 1 MiB leaves, hashed on all cores
+} CryptoBridgeHashMode;
+
+// Opaque per-caller settings
+typedef struct CryptoBridgeContext CryptoBridgeContext;
+
 // Status codes
 typedef enum {
     CRYPTO_STATUS_SUCCESS = 0,
@@ -107,9 +174,25 @@ typedef enum {
     CRYPTO_STATUS_CRYPTO_ERROR = -6,
     CRYPTO_STATUS_PASSWORD_TOO_SHORT = -7,
     CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL = -8,
-    CRYPTO_STATUS_UNKNOWN_ERROR = -9
+    CRYPTO_STATUS_UNKNOWN_ERROR = -9,
+    CRYPTO_STATUS_IO_ERROR = -10,
+    CRYPTO_STATUS_CANCELLED = -11,   // Job stopped by crypto_bridge_job_cancel
+    CRYPTO_STATUS_PENDING = 1        // Job still queued or running (crypto_bridge_job_poll)
 } CryptoBridgeStatus;
 
+// Job events (CryptoBridgeJobCallback)
+typedef enum {
+    CRYPTO_JOB_EVENT_PROGRESS = 1,  // done/total updated; status is CRYPTO_STATUS_PENDING
+    CRYPTO_JOB_EVENT_DONE = 2       // Job finished with status; sent exactly once
+} CryptoBridgeJobEvent;
+
+// Job priorities (CRYPTO_OPTION_JOB_PRIORITY); higher runs first
+typedef enum {
+    CRYPTO_JOB_PRIORITY_BACKGROUND = 0,  // Bulk work that may wait
+    CRYPTO_JOB_PRIORITY_NORMAL = 1,      // Default
+    CRYPTO_JOB_PRIORITY_INTERACTIVE = 2  // Work a user is waiting on
+} CryptoBridgeJobPriority;
+
 /**
  * Main FFI function for encryption and decryption operations
  * 
@@ -121,10 +204,14 @@ typedef enum {
  * @param password_len Length of password (excluding null terminator)
  * @param input_data Input data buffer
  * @param input_len Length of input data
- * @param output_data Output data buffer (allocated by caller)
+ * @param output_data Output data buffer (allocated by caller, may equal input_data)
  * @param output_len Pointer to output buffer size (in/out parameter)
- * @param iv Initialization vector (16 bytes, can be null for auto-generation)
- * @param auth_tag Authentication tag for GCM mode (16 bytes, can be null)
+ * @param iv Initialization vector (16 bytes, can be null for auto-generation). For
+ *           Poly1305, OCB and EAX encryption picks a random nonce and returns it
+ *           here; decryption reads it back from here. With a null iv the nonce
+ *           (12 bytes for ChaCha20 and OCB, 16 otherwise) is prepended to the data.
+ * @param auth_tag Authentication tag for AEAD modes (GCM, Poly1305, OCB, EAX) and for
+ *                 CRYPTO_OPTION_MAC (16 bytes, can be null to append it to the data)
  * 
  * @return Status code (0 = success, negative = error)
  */
@@ -143,6 +230,758 @@ int crypto_bridge_process(
     unsigned char* auth_tag
 );
 
+/**
+ * crypto_bridge_process with per-context settings
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * 
+ * All other parameters are as for crypto_bridge_process.
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_process_ex(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len,
+    unsigned char* iv,
+    unsigned char* auth_tag
+);
+
+/**
+ * Encrypt or decrypt sectors starting at a given sector number
+ * 
+ * For random access to sector-addressed data (disk images, paged files) in
+ * the position-addressed modes (XTS, Tweak). Overrides the context's start
+ * sector for this call only, so one configured context can serve concurrent
+ * page reads and writes. Input and output may be the same buffer. In XTS
+ * mode the input may end in a partial sector of at least 16 bytes; in Tweak
+ * mode it must hold at least one Threefish block.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param start_sector Sector number of the first input byte
+ * 
+ * All other parameters are as for crypto_bridge_process.
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_process_sectors(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    long long start_sector,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len
+);
+
+/**
+ * Encrypt or decrypt bytes starting at a given offset in the keystream
+ * 
+ * CTR mode only (block ciphers in CTR, ChaCha20, Salsa20 and the other
+ * stream ciphers). The output equals the matching slice of processing the
+ * whole stream in one call, so a large file can be split into ranges that
+ * different threads, processes or machines transform independently. Block
+ * cipher CTR and the counter-based stream ciphers (ChaCha20, XChaCha20,
+ * Salsa20, XSalsa20, SEAL) seek in constant time; the stream ciphers that
+ * cannot seek return CRYPTO_STATUS_INVALID_PARAMS for any offset but 0.
+ * Overrides the context's stream offset for this call only.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param stream_offset Byte position of the first input byte in the stream
+ * 
+ * All other parameters are as for crypto_bridge_process.
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_process_at(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    long long stream_offset,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len
+);
+
+/**
+ * crypto_bridge_process_ex that also digests the plaintext
+ * 
+ * The digest covers the input when encrypting and the output when
+ * decrypting, so both sides of a transfer can compare it. In CBC, ECB, CFB,
+ * OFB and CTR modes the hash reads each slice of data in the same pass as
+ * the cipher; other modes hash the plaintext separately. The digest is
+ * only written on success.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param hash_algorithm Digest algorithm (CryptoBridgeHash enum)
+ * @param hash_mode Digest construction (CryptoBridgeHashMode enum)
+ * @param digest Digest buffer (up to 64 bytes)
+ * @param digest_len Pointer to digest buffer size (in/out parameter)
+ * 
+ * All other parameters are as for crypto_bridge_process.
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_process_digest(
+    CryptoBridgeContext* context,
+    int hash_algorithm,
+    int hash_mode,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len,
+    unsigned char* iv,
+    unsigned char* auth_tag,
+    unsigned char* digest,
+    int* digest_len
+);
+
+/**
+ * Digest a buffer
+ * 
+ * @param context Context (thread count for tree mode), or null for defaults
+ * @param hash_algorithm Digest algorithm (CryptoBridgeHash enum)
+ * @param hash_mode Digest construction (CryptoBridgeHashMode enum)
+ * @param data Data to digest (may be null when data_len is 0)
+ * @param data_len Length of data
+ * @param digest Digest buffer (up to 64 bytes)
+ * @param digest_len Pointer to digest buffer size (in/out parameter)
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_hash(
+    CryptoBridgeContext* context,
+    int hash_algorithm,
+    int hash_mode,
+    const unsigned char* data,
+    int data_len,
+    unsigned char* digest,
+    int* digest_len
+);
+
+/**
+ * Digest a file, reading it in blocks without loading it into memory
+ * 
+ * In tree mode each block's leaves are hashed on all cores. Files of any
+ * size are supported.
+ * 
+ * @param path File path
+ * 
+ * All other parameters are as for crypto_bridge_hash.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_IO_ERROR if the file
+ *         cannot be read, other negative values on error)
+ */
+int crypto_bridge_hash_file(
+    CryptoBridgeContext* context,
+    int hash_algorithm,
+    int hash_mode,
+    const char* path,
+    unsigned char* digest,
+    int* digest_len
+);
+
+/**
+ * Progress callback for crypto_bridge_process_tree
+ * 
+ * Byte counts refer to input bytes read so far and in total.
+ */
+typedef void (*CryptoBridgeTreeProgress)(long long files_done, long long files_total,
+                                         long long bytes_done, long long bytes_total,
+                                         void* user_data);
+
+/**
+ * Encrypt or decrypt every file below a directory into another directory
+ * 
+ * The destination mirrors the source tree (same relative names, empty
+ * directories included); symbolic links and special files are skipped.
+ * Encrypted files use the segmented format: a 36-byte header followed by
+ * independently sealed 4 MiB segments, each with its own key and IV
+ * expanded from the password-derived key, the header's random salt and the
+ * segment number. The password KDF therefore runs once per call, not once
+ * per file. Small files are packed into shared tasks and large files are
+ * split across several, and all tasks run on a work-stealing pool sized by
+ * CRYPTO_OPTION_THREADS. The context's compression and MAC settings apply
+ * per segment; decryption takes compression from each file's header.
+ * Files are keyed by the password itself, with no key slots, so a new
+ * password means decrypting and encrypting them again; archives
+ * (crypto_bridge_archive_create) can change passwords in place.
+ * On failure, no partially written output file is left behind.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param source_dir Directory to read
+ * @param dest_dir Directory to write (created if missing; must differ from source_dir)
+ * @param progress Called on the calling thread about every 100 ms and once
+ *                 at the end (can be null)
+ * @param user_data Passed through to progress
+ * 
+ * All other parameters are as for crypto_bridge_process.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_IO_ERROR if a file or
+ *         directory cannot be read or written, CRYPTO_STATUS_CRYPTO_ERROR
+ *         if an input is not a valid encrypted file, other negative values
+ *         on error)
+ */
+int crypto_bridge_process_tree(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const char* source_dir,
+    const char* dest_dir,
+    CryptoBridgeTreeProgress progress,
+    void* user_data
+);
+
+/**
+ * Input callback for crypto_bridge_process_stream
+ * 
+ * Fills up to `capacity` bytes of `buffer`. Returns the number of bytes
+ * read, 0 at the end of the input, or a negative value on error.
+ */
+typedef long long (*CryptoBridgeStreamRead)(void* user_data, unsigned char* buffer,
+                                            long long capacity);
+
+/**
+ * Output callback for crypto_bridge_process_stream
+ * 
+ * Writes all `len` bytes of `data`. Returns 0 on success, anything else on
+ * error.
+ */
+typedef int (*CryptoBridgeStreamWrite)(void* user_data, const unsigned char* data, long long len);
+
+/**
+ * Encrypt or decrypt a stream of unknown length, such as a pipe
+ * 
+ * The output uses the segmented format of crypto_bridge_process_tree with
+ * a stream flag in the header: segments are read a window at a time,
+ * sealed or opened on CRYPTO_OPTION_THREADS workers and written in order,
+ * so memory stays at about two segment records per worker whatever the
+ * length of the stream. The last segment is sealed under its own key
+ * expansion, so with an AEAD mode or CRYPTO_OPTION_MAC a stream that was
+ * cut short fails to decrypt; an empty input still yields one empty last
+ * segment. The header records the algorithm, mode, key size, MAC and
+ * compression of the stream, and decryption follows it: the caller's
+ * values of these are only used to encrypt. With CRYPTO_OPTION_AUTOTUNE
+ * on, new streams use the segment size the autotuner settled on for the
+ * algorithm and mode. CRYPTO_OPTION_MEMORY_BUDGET caps the window, and the
+ * segment size of new streams if needed. Both callbacks run on the calling
+ * thread. Output already written is not taken back when a later segment
+ * fails. As with trees, the stream is keyed by the password itself.
+ * 
+ * @param read Supplies the input
+ * @param write Receives the output
+ * @param user_data Passed through to both callbacks
+ * 
+ * All other parameters are as for crypto_bridge_process_tree.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_IO_ERROR if a callback fails,
+ *         CRYPTO_STATUS_CRYPTO_ERROR if the input is not a valid stream,
+ *         other negative values on error)
+ */
+int crypto_bridge_process_stream(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    CryptoBridgeStreamRead read,
+    CryptoBridgeStreamWrite write,
+    void* user_data
+);
+
+/**
+ * Pack every file below a directory into one encrypted archive
+ * 
+ * The archive is a 48-byte header, eight key slots, the sealed segments of
+ * every file, and an encrypted index of names, sizes and segment locations,
+ * so neither the contents nor the layout of the tree are visible without
+ * the password. Data and index are sealed under a random archive key, and
+ * the first key slot wraps that key under the password, so passwords can
+ * later be changed without touching the data. Segments are sealed as in
+ * crypto_bridge_process_tree and run on the same work-stealing pool. The
+ * header records the algorithm, mode, MAC and key size, which listing and
+ * extraction read back from it. A tree holding a name with a control
+ * character, which would break the listing, is refused with
+ * CRYPTO_STATUS_INVALID_PARAMS. On failure, the archive file is removed.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param source_dir Directory to read
+ * @param archive_path Archive file to write (replaced if it exists)
+ * @param progress Called on the calling thread about every 100 ms and once
+ *                 at the end (can be null)
+ * @param user_data Passed through to progress
+ * 
+ * All other parameters are as for crypto_bridge_process.
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_archive_create(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* source_dir,
+    const char* archive_path,
+    CryptoBridgeTreeProgress progress,
+    void* user_data
+);
+
+/**
+ * List the entries of an archive
+ * 
+ * Only the header and the index are read and decrypted. The listing is
+ * NUL-terminated text with one line per entry: the size in bytes, a tab,
+ * and the '/' separated name, with a trailing '/' on directories.
+ * 
+ * @param listing Buffer for the listing
+ * @param listing_len Pointer to listing buffer size (in/out parameter,
+ *                    includes the terminating NUL)
+ * 
+ * algorithm, mode and key_size_bits are ignored; the archive header records
+ * them. All other parameters are as for crypto_bridge_archive_create.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL
+ *         with the required size in listing_len, CRYPTO_STATUS_CRYPTO_ERROR
+ *         if the file is not an archive or the password is wrong, other
+ *         negative values on error)
+ */
+int crypto_bridge_archive_list(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* archive_path,
+    char* listing,
+    int* listing_len
+);
+
+/**
+ * Extract one entry, or every entry, from an archive
+ * 
+ * Only the index and the segments of the selected entries are read, so
+ * pulling one file out of a large archive does not decrypt the rest.
+ * Parent directories are created as needed. Names in the index that are
+ * absolute, contain ".." or hold control characters are rejected before
+ * anything is written.
+ * 
+ * @param entry_name Name of the entry as listed (without the trailing '/'
+ *                   of directories), or null to extract everything
+ * @param dest_dir Directory to extract into (created if missing)
+ * 
+ * algorithm, mode and key_size_bits are ignored; the archive header records
+ * them. All other parameters are as for crypto_bridge_archive_create.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_INVALID_PARAMS if no
+ *         entry has that name, CRYPTO_STATUS_CRYPTO_ERROR if the archive
+ *         does not authenticate, other negative values on error)
+ */
+int crypto_bridge_archive_extract(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* archive_path,
+    const char* entry_name,
+    const char* dest_dir,
+    CryptoBridgeTreeProgress progress,
+    void* user_data
+);
+
+/**
+ * Let another password open an archive
+ * 
+ * The archive key is unwrapped with an existing password and wrapped under
+ * the new one in a free key slot. Only that 84-byte slot is written; the
+ * data is not read or re-encrypted.
+ * 
+ * @param archive_path Archive created by crypto_bridge_archive_create
+ * @param password Any password that already opens the archive
+ * @param password_len Length of password (at least 8)
+ * @param new_password Password to add
+ * @param new_password_len Length of new_password (at least 8)
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_CRYPTO_ERROR if password
+ *         opens no slot, CRYPTO_STATUS_INVALID_PARAMS if all eight slots
+ *         are used or the archive has no key slots, other negative values
+ *         on error)
+ */
+int crypto_bridge_archive_add_password(
+    const char* archive_path,
+    const char* password,
+    int password_len,
+    const char* new_password,
+    int new_password_len
+);
+
+/**
+ * Replace one of an archive's passwords
+ * 
+ * The new slot is written before the old one is cleared, so an interrupted
+ * change leaves at least one of the two passwords working. When every slot
+ * is in use, the old slot is rewritten in place.
+ * 
+ * Parameters and return values are as for crypto_bridge_archive_add_password,
+ * except that a full set of slots is not an error.
+ */
+int crypto_bridge_archive_change_password(
+    const char* archive_path,
+    const char* password,
+    int password_len,
+    const char* new_password,
+    int new_password_len
+);
+
+/**
+ * Stop a password from opening an archive
+ * 
+ * Clears the slot that password opens. The last remaining password cannot
+ * be removed.
+ * 
+ * @param archive_path Archive created by crypto_bridge_archive_create
+ * @param password Password to remove
+ * @param password_len Length of password
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_CRYPTO_ERROR if password
+ *         opens no slot, CRYPTO_STATUS_INVALID_PARAMS if it is the only
+ *         password or the archive has no key slots, other negative values
+ *         on error)
+ */
+int crypto_bridge_archive_remove_password(
+    const char* archive_path,
+    const char* password,
+    int password_len
+);
+
+/**
+ * Store a file in a deduplicating chunk store and write its recipe
+ * 
+ * The file is cut at content-defined boundaries (about 1 MiB apart, 256 KiB
+ * to 4 MiB) and each chunk is named by a keyed hash of its contents. Only
+ * chunks the store does not already hold are encrypted and written, so
+ * storing a slightly changed file again costs roughly the changed bytes.
+ * Chunks are sealed deterministically with AES-256 in an SIV construction,
+ * so identical chunks from any file share one object. The recipe, which
+ * lists the file's chunks, is encrypted with AES-256-GCM and written to
+ * recipe_path; keep it alongside, not inside, the store. The store is
+ * created on first use with a random salt, and every later call must use
+ * the same password. Chunks are processed on CRYPTO_OPTION_THREADS workers.
+ * A chunk the store already holds is sealed and compared with its object
+ * rather than trusted by name, and an object that differs (truncated or
+ * damaged) is written again. The store's cipher is fixed, so a context
+ * with CRYPTO_OPTION_COMPRESSION or CRYPTO_OPTION_MAC set is refused with
+ * CRYPTO_STATUS_INVALID_PARAMS, here and in crypto_bridge_store_get.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param password Store password
+ * @param password_len Length of password
+ * @param store_dir Store directory (created if missing)
+ * @param source_path File to store
+ * @param recipe_path Recipe file to write (replaced if it exists)
+ * @param stored_bytes Receives the number of chunk bytes newly written to
+ *                     the store, replaced objects included (can be null)
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_CRYPTO_ERROR if the
+ *         password does not match the store, other negative values on error)
+ */
+int crypto_bridge_store_put(
+    CryptoBridgeContext* context,
+    const char* password,
+    int password_len,
+    const char* store_dir,
+    const char* source_path,
+    const char* recipe_path,
+    long long* stored_bytes
+);
+
+/**
+ * Rebuild a file from its recipe and a chunk store
+ * 
+ * Every chunk is checked against its keyed hash as it is opened.
+ * 
+ * @param dest_path File to write (replaced if it exists; removed on failure)
+ * 
+ * All other parameters are as for crypto_bridge_store_put.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_IO_ERROR if the store,
+ *         the recipe or a chunk cannot be read, CRYPTO_STATUS_CRYPTO_ERROR
+ *         if the recipe or a chunk does not authenticate, other negative
+ *         values on error)
+ */
+int crypto_bridge_store_get(
+    CryptoBridgeContext* context,
+    const char* password,
+    int password_len,
+    const char* store_dir,
+    const char* recipe_path,
+    const char* dest_path
+);
+
+/**
+ * Bring an encrypted file up to date with its plaintext, rewriting only
+ * the segments that changed
+ * 
+ * The encrypted file uses the segmented format of crypto_bridge_process_tree
+ * with a digest table: an encrypted list of each segment's SHA-256 and key
+ * version, stored after the last record. Each segment of the new plaintext
+ * is hashed and compared with the table, and only segments whose digest or
+ * length changed are resealed, in place, under a fresh random version; the
+ * table and header are then rewritten and the file is cut to its new
+ * length. With changed ranges, segments outside them are not even read, so
+ * the work follows the size of the edit. If encrypted_path does not exist,
+ * or has no digest table (such as a file written by
+ * crypto_bridge_process_tree), it is encrypted from scratch with one.
+ * crypto_bridge_process_tree decrypts either kind. Compression is not
+ * supported, since compressed segments cannot be rewritten in place.
+ * Before the first in-place write, the bytes the update will overwrite are
+ * saved to encrypted_path + ".journal" (ciphertext only; records cut off by
+ * a shrink are included). A failed update restores them before returning.
+ * If the process dies mid-update, the file does not decrypt until the next
+ * call with the same encrypted_path, which restores it first. The journal
+ * is removed once the update is complete.
+ * 
+ * @param context Context from crypto_bridge_context_create, or null for defaults
+ * @param plain_path Current plaintext
+ * @param encrypted_path Encrypted file to update or create
+ * @param ranges Changed byte ranges of the plaintext as (offset, length)
+ *               pairs, or null to compare every segment
+ * @param range_count Number of pairs in ranges
+ * @param rewritten_bytes Receives the plaintext bytes that were resealed
+ *                        (can be null)
+ * 
+ * All other parameters are as for crypto_bridge_process. The algorithm,
+ * mode, key size, password and MAC must match those the file was written
+ * with.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_CRYPTO_ERROR if the
+ *         existing digest table does not open with these settings, other
+ *         negative values on error)
+ */
+int crypto_bridge_file_update(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* plain_path,
+    const char* encrypted_path,
+    const long long* ranges,
+    int range_count,
+    long long* rewritten_bytes
+);
+
+/**
+ * Event callback for background jobs
+ * 
+ * Runs on a native worker thread, never on the thread that submitted the
+ * job, and must not block for long. done/total count input bytes.
+ */
+typedef void (*CryptoBridgeJobCallback)(long long job_id, int event, int status,
+                                        long long done, long long total, void* user_data);
+
+/**
+ * Start crypto_bridge_process_ex on a background thread
+ * 
+ * Returns at once; the work runs on a small pool of native worker threads
+ * (and from there on the context's threads, as in a direct call). Events go
+ * to callback, or, when callback is null, to the Dart port set with
+ * CRYPTO_OPTION_NOTIFY_PORT once crypto_bridge_job_set_dart_api has been
+ * called. A port receives each event as an Int64List of
+ * [job_id, event, status, done, total]. The settings and password are
+ * copied, so the context may be destroyed right after submitting.
+ * 
+ * Jobs start in order of CRYPTO_OPTION_JOB_PRIORITY, at most
+ * crypto_bridge_job_set_concurrency at a time, and inputs of up to 1 MiB
+ * also have a lane of their own so they never wait behind bulk work.
+ * 
+ * The output is allocated by the bridge; fetch it with
+ * crypto_bridge_job_take_result after CRYPTO_JOB_EVENT_DONE.
+ * 
+ * @param input_data Input data; must stay valid until the job finishes
+ * @param iv As for crypto_bridge_process; must stay valid until the job finishes
+ * @param auth_tag As for crypto_bridge_process; must stay valid until the job finishes
+ * @param callback Event callback (can be null to use the context's port)
+ * @param user_data Passed through to callback
+ * 
+ * All other parameters are as for crypto_bridge_process_ex.
+ * 
+ * @return Job id (> 0), or a negative status code if the job could not be
+ *         queued. Errors of the operation itself arrive with the DONE event.
+ */
+long long crypto_bridge_job_process(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* iv,
+    unsigned char* auth_tag,
+    CryptoBridgeJobCallback callback,
+    void* user_data
+);
+
+/**
+ * Start crypto_bridge_process_tree on a background thread
+ * 
+ * Progress events carry the byte counts of the tree's progress callback,
+ * about every 100 ms. Parameters and return values are as for
+ * crypto_bridge_job_process and crypto_bridge_process_tree; the paths are
+ * copied.
+ * 
+ * Between file pieces the job checks for cancellation, and pauses while a
+ * job of higher priority waits for its slot. With CRYPTO_OPTION_THREADS at
+ * 0 it leaves one core free for other jobs.
+ */
+long long crypto_bridge_job_process_tree(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const char* source_dir,
+    const char* dest_dir,
+    CryptoBridgeJobCallback callback,
+    void* user_data
+);
+
+/**
+ * Get the status and progress of a job
+ * 
+ * @param job_id Id returned when the job was submitted
+ * @param done Receives the input bytes processed so far (can be null)
+ * @param total Receives the total input bytes (can be null)
+ * 
+ * @return CRYPTO_STATUS_PENDING while the job is queued or running, then
+ *         its final status; CRYPTO_STATUS_INVALID_PARAMS for unknown ids
+ */
+int crypto_bridge_job_poll(long long job_id, long long* done, long long* total);
+
+/**
+ * Ask a job to stop
+ * 
+ * A queued job finishes at once; a running tree job stops at its next file
+ * piece, and a running buffer job completes. Cancelled jobs finish with
+ * CRYPTO_STATUS_CANCELLED, and a tree job removes the files it had not
+ * finished.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_INVALID_PARAMS if the
+ *         job is unknown or already finished)
+ */
+int crypto_bridge_job_cancel(long long job_id);
+
+/**
+ * Set how many jobs may run at once, not counting the small-input lane
+ * 
+ * @param max_jobs 1 to 64 (default 2)
+ * 
+ * @return Status code (0 = success)
+ */
+int crypto_bridge_job_set_concurrency(int max_jobs);
+
+/**
+ * Take the output of a finished crypto_bridge_job_process job
+ * 
+ * The caller owns the output and frees it with crypto_bridge_result_free.
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_INVALID_PARAMS if the
+ *         job is unknown, still running, failed, or its output was taken)
+ */
+int crypto_bridge_job_take_result(long long job_id, unsigned char** output_data, int* output_len);
+
+/**
+ * Forget a finished job, freeing output that was not taken
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_INVALID_PARAMS if the
+ *         job is unknown or still running)
+ */
+int crypto_bridge_job_release(long long job_id);
+
+/**
+ * Register Dart_PostCObject (NativeApi.postCObject in dart:ffi) so that
+ * jobs can report to the port set with CRYPTO_OPTION_NOTIFY_PORT
+ */
+void crypto_bridge_job_set_dart_api(void* post_cobject);
+
+/**
+ * Encrypt or decrypt into a result buffer owned by the bridge
+ * 
+ * Takes the same parameters as crypto_bridge_process, except that the output
+ * buffer is allocated natively, sized to the result (plus at most one block
+ * of slack) and 64-byte aligned. The caller owns it and must release it with
+ * crypto_bridge_result_free. That function matches the Dart
+ * NativeFinalizerFunction signature, so the buffer can be exposed with
+ * `asTypedList(len, finalizer: ...)` and freed by the garbage collector
+ * without copying.
+ * 
+ * @param output_data Receives the result buffer (null on failure)
+ * @param output_len Receives the result length
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_process_alloc(
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char** output_data,
+    int* output_len,
+    unsigned char* iv,
+    unsigned char* auth_tag
+);
+
+/**
+ * Free a buffer returned by crypto_bridge_process_alloc (wiped before release)
+ * 
+ * @param result Result buffer, may be null
+ */
+void crypto_bridge_result_free(void* result);
+
 /**
  * Get version string of the crypto bridge
  * 
@@ -150,6 +989,224 @@ int crypto_bridge_process(
  */
 const char* crypto_bridge_version(void);
 
+/**
+ * Create a context with default settings
+ * 
+ * A context is not thread-safe while options are being changed, but may be
+ * shared by concurrent crypto_bridge_process_ex calls once configured.
+ * 
+ * @return New context, or null on allocation failure
+ */
+CryptoBridgeContext* crypto_bridge_context_create(void);
+
+/**
+ * Destroy a context created by crypto_bridge_context_create
+ * 
+ * @param context Context to destroy, may be null
+ */
+void crypto_bridge_context_destroy(CryptoBridgeContext* context);
+
+/**
+ * Change one setting of a context
+ * 
+ * @param context Context to modify
+ * @param option Option identifier (CryptoBridgeOption enum)
+ * @param value New value; see the option for its valid range
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_context_set_option(CryptoBridgeContext* context, int option, long long value);
+
+/**
+ * Measure raw cipher throughput for one algorithm/mode combination
+ * 
+ * Encrypts `data_len` bytes `iterations` times with a random key, so the
+ * password KDF is excluded from the figure. GCM uses the context's table
+ * setting.
+ * 
+ * @param context Context, or null for defaults
+ * @param megabytes_per_second Receives the throughput in MB/s (10^6 bytes)
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_benchmark(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int data_len,
+    int iterations,
+    double* megabytes_per_second
+);
+
+/**
+ * Run the built-in benchmark matrix and write a text report
+ * 
+ * The report has one line per algorithm/mode; GCM rows are repeated for 2K,
+ * 64K and automatic table selection and name the table size actually used.
+ * 
+ * @param data_len Bytes per encryption
+ * @param iterations Encryptions per row
+ * @param report Output buffer for the null-terminated report
+ * @param report_len Pointer to report buffer size (in/out parameter; on
+ *                   CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL receives the size needed)
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_benchmark_suite(int data_len, int iterations, char* report, int* report_len);
+
+/**
+ * Report allocation counters of the calling thread's scratch arena
+ * 
+ * Temporary buffers used by crypto_bridge_process (derived key, IV, padding
+ * block) are served from a per-thread arena that is wiped and rewound after
+ * every call. Once warmed up, repeated calls of the same shape leave
+ * system_allocations unchanged. The counters cover the arena only: the
+ * Crypto++ cipher and mode objects each call keys (key schedules, GCM
+ * tables) still allocate on the heap, so a call is not allocation-free as
+ * a whole.
+ * 
+ * @param system_allocations Number of blocks requested from the system allocator
+ * @param bytes_reserved Bytes currently held by the arena
+ * @param high_water Largest number of bytes used by a single call
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_arena_stats(
+    long long* system_allocations,
+    long long* bytes_reserved,
+    long long* high_water
+);
+
+/**
+ * Report the state of the locked memory that holds key material
+ * 
+ * Derived keys and IVs, tree and archive master keys, and the passwords of
+ * queued jobs live in a small pool of 1 KiB slots that is locked into RAM,
+ * kept out of core dumps where supported and bracketed by inaccessible
+ * guard pages. The pool is set up once; calls borrow and return slots
+ * without system calls, and returned slots are wiped. Secrets that do not
+ * fit a slot, or that arrive while all slots are in use, go to ordinary
+ * memory, which is wiped as well; fallbacks counts them.
+ * 
+ * @param slots Receives the number of slots (0 if the pool could not be set up)
+ * @param in_use Receives the slots currently held
+ * @param fallbacks Receives the secrets served from ordinary memory so far
+ * @param locked Receives 1 if the slots are locked into RAM, 0 if the
+ *               system refused (e.g. RLIMIT_MEMLOCK)
+ * 
+ * @return Status code (0 = success, negative = error)
+ */
+int crypto_bridge_secure_memory_stats(
+    long long* slots,
+    long long* in_use,
+    long long* fallbacks,
+    int* locked
+);
+
+/**
+ * Acquire a reusable I/O buffer from the native pool
+ * 
+ * Buffers are 64-byte aligned and kept in power-of-two size classes, but
+ * only the `size` bytes asked for may be used; those are the bytes wiped on
+ * release. Their contents are unspecified. Callers can write input straight into the
+ * buffer (e.g. through Pointer.asTypedList in Dart) and pass it to
+ * crypto_bridge_process, avoiding a fresh allocation and zero-fill per call.
+ * 
+ * @param size Minimum buffer size in bytes
+ * @param flags CryptoBridgeBufferFlags
+ * 
+ * @return Buffer pointer, or null on failure
+ */
+unsigned char* crypto_bridge_buffer_acquire(int size, int flags);
+
+/**
+ * Return a buffer to the native pool
+ * 
+ * The buffer is wiped before it can be handed out again.
+ * 
+ * @param buffer Pointer returned by crypto_bridge_buffer_acquire
+ * 
+ * @return Status code (0 = success, -1 if the buffer is not owned by the pool)
+ */
+int crypto_bridge_buffer_release(unsigned char* buffer);
+
+/**
+ * Free every idle buffer held by the native pool
+ */
+void crypto_bridge_buffer_trim(void);
+
+/**
+ * Keep the autotuner's profile in a file
+ * 
+ * With CRYPTO_OPTION_AUTOTUNE on (the default), a tree call measures its
+ * throughput while it runs. With CRYPTO_OPTION_THREADS at 0 it moves the
+ * number of busy workers one step at a time towards the fastest, and while
+ * a candidate segment size (1, 2, 4 or 8 MiB) has too few samples,
+ * encrypting jobs plan their first large files with it. What each job
+ * learns is kept per algorithm, mode, key size and direction, so later
+ * jobs of the same kind start tuned. The
+ * profile lives in memory until a path is set; from then on it is loaded
+ * from and saved to that file after each tuned job. A profile written on
+ * a host with another core count is ignored.
+ * 
+ * @param path Profile file, e.g. in the app's support directory (null = memory only)
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_IO_ERROR if the file
+ *         exists but is not a profile; tuning then starts afresh)
+ */
+int crypto_bridge_tuner_set_profile(const char* path);
+
+/**
+ * Get what the autotuner settled on for an algorithm, mode, key size and
+ * direction
+ * 
+ * @param operation CRYPTO_OPERATION_ENCRYPT or CRYPTO_OPERATION_DECRYPT;
+ *        segment sizes are only measured when encrypting
+ * @param segment_size Receives the fastest segment size measured (4 MiB until measured)
+ * @param threads Receives the settled worker count (0 until measured)
+ * @param mb_per_s Receives the throughput of the last tuned job (can be null)
+ * 
+ * @return Status code (0 = success)
+ */
+int crypto_bridge_tuner_get(int algorithm, int mode, int key_size_bits, int operation,
+                            int* segment_size, int* threads, double* mb_per_s);
+
+/**
+ * List the CPU cores the bridge may use
+ * 
+ * On Linux and Android the layout comes from sysfs: cores whose capacity
+ * (or maximum frequency) is below 80% of the fastest core's are efficiency
+ * cores, every other core is a performance core. Worker threads of
+ * parallel modes and trees are pinned to one core each, performance cores
+ * first; job threads waiting on files keep to the efficiency cores. Cores
+ * come back in that placement order.
+ * 
+ * @param cores Receives the kernel CPU numbers
+ * @param performance Receives 1 for performance cores, 0 for efficiency cores (can be null)
+ * @param max_cores Capacity of cores and performance
+ * @param core_count Receives the number of usable cores
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL
+ *         if max_cores is below *core_count)
+ */
+int crypto_bridge_get_cpu_cores(int* cores, int* performance, int max_cores, int* core_count);
+
+/**
+ * Restrict the bridge to a set of CPU cores
+ * 
+ * Applies to worker threads started afterwards and to the default thread
+ * count (CRYPTO_OPTION_THREADS = 0). Has no effect on placement outside
+ * Linux and Android.
+ * 
+ * @param cores Kernel CPU numbers from crypto_bridge_get_cpu_cores (null with count 0 lifts the limit)
+ * @param count Number of cores
+ * 
+ * @return Status code (0 = success, CRYPTO_STATUS_INVALID_PARAMS if a
+ *         core is not usable)
+ */
+int crypto_bridge_set_cpu_cores(const int* cores, int count);
+
 #ifdef __cplusplus
 }
 #endif
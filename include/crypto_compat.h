@@ -37,12 +37,21 @@
     #include <crypto++/cast.h>
     #include <crypto++/modes.h>
     #include <crypto++/gcm.h>
+    #include <crypto++/eax.h>
+    #include <crypto++/xts.h>
     #include <crypto++/filters.h>
+    #include <crypto++/zdeflate.h>
+    #include <crypto++/zinflate.h>
     #include <crypto++/hex.h>
     #include <crypto++/pwdbased.h>
+    #include <crypto++/hmac.h>
+    #include <crypto++/hkdf.h>
     #include <crypto++/sha.h>
+    #include <crypto++/sha3.h>
+    #include <crypto++/blake2.h>
     #include <crypto++/secblock.h>
     #include <crypto++/osrng.h>
+    #include <crypto++/cpu.h>
     
     // Additional algorithms - Tier 3-4 (AES finalists and strong ciphers)
     #include <crypto++/mars.h>
@@ -52,6 +61,7 @@
     
     // Stream ciphers - Tier 5
     #include <crypto++/chacha.h>
+    #include <crypto++/chachapoly.h>
     #include <crypto++/salsa.h>
     #include <crypto++/hc128.h>
     #include <crypto++/hc256.h>
@@ -92,12 +102,21 @@
     #include <cryptopp/cast.h>
     #include <cryptopp/modes.h>
     #include <cryptopp/gcm.h>
+    #include <cryptopp/eax.h>
+    #include <cryptopp/xts.h>
     #include <cryptopp/filters.h>
+    #include <cryptopp/zdeflate.h>
+    #include <cryptopp/zinflate.h>
     #include <cryptopp/hex.h>
     #include <cryptopp/pwdbased.h>
+    #include <cryptopp/hmac.h>
+    #include <cryptopp/hkdf.h>
     #include <cryptopp/sha.h>
+    #include <cryptopp/sha3.h>
+    #include <cryptopp/blake2.h>
     #include <cryptopp/secblock.h>
     #include <cryptopp/osrng.h>
+    #include <cryptopp/cpu.h>
     
     // Additional algorithms - Tier 3-4 (AES finalists and strong ciphers)
     #include <cryptopp/mars.h>
@@ -107,6 +126,7 @@
     
     // Stream ciphers - Tier 5
     #include <cryptopp/chacha.h>
+    #include <cryptopp/chachapoly.h>
     #include <cryptopp/salsa.h>
     #include <cryptopp/hc128.h>
     #include <cryptopp/hc256.h>
@@ -147,12 +167,21 @@
     #include <cast.h>
     #include <modes.h>
     #include <gcm.h>
+    #include <eax.h>
+    #include <xts.h>
     #include <filters.h>
+    #include <zdeflate.h>
+    #include <zinflate.h>
     #include <hex.h>
     #include <pwdbased.h>
+    #include <hmac.h>
+    #include <hkdf.h>
     #include <sha.h>
+    #include <sha3.h>
+    #include <blake2.h>
     #include <secblock.h>
     #include <osrng.h>
+    #include <cpu.h>
     
     // Additional algorithms - Tier 3-4 (AES finalists and strong ciphers)
     #include <mars.h>
@@ -162,6 +191,7 @@
     
     // Stream ciphers - Tier 5
     #include <chacha.h>
+    #include <chachapoly.h>
     #include <salsa.h>
     #include <hc128.h>
     #include <hc256.h>
@@ -23,6 +23,18 @@ class CryptoBridgeService {
   /// Get the crypto bridge version
   static String getVersion() => CryptoFFI.getVersion();
 
+  /// Bytes per chunk the native engine uses for this configuration
+  static int chunkSize(EncryptionConfig config) {
+    if (!_initialized) {
+      return 4 * 1024 * 1024;
+    }
+    return CryptoFFI.tunedSegmentSize(
+      _mapAlgorithm(config.algorithm),
+      _mapMode(config.mode),
+      config.keySize,
+    );
+  }
+
   /// Encrypt data using the specified configuration
   static Future<CryptoResult> encrypt({
     required EncryptionConfig config,
@@ -110,6 +122,8 @@ class CryptoBridgeService {
         return CryptoConstants.algorithmSalsa20;
       case EncryptionAlgorithm.xsalsa20:
         return CryptoConstants.algorithmXSalsa20;
+      case EncryptionAlgorithm.xchacha20:
+        return CryptoConstants.algorithmXChaCha20;
       case EncryptionAlgorithm.hc128:
         return CryptoConstants.algorithmHC128;
       case EncryptionAlgorithm.hc256:
@@ -202,6 +216,16 @@ class CryptoBridgeService {
         return CryptoConstants.modeOFB;
       case OperationMode.ctr:
         return CryptoConstants.modeCTR;
+      case OperationMode.poly1305:
+        return CryptoConstants.modePoly1305;
+      case OperationMode.ocb:
+        return CryptoConstants.modeOCB;
+      case OperationMode.eax:
+        return CryptoConstants.modeEAX;
+      case OperationMode.tweak:
+        return CryptoConstants.modeTweak;
+      case OperationMode.xts:
+        return CryptoConstants.modeXTS;
     }
   }
 
@@ -44,6 +44,7 @@ class CryptoConstants {
   static const int algorithmLucifer = 41;
   static const int algorithmSimon = 42;
   static const int algorithmSpeck = 43;
+  static const int algorithmXChaCha20 = 44;
 
   // Modes
   static const int modeCBC = 1;
@@ -52,6 +53,11 @@ class CryptoConstants {
   static const int modeCFB = 4;
   static const int modeOFB = 5;
   static const int modeCTR = 6;
+  static const int modePoly1305 = 7;
+  static const int modeOCB = 8;
+  static const int modeEAX = 9;
+  static const int modeTweak = 10;
+  static const int modeXTS = 11;
 
   // Operations
   static const int operationEncrypt = 1;
@@ -1,8 +1,10 @@
 import 'dart:ffi' as ffi;
 import 'dart:io' show Platform;
+import 'dart:isolate';
 import 'dart:typed_data';
 import 'package:ffi/ffi.dart';
 
+import 'crypto_constants.dart';
 import 'crypto_result.dart';
 
 // --- FFI Signature Definitions ---
@@ -39,19 +41,206 @@ typedef CryptoProcessDart = int Function(
   ffi.Pointer<ffi.Uint8> authTag,
 );
 
+// C: int crypto_bridge_process_alloc(...)
+typedef CryptoProcessAllocNative = ffi.Int32 Function(
+  ffi.Int32 algorithm,
+  ffi.Int32 mode,
+  ffi.Int32 keySizeBits,
+  ffi.Int32 operation,
+  ffi.Pointer<Utf8> password,
+  ffi.Int32 passwordLen,
+  ffi.Pointer<ffi.Uint8> inputData,
+  ffi.Int32 inputLen,
+  ffi.Pointer<ffi.Pointer<ffi.Uint8>> outputData,
+  ffi.Pointer<ffi.Int32> outputLen,
+  ffi.Pointer<ffi.Uint8> iv,
+  ffi.Pointer<ffi.Uint8> authTag,
+);
+
+// Dart: int cryptoBridgeProcessAlloc(...)
+typedef CryptoProcessAllocDart = int Function(
+  int algorithm,
+  int mode,
+  int keySizeBits,
+  int operation,
+  ffi.Pointer<Utf8> password,
+  int passwordLen,
+  ffi.Pointer<ffi.Uint8> inputData,
+  int inputLen,
+  ffi.Pointer<ffi.Pointer<ffi.Uint8>> outputData,
+  ffi.Pointer<ffi.Int32> outputLen,
+  ffi.Pointer<ffi.Uint8> iv,
+  ffi.Pointer<ffi.Uint8> authTag,
+);
+
 // C: const char* crypto_bridge_version(void)
 typedef CryptoVersionNative = ffi.Pointer<Utf8> Function();
 // Dart: ffi.Pointer<Utf8> cryptoBridgeVersion()
 typedef CryptoVersionDart = ffi.Pointer<Utf8> Function();
 
+// C: unsigned char* crypto_bridge_buffer_acquire(int size, int flags)
+typedef CryptoBufferAcquireNative = ffi.Pointer<ffi.Uint8> Function(
+  ffi.Int32 size,
+  ffi.Int32 flags,
+);
+// Dart: ffi.Pointer<ffi.Uint8> cryptoBridgeBufferAcquire(...)
+typedef CryptoBufferAcquireDart = ffi.Pointer<ffi.Uint8> Function(
+  int size,
+  int flags,
+);
+
+// C: int crypto_bridge_buffer_release(unsigned char* buffer)
+typedef CryptoBufferReleaseNative = ffi.Int32 Function(ffi.Pointer<ffi.Uint8> buffer);
+// Dart: int cryptoBridgeBufferRelease(...)
+typedef CryptoBufferReleaseDart = int Function(ffi.Pointer<ffi.Uint8> buffer);
+
+// C: CryptoBridgeContext* crypto_bridge_context_create(void)
+typedef CryptoContextCreateNative = ffi.Pointer<ffi.Void> Function();
+// Dart: ffi.Pointer<ffi.Void> cryptoBridgeContextCreate()
+typedef CryptoContextCreateDart = ffi.Pointer<ffi.Void> Function();
+
+// C: void crypto_bridge_context_destroy(CryptoBridgeContext* context)
+typedef CryptoContextDestroyNative = ffi.Void Function(ffi.Pointer<ffi.Void> context);
+// Dart: void cryptoBridgeContextDestroy(...)
+typedef CryptoContextDestroyDart = void Function(ffi.Pointer<ffi.Void> context);
+
+// C: int crypto_bridge_context_set_option(CryptoBridgeContext* context, int option, long long value)
+typedef CryptoContextSetOptionNative = ffi.Int32 Function(
+  ffi.Pointer<ffi.Void> context,
+  ffi.Int32 option,
+  ffi.Int64 value,
+);
+// Dart: int cryptoBridgeContextSetOption(...)
+typedef CryptoContextSetOptionDart = int Function(
+  ffi.Pointer<ffi.Void> context,
+  int option,
+  int value,
+);
+
+// C: long long crypto_bridge_job_process(...)
+typedef CryptoJobProcessNative = ffi.Int64 Function(
+  ffi.Pointer<ffi.Void> context,
+  ffi.Int32 algorithm,
+  ffi.Int32 mode,
+  ffi.Int32 keySizeBits,
+  ffi.Int32 operation,
+  ffi.Pointer<Utf8> password,
+  ffi.Int32 passwordLen,
+  ffi.Pointer<ffi.Uint8> inputData,
+  ffi.Int32 inputLen,
+  ffi.Pointer<ffi.Uint8> iv,
+  ffi.Pointer<ffi.Uint8> authTag,
+  ffi.Pointer<ffi.Void> callback,
+  ffi.Pointer<ffi.Void> userData,
+);
+// Dart: int cryptoBridgeJobProcess(...)
+typedef CryptoJobProcessDart = int Function(
+  ffi.Pointer<ffi.Void> context,
+  int algorithm,
+  int mode,
+  int keySizeBits,
+  int operation,
+  ffi.Pointer<Utf8> password,
+  int passwordLen,
+  ffi.Pointer<ffi.Uint8> inputData,
+  int inputLen,
+  ffi.Pointer<ffi.Uint8> iv,
+  ffi.Pointer<ffi.Uint8> authTag,
+  ffi.Pointer<ffi.Void> callback,
+  ffi.Pointer<ffi.Void> userData,
+);
+
+// C: int crypto_bridge_job_take_result(long long job_id, unsigned char** output_data, int* output_len)
+typedef CryptoJobTakeResultNative = ffi.Int32 Function(
+  ffi.Int64 jobId,
+  ffi.Pointer<ffi.Pointer<ffi.Uint8>> outputData,
+  ffi.Pointer<ffi.Int32> outputLen,
+);
+// Dart: int cryptoBridgeJobTakeResult(...)
+typedef CryptoJobTakeResultDart = int Function(
+  int jobId,
+  ffi.Pointer<ffi.Pointer<ffi.Uint8>> outputData,
+  ffi.Pointer<ffi.Int32> outputLen,
+);
+
+// C: int crypto_bridge_job_release(long long job_id)
+typedef CryptoJobReleaseNative = ffi.Int32 Function(ffi.Int64 jobId);
+// Dart: int cryptoBridgeJobRelease(...)
+typedef CryptoJobReleaseDart = int Function(int jobId);
+
+// C: void crypto_bridge_job_set_dart_api(void* post_cobject)
+typedef CryptoJobSetDartApiNative = ffi.Void Function(ffi.Pointer<ffi.Void> postCObject);
+// Dart: void cryptoBridgeJobSetDartApi(...)
+typedef CryptoJobSetDartApiDart = void Function(ffi.Pointer<ffi.Void> postCObject);
+
+// C: int crypto_bridge_tuner_get(int algorithm, int mode, int key_size_bits, int operation, int* segment_size, int* threads, double* mb_per_s)
+typedef CryptoTunerGetNative = ffi.Int32 Function(
+  ffi.Int32 algorithm,
+  ffi.Int32 mode,
+  ffi.Int32 keySizeBits,
+  ffi.Int32 operation,
+  ffi.Pointer<ffi.Int32> segmentSize,
+  ffi.Pointer<ffi.Int32> threads,
+  ffi.Pointer<ffi.Double> mbPerS,
+);
+// Dart: int cryptoBridgeTunerGet(...)
+typedef CryptoTunerGetDart = int Function(
+  int algorithm,
+  int mode,
+  int keySizeBits,
+  int operation,
+  ffi.Pointer<ffi.Int32> segmentSize,
+  ffi.Pointer<ffi.Int32> threads,
+  ffi.Pointer<ffi.Double> mbPerS,
+);
+
+/// Job constants shared with crypto_bridge.h
+class CryptoJobConstants {
+  /// CRYPTO_OPTION_NOTIFY_PORT
+  static const int optionNotifyPort = 8;
+
+  /// CRYPTO_OPTION_JOB_PRIORITY
+  static const int optionJobPriority = 9;
+
+  /// CRYPTO_JOB_PRIORITY_INTERACTIVE
+  static const int priorityInteractive = 2;
+
+  /// CRYPTO_JOB_EVENT_PROGRESS
+  static const int eventProgress = 1;
+
+  /// CRYPTO_JOB_EVENT_DONE
+  static const int eventDone = 2;
+}
+
+/// Buffer flags shared with crypto_bridge.h
+class CryptoBufferFlags {
+  static const int none = 0;
+
+  /// Back buffers of 2 MiB and up with huge pages where the OS supports it
+  static const int hugePages = 1;
+}
+
 
 /// Manages FFI calls and memory for the crypto bridge
 class CryptoFFI {
   static final ffi.DynamicLibrary _cryptoLib = _loadDynamicLibrary();
-  static final CryptoProcessDart _cryptoProcess = _lookupCryptoProcess();
   static final CryptoVersionDart _cryptoVersion = _lookupCryptoVersion();
+  static final CryptoBufferAcquireDart _bufferAcquire = _lookupBufferAcquire();
+  static final CryptoBufferReleaseDart _bufferRelease = _lookupBufferRelease();
+  static final ffi.Pointer<ffi.NativeFinalizerFunction> _resultFree = _lookupResultFree();
+  static final CryptoContextCreateDart _contextCreate = _lookupContextCreate();
+  static final CryptoContextDestroyDart _contextDestroy = _lookupContextDestroy();
+  static final CryptoContextSetOptionDart _contextSetOption = _lookupContextSetOption();
+  static final CryptoJobProcessDart _jobProcess = _lookupJobProcess();
+  static final CryptoJobTakeResultDart _jobTakeResult = _lookupJobTakeResult();
+  static final CryptoJobReleaseDart _jobRelease = _lookupJobRelease();
+  static final CryptoJobSetDartApiDart _jobSetDartApi = _lookupJobSetDartApi();
+  static final CryptoTunerGetDart _tunerGet = _lookupTunerGet();
   static bool _initialized = false;
 
+  /// Payloads at least this large ask for huge-page backed buffers
+  static const int _hugePageThreshold = 2 * 1024 * 1024;
+
   /// Loads the dynamic library based on the platform
   static ffi.DynamicLibrary _loadDynamicLibrary() {
     if (Platform.isAndroid || Platform.isLinux) {
@@ -65,13 +254,6 @@ class CryptoFFI {
     }
   }
   
-  /// Looks up the crypto_bridge_process function
-  static CryptoProcessDart _lookupCryptoProcess() {
-    return _cryptoLib
-      .lookup<ffi.NativeFunction<CryptoProcessNative>>('crypto_bridge_process')
-      .asFunction<CryptoProcessDart>();
-  }
-  
   /// Looks up the crypto_bridge_version function
   static CryptoVersionDart _lookupCryptoVersion() {
     return _cryptoLib
@@ -79,9 +261,86 @@ class CryptoFFI {
       .asFunction<CryptoVersionDart>();
   }
 
+  /// Looks up the crypto_bridge_buffer_acquire function
+  static CryptoBufferAcquireDart _lookupBufferAcquire() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoBufferAcquireNative>>('crypto_bridge_buffer_acquire')
+      .asFunction<CryptoBufferAcquireDart>();
+  }
+
+  /// Looks up the crypto_bridge_buffer_release function
+  static CryptoBufferReleaseDart _lookupBufferRelease() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoBufferReleaseNative>>('crypto_bridge_buffer_release')
+      .asFunction<CryptoBufferReleaseDart>();
+  }
+
+  /// Looks up crypto_bridge_result_free, used as the finalizer of results
+  static ffi.Pointer<ffi.NativeFinalizerFunction> _lookupResultFree() {
+    return _cryptoLib
+      .lookup<ffi.NativeFinalizerFunction>('crypto_bridge_result_free');
+  }
+
+  /// Looks up the crypto_bridge_context_create function
+  static CryptoContextCreateDart _lookupContextCreate() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoContextCreateNative>>('crypto_bridge_context_create')
+      .asFunction<CryptoContextCreateDart>();
+  }
+
+  /// Looks up the crypto_bridge_context_destroy function
+  static CryptoContextDestroyDart _lookupContextDestroy() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoContextDestroyNative>>('crypto_bridge_context_destroy')
+      .asFunction<CryptoContextDestroyDart>();
+  }
+
+  /// Looks up the crypto_bridge_context_set_option function
+  static CryptoContextSetOptionDart _lookupContextSetOption() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoContextSetOptionNative>>('crypto_bridge_context_set_option')
+      .asFunction<CryptoContextSetOptionDart>();
+  }
+
+  /// Looks up the crypto_bridge_job_process function
+  static CryptoJobProcessDart _lookupJobProcess() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoJobProcessNative>>('crypto_bridge_job_process')
+      .asFunction<CryptoJobProcessDart>();
+  }
+
+  /// Looks up the crypto_bridge_job_take_result function
+  static CryptoJobTakeResultDart _lookupJobTakeResult() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoJobTakeResultNative>>('crypto_bridge_job_take_result')
+      .asFunction<CryptoJobTakeResultDart>();
+  }
+
+  /// Looks up the crypto_bridge_job_release function
+  static CryptoJobReleaseDart _lookupJobRelease() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoJobReleaseNative>>('crypto_bridge_job_release')
+      .asFunction<CryptoJobReleaseDart>();
+  }
+
+  /// Looks up the crypto_bridge_job_set_dart_api function
+  static CryptoJobSetDartApiDart _lookupJobSetDartApi() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoJobSetDartApiNative>>('crypto_bridge_job_set_dart_api')
+      .asFunction<CryptoJobSetDartApiDart>();
+  }
+
+  /// Looks up the crypto_bridge_tuner_get function
+  static CryptoTunerGetDart _lookupTunerGet() {
+    return _cryptoLib
+      .lookup<ffi.NativeFunction<CryptoTunerGetNative>>('crypto_bridge_tuner_get')
+      .asFunction<CryptoTunerGetDart>();
+  }
+
   /// Initializes the FFI bindings
   static bool initialize() {
-    // Here, we can just check if the functions were loaded
+    // Jobs report back to Dart ports through Dart_PostCObject
+    _jobSetDartApi(ffi.NativeApi.postCObject.cast());
     _initialized = true;
     return _initialized;
   }
@@ -92,8 +351,48 @@ class CryptoFFI {
     return versionPtr.toDartString();
   }
 
+  /// Segment size the native autotuner settled on when encrypting with
+  /// [algorithm], [mode] and [keySize] bits, or the format default of 4 MiB
+  /// before any tuned job ran
+  static int tunedSegmentSize(int algorithm, int mode, int keySize) {
+    final ffi.Pointer<ffi.Int32> segmentSize = calloc<ffi.Int32>();
+    final ffi.Pointer<ffi.Int32> threads = calloc<ffi.Int32>();
+    try {
+      if (_tunerGet(algorithm, mode, keySize, CryptoConstants.operationEncrypt,
+              segmentSize, threads, ffi.nullptr) != 0) {
+        return 4 * 1024 * 1024;
+      }
+      return segmentSize.value;
+    } finally {
+      calloc.free(segmentSize);
+      calloc.free(threads);
+    }
+  }
+
+  /// Acquires a reusable, 64-byte aligned buffer from the native pool.
+  ///
+  /// The memory is reused across calls and is not zero-filled. Write into it
+  /// through `pointer.asTypedList(size)` to avoid an extra copy, and hand it
+  /// back with [releaseBuffer], which wipes those [size] bytes; do not use
+  /// more than [size]. Returns `nullptr` if the pool is exhausted.
+  static ffi.Pointer<ffi.Uint8> acquireBuffer(int size,
+      {int flags = CryptoBufferFlags.none}) {
+    return _bufferAcquire(size, flags);
+  }
+
+  /// Returns a buffer obtained from [acquireBuffer] to the native pool.
+  static void releaseBuffer(ffi.Pointer<ffi.Uint8> buffer) {
+    if (buffer != ffi.nullptr) {
+      _bufferRelease(buffer);
+    }
+  }
+
   /// High-level wrapper for the native crypto_bridge_process function.
   /// Handles all memory allocation, conversion, and deallocation.
+  ///
+  /// The work runs as a native background job, so the calling isolate keeps
+  /// running while large payloads are processed; [onProgress] receives the
+  /// processed and total input bytes as the job reports them.
   static Future<CryptoResult> processData({
     required int algorithm,
     required int mode,
@@ -101,55 +400,112 @@ class CryptoFFI {
     required int operation,
     required String password,
     required Uint8List inputData,
+    void Function(int done, int total)? onProgress,
   }) async {
     if (!_initialized) {
       return CryptoResult.error('FFI not initialized');
     }
 
-    // Allocate memory for inputs
-    final ffi.Pointer<Utf8> passwordPtr = password.toNativeUtf8();
-    final ffi.Pointer<ffi.Uint8> inputPtr = calloc<ffi.Uint8>(inputData.length);
+    // Input lives in a pooled native buffer that is reused across calls, so
+    // large payloads do not fault in fresh zeroed pages every time. The job
+    // reads it until it finishes.
+    final int bufferFlags = inputData.length >= _hugePageThreshold
+        ? CryptoBufferFlags.hugePages
+        : CryptoBufferFlags.none;
+    final ffi.Pointer<ffi.Uint8> inputPtr =
+        acquireBuffer(inputData.length, flags: bufferFlags);
+    if (inputPtr == ffi.nullptr) {
+      return CryptoResult.error('Unable to allocate native buffers');
+    }
     inputPtr.asTypedList(inputData.length).setAll(0, inputData);
 
-    // Allocate memory for outputs
-    // Output can be slightly larger than input (padding, etc.)
-    final int outputBufferSize = inputData.length + 256; 
-    final ffi.Pointer<ffi.Uint8> outputPtr = calloc<ffi.Uint8>(outputBufferSize);
+    // Job events arrive on this port as [id, event, status, done, total]
+    final ReceivePort port = ReceivePort();
+    final ffi.Pointer<ffi.Pointer<ffi.Uint8>> outputPtrPtr =
+        calloc<ffi.Pointer<ffi.Uint8>>();
     final ffi.Pointer<ffi.Int32> outputLenPtr = calloc<ffi.Int32>();
-    outputLenPtr.value = outputBufferSize;
+    int jobId = 0;
+    bool jobRunning = false;
 
-    // IV and Auth Tag are handled by the C++ layer for simplicity
-    final ffi.Pointer<ffi.Uint8> ivPtr = ffi.nullptr;
-    final ffi.Pointer<ffi.Uint8> authTagPtr = ffi.nullptr;
-    
     try {
-      final int status = _cryptoProcess(
-        algorithm,
-        mode,
-        keySize,
-        operation,
-        passwordPtr,
-        password.length,
-        inputPtr,
-        inputData.length,
-        outputPtr,
-        outputLenPtr,
-        ivPtr,
-        authTagPtr,
-      );
+      // The job copies the settings and the password when it is submitted
+      final ffi.Pointer<ffi.Void> context = _contextCreate();
+      if (context == ffi.nullptr) {
+        return CryptoResult.error('Unable to allocate native context');
+      }
+      final ffi.Pointer<Utf8> passwordPtr = password.toNativeUtf8();
+      try {
+        _contextSetOption(context, CryptoJobConstants.optionNotifyPort,
+            port.sendPort.nativePort);
+        // The user is waiting on this one
+        _contextSetOption(context, CryptoJobConstants.optionJobPriority,
+            CryptoJobConstants.priorityInteractive);
+        // IV and Auth Tag are handled by the C++ layer for simplicity
+        jobId = _jobProcess(
+          context,
+          algorithm,
+          mode,
+          keySize,
+          operation,
+          passwordPtr,
+          password.length,
+          inputPtr,
+          inputData.length,
+          ffi.nullptr,
+          ffi.nullptr,
+          ffi.nullptr,
+          ffi.nullptr,
+        );
+      } finally {
+        calloc.free(passwordPtr);
+        _contextDestroy(context);
+      }
+      if (jobId < 0) {
+        return CryptoResult.error('Native call failed with status code: $jobId');
+      }
+      jobRunning = true;
 
-      if (status == 0) { // Success
-        final int actualOutputLen = outputLenPtr.value;
-        final Uint8List resultData = outputPtr.asTypedList(actualOutputLen);
-        return CryptoResult.success(Uint8List.fromList(resultData));
-      } else {
+      int status = 0;
+      await for (final dynamic message in port) {
+        final Int64List event = message as Int64List;
+        if (event[1] == CryptoJobConstants.eventDone) {
+          status = event[2];
+          jobRunning = false;
+          break;
+        }
+        onProgress?.call(event[3], event[4]);
+      }
+
+      if (status != 0) {
         return CryptoResult.error('Native call failed with status code: $status');
       }
+
+      // The result buffer is allocated by the bridge and owned by the
+      // returned Uint8List; it is freed natively when the list is
+      // garbage-collected
+      final int takeStatus = _jobTakeResult(jobId, outputPtrPtr, outputLenPtr);
+      if (takeStatus != 0) {
+        return CryptoResult.error('Native call failed with status code: $takeStatus');
+      }
+      final ffi.Pointer<ffi.Uint8> outputPtr = outputPtrPtr.value;
+      final Uint8List resultData = outputPtr.asTypedList(
+        outputLenPtr.value,
+        finalizer: _resultFree,
+        token: outputPtr.cast(),
+      );
+      return CryptoResult.success(resultData);
     } finally {
-      // CRITICAL: Free all allocated memory to prevent leaks
-      calloc.free(passwordPtr);
-      calloc.free(inputPtr);
-      calloc.free(outputPtr);
+      // CRITICAL: Free all allocated memory to prevent leaks. The input is
+      // only released once the job has finished with it; a job that is
+      // somehow still running keeps its buffer.
+      port.close();
+      if (jobId > 0) {
+        _jobRelease(jobId);
+      }
+      if (!jobRunning) {
+        releaseBuffer(inputPtr);
+      }
+      calloc.free(outputPtrPtr);
       calloc.free(outputLenPtr);
     }
   }
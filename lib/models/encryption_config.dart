@@ -29,6 +29,7 @@ enum EncryptionAlgorithm {
   chacha20('ChaCha20', 'ChaCha20 Stream Cipher (256-bit key)'),
   salsa20('Salsa20', 'Salsa20 Stream Cipher (128/256-bit key)'),
   xsalsa20('XSalsa20', 'Extended Salsa20 Stream Cipher (256-bit key)'),
+  xchacha20('XChaCha20', 'Extended-nonce ChaCha20 Stream Cipher (256-bit key)'),
   hc128('HC-128', 'HC-128 Stream Cipher (128-bit key)'),
   hc256('HC-256', 'HC-256 Stream Cipher (256-bit key)'),
   rabbit('Rabbit', 'Rabbit Stream Cipher (128-bit key)'),
@@ -135,6 +136,8 @@ enum EncryptionAlgorithm {
         return [128, 256];
       case EncryptionAlgorithm.xsalsa20:
         return [256];
+      case EncryptionAlgorithm.xchacha20:
+        return [256];
       case EncryptionAlgorithm.hc128:
         return [128];
       case EncryptionAlgorithm.hc256:
@@ -187,7 +190,7 @@ enum EncryptionAlgorithm {
       case EncryptionAlgorithm.shacal2:
         return [128, 192, 256, 384, 512];
       case EncryptionAlgorithm.wake:
-        return [128];
+        return [256];
         
       // Research/Archive ciphers
       case EncryptionAlgorithm.square:
@@ -210,6 +213,11 @@ enum EncryptionAlgorithm {
   }
 
   List<OperationMode> getSupportedModes() {
+    // ChaCha20 variants add Poly1305 authentication (preferred)
+    if (this == EncryptionAlgorithm.chacha20 || this == EncryptionAlgorithm.xchacha20) {
+      return [OperationMode.poly1305, OperationMode.ctr];
+    }
+
     // Stream ciphers only support stream mode (we'll represent as CTR)
     if (_isStreamCipher()) {
       return [OperationMode.ctr]; // Stream ciphers operate in counter-like mode
@@ -231,16 +239,30 @@ enum EncryptionAlgorithm {
       case EncryptionAlgorithm.aria:
         return [
           OperationMode.gcm,    // Authenticated encryption (preferred)
+          OperationMode.ocb,    // Single-pass authenticated encryption
+          OperationMode.eax,    // Two-pass authenticated encryption
           OperationMode.cbc,    // Standard mode
           OperationMode.cfb,    // Cipher feedback
           OperationMode.ofb,    // Output feedback  
           OperationMode.ctr,    // Counter mode
+          OperationMode.xts,    // Sector-addressed disk/page encryption
           OperationMode.ecb,    // Electronic codebook (less secure)
         ];
         
-      // Good block ciphers - most modes
+      // 128-bit AES finalists - OCB/EAX authentication, no GCM
       case EncryptionAlgorithm.rc6:
       case EncryptionAlgorithm.mars:
+        return [
+          OperationMode.ocb,
+          OperationMode.eax,
+          OperationMode.cbc,
+          OperationMode.cfb,
+          OperationMode.ofb,
+          OperationMode.ctr,
+          OperationMode.ecb,
+        ];
+        
+      // Good block ciphers - most modes
       case EncryptionAlgorithm.cast256:
       case EncryptionAlgorithm.seed:
       case EncryptionAlgorithm.sm4:
@@ -272,10 +294,16 @@ enum EncryptionAlgorithm {
           OperationMode.ecb,
         ];
         
-      // Research/specialized algorithms - limited modes
+      // Threefish - tweaked position mode, length preserving
       case EncryptionAlgorithm.threefish256:
       case EncryptionAlgorithm.threefish512:
       case EncryptionAlgorithm.threefish1024:
+        return [
+          OperationMode.tweak,
+          OperationMode.ctr,
+        ];
+        
+      // Research/specialized algorithms - limited modes
       case EncryptionAlgorithm.shacal2:
       case EncryptionAlgorithm.square:
       case EncryptionAlgorithm.shark:
@@ -299,6 +327,7 @@ enum EncryptionAlgorithm {
       EncryptionAlgorithm.chacha20,
       EncryptionAlgorithm.salsa20,
       EncryptionAlgorithm.xsalsa20,
+      EncryptionAlgorithm.xchacha20,
       EncryptionAlgorithm.hc128,
       EncryptionAlgorithm.hc256,
       EncryptionAlgorithm.rabbit,
@@ -317,12 +346,25 @@ enum OperationMode {
   ecb('ECB', 'Electronic Codebook'),
   cfb('CFB', 'Cipher Feedback'),
   ofb('OFB', 'Output Feedback'),
-  ctr('CTR', 'Counter Mode');
+  ctr('CTR', 'Counter Mode'),
+  poly1305('Poly1305', 'ChaCha20-Poly1305 Authenticated Encryption'),
+  ocb('OCB', 'Offset Codebook Mode (Authenticated)'),
+  eax('EAX', 'Encrypt-then-Authenticate-then-Translate (Authenticated)'),
+  tweak('Tweak', 'Threefish Position-Tweaked Mode (Random Access)'),
+  xts('XTS', 'XEX Tweaked Codebook with Ciphertext Stealing (Disk Sectors)');
 
   const OperationMode(this.displayName, this.description);
 
   final String displayName;
   final String description;
+
+  /// Whether the mode authenticates the data with a 16-byte tag
+  bool get isAead => const [
+        OperationMode.gcm,
+        OperationMode.poly1305,
+        OperationMode.ocb,
+        OperationMode.eax,
+      ].contains(this);
 }
 
 class EncryptionConfig {
@@ -240,8 +240,9 @@ class AppStateProvider with ChangeNotifier {
   }
 
   int _calculateChunks(int fileSize) {
-    const chunkSize = 64 * 1024; // 64KB chunks
-    return (fileSize / chunkSize).ceil().clamp(1, 1000); // Minimum 1, maximum 1000 chunks for demo
+    // Segment size the native autotuner measured as fastest on this device
+    final chunkSize = CryptoBridgeService.chunkSize(_config);
+    return (fileSize / chunkSize).ceil().clamp(1, 1000);
   }
 
   // Logging methods
@@ -476,7 +476,7 @@ class _EncryptionConfigPanelState extends State<EncryptionConfigPanel>
 
   String _getSecurityLevel() {
     final keySize = widget.config.keySize;
-    final isAead = widget.config.mode == OperationMode.gcm;
+    final isAead = widget.config.mode.isAead;
     
     if (keySize >= 256 && isAead) return 'MAXIMUM';
     if (keySize >= 256 || isAead) return 'HIGH';
@@ -0,0 +1,862 @@
+/*
+ * crypto_archive.cpp - Encrypted multi-file archive format, and the archive
+ * calls of the crypto bridge
+ */
+
+#include "crypto_archive.h"
+#include "crypto_arena.h"
+#include "crypto_compat.h"
+#include "crypto_fs.h"
+#include "crypto_secure_pool.h"
+#include "crypto_tree.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+static const unsigned char kArchiveMagic[4] = { 'C', 'T', 'A', 0x01 };
+
+// Fixed part of an index entry: flags, name length, size, salt
+static const size_t kEntryFixedSize = 1 + 2 + 8 + SEGMENT_SALT_SIZE;
+
+// Offset and stored length of one segment
+static const size_t kSegmentEntrySize = 8 + 4;
+
+static const size_t kMaxNameLength = 0xFFFF;
+
+// Slots whose work factor is out of this range are rejected rather than run
+static const unsigned int kMinSlotIterations = 1000;
+static const unsigned int kMaxSlotIterations = 10000000;
+
+static void store_le64(unsigned char* out, unsigned long long value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static unsigned long long load_le64(const unsigned char* in) {
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+bool archive_name_is_safe(const std::string& name) {
+    if (name.empty() || name[0] == '/') {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find('/', start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        const std::string part = name.substr(start, end - start);
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(name[i]);
+        if (c < 0x20 || c == 0x7F || c == '\\' || c == ':') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void write_archive_header(const ArchiveHeader& header, unsigned char* out) {
+    std::memcpy(out, kArchiveMagic, sizeof(kArchiveMagic));
+    out[4] = static_cast<unsigned char>(header.flags);
+    out[5] = out[6] = out[7] = 0;
+    store_segment_le32(out + 8, header.segment_size);
+    store_segment_le32(out + 12, header.index_len);
+    store_le64(out + 16, header.index_offset);
+    std::memcpy(out + 24, header.salt, SEGMENT_SALT_SIZE);
+    store_le64(out + 40, pack_stream_params(header.params));
+}
+
+bool read_archive_header(const unsigned char* in, ArchiveHeader* header) {
+    if (std::memcmp(in, kArchiveMagic, sizeof(kArchiveMagic)) != 0) {
+        return false;
+    }
+    if ((in[4] & ~(ARCHIVE_FLAG_COMPRESSED | ARCHIVE_FLAG_KEY_SLOTS)) != 0 ||
+        in[5] || in[6] || in[7]) {
+        return false;
+    }
+    header->flags = in[4];
+    header->segment_size = load_segment_le32(in + 8);
+    header->index_len = load_segment_le32(in + 12);
+    header->index_offset = load_le64(in + 16);
+    std::memcpy(header->salt, in + 24, SEGMENT_SALT_SIZE);
+    if (!unpack_stream_params(load_le64(in + 40), &header->params)) {
+        return false;
+    }
+    return header->segment_size > 0 && header->segment_size <= SEGMENT_MAX_SIZE &&
+           header->index_len > 0 && header->index_offset >= archive_data_offset(*header);
+}
+
+unsigned long long archive_data_offset(const ArchiveHeader& header) {
+    return (header.flags & ARCHIVE_FLAG_KEY_SLOTS)
+        ? ARCHIVE_HEADER_SIZE + ARCHIVE_SLOT_COUNT * ARCHIVE_SLOT_SIZE : ARCHIVE_HEADER_SIZE;
+}
+
+void write_archive_slot(const ArchiveKeySlot& slot, unsigned char* out) {
+    std::memset(out, 0, ARCHIVE_SLOT_SIZE);
+    if (!slot.used) {
+        return;
+    }
+    store_segment_le32(out, 1);
+    store_segment_le32(out + 4, slot.iterations);
+    unsigned char* p = out + 8;
+    std::memcpy(p, slot.salt, sizeof(slot.salt));
+    p += sizeof(slot.salt);
+    std::memcpy(p, slot.nonce, sizeof(slot.nonce));
+    p += sizeof(slot.nonce);
+    std::memcpy(p, slot.wrapped, sizeof(slot.wrapped));
+    p += sizeof(slot.wrapped);
+    std::memcpy(p, slot.tag, sizeof(slot.tag));
+}
+
+bool read_archive_slot(const unsigned char* in, ArchiveKeySlot* slot) {
+    const size_t state = load_segment_le32(in);
+    if (state > 1) {
+        return false;
+    }
+    slot->used = state == 1;
+    slot->iterations = static_cast<unsigned int>(load_segment_le32(in + 4));
+    const unsigned char* p = in + 8;
+    std::memcpy(slot->salt, p, sizeof(slot->salt));
+    p += sizeof(slot->salt);
+    std::memcpy(slot->nonce, p, sizeof(slot->nonce));
+    p += sizeof(slot->nonce);
+    std::memcpy(slot->wrapped, p, sizeof(slot->wrapped));
+    p += sizeof(slot->wrapped);
+    std::memcpy(slot->tag, p, sizeof(slot->tag));
+    return true;
+}
+
+// Key that wraps the archive key in one slot
+static void derive_slot_key(const ArchiveKeySlot& slot, const char* password, size_t password_len,
+                            unsigned char* key) {
+    CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> pbkdf2;
+    pbkdf2.DeriveKey(key, ARCHIVE_KEY_SIZE, 0x00,
+                     reinterpret_cast<const CryptoPP::byte*>(password), password_len,
+                     slot.salt, sizeof(slot.salt), slot.iterations);
+}
+
+void seal_archive_slot(const ArchiveHeader& header, const char* password, size_t password_len,
+                       const unsigned char* key, ArchiveKeySlot* slot) {
+    CryptoPP::AutoSeededRandomPool rng;
+    slot->used = true;
+    slot->iterations = ARCHIVE_SLOT_ITERATIONS;
+    rng.GenerateBlock(slot->salt, sizeof(slot->salt));
+    rng.GenerateBlock(slot->nonce, sizeof(slot->nonce));
+
+    SecureBlock wrapping(ARCHIVE_KEY_SIZE);
+    derive_slot_key(*slot, password, password_len, wrapping.data());
+    CryptoPP::GCM<CryptoPP::AES>::Encryption cipher;
+    cipher.SetKeyWithIV(wrapping.data(), wrapping.size(), slot->nonce, sizeof(slot->nonce));
+    cipher.EncryptAndAuthenticate(slot->wrapped, slot->tag, sizeof(slot->tag),
+                                  slot->nonce, static_cast<int>(sizeof(slot->nonce)),
+                                  header.salt, SEGMENT_SALT_SIZE, key, ARCHIVE_KEY_SIZE);
+}
+
+bool open_archive_slot(const ArchiveHeader& header, const ArchiveKeySlot& slot,
+                       const char* password, size_t password_len, unsigned char* key) {
+    if (!slot.used || slot.iterations < kMinSlotIterations || slot.iterations > kMaxSlotIterations) {
+        return false;
+    }
+    SecureBlock wrapping(ARCHIVE_KEY_SIZE);
+    derive_slot_key(slot, password, password_len, wrapping.data());
+    CryptoPP::GCM<CryptoPP::AES>::Decryption cipher;
+    cipher.SetKeyWithIV(wrapping.data(), wrapping.size(), slot.nonce, sizeof(slot.nonce));
+    return cipher.DecryptAndVerify(key, slot.tag, sizeof(slot.tag),
+                                   slot.nonce, static_cast<int>(sizeof(slot.nonce)),
+                                   header.salt, SEGMENT_SALT_SIZE, slot.wrapped, ARCHIVE_KEY_SIZE);
+}
+
+void write_archive_index(const std::vector<ArchiveEntry>& entries, std::vector<unsigned char>* out) {
+    unsigned char count[4];
+    store_segment_le32(count, entries.size());
+    out->insert(out->end(), count, count + sizeof(count));
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const ArchiveEntry& entry = entries[i];
+        const size_t offset = out->size();
+        out->resize(offset + kEntryFixedSize + entry.name.size() +
+                    entry.segments.size() * kSegmentEntrySize);
+        unsigned char* p = &(*out)[offset];
+
+        p[0] = static_cast<unsigned char>(entry.flags);
+        p[1] = static_cast<unsigned char>(entry.name.size());
+        p[2] = static_cast<unsigned char>(entry.name.size() >> 8);
+        p += 3;
+        std::memcpy(p, entry.name.data(), entry.name.size());
+        p += entry.name.size();
+        store_le64(p, entry.size);
+        std::memcpy(p + 8, entry.salt, SEGMENT_SALT_SIZE);
+        p += 8 + SEGMENT_SALT_SIZE;
+
+        for (size_t s = 0; s < entry.segments.size(); ++s) {
+            store_le64(p, entry.segments[s].offset);
+            store_segment_le32(p + 8, entry.segments[s].stored);
+            p += kSegmentEntrySize;
+        }
+    }
+}
+
+bool read_archive_index(const unsigned char* in, size_t len, const ArchiveHeader& header,
+                        std::vector<ArchiveEntry>* entries) {
+    if (len < 4) {
+        return false;
+    }
+    const size_t count = load_segment_le32(in);
+    if (count > (len - 4) / kEntryFixedSize) {
+        return false;
+    }
+
+    entries->clear();
+    entries->resize(count);
+    size_t pos = 4;
+    for (size_t i = 0; i < count; ++i) {
+        ArchiveEntry& entry = (*entries)[i];
+        if (len - pos < kEntryFixedSize) {
+            return false;
+        }
+        entry.flags = in[pos];
+        const size_t name_len = static_cast<size_t>(in[pos + 1]) | (static_cast<size_t>(in[pos + 2]) << 8);
+        pos += 3;
+        if ((entry.flags & ~ARCHIVE_ENTRY_DIRECTORY) != 0 ||
+            len - pos < name_len + kEntryFixedSize - 3) {
+            return false;
+        }
+        entry.name.assign(reinterpret_cast<const char*>(in + pos), name_len);
+        pos += name_len;
+        entry.size = load_le64(in + pos);
+        std::memcpy(entry.salt, in + pos + 8, SEGMENT_SALT_SIZE);
+        pos += 8 + SEGMENT_SALT_SIZE;
+
+        if (name_len > kMaxNameLength || !archive_name_is_safe(entry.name)) {
+            return false;
+        }
+        if ((entry.flags & ARCHIVE_ENTRY_DIRECTORY) && entry.size != 0) {
+            return false;
+        }
+
+        const unsigned long long segments =
+            (entry.size + header.segment_size - 1) / header.segment_size;
+        if (segments > (len - pos) / kSegmentEntrySize) {
+            return false;
+        }
+        entry.segments.resize(static_cast<size_t>(segments));
+        for (size_t s = 0; s < entry.segments.size(); ++s) {
+            ArchiveSegment& segment = entry.segments[s];
+            segment.offset = load_le64(in + pos);
+            segment.stored = load_segment_le32(in + pos + 8);
+            pos += kSegmentEntrySize;
+
+            // Data lives between the header (and key slots) and the index
+            if (segment.stored == 0 || segment.offset < archive_data_offset(header) ||
+                segment.offset > header.index_offset ||
+                segment.stored > header.index_offset - segment.offset) {
+                return false;
+            }
+        }
+    }
+    return pos == len;
+}
+
+SegmentHeader archive_entry_segments(const ArchiveHeader& header, const ArchiveEntry& entry) {
+    SegmentHeader segments;
+    segments.flags = (header.flags & ARCHIVE_FLAG_COMPRESSED) ? SEGMENT_FLAG_COMPRESSED : 0;
+    segments.segment_size = header.segment_size;
+    segments.plaintext_len = entry.size;
+    std::memcpy(segments.salt, entry.salt, SEGMENT_SALT_SIZE);
+    return segments;
+}
+
+SegmentHeader archive_index_segments(const ArchiveHeader& header) {
+    SegmentHeader segments;
+    segments.flags = (header.flags & ARCHIVE_FLAG_COMPRESSED) ? SEGMENT_FLAG_COMPRESSED : 0;
+    segments.segment_size = header.segment_size;
+    // Binds the cipher settings into the index's keys
+    segments.plaintext_len = pack_stream_params(header.params);
+    std::memcpy(segments.salt, header.salt, SEGMENT_SALT_SIZE);
+    return segments;
+}
+
+// Archive being written: workers seal segments in parallel and append them
+// one at a time
+struct ArchiveWriter {
+    std::mutex mutex;
+    std::FILE* file;
+    unsigned long long end;  // Offset of the next appended byte
+};
+
+static int open_archive(TreeJob& job, const CryptoBridgeContext& options, const std::string& path,
+                        const char* password, int password_len, ArchiveHeader* header,
+                        std::vector<ArchiveEntry>* entries);
+static int unlock_archive(const ArchiveHeader& header, const ArchiveKeySlot* slots,
+                          const char* password, int password_len, unsigned char* key);
+static int append_archive_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                                PooledBuffer& buffer, ArchiveWriter& writer, ArchiveEntry& entry);
+static int extract_archive_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                                 PooledBuffer& buffer, const ArchiveEntry& entry);
+
+// Body of crypto_bridge_archive_create. Segments are sealed in parallel on
+// the tree pool and appended in completion order; the index, written last,
+// records where each one landed.
+int process_archive_create(const CryptoBridgeContext& options, int algorithm, int mode,
+                           int key_size_bits, const char* password, int password_len,
+                           const char* source_dir, const char* archive_path,
+                           CryptoBridgeTreeProgress progress, void* user_data) {
+    if (!source_dir || !archive_path || !*source_dir || !*archive_path) {
+        return STATUS_INVALID_PARAMS;
+    }
+    const std::string source(source_dir);
+    const std::string path(archive_path);
+
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    TreeJob job;
+    int status = configure_tree_job(job, options, algorithm, mode, key_size_bits, OPERATION_ENCRYPT,
+                                    password, password_len);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    std::vector<FsEntry> walked;
+    if (!fs_walk(source, &walked)) {
+        return STATUS_IO_ERROR;
+    }
+
+    CryptoPP::AutoSeededRandomPool rng;
+    ArchiveHeader header;
+    header.flags = ARCHIVE_FLAG_KEY_SLOTS;
+    if (options.compression != COMPRESSION_NONE) {
+        header.flags |= ARCHIVE_FLAG_COMPRESSED;
+    }
+    header.segment_size = budget_segment_size(job, SEGMENT_DEFAULT_SIZE);
+    header.index_len = 0;
+    header.index_offset = 0;
+    rng.GenerateBlock(header.salt, SEGMENT_SALT_SIZE);
+    header.params.algorithm = algorithm;
+    header.params.mode = mode;
+    header.params.key_size_bits = key_size_bits;
+    header.params.mac = options.mac;
+
+    // The data is sealed under a random archive key; the password only
+    // wraps it, in the first key slot
+    unsigned char* key = arena.allocate_secret(ARCHIVE_KEY_SIZE);
+    rng.GenerateBlock(key, ARCHIVE_KEY_SIZE);
+    job.master = key;
+    job.master_len = static_cast<int>(ARCHIVE_KEY_SIZE);
+
+    unsigned char slots[ARCHIVE_SLOT_COUNT * ARCHIVE_SLOT_SIZE];
+    ArchiveKeySlot slot;
+    seal_archive_slot(header, password, static_cast<size_t>(password_len), key, &slot);
+    std::memset(slots, 0, sizeof(slots));
+    write_archive_slot(slot, slots);
+
+    std::vector<ArchiveEntry> entries(walked.size());
+    std::vector<TreeFile> files(walked.size());
+    std::vector<std::vector<TreePiece> > tasks;
+    unsigned long long batch_bytes = 0;
+    long long bytes_total = 0;
+
+    for (size_t i = 0; i < walked.size(); ++i) {
+        // Checked before anything is written: the index of an archive with
+        // such a name would not parse
+        if (!archive_name_is_safe(walked[i].path)) {
+            return STATUS_INVALID_PARAMS;
+        }
+        ArchiveEntry& entry = entries[i];
+        entry.name = walked[i].path;
+        entry.flags = walked[i].directory ? ARCHIVE_ENTRY_DIRECTORY : 0;
+        entry.size = walked[i].size;
+        rng.GenerateBlock(entry.salt, SEGMENT_SALT_SIZE);
+        if (entry.flags & ARCHIVE_ENTRY_DIRECTORY) {
+            continue;
+        }
+
+        TreeFile& file = files[i];
+        file.source = fs_join(source, entry.name);
+        file.input_size = entry.size;
+        file.header = archive_entry_segments(header, entry);
+        entry.segments.resize(static_cast<size_t>(segment_count(file.header)));
+        // Segments land wherever the writer is, so any file can be split
+        file.split = segment_count(file.header) > TREE_SPLIT_SEGMENTS;
+        bytes_total += static_cast<long long>(entry.size);
+        add_tree_pieces(tasks, file, i, &batch_bytes);
+    }
+
+    FsFile archive(path, "wb");
+    if (!archive.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    // Until the real header replaces it, the file does not parse as an
+    // archive, so an interrupted run is never mistaken for a complete one
+    unsigned char raw[ARCHIVE_HEADER_SIZE];
+    std::memset(raw, 0, sizeof(raw));
+    if (std::fwrite(raw, 1, sizeof(raw), archive.get()) != sizeof(raw) ||
+        std::fwrite(slots, 1, sizeof(slots), archive.get()) != sizeof(slots)) {
+        archive.close();
+        fs_remove(path);
+        return STATUS_IO_ERROR;
+    }
+
+    ArchiveWriter writer;
+    writer.file = archive.get();
+    writer.end = archive_data_offset(header);
+    status = run_tree_tasks(job, files, tasks, bytes_total, progress, user_data,
+                            [&](const TreePiece& piece, PooledBuffer& buffer) {
+        return append_archive_piece(job, files[piece.file], piece, buffer, writer,
+                                    entries[piece.file]);
+    });
+
+    if (status == STATUS_SUCCESS) {
+        std::vector<unsigned char> index;
+        write_archive_index(entries, &index);
+        if (index.size() > static_cast<size_t>(INT_MAX / 2)) {
+            status = STATUS_INVALID_PARAMS;
+        } else {
+            PooledBuffer sealed;
+            sealed.reserve(segment_record_bound(index.size()));
+            int sealed_len = static_cast<int>(sealed.capacity());
+            status = process_segment(job, archive_index_segments(header), ARCHIVE_INDEX_SEGMENT,
+                                     &index[0], static_cast<int>(index.size()),
+                                     sealed.data(), &sealed_len, nullptr);
+            if (status == STATUS_SUCCESS) {
+                header.index_offset = writer.end;
+                header.index_len = static_cast<size_t>(sealed_len);
+                write_archive_header(header, raw);
+                if (std::fwrite(sealed.data(), 1, sealed_len, archive.get()) !=
+                        static_cast<size_t>(sealed_len) ||
+                    !fs_seek(archive.get(), 0) ||
+                    std::fwrite(raw, 1, sizeof(raw), archive.get()) != sizeof(raw)) {
+                    status = STATUS_IO_ERROR;
+                }
+            }
+        }
+    }
+
+    if (!archive.close() && status == STATUS_SUCCESS) {
+        status = STATUS_IO_ERROR;
+    }
+    if (status != STATUS_SUCCESS) {
+        fs_remove(path);
+    }
+    return status;
+}
+
+// Body of crypto_bridge_archive_list: one line per entry, "size<TAB>name",
+// with a trailing '/' on directories
+int process_archive_list(const CryptoBridgeContext& options,
+                         const char* password, int password_len,
+                         const char* archive_path, char* listing, int* listing_len) {
+    if (!archive_path || !listing || !listing_len || *listing_len <= 0) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    TreeJob job;
+    ArchiveHeader header;
+    std::vector<ArchiveEntry> entries;
+    int status = open_archive(job, options, archive_path, password, password_len,
+                              &header, &entries);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    std::string text;
+    char size[32];
+    for (size_t i = 0; i < entries.size(); ++i) {
+        std::snprintf(size, sizeof(size), "%llu\t", entries[i].size);
+        text += size;
+        text += entries[i].name;
+        text += (entries[i].flags & ARCHIVE_ENTRY_DIRECTORY) ? "/\n" : "\n";
+    }
+
+    const int required = static_cast<int>(text.size()) + 1;
+    if (*listing_len < required) {
+        *listing_len = required;
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+    std::memcpy(listing, text.c_str(), required);
+    *listing_len = required;
+    return STATUS_SUCCESS;
+}
+
+// Body of crypto_bridge_archive_extract. Only the index and the segments of
+// the selected entries are read.
+int process_archive_extract(const CryptoBridgeContext& options,
+                            const char* password, int password_len,
+                            const char* archive_path, const char* entry_name,
+                            const char* dest_dir,
+                            CryptoBridgeTreeProgress progress, void* user_data) {
+    if (!archive_path || !dest_dir || !*dest_dir) {
+        return STATUS_INVALID_PARAMS;
+    }
+    const std::string path(archive_path);
+    const std::string target(dest_dir);
+
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    TreeJob job;
+    ArchiveHeader header;
+    std::vector<ArchiveEntry> entries;
+    int status = open_archive(job, options, path, password, password_len, &header, &entries);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (!fs_make_directories(target)) {
+        return STATUS_IO_ERROR;
+    }
+
+    std::vector<TreeFile> files(entries.size());
+    std::vector<std::vector<TreePiece> > tasks;
+    unsigned long long batch_bytes = 0;
+    long long bytes_total = 0;
+    bool found = false;
+
+    for (size_t i = 0; i < entries.size() && status == STATUS_SUCCESS; ++i) {
+        const ArchiveEntry& entry = entries[i];
+        if (entry_name && entry.name != entry_name) {
+            continue;
+        }
+        found = true;
+
+        const std::string output = fs_join(target, entry.name);
+        const size_t slash = entry.name.rfind('/');
+        const std::string parent = slash == std::string::npos
+            ? target : fs_join(target, entry.name.substr(0, slash));
+        if (!fs_make_directories((entry.flags & ARCHIVE_ENTRY_DIRECTORY) ? output : parent)) {
+            status = STATUS_IO_ERROR;
+            break;
+        }
+        if (entry.flags & ARCHIVE_ENTRY_DIRECTORY) {
+            continue;
+        }
+
+        TreeFile& file = files[i];
+        file.source = path;
+        file.target = output;
+        file.header = archive_entry_segments(header, entry);
+        file.split = segment_count(file.header) > TREE_SPLIT_SEGMENTS;
+        for (size_t s = 0; s < entry.segments.size(); ++s) {
+            file.input_size += entry.segments[s].stored;
+        }
+        if (file.split) {
+            FsFile created(file.target, "wb");
+            if (!created.get() || !created.close()) {
+                status = STATUS_IO_ERROR;
+                break;
+            }
+        }
+        bytes_total += static_cast<long long>(file.input_size);
+        add_tree_pieces(tasks, file, i, &batch_bytes);
+    }
+    if (status != STATUS_SUCCESS) {
+        remove_unfinished_files(files);
+        return status;
+    }
+    if (!found) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    return run_tree_tasks(job, files, tasks, bytes_total, progress, user_data,
+                          [&](const TreePiece& piece, PooledBuffer& buffer) {
+        return extract_archive_piece(job, files[piece.file], piece, buffer, entries[piece.file]);
+    });
+}
+
+// Reads an archive's header, configures `job` to decrypt with the cipher it
+// records, unlocks its key and decrypts its index. Anything that does not
+// parse, or does not authenticate, is reported as a crypto error.
+static int open_archive(TreeJob& job, const CryptoBridgeContext& options, const std::string& path,
+                        const char* password, int password_len, ArchiveHeader* header,
+                        std::vector<ArchiveEntry>* entries) {
+    if (!password) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (password_len < 8) {
+        return STATUS_PASSWORD_TOO_SHORT;
+    }
+    FsFile archive(path, "rb");
+    if (!archive.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    unsigned char raw[ARCHIVE_HEADER_SIZE];
+    if (std::fread(raw, 1, sizeof(raw), archive.get()) != sizeof(raw) ||
+        !read_archive_header(raw, header) ||
+        header->index_len > static_cast<size_t>(INT_MAX / 2)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    const StreamParams& params = header->params;
+    if (params.mac != MAC_NONE && params.mac != MAC_HMAC_SHA256 && params.mac != MAC_BLAKE2B) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    CryptoBridgeContext archive_options = options;
+    archive_options.mac = params.mac;
+    // The password is already checked, so only the recorded cipher can fail
+    int status = configure_tree_job(job, archive_options, params.algorithm, params.mode,
+                                    params.key_size_bits, OPERATION_DECRYPT,
+                                    password, password_len);
+    if (status != STATUS_SUCCESS) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    if (header->flags & ARCHIVE_FLAG_KEY_SLOTS) {
+        unsigned char block[ARCHIVE_SLOT_COUNT * ARCHIVE_SLOT_SIZE];
+        ArchiveKeySlot slots[ARCHIVE_SLOT_COUNT];
+        if (std::fread(block, 1, sizeof(block), archive.get()) != sizeof(block)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        for (size_t i = 0; i < ARCHIVE_SLOT_COUNT; ++i) {
+            if (!read_archive_slot(block + i * ARCHIVE_SLOT_SIZE, &slots[i])) {
+                return STATUS_CRYPTO_ERROR;
+            }
+        }
+        unsigned char* key = CryptoArena::thread_instance().allocate_secret(ARCHIVE_KEY_SIZE);
+        if (unlock_archive(*header, slots, password, password_len, key) < 0) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        job.master = key;
+        job.master_len = static_cast<int>(ARCHIVE_KEY_SIZE);
+    } else {
+        // Archives without key slots are sealed under the password itself
+        status = derive_tree_master(job, password, password_len);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    CryptoPP::SecByteBlock sealed(header->index_len);
+    if (!fs_seek(archive.get(), header->index_offset) ||
+        std::fread(sealed.data(), 1, sealed.size(), archive.get()) != sealed.size()) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    // A compressed index expands; the first attempt reports its size
+    const SegmentHeader segments = archive_index_segments(*header);
+    CryptoPP::SecByteBlock index(sealed.size());
+    int index_len = static_cast<int>(index.size());
+    status = process_segment(job, segments, ARCHIVE_INDEX_SEGMENT,
+                                 sealed.data(), static_cast<int>(sealed.size()),
+                                 index.data(), &index_len, nullptr);
+    if (status == STATUS_OUTPUT_BUFFER_TOO_SMALL) {
+        index.New(static_cast<size_t>(index_len));
+        status = process_segment(job, segments, ARCHIVE_INDEX_SEGMENT,
+                                 sealed.data(), static_cast<int>(sealed.size()),
+                                 index.data(), &index_len, nullptr);
+    }
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    if (!read_archive_index(index.data(), static_cast<size_t>(index_len), *header, entries)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Tries the password on every used slot; returns the slot that opened and
+// leaves the archive key in `key`, or returns -1
+static int unlock_archive(const ArchiveHeader& header, const ArchiveKeySlot* slots,
+                          const char* password, int password_len, unsigned char* key) {
+    for (size_t i = 0; i < ARCHIVE_SLOT_COUNT; ++i) {
+        if (open_archive_slot(header, slots[i], password, static_cast<size_t>(password_len), key)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// Body of the crypto_bridge_archive_*_password functions. Only key slots
+// are rewritten; a change writes the new slot before clearing the old one
+// whenever a slot is free, so an interruption never locks the archive.
+int process_archive_password(const char* archive_path,
+                             const char* password, int password_len,
+                             const char* new_password, int new_password_len, int action) {
+    const bool adding = action != ARCHIVE_PASSWORD_REMOVE;
+    if (!archive_path || !password || (adding && !new_password)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (password_len < 8 || (adding && new_password_len < 8)) {
+        return STATUS_PASSWORD_TOO_SHORT;
+    }
+
+    FsFile archive(archive_path, "r+b");
+    if (!archive.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    unsigned char raw[ARCHIVE_HEADER_SIZE];
+    unsigned char block[ARCHIVE_SLOT_COUNT * ARCHIVE_SLOT_SIZE];
+    ArchiveHeader header;
+    if (std::fread(raw, 1, sizeof(raw), archive.get()) != sizeof(raw) ||
+        !read_archive_header(raw, &header)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    // Archives sealed under the password itself cannot change it in place
+    if (!(header.flags & ARCHIVE_FLAG_KEY_SLOTS)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (std::fread(block, 1, sizeof(block), archive.get()) != sizeof(block)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    ArchiveKeySlot slots[ARCHIVE_SLOT_COUNT];
+    int free_slot = -1;
+    int used = 0;
+    for (size_t i = 0; i < ARCHIVE_SLOT_COUNT; ++i) {
+        if (!read_archive_slot(block + i * ARCHIVE_SLOT_SIZE, &slots[i])) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        if (slots[i].used) {
+            ++used;
+        } else if (free_slot < 0) {
+            free_slot = static_cast<int>(i);
+        }
+    }
+
+    SecureBlock key(ARCHIVE_KEY_SIZE);
+    const int unlocked = unlock_archive(header, slots, password, password_len, key.data());
+    if (unlocked < 0) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    int target = -1;
+    if (action == ARCHIVE_PASSWORD_ADD) {
+        target = free_slot;
+    } else if (action == ARCHIVE_PASSWORD_CHANGE) {
+        target = free_slot >= 0 ? free_slot : unlocked;
+    }
+    if ((action == ARCHIVE_PASSWORD_ADD && target < 0) ||
+        (action == ARCHIVE_PASSWORD_REMOVE && used == 1)) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    std::vector<int> written;
+    if (target >= 0) {
+        seal_archive_slot(header, new_password, static_cast<size_t>(new_password_len), key.data(),
+                          &slots[target]);
+        written.push_back(target);
+    }
+    if (action != ARCHIVE_PASSWORD_ADD && target != unlocked) {
+        slots[unlocked].used = false;
+        written.push_back(unlocked);
+    }
+
+    for (size_t i = 0; i < written.size(); ++i) {
+        unsigned char slot[ARCHIVE_SLOT_SIZE];
+        write_archive_slot(slots[written[i]], slot);
+        if (!fs_seek(archive.get(), ARCHIVE_HEADER_SIZE + written[i] * ARCHIVE_SLOT_SIZE) ||
+            std::fwrite(slot, 1, sizeof(slot), archive.get()) != sizeof(slot) ||
+            std::fflush(archive.get()) != 0) {
+            return STATUS_IO_ERROR;
+        }
+    }
+    return archive.close() ? STATUS_SUCCESS : STATUS_IO_ERROR;
+}
+
+// Seals a piece of one file and appends its segments to the archive
+static int append_archive_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                                PooledBuffer& buffer, ArchiveWriter& writer, ArchiveEntry& entry) {
+    const SegmentHeader& header = file.header;
+    const unsigned long long first = piece.first_segment;
+    const unsigned long long count = file.split ? piece.segments : segment_count(header);
+
+    FsFile input(file.source, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (first > 0 && !fs_seek(input.get(), first * header.segment_size)) {
+        return STATUS_IO_ERROR;
+    }
+
+    const size_t bound = segment_record_bound(header.segment_size);
+    unsigned char* data = buffer.reserve(segment_work_size(header));
+    unsigned char* scratch = segment_scratch(header, data);
+    for (unsigned long long i = first; i < first + count; ++i) {
+        const size_t len = segment_length(header, i);
+        if (std::fread(data, 1, len, input.get()) != len) {
+            return STATUS_IO_ERROR;  // The file shrank since the walk
+        }
+
+        int sealed = static_cast<int>(bound);
+        const int status = process_segment(job, header, i, data, static_cast<int>(len), data, &sealed,
+                                           scratch);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        ArchiveSegment& segment = entry.segments[static_cast<size_t>(i)];
+        segment.stored = static_cast<size_t>(sealed);
+        {
+            std::lock_guard<std::mutex> lock(writer.mutex);
+            if (std::fwrite(data, 1, segment.stored, writer.file) != segment.stored) {
+                return STATUS_IO_ERROR;
+            }
+            segment.offset = writer.end;
+            writer.end += segment.stored;
+        }
+        job.bytes_done += static_cast<long long>(len);
+    }
+    return STATUS_SUCCESS;
+}
+
+// Decrypts a piece of one entry into its output file
+static int extract_archive_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                                 PooledBuffer& buffer, const ArchiveEntry& entry) {
+    const SegmentHeader& header = file.header;
+    const unsigned long long first = piece.first_segment;
+    const unsigned long long count = file.split ? piece.segments : segment_count(header);
+
+    FsFile input(file.source, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+    FsFile output(file.target, file.split ? "r+b" : "wb");
+    if (!output.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (file.split && !fs_seek(output.get(), first * header.segment_size)) {
+        return STATUS_IO_ERROR;
+    }
+
+    const size_t bound = segment_record_bound(header.segment_size);
+    unsigned char* data = buffer.reserve(segment_work_size(header));
+    unsigned char* scratch = segment_scratch(header, data);
+    for (unsigned long long i = first; i < first + count; ++i) {
+        const ArchiveSegment& segment = entry.segments[static_cast<size_t>(i)];
+        if (segment.stored > bound) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        if (!fs_seek(input.get(), segment.offset) ||
+            std::fread(data, 1, segment.stored, input.get()) != segment.stored) {
+            return STATUS_CRYPTO_ERROR;
+        }
+
+        int len = static_cast<int>(bound);
+        const int status = process_segment(job, header, i, data, static_cast<int>(segment.stored),
+                                           data, &len, scratch);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+        if (static_cast<size_t>(len) != segment_length(header, i)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        if (std::fwrite(data, 1, len, output.get()) != static_cast<size_t>(len)) {
+            return STATUS_IO_ERROR;
+        }
+        job.bytes_done += static_cast<long long>(segment.stored);
+    }
+    return output.close() ? STATUS_SUCCESS : STATUS_IO_ERROR;
+}
@@ -0,0 +1,139 @@
+/*
+ * crypto_archive.h - Encrypted multi-file archive format
+ *
+ * An archive packs a directory tree into one file whose names, sizes and
+ * layout are encrypted along with the data:
+ *
+ *   header   "CTA" 0x01 | flags (1) | reserved (3) | segment size (4) |
+ *            index length (4) | index offset (8) | salt (16) | cipher (8)
+ *   slots    with ARCHIVE_FLAG_KEY_SLOTS: ARCHIVE_SLOT_COUNT key slots
+ *   data     sealed segments of every entry, in no particular order
+ *   index    the sealed index, at the offset the header records
+ *
+ * The index holds, per entry: flags (1) | name length (2) | name | size (8) |
+ * salt (16) | one (offset (8), stored length (4)) pair per segment. Segments
+ * are sealed exactly as in the segmented file format, with the entry's salt
+ * and size standing in for the file header, so listing an archive reads the
+ * header and the index, and extracting one entry additionally reads only
+ * that entry's segments. All integers are little endian; names are '/'
+ * separated relative paths without control characters.
+ *
+ * The cipher field holds the algorithm, mode, MAC and key size packed as in
+ * a stream header, so reading an archive takes them from there. The index
+ * is sealed with that field in place of its length, so an edited field
+ * makes the index fail to authenticate.
+ *
+ * Archives with key slots are encrypted under a random archive key rather
+ * than the password. Each used slot wraps that key under one password:
+ *
+ *   slot     state (4) | PBKDF2 iterations (4) | salt (16) | nonce (12) |
+ *            wrapped key (32) | tag (16)
+ *
+ * The wrap is AES-256-GCM under PBKDF2-HMAC-SHA256 of the password and the
+ * slot's salt, with the archive salt as associated data. Adding, changing
+ * or removing a password rewrites one slot and leaves the data untouched.
+ */
+
+#ifndef CRYPTO_ARCHIVE_H
+#define CRYPTO_ARCHIVE_H
+
+#include "crypto_segment.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+static const size_t ARCHIVE_HEADER_SIZE = 48;
+
+// Index position in the segment key expansion, never used by an entry
+static const unsigned long long ARCHIVE_INDEX_SEGMENT = ~0ULL;
+
+// Header flags
+enum ArchiveFlags {
+    ARCHIVE_FLAG_COMPRESSED = 1,  // Segments and index hold compressed frames
+    ARCHIVE_FLAG_KEY_SLOTS = 2    // Random archive key wrapped in key slots
+};
+
+static const size_t ARCHIVE_KEY_SIZE = 32;
+static const size_t ARCHIVE_SLOT_COUNT = 8;
+static const size_t ARCHIVE_SLOT_SIZE = 84;
+
+// PBKDF2 work factor for new slots; each slot records its own
+static const unsigned int ARCHIVE_SLOT_ITERATIONS = 100000;
+
+// Entry flags
+enum ArchiveEntryFlags {
+    ARCHIVE_ENTRY_DIRECTORY = 1
+};
+
+struct ArchiveHeader {
+    unsigned int flags;
+    size_t segment_size;
+    size_t index_len;                 // Sealed index length
+    unsigned long long index_offset;
+    unsigned char salt[SEGMENT_SALT_SIZE];
+    StreamParams params;              // Cipher the archive is sealed with
+};
+
+struct ArchiveKeySlot {
+    bool used;
+    unsigned int iterations;
+    unsigned char salt[16];
+    unsigned char nonce[12];
+    unsigned char wrapped[ARCHIVE_KEY_SIZE];
+    unsigned char tag[16];
+};
+
+struct ArchiveSegment {
+    unsigned long long offset;
+    size_t stored;
+};
+
+struct ArchiveEntry {
+    std::string name;
+    unsigned int flags;
+    unsigned long long size;
+    unsigned char salt[SEGMENT_SALT_SIZE];
+    std::vector<ArchiveSegment> segments;
+};
+
+void write_archive_header(const ArchiveHeader& header, unsigned char* out);
+
+// Parses ARCHIVE_HEADER_SIZE bytes; false if they are not a valid header
+bool read_archive_header(const unsigned char* in, ArchiveHeader* header);
+
+// Offset of the first data byte: past the header and any key slots
+unsigned long long archive_data_offset(const ArchiveHeader& header);
+
+// Serialises a slot into ARCHIVE_SLOT_SIZE bytes, or parses one; unused
+// slots are all zero
+void write_archive_slot(const ArchiveKeySlot& slot, unsigned char* out);
+bool read_archive_slot(const unsigned char* in, ArchiveKeySlot* slot);
+
+// Wraps the archive key under a password with a fresh salt and nonce
+void seal_archive_slot(const ArchiveHeader& header, const char* password, size_t password_len,
+                       const unsigned char* key, ArchiveKeySlot* slot);
+
+// Unwraps the archive key; false if the password does not open the slot
+bool open_archive_slot(const ArchiveHeader& header, const ArchiveKeySlot& slot,
+                       const char* password, size_t password_len, unsigned char* key);
+
+// True for a '/' separated relative name that stays inside the extraction
+// directory and has no control characters, which would break the listing
+bool archive_name_is_safe(const std::string& name);
+
+// Appends the plaintext index for `entries` to `out`
+void write_archive_index(const std::vector<ArchiveEntry>& entries, std::vector<unsigned char>* out);
+
+// Parses a plaintext index. Fails on malformed data, on names that could
+// escape the extraction directory, and on segment tables that do not match
+// the entry size or point outside the archive's data area.
+bool read_archive_index(const unsigned char* in, size_t len, const ArchiveHeader& header,
+                        std::vector<ArchiveEntry>* entries);
+
+// Segment header under which an entry's segments are sealed
+SegmentHeader archive_entry_segments(const ArchiveHeader& header, const ArchiveEntry& entry);
+
+// Segment header under which the index is sealed
+SegmentHeader archive_index_segments(const ArchiveHeader& header);
+
+#endif // CRYPTO_ARCHIVE_H
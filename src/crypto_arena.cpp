@@ -0,0 +1,161 @@
+/*
+ * crypto_arena.cpp - Per-thread scratch arena for the crypto bridge
+ *
+ * Blocks are kept in a singly linked list with the active block at the head.
+ * If a call outgrows the head block, a larger block is chained in front of
+ * it; on the next reset all blocks are folded into a single block of the
+ * combined size, so steady-state calls are served from one block with no
+ * system allocations.
+ */
+
+#include "crypto_arena.h"
+#include "crypto_compat.h"
+#include "crypto_secure_pool.h"
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+// Smallest block requested from the system allocator
+static const size_t kMinBlockSize = 16 * 1024;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+CryptoArena& CryptoArena::thread_instance() {
+    static thread_local CryptoArena arena;
+    return arena;
+}
+
+CryptoArena::CryptoArena()
+    : head_(nullptr),
+      depth_(0),
+      in_use_(0),
+      secret_slot_(nullptr),
+      secret_used_(0),
+      system_allocations_(0),
+      bytes_reserved_(0),
+      high_water_(0),
+      resets_(0) {
+}
+
+CryptoArena::~CryptoArena() {
+    reset();
+    free_blocks();
+}
+
+unsigned char* CryptoArena::allocate(size_t size) {
+    const size_t rounded = align_up(size == 0 ? 1 : size, kAlignment);
+
+    if (!head_ || head_->capacity - head_->used < rounded) {
+        // Grow geometrically so a call that keeps allocating settles quickly
+        size_t capacity = kMinBlockSize;
+        if (head_ && head_->capacity * 2 > capacity) {
+            capacity = head_->capacity * 2;
+        }
+        if (rounded > capacity) {
+            capacity = align_up(rounded, kMinBlockSize);
+        }
+        Block* block = new_block(capacity);
+        block->next = head_;
+        head_ = block;
+    }
+
+    unsigned char* ptr = head_->data + head_->used;
+    head_->used += rounded;
+    in_use_ += rounded;
+    if (static_cast<long long>(in_use_) > high_water_) {
+        high_water_ = static_cast<long long>(in_use_);
+    }
+    return ptr;
+}
+
+unsigned char* CryptoArena::allocate_secret(size_t size) {
+    const size_t rounded = align_up(size == 0 ? 1 : size, kAlignment);
+    if (!secret_slot_ && secret_used_ == 0) {
+        // One attempt per scope: a full pool stays full for the whole call
+        secret_slot_ = SecurePool::instance().acquire();
+        secret_used_ = secret_slot_ ? 0 : SECURE_SLOT_SIZE;
+    }
+    if (!secret_slot_ || SECURE_SLOT_SIZE - secret_used_ < rounded) {
+        SecurePool::instance().note_fallback();
+        return allocate(size);
+    }
+    unsigned char* ptr = secret_slot_ + secret_used_;
+    secret_used_ += rounded;
+    return ptr;
+}
+
+CryptoArena::Block* CryptoArena::new_block(size_t capacity) {
+    Block* block = try_new_block(capacity);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+// Same as new_block, but returns null when the system is out of memory
+CryptoArena::Block* CryptoArena::try_new_block(size_t capacity) noexcept {
+    // One allocation holds the header and the aligned payload
+    void* raw = std::malloc(sizeof(Block) + capacity + kAlignment);
+    if (!raw) {
+        return nullptr;
+    }
+
+    Block* block = static_cast<Block*>(raw);
+    uintptr_t payload = reinterpret_cast<uintptr_t>(block + 1);
+    payload = (payload + kAlignment - 1) & ~(static_cast<uintptr_t>(kAlignment) - 1);
+
+    block->next = nullptr;
+    block->data = reinterpret_cast<unsigned char*>(payload);
+    block->capacity = capacity;
+    block->used = 0;
+
+    ++system_allocations_;
+    bytes_reserved_ += static_cast<long long>(capacity);
+    return block;
+}
+
+void CryptoArena::free_blocks() noexcept {
+    while (head_) {
+        Block* next = head_->next;
+        bytes_reserved_ -= static_cast<long long>(head_->capacity);
+        std::free(head_);
+        head_ = next;
+    }
+}
+
+// Runs from Scope's destructor, so nothing here may throw
+void CryptoArena::reset() noexcept {
+    // The pool wipes the slot as it takes it back
+    SecurePool::instance().release(secret_slot_);
+    secret_slot_ = nullptr;
+    secret_used_ = 0;
+
+    if (!head_) {
+        return;
+    }
+
+    // Wipe only what was handed out since the last reset
+    size_t total_capacity = 0;
+    for (Block* block = head_; block; block = block->next) {
+        if (block->used) {
+            CryptoPP::SecureWipeBuffer(block->data, block->used);
+            block->used = 0;
+        }
+        total_capacity += block->capacity;
+    }
+
+    // Fold a chain into one block so the next call of this size fits
+    // without growing. Without memory for it the chain is kept as it is.
+    if (head_->next) {
+        Block* block = try_new_block(total_capacity);
+        if (block) {
+            free_blocks();
+            head_ = block;
+        }
+    }
+
+    in_use_ = 0;
+    ++resets_;
+}
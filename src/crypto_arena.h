@@ -0,0 +1,95 @@
+/*
+ * crypto_arena.h - Per-thread scratch arena for the crypto bridge
+ *
+ * Every crypto_bridge_process call needs a few short-lived buffers (derived
+ * key, IV, padding block, ...). Instead of going to the heap for each of
+ * them, the bridge carves them out of a thread-local arena. When the call
+ * returns, the bytes that were handed out are wiped and the arena is rewound
+ * in O(1). Once the arena has grown to the working set of a call, later
+ * calls take no more memory from the system for these buffers; the
+ * counters below make that observable. The Crypto++ cipher objects a call
+ * keys live outside the arena and are still allocated per call.
+ *
+ * Keys and IVs are asked for with allocate_secret instead. They are carved
+ * from a locked slot of the SecurePool that the arena borrows for the
+ * outermost scope and hands back, wiped, when the scope closes.
+ */
+
+#ifndef CRYPTO_ARENA_H
+#define CRYPTO_ARENA_H
+
+#include <cstddef>
+
+class CryptoArena {
+public:
+    // All allocations are aligned to this many bytes (one cache line)
+    static const size_t kAlignment = 64;
+
+    // Arena owned by the calling thread
+    static CryptoArena& thread_instance();
+
+    // Returns an uninitialised, 64-byte aligned block of at least `size` bytes.
+    // The memory stays valid until the outermost Scope on this arena closes.
+    unsigned char* allocate(size_t size);
+
+    // Same as allocate, but from locked memory while the scope's pool slot
+    // has room; ordinary arena memory otherwise
+    unsigned char* allocate_secret(size_t size);
+
+    // Number of times the arena had to ask the system allocator for memory
+    long long system_allocations() const { return system_allocations_; }
+    // Bytes currently reserved from the system allocator
+    long long bytes_reserved() const { return bytes_reserved_; }
+    // Largest number of bytes handed out between two resets
+    long long high_water() const { return high_water_; }
+    // Number of completed resets (one per outermost Scope)
+    long long resets() const { return resets_; }
+
+    // RAII guard: the outermost scope wipes and rewinds the arena on exit,
+    // including when the call unwinds through an exception. The rewind
+    // cannot throw, so closing a scope never terminates the process.
+    class Scope {
+    public:
+        explicit Scope(CryptoArena& arena) : arena_(arena) { ++arena_.depth_; }
+        ~Scope() noexcept {
+            if (--arena_.depth_ == 0) {
+                arena_.reset();
+            }
+        }
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+        CryptoArena& arena_;
+    };
+
+    CryptoArena();
+    ~CryptoArena();
+
+private:
+    struct Block {
+        Block* next;
+        unsigned char* data;
+        size_t capacity;
+        size_t used;
+    };
+
+    CryptoArena(const CryptoArena&);
+    CryptoArena& operator=(const CryptoArena&);
+
+    Block* new_block(size_t capacity);
+    Block* try_new_block(size_t capacity) noexcept;
+    void free_blocks() noexcept;
+    void reset() noexcept;
+
+    Block* head_;
+    int depth_;
+    size_t in_use_;
+    unsigned char* secret_slot_;  // Borrowed from the SecurePool, or null
+    size_t secret_used_;
+    long long system_allocations_;
+    long long bytes_reserved_;
+    long long high_water_;
+    long long resets_;
+};
+
+#endif // CRYPTO_ARENA_H
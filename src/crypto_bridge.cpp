@@ -35,113 +35,157 @@
 
 // Use compatibility header that handles different Crypto++ installation paths
 #include "crypto_compat.h"
+#include "crypto_arena.h"
+#include "crypto_bridge_internal.h"
+#include "crypto_buffer_pool.h"
+#include "crypto_compress.h"
+#include "crypto_fs.h"
+#include "crypto_hash.h"
+#include "crypto_jobs.h"
+#include "crypto_ocb.h"
+#include "crypto_parallel.h"
+#include "crypto_secure_pool.h"
+#include "crypto_segment.h"
+#include "crypto_topology.h"
+#include "crypto_tree.h"
+#include "crypto_tuner.h"
+#include "crypto_xts.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-// Algorithm identifiers
-enum CryptoBridgeAlgorithm {
-    // Tier 1-2: Modern High Security
-    ALGORITHM_AES = 1,
-    ALGORITHM_SERPENT = 2,
-    ALGORITHM_TWOFISH = 3,
-    
-    // Tier 3: Strong Security - AES Finalists & Modern Ciphers  
-    ALGORITHM_RC6 = 4,
-    ALGORITHM_MARS = 5,
-    ALGORITHM_RC5 = 6,
-    ALGORITHM_SKIPJACK = 7,
-    
-    // Tier 4: Reliable Security - Established Algorithms
-    ALGORITHM_BLOWFISH = 8,
-    ALGORITHM_CAST128 = 9,
-    ALGORITHM_CAST256 = 10,
-    ALGORITHM_CAMELLIA = 11,
-    
-    // Tier 5: Stream Ciphers - High Performance
-    ALGORITHM_CHACHA20 = 12,
-    ALGORITHM_SALSA20 = 13,
-    ALGORITHM_XSALSA20 = 14,
-    ALGORITHM_HC128 = 15,
-    ALGORITHM_HC256 = 16,
-    ALGORITHM_RABBIT = 17,
-    ALGORITHM_SOSEMANUK = 18,
-    
-    // Tier 6: Specialized & National Algorithms
-    ALGORITHM_ARIA = 19,
-    ALGORITHM_SEED = 20,
-    ALGORITHM_SM4 = 21,
-    ALGORITHM_GOST28147 = 22,
-    
-    // Tier 7: Legacy Strong Algorithms
-    ALGORITHM_DES3 = 23,
-    ALGORITHM_IDEA = 24,
-    ALGORITHM_RC2 = 25,
-    ALGORITHM_SAFER = 26,
-    ALGORITHM_SAFER_PLUS = 27,
-    
-    // Tier 8: Historical & Compatibility
-    ALGORITHM_DES = 28,
-    ALGORITHM_RC4 = 29,
-    
-    // Tier 9: Experimental & Research
-    ALGORITHM_THREEFISH256 = 30,
-    ALGORITHM_THREEFISH512 = 31,
-    ALGORITHM_THREEFISH1024 = 32,
-    
-    // Tier 10: Additional Algorithms
-    ALGORITHM_TEA = 33,
-    ALGORITHM_XTEA = 34,
-    ALGORITHM_SHACAL2 = 35,
-    ALGORITHM_WAKE = 36,
-    
-    // Archive/Research Ciphers
-    ALGORITHM_SQUARE = 37,
-    ALGORITHM_SHARK = 38,
-    ALGORITHM_PANAMA = 39,
-    ALGORITHM_SEAL = 40,
-    ALGORITHM_LUCIFER = 41,
-    
-    // Modern lightweight ciphers (placeholders)
-    ALGORITHM_SIMON = 42,
-    ALGORITHM_SPECK = 43
-};
+// Largest CRYPTO_OPTION_SECTOR_SIZE
+static const int MAX_SECTOR_SIZE = 1 << 24;
+
+// Blocks per parallel work item in position-addressed modes
+static const size_t TWEAK_GRAIN_BLOCKS = 1024;
 
-// Mode identifiers  
-enum CryptoBridgeMode {
-    MODE_CBC = 1,
-    MODE_GCM = 2,
-    MODE_ECB = 3,
-    MODE_CFB = 4,
-    MODE_OFB = 5,
-    MODE_CTR = 6
+// Plaintext bytes per cipher call when a digest is computed in the same pass;
+// a multiple of every block size, small enough to stay in L2
+static const size_t DIGEST_SLICE_SIZE = 64 * 1024;
+
+// Smallest CRYPTO_OPTION_MEMORY_BUDGET: a chunk store window and one chunk
+static const long long MIN_MEMORY_BUDGET = 8 * 1024 * 1024;
+
+// Without carry-less multiply instructions GHASH runs from lookup tables.
+// From this input size on, the one-off cost of building 64K tables pays
+// for itself.
+static const int GCM_LARGE_TABLE_THRESHOLD = 1024 * 1024;
+
+// Everything a cipher needs for one crypto_bridge_process call. Key and IV
+// point into the calling thread's CryptoArena.
+struct CipherJob {
+    int operation;
+    const CryptoPP::byte* input;
+    int input_len;
+    CryptoPP::byte* output;
+    int output_capacity;
+    int* output_len;
+    const CryptoPP::byte* key;
+    int key_len;
+    const CryptoPP::byte* iv;
+    int iv_len;
+    unsigned char* auth_tag;
+    int gcm_tables;  // GCM_TABLES_2K or GCM_TABLES_64K, already resolved
+    int sector_size;
+    long long start_sector;
+    int threads;
+    long long stream_offset;  // Keystream position of the first input byte (CTR only)
+    DigestStage* digest;      // Receives the plaintext as it is processed, or null
+    CryptoPP::MessageAuthenticationCode* mac;  // Receives the ciphertext, or null
+    CryptoPP::byte* mac_tag;  // Tag to write (encrypt) or verify (decrypt); null = append
 };
 
-// Operation type
-enum CryptoBridgeOperation {
-    OPERATION_ENCRYPT = 1,
-    OPERATION_DECRYPT = 2
+// One row of the benchmark matrix
+struct BenchmarkCase {
+    int algorithm;
+    int mode;
+    int key_size_bits;
+    int gcm_tables;
+    const char* label;
 };
 
-// Status codes
-enum CryptoBridgeStatus {
-    STATUS_SUCCESS = 0,
-    STATUS_INVALID_PARAMS = -1,
-    STATUS_UNSUPPORTED_ALGORITHM = -2,
-    STATUS_UNSUPPORTED_MODE = -3,
-    STATUS_INVALID_KEY_SIZE = -4,
-    STATUS_MEMORY_ERROR = -5,
-    STATUS_CRYPTO_ERROR = -6,
-    STATUS_PASSWORD_TOO_SHORT = -7,
-    STATUS_OUTPUT_BUFFER_TOO_SMALL = -8,
-    STATUS_UNKNOWN_ERROR = -9
+static const BenchmarkCase kBenchmarkCases[] = {
+    { ALGORITHM_AES,           MODE_CBC,       256, GCM_TABLES_AUTO, "AES-256/CBC" },
+    { ALGORITHM_AES,           MODE_CTR,       256, GCM_TABLES_AUTO, "AES-256/CTR" },
+    { ALGORITHM_AES,           MODE_GCM,       256, GCM_TABLES_2K,   "AES-256/GCM" },
+    { ALGORITHM_AES,           MODE_GCM,       256, GCM_TABLES_64K,  "AES-256/GCM" },
+    { ALGORITHM_AES,           MODE_GCM,       256, GCM_TABLES_AUTO, "AES-256/GCM" },
+    { ALGORITHM_AES,           MODE_OCB,       256, GCM_TABLES_AUTO, "AES-256/OCB" },
+    { ALGORITHM_AES,           MODE_EAX,       256, GCM_TABLES_AUTO, "AES-256/EAX" },
+    { ALGORITHM_AES,           MODE_XTS,       256, GCM_TABLES_AUTO, "AES-256/XTS" },
+    { ALGORITHM_SERPENT,       MODE_CTR,       256, GCM_TABLES_AUTO, "Serpent-256/CTR" },
+    { ALGORITHM_SERPENT,       MODE_OCB,       256, GCM_TABLES_AUTO, "Serpent-256/OCB" },
+    { ALGORITHM_SERPENT,       MODE_XTS,       256, GCM_TABLES_AUTO, "Serpent-256/XTS" },
+    { ALGORITHM_TWOFISH,       MODE_CTR,       256, GCM_TABLES_AUTO, "Twofish-256/CTR" },
+    { ALGORITHM_RC6,           MODE_OCB,       256, GCM_TABLES_AUTO, "RC6-256/OCB" },
+    { ALGORITHM_CAMELLIA,      MODE_GCM,       256, GCM_TABLES_2K,   "Camellia-256/GCM" },
+    { ALGORITHM_CAMELLIA,      MODE_GCM,       256, GCM_TABLES_64K,  "Camellia-256/GCM" },
+    { ALGORITHM_CHACHA20,      MODE_CTR,       256, GCM_TABLES_AUTO, "ChaCha20" },
+    { ALGORITHM_CHACHA20,      MODE_POLY1305,  256, GCM_TABLES_AUTO, "ChaCha20-Poly1305" },
+    { ALGORITHM_XCHACHA20,     MODE_POLY1305,  256, GCM_TABLES_AUTO, "XChaCha20-Poly1305" },
+    { ALGORITHM_SALSA20,       MODE_CTR,       256, GCM_TABLES_AUTO, "Salsa20" },
+    { ALGORITHM_HC128,         MODE_CTR,       128, GCM_TABLES_AUTO, "HC-128" },
+    { ALGORITHM_HC256,         MODE_CTR,       256, GCM_TABLES_AUTO, "HC-256" },
+    { ALGORITHM_RABBIT,        MODE_CTR,       128, GCM_TABLES_AUTO, "Rabbit" },
+    { ALGORITHM_SOSEMANUK,     MODE_CTR,       256, GCM_TABLES_AUTO, "Sosemanuk" },
+    { ALGORITHM_PANAMA,        MODE_CTR,       256, GCM_TABLES_AUTO, "Panama" },
+    { ALGORITHM_SEAL,          MODE_CTR,       160, GCM_TABLES_AUTO, "SEAL" },
+    { ALGORITHM_WAKE,          MODE_CTR,       256, GCM_TABLES_AUTO, "WAKE-OFB" },
+    { ALGORITHM_THREEFISH512,  MODE_TWEAK,     512, GCM_TABLES_AUTO, "Threefish-512/Tweak" },
+    { ALGORITHM_THREEFISH1024, MODE_TWEAK,    1024, GCM_TABLES_AUTO, "Threefish-1024/Tweak" },
+    { ALGORITHM_THREEFISH512,  MODE_CTR,       512, GCM_TABLES_AUTO, "Threefish-512/CTR" },
+    { ALGORITHM_BLOWFISH,      MODE_CBC,       128, GCM_TABLES_AUTO, "Blowfish-128/CBC" }
 };
 
 // Forward declarations for internal functions
-static int validate_algorithm_key_size(int algorithm, int key_size_bits);
-static int validate_algorithm_mode_combination(int algorithm, int mode);
-static int derive_key_and_iv(const char* password, int password_len, 
-                           unsigned char* key, int key_len,
-                           unsigned char* iv, int iv_len);
+static int expand_frame(const unsigned char* frame, size_t frame_len, int codec,
+                        unsigned char* output, int* output_len, int capacity, int threads,
+                        DigestStage* digest);
+static int hash_status(int hash_algorithm, int hash_mode, int* digest_len);
+static CryptoPP::MessageAuthenticationCode* new_mac(int mac, const unsigned char* key, int key_len);
+static bool uses_random_nonce(int mode);
+static int random_nonce_length(int algorithm, int mode);
+static bool has_carryless_multiply();
+static int resolve_gcm_tables(int requested, int input_len);
+static void configure_job(CipherJob& job, const CryptoBridgeContext& options);
+static int dispatch_cipher(int algorithm, int mode, const CipherJob& job);
+static int benchmark_case(int algorithm, int mode, int key_size_bits,
+                          const CryptoBridgeContext& options, int data_len, int iterations,
+                          double* megabytes_per_second, int* gcm_tables_used);
+static int transform_buffer(CryptoPP::StreamTransformation& cipher, const CipherJob& job);
+static void process_slices(CryptoPP::StreamTransformation& cipher, const CipherJob& job,
+                           CryptoPP::byte* out, const CryptoPP::byte* in, size_t len);
+static bool seek_keystream(CryptoPP::StreamTransformation& cipher, long long offset);
+static int finish_mac(const CipherJob& job, int written);
+template <class Mode> static int run_cipher(const CipherJob& job, bool uses_iv);
+template <class Mode> static int run_aead(const CipherJob& job);
+template <class Cipher> static int run_block_cipher(int mode, const CipherJob& job);
+template <class Cipher> static int run_stream_cipher(int mode, const CipherJob& job, bool uses_iv);
+template <class Cipher> static int run_block_cipher_128(int mode, const CipherJob& job);
+template <class Cipher> static int run_threefish(int mode, const CipherJob& job);
+template <class Cipher> static int run_tweak_mode(const CipherJob& job);
+template <class Cipher> static int run_xts(const CipherJob& job);
+template <class Tweaked> static void tweak_blocks(const CipherJob& job, CryptoPP::word64 first_block,
+                                                  CryptoPP::word64 domain, size_t begin, size_t end);
+template <class Tweaked> static void tweak_tail(const CipherJob& job, CryptoPP::word64 first_block,
+                                                CryptoPP::word64 domain);
+static CryptoPP::word64 load_le64(const CryptoPP::byte* in);
+static void store_le64(CryptoPP::byte* out, CryptoPP::word64 value);
+
+extern "C" int crypto_bridge_process_ex(CryptoBridgeContext* context, int algorithm, int mode,
+                                        int key_size_bits, int operation,
+                                        const char* password, int password_len,
+                                        const unsigned char* input_data, int input_len,
+                                        unsigned char* output_data, int* output_len,
+                                        unsigned char* iv, unsigned char* auth_tag);
 
 extern "C" {
 
@@ -156,10 +200,10 @@ extern "C" {
  * @param password_len Length of password (excluding null terminator)
  * @param input_data Input data buffer
  * @param input_len Length of input data
- * @param output_data Output data buffer (allocated by caller)
+ * @param output_data Output data buffer (allocated by caller, may equal input_data)
  * @param output_len Pointer to output buffer size (in/out parameter)
  * @param iv Initialization vector (16 bytes, can be null for auto-generation)
- * @param auth_tag Authentication tag for GCM mode (16 bytes, can be null)
+ * @param auth_tag Authentication tag for AEAD modes (GCM, Poly1305, OCB, EAX; 16 bytes, can be null)
  * 
  * @return Status code (0 = success, negative = error)
  */
@@ -177,1114 +221,2060 @@ int crypto_bridge_process(
     unsigned char* iv,
     unsigned char* auth_tag
 ) {
-    try {
-        // Input validation
-        if (!password || !input_data || !output_data || !output_len) {
+    return crypto_bridge_process_ex(nullptr, algorithm, mode, key_size_bits, operation,
+                                    password, password_len, input_data, input_len,
+                                    output_data, output_len, iv, auth_tag);
+}
+
+/**
+ * crypto_bridge_process with per-context settings
+ */
+int crypto_bridge_process_ex(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len,
+    unsigned char* iv,
+    unsigned char* auth_tag
+) {
+    const CryptoBridgeContext defaults;
+    return process_buffer(context ? *context : defaults, algorithm, mode, key_size_bits,
+                          operation, password, password_len, input_data, input_len,
+                          output_data, output_len, iv, auth_tag, nullptr, nullptr, nullptr);
+}
+
+/**
+ * crypto_bridge_process_ex for data starting at a given sector
+ */
+int crypto_bridge_process_sectors(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    long long start_sector,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len
+) {
+    if (start_sector < 0) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    // Work on a copy so one configured context can serve concurrent calls
+    CryptoBridgeContext options;
+    if (context) {
+        options = *context;
+    }
+    options.start_sector = start_sector;
+
+    return crypto_bridge_process_ex(&options, algorithm, mode, key_size_bits, operation,
+                                    password, password_len, input_data, input_len,
+                                    output_data, output_len, nullptr, nullptr);
+}
+
+/**
+ * crypto_bridge_process_ex for data starting at a given keystream offset
+ */
+int crypto_bridge_process_at(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    long long stream_offset,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len
+) {
+    if (stream_offset < 0) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    CryptoBridgeContext options;
+    if (context) {
+        options = *context;
+    }
+    options.stream_offset = stream_offset;
+
+    return crypto_bridge_process_ex(&options, algorithm, mode, key_size_bits, operation,
+                                    password, password_len, input_data, input_len,
+                                    output_data, output_len, nullptr, nullptr);
+}
+
+/**
+ * crypto_bridge_process_ex that also digests the plaintext in the same pass
+ */
+int crypto_bridge_process_digest(
+    CryptoBridgeContext* context,
+    int hash_algorithm,
+    int hash_mode,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* output_data,
+    int* output_len,
+    unsigned char* iv,
+    unsigned char* auth_tag,
+    unsigned char* digest,
+    int* digest_len
+) {
+    return guarded([&]() -> int {
+        if (!digest) {
             return STATUS_INVALID_PARAMS;
         }
-        
-        if (password_len < 8) {
-            return STATUS_PASSWORD_TOO_SHORT;
+        const int status = hash_status(hash_algorithm, hash_mode, digest_len);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        const CryptoBridgeContext defaults;
+        const CryptoBridgeContext& options = context ? *context : defaults;
+        DigestStage stage(hash_algorithm, hash_mode, options.threads);
+        const int result = process_buffer(options, algorithm, mode, key_size_bits, operation,
+                                          password, password_len, input_data, input_len,
+                                          output_data, output_len, iv, auth_tag, &stage,
+                                          nullptr, nullptr);
+        if (result != STATUS_SUCCESS) {
+            return result;
+        }
+
+        stage.final(digest);
+        *digest_len = static_cast<int>(stage.digest_size());
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * Digest a buffer
+ */
+int crypto_bridge_hash(
+    CryptoBridgeContext* context,
+    int hash_algorithm,
+    int hash_mode,
+    const unsigned char* data,
+    int data_len,
+    unsigned char* digest,
+    int* digest_len
+) {
+    return guarded([&]() -> int {
+        if ((!data && data_len != 0) || data_len < 0 || !digest) {
+            return STATUS_INVALID_PARAMS;
+        }
+        const int status = hash_status(hash_algorithm, hash_mode, digest_len);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        DigestStage stage(hash_algorithm, hash_mode, context ? context->threads : 0);
+        stage.update(data, static_cast<size_t>(data_len));
+        stage.final(digest);
+        *digest_len = static_cast<int>(stage.digest_size());
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * Digest a file without loading it into memory
+ */
+int crypto_bridge_hash_file(
+    CryptoBridgeContext* context,
+    int hash_algorithm,
+    int hash_mode,
+    const char* path,
+    unsigned char* digest,
+    int* digest_len
+) {
+    return guarded([&]() -> int {
+        if (!path || !digest) {
+            return STATUS_INVALID_PARAMS;
+        }
+        const int status = hash_status(hash_algorithm, hash_mode, digest_len);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        if (!hash_file(hash_algorithm, hash_mode, path, context ? context->threads : 0, digest)) {
+            return STATUS_IO_ERROR;
+        }
+        *digest_len = hash_digest_size(hash_algorithm);
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * Encrypt or decrypt every file below a directory into another directory
+ */
+int crypto_bridge_process_tree(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const char* source_dir,
+    const char* dest_dir,
+    CryptoBridgeTreeProgress progress,
+    void* user_data
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        return process_tree(context ? *context : defaults, algorithm, mode, key_size_bits,
+                            operation, password, password_len, source_dir, dest_dir,
+                            progress, user_data, nullptr);
+    });
+}
+
+/**
+ * Encrypt or decrypt a stream of unknown length through caller callbacks
+ */
+int crypto_bridge_process_stream(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    CryptoBridgeStreamRead read,
+    CryptoBridgeStreamWrite write,
+    void* user_data
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        return process_stream(context ? *context : defaults, algorithm, mode, key_size_bits,
+                              operation, password, password_len, read, write, user_data);
+    });
+}
+
+/**
+ * Pack every file below a directory into one encrypted archive
+ */
+int crypto_bridge_archive_create(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* source_dir,
+    const char* archive_path,
+    CryptoBridgeTreeProgress progress,
+    void* user_data
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        return process_archive_create(context ? *context : defaults, algorithm, mode,
+                                      key_size_bits, password, password_len,
+                                      source_dir, archive_path, progress, user_data);
+    });
+}
+
+/**
+ * List the entries of an archive, reading only its header and index
+ */
+int crypto_bridge_archive_list(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* archive_path,
+    char* listing,
+    int* listing_len
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        // The cipher settings come from the archive header
+        (void)algorithm;
+        (void)mode;
+        (void)key_size_bits;
+        return process_archive_list(context ? *context : defaults, password, password_len,
+                                    archive_path, listing, listing_len);
+    });
+}
+
+/**
+ * Extract one entry, or all of them, from an archive
+ */
+int crypto_bridge_archive_extract(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* archive_path,
+    const char* entry_name,
+    const char* dest_dir,
+    CryptoBridgeTreeProgress progress,
+    void* user_data
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        // The cipher settings come from the archive header
+        (void)algorithm;
+        (void)mode;
+        (void)key_size_bits;
+        return process_archive_extract(context ? *context : defaults, password, password_len,
+                                       archive_path, entry_name, dest_dir, progress, user_data);
+    });
+}
+
+/**
+ * Let another password open an archive
+ */
+int crypto_bridge_archive_add_password(
+    const char* archive_path,
+    const char* password,
+    int password_len,
+    const char* new_password,
+    int new_password_len
+) {
+    return guarded([&]() {
+        return process_archive_password(archive_path, password, password_len,
+                                        new_password, new_password_len, ARCHIVE_PASSWORD_ADD);
+    });
+}
+
+/**
+ * Replace one of an archive's passwords
+ */
+int crypto_bridge_archive_change_password(
+    const char* archive_path,
+    const char* password,
+    int password_len,
+    const char* new_password,
+    int new_password_len
+) {
+    return guarded([&]() {
+        return process_archive_password(archive_path, password, password_len,
+                                        new_password, new_password_len, ARCHIVE_PASSWORD_CHANGE);
+    });
+}
+
+/**
+ * Stop a password from opening an archive
+ */
+int crypto_bridge_archive_remove_password(
+    const char* archive_path,
+    const char* password,
+    int password_len
+) {
+    return guarded([&]() {
+        return process_archive_password(archive_path, password, password_len,
+                                        nullptr, 0, ARCHIVE_PASSWORD_REMOVE);
+    });
+}
+
+/**
+ * Store a file in a deduplicating chunk store and write its recipe
+ */
+int crypto_bridge_store_put(
+    CryptoBridgeContext* context,
+    const char* password,
+    int password_len,
+    const char* store_dir,
+    const char* source_path,
+    const char* recipe_path,
+    long long* stored_bytes
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        return process_store_put(context ? *context : defaults, password, password_len,
+                                 store_dir, source_path, recipe_path, stored_bytes);
+    });
+}
+
+/**
+ * Rebuild a file from its recipe and a chunk store
+ */
+int crypto_bridge_store_get(
+    CryptoBridgeContext* context,
+    const char* password,
+    int password_len,
+    const char* store_dir,
+    const char* recipe_path,
+    const char* dest_path
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        return process_store_get(context ? *context : defaults, password, password_len,
+                                 store_dir, recipe_path, dest_path);
+    });
+}
+
+/**
+ * Bring an encrypted file up to date with its plaintext, rewriting only
+ * the segments that changed
+ */
+int crypto_bridge_file_update(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    const char* password,
+    int password_len,
+    const char* plain_path,
+    const char* encrypted_path,
+    const long long* ranges,
+    int range_count,
+    long long* rewritten_bytes
+) {
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        return process_file_update(context ? *context : defaults, algorithm, mode, key_size_bits,
+                                   password, password_len, plain_path, encrypted_path,
+                                   ranges, range_count, rewritten_bytes);
+    });
+}
+
+/**
+ * Start crypto_bridge_process_ex on a background thread
+ */
+long long crypto_bridge_job_process(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char* iv,
+    unsigned char* auth_tag,
+    CryptoBridgeJobCallback callback,
+    void* user_data
+) {
+    if (!password || password_len < 0 || !input_data || input_len <= 0) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return guarded([&]() {
+        return submit_buffer_job(context ? *context : CryptoBridgeContext(), algorithm, mode,
+                                 key_size_bits, operation, password, password_len,
+                                 input_data, input_len, iv, auth_tag, callback, user_data);
+    });
+}
+
+/**
+ * Start crypto_bridge_process_tree on a background thread
+ */
+long long crypto_bridge_job_process_tree(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const char* source_dir,
+    const char* dest_dir,
+    CryptoBridgeJobCallback callback,
+    void* user_data
+) {
+    if (!password || password_len < 0 || !source_dir || !dest_dir) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return guarded([&]() {
+        return submit_tree_job(context ? *context : CryptoBridgeContext(), algorithm, mode,
+                               key_size_bits, operation, password, password_len,
+                               source_dir, dest_dir, callback, user_data);
+    });
+}
+
+/**
+ * Get the status and progress of a job
+ */
+int crypto_bridge_job_poll(long long job_id, long long* done, long long* total) {
+    int status = STATUS_INVALID_PARAMS;
+    long long job_done = 0;
+    long long job_total = 0;
+    if (!JobQueue::instance().poll(job_id, &status, &job_done, &job_total)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (done) {
+        *done = job_done;
+    }
+    if (total) {
+        *total = job_total;
+    }
+    return status;
+}
+
+/**
+ * Ask a job to stop
+ */
+int crypto_bridge_job_cancel(long long job_id) {
+    return JobQueue::instance().cancel(job_id) ? STATUS_SUCCESS : STATUS_INVALID_PARAMS;
+}
+
+/**
+ * Set how many jobs may run at once outside the fast lane
+ */
+int crypto_bridge_job_set_concurrency(int max_jobs) {
+    if (max_jobs < 1 || max_jobs > JOB_MAX_CONCURRENCY) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return guarded([&]() -> int {
+        JobQueue::instance().set_concurrency(max_jobs);
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * Take the output of a finished crypto_bridge_job_process job
+ */
+int crypto_bridge_job_take_result(long long job_id, unsigned char** output_data, int* output_len) {
+    if (!output_data || !output_len) {
+        return STATUS_INVALID_PARAMS;
+    }
+    *output_data = nullptr;
+    *output_len = 0;
+
+    unsigned char* result = nullptr;
+    size_t result_len = 0;
+    if (!JobQueue::instance().take_result(job_id, &result, &result_len)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    *output_data = result;
+    *output_len = static_cast<int>(result_len);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Forget a finished job
+ */
+int crypto_bridge_job_release(long long job_id) {
+    return JobQueue::instance().release(job_id) ? STATUS_SUCCESS : STATUS_INVALID_PARAMS;
+}
+
+/**
+ * Register Dart_PostCObject for jobs that report to a Dart port
+ */
+void crypto_bridge_job_set_dart_api(void* post_cobject) {
+    set_dart_post_cobject(reinterpret_cast<DartPostCObject>(post_cobject));
+}
+
+/**
+ * Same as crypto_bridge_process, but the bridge allocates the result
+ */
+int crypto_bridge_process_alloc(
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int operation,
+    const char* password,
+    int password_len,
+    const unsigned char* input_data,
+    int input_len,
+    unsigned char** output_data,
+    int* output_len,
+    unsigned char* iv,
+    unsigned char* auth_tag
+) {
+    if (!output_data || !output_len) {
+        return STATUS_INVALID_PARAMS;
+    }
+    *output_data = nullptr;
+    *output_len = 0;
+
+    // Room for one block of padding or an appended tag, and for a nonce
+    // prepended when iv is null
+    if (input_len <= 0 || input_len > INT_MAX - 32) {
+        return STATUS_INVALID_PARAMS;
+    }
+    int result_len = input_len + 32;
+
+    unsigned char* result = CryptoBufferPool::allocate_result(static_cast<size_t>(result_len));
+    if (!result) {
+        return STATUS_MEMORY_ERROR;
+    }
+
+    int status = crypto_bridge_process(algorithm, mode, key_size_bits, operation,
+                                       password, password_len,
+                                       input_data, input_len,
+                                       result, &result_len,
+                                       iv, auth_tag);
+    if (status != STATUS_SUCCESS) {
+        CryptoBufferPool::free_result(result);
+        return status;
+    }
+
+    *output_data = result;
+    *output_len = result_len;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Free a result returned by crypto_bridge_process_alloc
+ */
+void crypto_bridge_result_free(void* result) {
+    CryptoBufferPool::free_result(result);
+}
+
+/**
+ * Get version string of the crypto bridge
+ */
+const char* crypto_bridge_version() {
+    return "1.0.0";
+}
+
+/**
+ * Create a context holding per-caller settings for crypto_bridge_process_ex
+ */
+CryptoBridgeContext* crypto_bridge_context_create(void) {
+    try {
+        return new CryptoBridgeContext();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+/**
+ * Destroy a context created by crypto_bridge_context_create
+ */
+void crypto_bridge_context_destroy(CryptoBridgeContext* context) {
+    delete context;
+}
+
+/**
+ * Change one setting of a context
+ */
+int crypto_bridge_context_set_option(CryptoBridgeContext* context, int option, long long value) {
+    if (!context) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    switch (option) {
+        case OPTION_GCM_TABLES:
+            if (value != GCM_TABLES_AUTO && value != GCM_TABLES_2K && value != GCM_TABLES_64K) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->gcm_tables = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_SECTOR_SIZE:
+            if (value < 16 || value > MAX_SECTOR_SIZE || (value % 16) != 0) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->sector_size = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_START_SECTOR:
+            if (value < 0) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->start_sector = value;
+            return STATUS_SUCCESS;
+        case OPTION_THREADS:
+            if (value < 0 || value > 256) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->threads = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_STREAM_OFFSET:
+            if (value < 0) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->stream_offset = value;
+            return STATUS_SUCCESS;
+        case OPTION_COMPRESSION:
+            if (value != COMPRESSION_NONE && value != COMPRESSION_DEFLATE) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->compression = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_MAC:
+            if (value != MAC_NONE && value != MAC_HMAC_SHA256 && value != MAC_BLAKE2B) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->mac = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_NOTIFY_PORT:
+            context->notify_port = value;
+            return STATUS_SUCCESS;
+        case OPTION_JOB_PRIORITY:
+            if (value < JOB_PRIORITY_BACKGROUND || value > JOB_PRIORITY_INTERACTIVE) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->job_priority = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_AUTOTUNE:
+            if (value != 0 && value != 1) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->autotune = static_cast<int>(value);
+            return STATUS_SUCCESS;
+        case OPTION_MEMORY_BUDGET:
+            if (value != 0 && value < MIN_MEMORY_BUDGET) {
+                return STATUS_INVALID_PARAMS;
+            }
+            context->memory_budget = value;
+            return STATUS_SUCCESS;
+        default:
+            return STATUS_INVALID_PARAMS;
+    }
+}
+
+/**
+ * Measure raw cipher throughput for one algorithm/mode combination
+ */
+int crypto_bridge_benchmark(
+    CryptoBridgeContext* context,
+    int algorithm,
+    int mode,
+    int key_size_bits,
+    int data_len,
+    int iterations,
+    double* megabytes_per_second
+) {
+    if (!megabytes_per_second || data_len <= 0 || iterations <= 0 ||
+        data_len > INT_MAX - 2 * AUTH_TAG_SIZE) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    return guarded([&]() -> int {
+        const CryptoBridgeContext defaults;
+        int gcm_tables_used = GCM_TABLES_2K;
+        return benchmark_case(algorithm, mode, key_size_bits, context ? *context : defaults,
+                              data_len, iterations, megabytes_per_second, &gcm_tables_used);
+    });
+}
+
+/**
+ * Run the built-in benchmark matrix and write a text report
+ */
+int crypto_bridge_benchmark_suite(int data_len, int iterations, char* report, int* report_len) {
+    if (!report || !report_len || *report_len <= 0 || data_len <= 0 || iterations <= 0 ||
+        data_len > INT_MAX - 2 * AUTH_TAG_SIZE) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    return guarded([&]() -> int {
+        std::string text;
+        char line[160];
+
+        std::snprintf(line, sizeof(line),
+                      "crypto_bridge %s benchmark: %d bytes x %d, carry-less multiply: %s\n",
+                      crypto_bridge_version(), data_len, iterations,
+                      has_carryless_multiply() ? "yes" : "no");
+        text += line;
+
+        for (size_t i = 0; i < sizeof(kBenchmarkCases) / sizeof(kBenchmarkCases[0]); ++i) {
+            const BenchmarkCase& bench = kBenchmarkCases[i];
+            double mbps = 0.0;
+            int gcm_tables_used = GCM_TABLES_2K;
+            CryptoBridgeContext options;
+            options.gcm_tables = bench.gcm_tables;
+            const int status = benchmark_case(bench.algorithm, bench.mode, bench.key_size_bits,
+                                              options, data_len, iterations,
+                                              &mbps, &gcm_tables_used);
+
+            // GCM rows show the table size that was actually used
+            char variant[32] = "";
+            if (bench.mode == MODE_GCM) {
+                std::snprintf(variant, sizeof(variant), "%s%s",
+                              gcm_tables_used == GCM_TABLES_64K ? "64K tables" : "2K tables",
+                              bench.gcm_tables == GCM_TABLES_AUTO ? " (auto)" : "");
+            }
+
+            if (status == STATUS_SUCCESS) {
+                std::snprintf(line, sizeof(line), "%-20s %-18s %10.1f MB/s\n",
+                              bench.label, variant, mbps);
+            } else {
+                std::snprintf(line, sizeof(line), "%-20s %-18s %10s (status %d)\n",
+                              bench.label, variant, "n/a", status);
+            }
+            text += line;
+        }
+
+        const int required = static_cast<int>(text.size()) + 1;
+        if (*report_len < required) {
+            *report_len = required;
+            return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+        }
+        std::memcpy(report, text.c_str(), required);
+        *report_len = required;
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * Report allocation counters of the calling thread's scratch arena
+ */
+int crypto_bridge_arena_stats(
+    long long* system_allocations,
+    long long* bytes_reserved,
+    long long* high_water
+) {
+    if (!system_allocations || !bytes_reserved || !high_water) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    const CryptoArena& arena = CryptoArena::thread_instance();
+    *system_allocations = arena.system_allocations();
+    *bytes_reserved = arena.bytes_reserved();
+    *high_water = arena.high_water();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Report the state of the locked memory that holds key material
+ */
+int crypto_bridge_secure_memory_stats(
+    long long* slots,
+    long long* in_use,
+    long long* fallbacks,
+    int* locked
+) {
+    if (!slots || !in_use || !fallbacks || !locked) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    const SecurePoolStats stats = SecurePool::instance().stats();
+    *slots = stats.slots;
+    *in_use = stats.in_use;
+    *fallbacks = stats.fallbacks;
+    *locked = stats.locked ? 1 : 0;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Hand out a reusable, 64-byte aligned buffer from the native pool
+ */
+unsigned char* crypto_bridge_buffer_acquire(int size, int flags) {
+    if (size <= 0) {
+        return nullptr;
+    }
+    try {
+        return CryptoBufferPool::instance().acquire(static_cast<size_t>(size), flags);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+/**
+ * Return a buffer obtained from crypto_bridge_buffer_acquire to the pool
+ */
+int crypto_bridge_buffer_release(unsigned char* buffer) {
+    return guarded([&]() {
+        return CryptoBufferPool::instance().release(buffer)
+               ? STATUS_SUCCESS : STATUS_INVALID_PARAMS;
+    });
+}
+
+/**
+ * Free every idle buffer held by the pool
+ */
+void crypto_bridge_buffer_trim(void) {
+    CryptoBufferPool::instance().trim();
+}
+
+/**
+ * Keep the autotuner's per-host profile in a file
+ */
+int crypto_bridge_tuner_set_profile(const char* path) {
+    return guarded([&]() {
+        return AutoTuner::instance().set_profile_path(path ? path : "")
+               ? STATUS_SUCCESS : STATUS_IO_ERROR;
+    });
+}
+
+/**
+ * Get the segment size and thread count the autotuner settled on
+ */
+int crypto_bridge_tuner_get(int algorithm, int mode, int key_size_bits, int operation,
+                            int* segment_size, int* threads, double* mb_per_s) {
+    if (!segment_size || !threads ||
+        (operation != OPERATION_ENCRYPT && operation != OPERATION_DECRYPT)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return guarded([&]() -> int {
+        const TunerProfile profile = AutoTuner::instance().lookup(
+            algorithm, mode, key_size_bits, operation == OPERATION_ENCRYPT);
+        *segment_size = static_cast<int>(profile.segment_size);
+        *threads = profile.threads;
+        if (mb_per_s) {
+            *mb_per_s = profile.mb_per_s;
+        }
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * List the cores the bridge may use and which of them are performance cores
+ */
+int crypto_bridge_get_cpu_cores(int* cores, int* performance, int max_cores, int* core_count) {
+    if (!core_count || max_cores < 0 || (max_cores > 0 && !cores)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return guarded([&]() -> int {
+        const std::vector<CpuCore> usable = cpu_cores();
+        *core_count = static_cast<int>(usable.size());
+        if (usable.size() > static_cast<size_t>(max_cores)) {
+            return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+        }
+        for (size_t i = 0; i < usable.size(); ++i) {
+            cores[i] = usable[i].id;
+            if (performance) {
+                performance[i] = usable[i].performance ? 1 : 0;
+            }
+        }
+        return STATUS_SUCCESS;
+    });
+}
+
+/**
+ * Restrict the bridge's worker threads to a set of cores
+ */
+int crypto_bridge_set_cpu_cores(const int* cores, int count) {
+    if (count < 0 || (count > 0 && !cores)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return guarded([&]() -> int {
+        const std::vector<int> ids(cores, cores + count);
+        return set_cpu_core_limit(ids) ? STATUS_SUCCESS : STATUS_INVALID_PARAMS;
+    });
+}
+
+} // extern "C"
+
+// Helper function implementations
+
+// Body of crypto_bridge_process_ex. When `digest` is given, it receives
+// the plaintext: the input when encrypting, the output when decrypting.
+// When `keys` is given, they are used instead of deriving them from the
+// password, which may then be null. When `scratch` is given, it holds the
+// compressed frame (compress_frame_bound(input_len) bytes when encrypting,
+// input_len when decrypting); otherwise the frame is allocated per call.
+// Password-sealed data that decrypts to a compression frame is expanded
+// with the codec its header records even without options.compression;
+// callers passing keys record compression in their own headers.
+int process_buffer(const CryptoBridgeContext& options, int algorithm, int mode,
+                   int key_size_bits, int operation,
+                   const char* password, int password_len,
+                   const unsigned char* input_data, int input_len,
+                   unsigned char* output_data, int* output_len,
+                   unsigned char* iv, unsigned char* auth_tag,
+                   DigestStage* digest, const SessionKeys* keys, unsigned char* scratch) {
+    return guarded([&]() -> int {
+        // Input validation
+        if ((!password && !keys) || !input_data || !output_data || !output_len) {
+            return STATUS_INVALID_PARAMS;
+        }
+        
+        if (!keys && password_len < 8) {
+            return STATUS_PASSWORD_TOO_SHORT;
+        }
+        
+        // Only a segment may be empty: a stream without data still seals
+        // its last segment
+        if (input_len < 0 || (input_len == 0 && !keys) || *output_len <= 0) {
+            return STATUS_INVALID_PARAMS;
+        }
+        const int output_capacity = *output_len;
+
+        // Validate algorithm and key size combination
+        int validation_result = validate_algorithm_key_size(algorithm, key_size_bits);
+        if (validation_result != STATUS_SUCCESS) {
+            return validation_result;
+        }
+        
+        // Validate algorithm and mode combination
+        validation_result = validate_algorithm_mode_combination(algorithm, mode);
+        if (validation_result != STATUS_SUCCESS) {
+            return validation_result;
+        }
+
+        if (!algorithm_implemented(algorithm)) {
+            return STATUS_UNSUPPORTED_ALGORITHM;
+        }
+
+        // Only counter-style keystreams can start in the middle of a stream
+        if (options.stream_offset != 0 &&
+            (mode != MODE_CTR || options.stream_offset > LLONG_MAX - input_len)) {
+            return STATUS_INVALID_PARAMS;
+        }
+
+        // Compression changes data positions, so it cannot be combined with
+        // sector or keystream addressing
+        const bool compressed = options.compression != COMPRESSION_NONE;
+        if (compressed && (mode == MODE_XTS || mode == MODE_TWEAK || options.stream_offset != 0)) {
+            return STATUS_INVALID_PARAMS;
+        }
+
+        // AEAD modes authenticate already; sector modes must stay length preserving
+        const bool mac_enabled = options.mac != MAC_NONE;
+        if (mac_enabled && !is_transform_mode(mode)) {
+            return STATUS_INVALID_PARAMS;
+        }
+
+        const int key_len = derived_key_length(mode, key_size_bits);
+        const int iv_len = nonce_length(algorithm);
+
+        // Poly1305, OCB and EAX seal every message under a fresh random
+        // nonce instead of the password-derived IV, which would repeat the
+        // (key, nonce) pair for every message under the same password. The
+        // nonce travels in `iv`, or ahead of the ciphertext when the caller
+        // passes no IV buffer. Session keys are unique per segment and keep
+        // their derived IV.
+        const bool random_nonce = !keys && uses_random_nonce(mode);
+        const int nonce_len = random_nonce_length(algorithm, mode);
+        const int nonce_prefix = random_nonce && !iv ? nonce_len : 0;
+
+        // Key material and scratch buffers come from the thread's arena and
+        // are wiped when this scope closes, on success and on every error path
+        CryptoArena& arena = CryptoArena::thread_instance();
+        CryptoArena::Scope arena_scope(arena);
+
+        // The digest runs inside the cipher loop where it can; otherwise it
+        // reads the plaintext in a pass of its own
+        const bool fused_digest = digest && !compressed && is_transform_mode(mode);
+        if (digest && !fused_digest && operation == OPERATION_ENCRYPT) {
+            digest->update(input_data, static_cast<size_t>(input_len));
+        }
+
+        // Compress before encrypting; the cipher then sees the frame. Frames
+        // are as large as the data, so they live outside the arena, which
+        // would keep a block that size for the thread's lifetime; segment
+        // workers pass budgeted scratch for them instead.
+        CryptoPP::SecByteBlock frame;
+        unsigned char* frame_data = scratch;
+        const unsigned char* cipher_input = input_data;
+        int cipher_input_len = input_len;
+        if (compressed && operation == OPERATION_ENCRYPT) {
+            const size_t bound = compress_frame_bound(static_cast<size_t>(input_len));
+            if (bound > static_cast<size_t>(INT_MAX - 16)) {
+                return STATUS_INVALID_PARAMS;
+            }
+            if (!frame_data) {
+                frame.New(bound);
+                frame_data = frame.data();
+            }
+            cipher_input_len = static_cast<int>(compress_frame(options.compression, input_data,
+                                                               static_cast<size_t>(input_len),
+                                                               frame_data, options.threads));
+            cipher_input = frame_data;
+        }
+
+        // A prepended nonce is not part of the ciphertext
+        if (nonce_prefix && operation == OPERATION_DECRYPT) {
+            if (cipher_input_len < nonce_prefix) {
+                return STATUS_CRYPTO_ERROR;
+            }
+            cipher_input += nonce_prefix;
+            cipher_input_len -= nonce_prefix;
+        }
+
+        // An appended MAC tag is not part of the ciphertext
+        if (mac_enabled && operation == OPERATION_DECRYPT && !auth_tag) {
+            cipher_input_len -= AUTH_TAG_SIZE;
+            if (cipher_input_len < 0) {
+                return STATUS_CRYPTO_ERROR;
+            }
+        }
+        
+        // Ensure output buffer is large enough. The size of decompressed
+        // output is only known after decryption.
+        int required_output_len = cipher_input_len;
+        if (operation == OPERATION_ENCRYPT) {
+            if (mode == MODE_CBC || mode == MODE_ECB) {
+                // Add padding space for the padded block modes
+                required_output_len += 16; // Block size padding
+            } else if (is_aead_mode(mode) && !auth_tag) {
+                // Tag is appended to the ciphertext
+                required_output_len += AUTH_TAG_SIZE;
+            }
+            if (mac_enabled && !auth_tag) {
+                required_output_len += AUTH_TAG_SIZE;
+            }
+            required_output_len += nonce_prefix;
+        }
+        
+        if (!(compressed && operation == OPERATION_DECRYPT) && *output_len < required_output_len) {
+            *output_len = required_output_len;
+            return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+        }
+
+        // Derive key and IV from password
+        unsigned char* derived_key = arena.allocate_secret(key_len);
+        unsigned char* derived_iv = arena.allocate_secret(iv_len);
+        
+        if (keys) {
+            std::memcpy(derived_key, keys->key, key_len);
+            std::memcpy(derived_iv, keys->iv, iv_len);
+        } else {
+            int derive_result = derive_key_and_iv(password, password_len,
+                                                derived_key, key_len,
+                                                derived_iv, iv_len);
+            if (derive_result != STATUS_SUCCESS) {
+                return derive_result;
+            }
+        }
+
+        // The random nonce replaces the leading bytes the caller's buffer
+        // holds; XChaCha20 keeps its last 8 derived bytes
+        if (random_nonce) {
+            if (operation == OPERATION_ENCRYPT) {
+                CryptoPP::AutoSeededRandomPool rng;
+                rng.GenerateBlock(derived_iv, nonce_len);
+            } else {
+                std::memcpy(derived_iv, iv ? iv : input_data, nonce_len);
+            }
+        }
+        
+        // Copy the IV or nonce to output if provided (the caller's buffer holds 16 bytes)
+        if (iv) {
+            std::memcpy(iv, derived_iv, random_nonce ? nonce_len : (iv_len < 16 ? iv_len : 16));
+        }
+
+        CipherJob job;
+        job.operation = operation;
+        job.input = cipher_input;
+        job.input_len = cipher_input_len;
+        job.output = output_data;
+        job.output_capacity = *output_len;
+        job.output_len = output_len;
+        job.key = derived_key;
+        job.key_len = key_len;
+        job.iv = derived_iv;
+        job.iv_len = iv_len;
+        job.auth_tag = auth_tag;
+        job.digest = fused_digest ? digest : nullptr;
+        job.mac = nullptr;
+        job.mac_tag = nullptr;
+
+        // Encrypt-then-MAC: the tag covers the ciphertext and the settings
+        // that shaped it, so it cannot be moved to another configuration
+        std::unique_ptr<CryptoPP::MessageAuthenticationCode> mac;
+        if (mac_enabled) {
+            mac.reset(new_mac(options.mac, derived_key, key_len));
+            CryptoPP::byte mac_context[12];
+            mac_context[0] = static_cast<CryptoPP::byte>(algorithm);
+            mac_context[1] = static_cast<CryptoPP::byte>(mode);
+            mac_context[2] = static_cast<CryptoPP::byte>(key_size_bits);
+            mac_context[3] = static_cast<CryptoPP::byte>(key_size_bits >> 8);
+            store_le64(mac_context + 4, static_cast<CryptoPP::word64>(options.stream_offset));
+            mac->Update(mac_context, sizeof(mac_context));
+            job.mac = mac.get();
+
+            if (auth_tag) {
+                job.mac_tag = auth_tag;
+            } else if (operation == OPERATION_ENCRYPT) {
+                job.output_capacity -= AUTH_TAG_SIZE;
+            } else {
+                job.mac_tag = arena.allocate(AUTH_TAG_SIZE);
+                std::memcpy(job.mac_tag, input_data + cipher_input_len, AUTH_TAG_SIZE);
+            }
+        }
+
+        configure_job(job, options);
+
+        // With a prepended nonce the ciphertext sits nonce_prefix bytes
+        // further into the buffer than the plaintext, so in-place calls move
+        // their data to its new position first
+        if (nonce_prefix && operation == OPERATION_ENCRYPT) {
+            if (cipher_input == output_data) {
+                std::memmove(output_data + nonce_prefix, output_data, cipher_input_len);
+                job.input = output_data + nonce_prefix;
+            }
+            job.output = output_data + nonce_prefix;
+            job.output_capacity -= nonce_prefix;
+        } else if (nonce_prefix && cipher_input == output_data + nonce_prefix) {
+            std::memmove(output_data, cipher_input, cipher_input_len);
+            job.input = output_data;
+        }
+
+        if (!(compressed && operation == OPERATION_DECRYPT)) {
+            const int status = dispatch_cipher(algorithm, mode, job);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+            if (nonce_prefix && operation == OPERATION_ENCRYPT) {
+                std::memcpy(output_data, derived_iv, nonce_prefix);
+                *output_len += nonce_prefix;
+            }
+
+            // Data sealed with compression on carries its frame; expand it
+            // rather than hand the frame back as plaintext
+            size_t original_len = 0;
+            if (operation == OPERATION_DECRYPT && !keys && options.stream_offset == 0 &&
+                compressed_frame_size(output_data, static_cast<size_t>(*output_len),
+                                      &original_len)) {
+                CryptoPP::SecByteBlock sealed_frame(output_data, static_cast<size_t>(*output_len));
+                CryptoPP::SecureWipeBuffer(output_data, static_cast<size_t>(*output_len));
+                if (fused_digest) {
+                    digest->restart();
+                }
+                return expand_frame(sealed_frame.data(), sealed_frame.size(), COMPRESSION_NONE,
+                                    output_data, output_len, output_capacity, options.threads,
+                                    digest);
+            }
+
+            if (digest && !fused_digest && operation == OPERATION_DECRYPT) {
+                digest->update(output_data, static_cast<size_t>(*output_len));
+            }
+            return STATUS_SUCCESS;
+        }
+
+        // Decrypt the frame into scratch memory, then expand it into the output
+        int frame_len = input_len;
+        if (!frame_data) {
+            frame.New(static_cast<size_t>(input_len));
+            frame_data = frame.data();
+        }
+        job.output = frame_data;
+        job.output_capacity = input_len;
+        job.output_len = &frame_len;
+        const int status = dispatch_cipher(algorithm, mode, job);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        return expand_frame(job.output, static_cast<size_t>(frame_len), options.compression,
+                            output_data, output_len, output_capacity, options.threads, digest);
+    });
+}
+
+// Restores the data a decrypted compression frame holds into `output`,
+// which has room for `capacity` bytes, and feeds it to `digest`. The frame
+// must use `codec` unless that is COMPRESSION_NONE; a malformed frame or
+// another codec fails as an authentication failure would.
+static int expand_frame(const unsigned char* frame, size_t frame_len, int codec,
+                        unsigned char* output, int* output_len, int capacity, int threads,
+                        DigestStage* digest) {
+    size_t original_len = 0;
+    if (!compressed_frame_size(frame, frame_len, &original_len) ||
+        original_len > static_cast<size_t>(INT_MAX) ||
+        (codec != COMPRESSION_NONE && compressed_frame_codec(frame) != codec)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    if (static_cast<size_t>(capacity) < original_len) {
+        *output_len = static_cast<int>(original_len);
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+    if (!decompress_frame(frame, frame_len, output, threads)) {
+        CryptoPP::SecureWipeBuffer(output, original_len);
+        return STATUS_CRYPTO_ERROR;
+    }
+    *output_len = static_cast<int>(original_len);
+    if (digest) {
+        digest->update(output, original_len);
+    }
+    return STATUS_SUCCESS;
+}
+
+// Nonce/IV length derived for each algorithm
+int nonce_length(int algorithm) {
+    switch (algorithm) {
+        case ALGORITHM_CHACHA20:
+            return 12; // ChaChaTLS uses a 12-byte nonce
+        case ALGORITHM_XSALSA20:
+            return 24; // XSalsa20 uses a 24-byte nonce
+        case ALGORITHM_XCHACHA20:
+            return 24; // XChaCha20 uses a 24-byte nonce
+        case ALGORITHM_HC256:
+        case ALGORITHM_PANAMA:
+            return 32; // HC-256 and Panama take a 256-bit IV
+        case ALGORITHM_THREEFISH256:
+            return 32; // CTR counters span a full Threefish block
+        case ALGORITHM_THREEFISH512:
+            return 64;
+        case ALGORITHM_THREEFISH1024:
+            return 128;
+        default:
+            return 16; // Block ciphers use up to 16 bytes; shorter stream IVs
+                       // (Salsa20/Rabbit 8, SEAL 4) read the leading bytes
+    }
+}
+
+static CryptoPP::word64 load_le64(const CryptoPP::byte* in) {
+    CryptoPP::word64 value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static void store_le64(CryptoPP::byte* out, CryptoPP::word64 value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<CryptoPP::byte>(value >> (8 * i));
+    }
+}
+
+// XTS keys the data and tweak ciphers separately, so it derives two keys
+int derived_key_length(int mode, int key_size_bits) {
+    return (mode == MODE_XTS ? 2 : 1) * (key_size_bits / 8);
+}
+
+// Copies the context settings a cipher needs into the job
+static void configure_job(CipherJob& job, const CryptoBridgeContext& options) {
+    job.gcm_tables = resolve_gcm_tables(options.gcm_tables, job.input_len);
+    job.sector_size = options.sector_size;
+    job.start_sector = options.start_sector;
+    job.threads = options.threads;
+    job.stream_offset = options.stream_offset;
+}
+
+// Modes that produce a 16-byte authentication tag instead of padding
+bool is_aead_mode(int mode) {
+    return mode == MODE_GCM || mode == MODE_POLY1305 || mode == MODE_OCB || mode == MODE_EAX;
+}
+
+// AEAD modes whose password-keyed calls take a random nonce per message.
+// GCM keeps its derived IV so existing GCM ciphertexts still open.
+static bool uses_random_nonce(int mode) {
+    return mode == MODE_POLY1305 || mode == MODE_OCB || mode == MODE_EAX;
+}
+
+// Random nonce bytes a mode takes: as many as it reads from its IV, up to
+// the 16 bytes of the caller's IV buffer. OCB reads 12; XChaCha20 reads 16
+// random bytes and keeps its last 8 derived ones.
+static int random_nonce_length(int algorithm, int mode) {
+    if (mode == MODE_OCB) {
+        return static_cast<int>(OCBCipher<CryptoPP::AES, true>::kNonceSize);
+    }
+    const int iv_len = nonce_length(algorithm);
+    return iv_len < 16 ? iv_len : 16;
+}
+
+// Modes that run through transform_buffer, which can feed a digest and a
+// MAC in the same pass as the cipher
+bool is_transform_mode(int mode) {
+    return mode == MODE_CBC || mode == MODE_ECB || mode == MODE_CFB ||
+           mode == MODE_OFB || mode == MODE_CTR;
+}
+
+// Keyed MAC for encrypt-then-MAC. Its key is expanded from the cipher key
+// with HKDF under a separate label, so the two keys are independent.
+static CryptoPP::MessageAuthenticationCode* new_mac(int mac, const unsigned char* key, int key_len) {
+    static const CryptoPP::byte label[] = "CryptingTool encrypt-then-MAC";
+    CryptoPP::byte mac_key[32];
+    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+    hkdf.DeriveKey(mac_key, sizeof(mac_key), key, key_len, nullptr, 0, label, sizeof(label) - 1);
+
+    CryptoPP::MessageAuthenticationCode* result = nullptr;
+    if (mac == MAC_BLAKE2B) {
+        result = new CryptoPP::BLAKE2b(mac_key, sizeof(mac_key));
+    } else {
+        result = new CryptoPP::HMAC<CryptoPP::SHA256>(mac_key, sizeof(mac_key));
+    }
+    CryptoPP::SecureWipeBuffer(mac_key, sizeof(mac_key));
+    return result;
+}
+
+// Validates digest parameters against the caller's digest buffer size
+static int hash_status(int hash_algorithm, int hash_mode, int* digest_len) {
+    const int size = hash_digest_size(hash_algorithm);
+    if (size == 0 || (hash_mode != HASH_MODE_PLAIN && hash_mode != HASH_MODE_TREE) || !digest_len) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (*digest_len < size) {
+        *digest_len = size;
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+    return STATUS_SUCCESS;
+}
+
+// True when GHASH can use PCLMULQDQ (x86) or PMULL (ARMv8)
+static bool has_carryless_multiply() {
+#if defined(CRYPTOPP_DISABLE_ASM)
+    return false;
+#elif (CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X32 || CRYPTOPP_BOOL_X64)
+    return CryptoPP::HasCLMUL();
+#elif (CRYPTOPP_BOOL_ARM32 || CRYPTOPP_BOOL_ARMV8)
+    return CryptoPP::HasPMULL();
+#else
+    return false;
+#endif
+}
+
+// Turns GCM_TABLES_AUTO into a concrete table size for one call
+static int resolve_gcm_tables(int requested, int input_len) {
+    if (requested == GCM_TABLES_2K || requested == GCM_TABLES_64K) {
+        return requested;
+    }
+    if (input_len >= GCM_LARGE_TABLE_THRESHOLD && !has_carryless_multiply()) {
+        return GCM_TABLES_64K;
+    }
+    return GCM_TABLES_2K;
+}
+
+// Algorithm-specific processing. Every path writes straight into
+// job.output; no intermediate strings, sources or filters.
+static int dispatch_cipher(int algorithm, int mode, const CipherJob& job) {
+    switch (algorithm) {
+        case ALGORITHM_AES:
+            return run_block_cipher_128<CryptoPP::AES>(mode, job);
+        case ALGORITHM_SERPENT:
+            return run_block_cipher_128<CryptoPP::Serpent>(mode, job);
+        case ALGORITHM_TWOFISH:
+            return run_block_cipher_128<CryptoPP::Twofish>(mode, job);
+        case ALGORITHM_RC6:
+            return run_block_cipher_128<CryptoPP::RC6>(mode, job);
+        case ALGORITHM_BLOWFISH:
+            return run_block_cipher<CryptoPP::Blowfish>(mode, job);
+        case ALGORITHM_CAST128:
+            return run_block_cipher<CryptoPP::CAST128>(mode, job);
+        case ALGORITHM_MARS:
+            return run_block_cipher_128<CryptoPP::MARS>(mode, job);
+        case ALGORITHM_CAMELLIA:
+            return run_block_cipher_128<CryptoPP::Camellia>(mode, job);
+        case ALGORITHM_ARIA:
+            return run_block_cipher_128<CryptoPP::ARIA>(mode, job);
+        case ALGORITHM_IDEA:
+            return run_block_cipher<CryptoPP::IDEA>(mode, job);
+
+        case ALGORITHM_DES3:
+            // Only CBC and ECB are wired up for 3DES
+            if (mode != MODE_CBC && mode != MODE_ECB) {
+                return STATUS_UNSUPPORTED_MODE;
+            }
+            return run_block_cipher<CryptoPP::DES_EDE3>(mode, job);
+        case ALGORITHM_TEA:
+            // Only CBC and ECB are wired up for TEA
+            if (mode != MODE_CBC && mode != MODE_ECB) {
+                return STATUS_UNSUPPORTED_MODE;
+            }
+            return run_block_cipher<CryptoPP::TEA>(mode, job);
+
+        // Threefish: tweaked position mode or CTR
+        case ALGORITHM_THREEFISH256:
+            return run_threefish<CryptoPP::Threefish256>(mode, job);
+        case ALGORITHM_THREEFISH512:
+            return run_threefish<CryptoPP::Threefish512>(mode, job);
+        case ALGORITHM_THREEFISH1024:
+            return run_threefish<CryptoPP::Threefish1024>(mode, job);
+
+        // ChaCha20 family: raw stream or RFC 8439 AEAD
+        case ALGORITHM_CHACHA20:
+            if (mode == MODE_POLY1305) {
+                return run_aead<CryptoPP::ChaCha20Poly1305>(job);
+            }
+            if (mode != MODE_CTR) {
+                return STATUS_UNSUPPORTED_MODE;
+            }
+            return run_cipher<CryptoPP::ChaChaTLS>(job, true);
+        case ALGORITHM_XCHACHA20:
+            if (mode == MODE_POLY1305) {
+                return run_aead<CryptoPP::XChaCha20Poly1305>(job);
+            }
+            if (mode != MODE_CTR) {
+                return STATUS_UNSUPPORTED_MODE;
+            }
+            return run_cipher<CryptoPP::XChaCha20>(job, true);
+
+        // Stream Ciphers (CTR mode only)
+        case ALGORITHM_SALSA20:
+            return run_stream_cipher<CryptoPP::Salsa20>(mode, job, true);
+        case ALGORITHM_XSALSA20:
+            return run_stream_cipher<CryptoPP::XSalsa20>(mode, job, true);
+        case ALGORITHM_HC128:
+            return run_stream_cipher<CryptoPP::HC128>(mode, job, true);
+        case ALGORITHM_HC256:
+            return run_stream_cipher<CryptoPP::HC256>(mode, job, true);
+        case ALGORITHM_RABBIT:
+            return run_stream_cipher<CryptoPP::RabbitWithIV>(mode, job, true);
+        case ALGORITHM_SOSEMANUK:
+            return run_stream_cipher<CryptoPP::Sosemanuk>(mode, job, true);
+        case ALGORITHM_PANAMA:
+            return run_stream_cipher<CryptoPP::PanamaCipher<CryptoPP::LittleEndian> >(mode, job, true);
+        case ALGORITHM_SEAL:
+            return run_stream_cipher<CryptoPP::SEAL<CryptoPP::BigEndian> >(mode, job, true);
+        case ALGORITHM_WAKE:
+            return run_stream_cipher<CryptoPP::WAKE_OFB<CryptoPP::BigEndian> >(mode, job, false);
+        case ALGORITHM_RC4:
+            return run_stream_cipher<CryptoPP::Weak::ARC4>(mode, job, false);
+        
+        default:
+            return STATUS_UNSUPPORTED_ALGORITHM;
+    }
+}
+
+// Algorithms with a case in dispatch_cipher; keep the two in sync. Checked
+// before the KDF so unimplemented algorithms fail without paying for it.
+bool algorithm_implemented(int algorithm) {
+    switch (algorithm) {
+        case ALGORITHM_AES:
+        case ALGORITHM_SERPENT:
+        case ALGORITHM_TWOFISH:
+        case ALGORITHM_RC6:
+        case ALGORITHM_BLOWFISH:
+        case ALGORITHM_CAST128:
+        case ALGORITHM_MARS:
+        case ALGORITHM_CAMELLIA:
+        case ALGORITHM_ARIA:
+        case ALGORITHM_IDEA:
+        case ALGORITHM_DES3:
+        case ALGORITHM_TEA:
+        case ALGORITHM_THREEFISH256:
+        case ALGORITHM_THREEFISH512:
+        case ALGORITHM_THREEFISH1024:
+        case ALGORITHM_CHACHA20:
+        case ALGORITHM_XCHACHA20:
+        case ALGORITHM_SALSA20:
+        case ALGORITHM_XSALSA20:
+        case ALGORITHM_HC128:
+        case ALGORITHM_HC256:
+        case ALGORITHM_RABBIT:
+        case ALGORITHM_SOSEMANUK:
+        case ALGORITHM_PANAMA:
+        case ALGORITHM_SEAL:
+        case ALGORITHM_WAKE:
+        case ALGORITHM_RC4:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Times `iterations` encryptions of `data_len` bytes. A random key and IV
+// are used directly, so the password KDF is not part of the measurement.
+static int benchmark_case(int algorithm, int mode, int key_size_bits,
+                          const CryptoBridgeContext& options, int data_len, int iterations,
+                          double* megabytes_per_second, int* gcm_tables_used) {
+    int status = validate_algorithm_key_size(algorithm, key_size_bits);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    status = validate_algorithm_mode_combination(algorithm, mode);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (!algorithm_implemented(algorithm)) {
+        return STATUS_UNSUPPORTED_ALGORITHM;
+    }
+
+    CryptoBufferPool& pool = CryptoBufferPool::instance();
+    const int capacity = data_len + 2 * AUTH_TAG_SIZE;
+    unsigned char* input = pool.acquire(data_len, BUFFER_FLAG_DEFAULT);
+    unsigned char* output = pool.acquire(capacity, BUFFER_FLAG_DEFAULT);
+    if (!input || !output) {
+        pool.release(input);
+        pool.release(output);
+        return STATUS_MEMORY_ERROR;
+    }
+    std::memset(input, 0x5A, data_len);
+
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    const int key_len = derived_key_length(mode, key_size_bits);
+    const int iv_len = nonce_length(algorithm);
+    unsigned char* key = arena.allocate_secret(key_len);
+    unsigned char* iv = arena.allocate_secret(iv_len);
+    CryptoPP::AutoSeededRandomPool rng;
+    rng.GenerateBlock(key, key_len);
+    rng.GenerateBlock(iv, iv_len);
+
+    int output_len = capacity;
+    CipherJob job;
+    job.operation = OPERATION_ENCRYPT;
+    job.input = input;
+    job.input_len = data_len;
+    job.output = output;
+    job.output_capacity = capacity;
+    job.output_len = &output_len;
+    job.key = key;
+    job.key_len = key_len;
+    job.iv = iv;
+    job.iv_len = iv_len;
+    job.auth_tag = nullptr;
+    job.digest = nullptr;
+    job.mac = nullptr;
+    job.mac_tag = nullptr;
+    configure_job(job, options);
+    // Throughput is measured from the start of the keystream
+    job.stream_offset = 0;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations && status == STATUS_SUCCESS; ++i) {
+        output_len = capacity;
+        status = dispatch_cipher(algorithm, mode, job);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    pool.release(input);
+    pool.release(output);
+
+    if (status == STATUS_SUCCESS) {
+        *megabytes_per_second = seconds > 0.0
+            ? (static_cast<double>(data_len) * iterations) / seconds / 1e6 : 0.0;
+        *gcm_tables_used = job.gcm_tables;
+    }
+    return status;
+}
+
+// Runs `cipher` over job.input into job.output. Block modes (ECB, CBC) use
+// PKCS#7 padding, matching StreamTransformationFilter's default; all other
+// modes are length preserving.
+static int transform_buffer(CryptoPP::StreamTransformation& cipher, const CipherJob& job) {
+    const int block_size = static_cast<int>(cipher.MandatoryBlockSize());
+
+    if (block_size <= 1) {
+        if (job.output_capacity < job.input_len) {
+            *job.output_len = job.input_len;
+            return STATUS_OUTPUT_BUFFER_TOO_SMALL;
         }
-        
-        if (input_len <= 0 || *output_len <= 0) {
-            return STATUS_INVALID_PARAMS;
+        process_slices(cipher, job, job.output, job.input, job.input_len);
+        *job.output_len = job.input_len;
+        return finish_mac(job, job.input_len);
+    }
+
+    const int full_len = job.input_len - (job.input_len % block_size);
+
+    if (job.operation == OPERATION_ENCRYPT) {
+        const int required = full_len + block_size;
+        if (job.output_capacity < required) {
+            *job.output_len = required;
+            return STATUS_OUTPUT_BUFFER_TOO_SMALL;
         }
 
-        // Validate algorithm and key size combination
-        int validation_result = validate_algorithm_key_size(algorithm, key_size_bits);
-        if (validation_result != STATUS_SUCCESS) {
-            return validation_result;
+        // Copy the tail out first so in-place calls keep working
+        const int remainder = job.input_len - full_len;
+        CryptoPP::byte* last_block = CryptoArena::thread_instance().allocate(block_size);
+        std::memcpy(last_block, job.input + full_len, remainder);
+        std::memset(last_block + remainder, block_size - remainder, block_size - remainder);
+
+        if (full_len > 0) {
+            process_slices(cipher, job, job.output, job.input, full_len);
         }
-        
-        // Validate algorithm and mode combination
-        validation_result = validate_algorithm_mode_combination(algorithm, mode);
-        if (validation_result != STATUS_SUCCESS) {
-            return validation_result;
+        if (job.digest) {
+            job.digest->update(last_block, remainder);
         }
+        cipher.ProcessData(job.output + full_len, last_block, block_size);
+        if (job.mac) {
+            job.mac->Update(job.output + full_len, block_size);
+        }
+        *job.output_len = required;
+        return finish_mac(job, required);
+    }
 
-        const int key_len = key_size_bits / 8;
-        const int iv_len = (algorithm == ALGORITHM_CHACHA20) ? 12 : 16; // ChaCha20 uses 12-byte nonce, others use 16
-        
-        // Ensure output buffer is large enough
-        int required_output_len = input_len;
-        if (mode != MODE_GCM && operation == OPERATION_ENCRYPT) {
-            // Add padding space for non-AEAD modes
-            required_output_len += 16; // Block size padding
+    // Padded ciphertext is always a whole number of blocks, at least one
+    if (full_len != job.input_len || full_len == 0) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    if (job.output_capacity < job.input_len) {
+        *job.output_len = job.input_len;
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+
+    // The last block holds the padding, which the digest must not see
+    const int body_len = job.input_len - block_size;
+    process_slices(cipher, job, job.output, job.input, body_len);
+    if (job.mac) {
+        job.mac->Update(job.input + body_len, block_size);
+    }
+    cipher.ProcessData(job.output + body_len, job.input + body_len, block_size);
+
+    // Authenticate before looking at the padding
+    const int verified = finish_mac(job, job.input_len);
+    if (verified != STATUS_SUCCESS) {
+        return verified;
+    }
+
+    const int pad = job.output[job.input_len - 1];
+    bool valid = pad >= 1 && pad <= block_size;
+    for (int i = 0; valid && i < pad; ++i) {
+        valid = job.output[job.input_len - 1 - i] == pad;
+    }
+    if (!valid) {
+        CryptoPP::SecureWipeBuffer(job.output, job.input_len);
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    if (job.digest) {
+        job.digest->update(job.output + body_len, block_size - pad);
+    }
+    *job.output_len = job.input_len - pad;
+    return STATUS_SUCCESS;
+}
+
+// ProcessData in slices, feeding each slice of plaintext to the job's
+// digest while it is still in cache
+static void process_slices(CryptoPP::StreamTransformation& cipher, const CipherJob& job,
+                           CryptoPP::byte* out, const CryptoPP::byte* in, size_t len) {
+    if (!job.digest && !job.mac) {
+        cipher.ProcessData(out, in, len);
+        return;
+    }
+
+    // Plaintext goes to the digest, ciphertext to the MAC; both read the
+    // input before an in-place call overwrites it
+    const bool encrypting = job.operation == OPERATION_ENCRYPT;
+    for (size_t done = 0; done < len; ) {
+        const size_t step = len - done < DIGEST_SLICE_SIZE ? len - done : DIGEST_SLICE_SIZE;
+        if (encrypting && job.digest) {
+            job.digest->update(in + done, step);
         }
-        
-        if (*output_len < required_output_len) {
-            *output_len = required_output_len;
-            return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+        if (!encrypting && job.mac) {
+            job.mac->Update(in + done, step);
         }
-
-        // Derive key and IV from password
-        CryptoPP::SecByteBlock derived_key(key_len);
-        CryptoPP::SecByteBlock derived_iv(iv_len);
-        
-        int derive_result = derive_key_and_iv(password, password_len,
-                                            derived_key.data(), key_len,
-                                            derived_iv.data(), iv_len);
-        if (derive_result != STATUS_SUCCESS) {
-            return derive_result;
+        cipher.ProcessData(out + done, in + done, step);
+        if (encrypting && job.mac) {
+            job.mac->Update(out + done, step);
         }
-        
-        // Copy derived IV to output if provided
-        if (iv) {
-            std::memcpy(iv, derived_iv.data(), iv_len);
+        if (!encrypting && job.digest) {
+            job.digest->update(out + done, step);
         }
+        done += step;
+    }
+}
 
-        std::string result;
-        
-        // Algorithm-specific processing
-        switch (algorithm) {
-            case ALGORITHM_AES: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_GCM: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::GCM<CryptoPP::AES>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), iv_len);
-                            CryptoPP::AuthenticatedEncryptionFilter aef(enc,
-                                new CryptoPP::StringSink(result));
-                            aef.Put((const CryptoPP::byte*)input_data, input_len);
-                            aef.MessageEnd();
-                            
-                            // Extract authentication tag if provided
-                            if (auth_tag) {
-                                std::memcpy(auth_tag, result.data() + input_len, 16);
-                                result.resize(input_len);
-                            }
-                        } else {
-                            CryptoPP::GCM<CryptoPP::AES>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), iv_len);
-                            CryptoPP::AuthenticatedDecryptionFilter adf(dec,
-                                new CryptoPP::StringSink(result));
-                            adf.Put((const CryptoPP::byte*)input_data, input_len);
-                            if (auth_tag) {
-                                adf.Put(auth_tag, 16);
-                            }
-                            adf.MessageEnd();
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::AES>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::AES>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::AES>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::AES>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_SERPENT: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::Serpent>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::Serpent>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::Serpent>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::Serpent>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::Serpent>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::Serpent>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::Serpent>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::Serpent>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::Serpent>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::Serpent>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_TWOFISH: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::Twofish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::Twofish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::Twofish>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::Twofish>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::Twofish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::Twofish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::Twofish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::Twofish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::Twofish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::Twofish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_RC6: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::RC6>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::RC6>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::RC6>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::RC6>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::RC6>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::RC6>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::RC6>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::RC6>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::RC6>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::RC6>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_BLOWFISH: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::Blowfish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8); // Blowfish uses 8-byte IV
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::Blowfish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::Blowfish>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::Blowfish>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::Blowfish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::Blowfish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::Blowfish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::Blowfish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::Blowfish>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::Blowfish>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_CAST128: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::CAST128>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8); // CAST128 uses 8-byte IV
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::CAST128>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::CAST128>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::CAST128>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::CAST128>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::CAST128>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::CAST128>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::CAST128>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::CAST128>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::CAST128>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_MARS: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::MARS>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::MARS>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::MARS>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::MARS>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::MARS>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::MARS>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::MARS>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::MARS>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::MARS>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::MARS>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_CAMELLIA: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::Camellia>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::Camellia>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_GCM: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::GCM<CryptoPP::Camellia>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), iv_len);
-                            CryptoPP::AuthenticatedEncryptionFilter aef(enc,
-                                new CryptoPP::StringSink(result));
-                            aef.Put((const CryptoPP::byte*)input_data, input_len);
-                            aef.MessageEnd();
-                            
-                            // Extract authentication tag if provided
-                            if (auth_tag) {
-                                std::memcpy(auth_tag, result.data() + input_len, 16);
-                                result.resize(input_len);
-                            }
-                        } else {
-                            CryptoPP::GCM<CryptoPP::Camellia>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), iv_len);
-                            CryptoPP::AuthenticatedDecryptionFilter adf(dec,
-                                new CryptoPP::StringSink(result));
-                            adf.Put((const CryptoPP::byte*)input_data, input_len);
-                            if (auth_tag) {
-                                adf.Put(auth_tag, 16);
-                            }
-                            adf.MessageEnd();
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::Camellia>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::Camellia>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::Camellia>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::Camellia>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::Camellia>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::Camellia>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::Camellia>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::Camellia>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data());
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            // Stream Ciphers (CTR mode only)
-            case ALGORITHM_CHACHA20: {
-                if (mode != MODE_CTR) {
-                    return STATUS_UNSUPPORTED_MODE;
-                }
-                
-                if (operation == OPERATION_ENCRYPT) {
-                    CryptoPP::ChaChaTLS::Encryption enc;
-                    enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 12); // ChaChaTLS uses 12-byte nonce
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(enc,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                } else {
-                    CryptoPP::ChaChaTLS::Decryption dec;
-                    dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 12);
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(dec,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                }
-                break;
-            }
-            
-            case ALGORITHM_SALSA20: {
-                if (mode != MODE_CTR) {
-                    return STATUS_UNSUPPORTED_MODE;
-                }
-                
-                if (operation == OPERATION_ENCRYPT) {
-                    CryptoPP::Salsa20::Encryption enc;
-                    enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8); // Salsa20 uses 8-byte IV
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(enc,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                } else {
-                    CryptoPP::Salsa20::Decryption dec;
-                    dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(dec,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                }
-                break;
-            }
-            
-            case ALGORITHM_XSALSA20: {
-                if (mode != MODE_CTR) {
-                    return STATUS_UNSUPPORTED_MODE;
-                }
-                
-                if (operation == OPERATION_ENCRYPT) {
-                    CryptoPP::XSalsa20::Encryption enc;
-                    enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 24); // XSalsa20 uses 24-byte nonce
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(enc,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                } else {
-                    CryptoPP::XSalsa20::Decryption dec;
-                    dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 24);
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(dec,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                }
-                break;
-            }
-            
-            case ALGORITHM_IDEA: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::IDEA>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::IDEA>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::IDEA>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::IDEA>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CFB_Mode<CryptoPP::IDEA>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CFB_Mode<CryptoPP::IDEA>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_OFB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::OFB_Mode<CryptoPP::IDEA>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::OFB_Mode<CryptoPP::IDEA>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_CTR: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CTR_Mode<CryptoPP::IDEA>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CTR_Mode<CryptoPP::IDEA>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_DES3: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::DES_EDE3>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::DES_EDE3>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::DES_EDE3>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::DES_EDE3>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            case ALGORITHM_RC4: {
-                if (mode != MODE_CTR) {
-                    return STATUS_UNSUPPORTED_MODE;
-                }
-                
-                if (operation == OPERATION_ENCRYPT) {
-                    CryptoPP::Weak::ARC4::Encryption enc;
-                    enc.SetKey(derived_key.data(), key_len);
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(enc,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                } else {
-                    CryptoPP::Weak::ARC4::Decryption dec;
-                    dec.SetKey(derived_key.data(), key_len);
-                    CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                        new CryptoPP::StreamTransformationFilter(dec,
-                            new CryptoPP::StringSink(result), CryptoPP::StreamTransformationFilter::NO_PADDING));
-                }
-                break;
-            }
-            
-            case ALGORITHM_TEA: {
-                switch (mode) {
-                    case MODE_CBC: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::CBC_Mode<CryptoPP::TEA>::Encryption enc;
-                            enc.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::CBC_Mode<CryptoPP::TEA>::Decryption dec;
-                            dec.SetKeyWithIV(derived_key.data(), key_len, derived_iv.data(), 8);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    case MODE_ECB: {
-                        if (operation == OPERATION_ENCRYPT) {
-                            CryptoPP::ECB_Mode<CryptoPP::TEA>::Encryption enc;
-                            enc.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(enc,
-                                    new CryptoPP::StringSink(result)));
-                        } else {
-                            CryptoPP::ECB_Mode<CryptoPP::TEA>::Decryption dec;
-                            dec.SetKey(derived_key.data(), key_len);
-                            CryptoPP::StringSource ss((const CryptoPP::byte*)input_data, input_len, true,
-                                new CryptoPP::StreamTransformationFilter(dec,
-                                    new CryptoPP::StringSink(result)));
-                        }
-                        break;
-                    }
-                    default:
-                        return STATUS_UNSUPPORTED_MODE;
-                }
-                break;
-            }
-            
-            default:
-                return STATUS_UNSUPPORTED_ALGORITHM;
+// Writes the MAC tag after encryption, or checks it after decryption and
+// wipes the `written` output bytes if it does not match
+static int finish_mac(const CipherJob& job, int written) {
+    if (!job.mac) {
+        return STATUS_SUCCESS;
+    }
+
+    if (job.operation == OPERATION_ENCRYPT) {
+        if (job.mac_tag) {
+            job.mac->TruncatedFinal(job.mac_tag, AUTH_TAG_SIZE);
+        } else {
+            job.mac->TruncatedFinal(job.output + *job.output_len, AUTH_TAG_SIZE);
+            *job.output_len += AUTH_TAG_SIZE;
         }
-        
-        // Copy result to output buffer
-        int actual_len = static_cast<int>(result.length());
-        if (actual_len > *output_len) {
-            *output_len = actual_len;
+        return STATUS_SUCCESS;
+    }
+
+    if (!job.mac->TruncatedVerify(job.mac_tag, AUTH_TAG_SIZE)) {
+        // Never release unauthenticated plaintext
+        CryptoPP::SecureWipeBuffer(job.output, written);
+        return STATUS_CRYPTO_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Keys a cipher/mode pair for job.operation and runs it over the job buffers
+template <class Mode>
+static int run_cipher(const CipherJob& job, bool uses_iv) {
+    if (job.operation == OPERATION_ENCRYPT) {
+        typename Mode::Encryption enc;
+        if (uses_iv) {
+            enc.SetKeyWithIV(job.key, job.key_len, job.iv, enc.IVSize());
+        } else {
+            enc.SetKey(job.key, job.key_len);
+        }
+        if (!seek_keystream(enc, job.stream_offset)) {
+            return STATUS_INVALID_PARAMS;
+        }
+        return transform_buffer(enc, job);
+    }
+
+    typename Mode::Decryption dec;
+    if (uses_iv) {
+        dec.SetKeyWithIV(job.key, job.key_len, job.iv, dec.IVSize());
+    } else {
+        dec.SetKey(job.key, job.key_len);
+    }
+    if (!seek_keystream(dec, job.stream_offset)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return transform_buffer(dec, job);
+}
+
+// Moves a freshly keyed keystream cipher to byte `offset`. CTR mode and the
+// counter-based stream ciphers (Salsa20, ChaCha, SEAL, ...) jump there
+// directly. The others could only get there by generating and dropping the
+// whole skipped keystream, as slow as encrypting it, so they refuse any
+// offset but 0.
+static bool seek_keystream(CryptoPP::StreamTransformation& cipher, long long offset) {
+    if (offset <= 0) {
+        return true;
+    }
+    if (!cipher.IsRandomAccess()) {
+        return false;
+    }
+    cipher.Seek(static_cast<CryptoPP::lword>(offset));
+    return true;
+}
+
+// AEAD modes: the tag goes to job.auth_tag when given, otherwise it is
+// appended to (encrypt) or taken from the end of (decrypt) the data.
+template <class Mode>
+static int run_aead(const CipherJob& job) {
+    if (job.operation == OPERATION_ENCRYPT) {
+        const int required = job.input_len + (job.auth_tag ? 0 : AUTH_TAG_SIZE);
+        if (job.output_capacity < required) {
+            *job.output_len = required;
             return STATUS_OUTPUT_BUFFER_TOO_SMALL;
         }
-        
-        std::memcpy(output_data, result.data(), actual_len);
-        *output_len = actual_len;
-        
+
+        typename Mode::Encryption enc;
+        enc.SetKeyWithIV(job.key, job.key_len, job.iv, job.iv_len);
+        CryptoPP::byte* tag = job.auth_tag ? job.auth_tag : job.output + job.input_len;
+        enc.EncryptAndAuthenticate(job.output, tag, AUTH_TAG_SIZE,
+                                   job.iv, job.iv_len, nullptr, 0,
+                                   job.input, job.input_len);
+        *job.output_len = required;
         return STATUS_SUCCESS;
-        
-    } catch (const CryptoPP::Exception& e) {
+    }
+
+    const int ciphertext_len = job.input_len - (job.auth_tag ? 0 : AUTH_TAG_SIZE);
+    if (ciphertext_len < 0) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    if (job.output_capacity < ciphertext_len) {
+        *job.output_len = ciphertext_len;
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+
+    typename Mode::Decryption dec;
+    dec.SetKeyWithIV(job.key, job.key_len, job.iv, job.iv_len);
+    const CryptoPP::byte* tag = job.auth_tag ? job.auth_tag : job.input + ciphertext_len;
+    if (!dec.DecryptAndVerify(job.output, tag, AUTH_TAG_SIZE,
+                              job.iv, job.iv_len, nullptr, 0,
+                              job.input, ciphertext_len)) {
+        // Never release unauthenticated plaintext
+        CryptoPP::SecureWipeBuffer(job.output, ciphertext_len);
         return STATUS_CRYPTO_ERROR;
-    } catch (const std::exception& e) {
-        return STATUS_UNKNOWN_ERROR;
-    } catch (...) {
-        return STATUS_UNKNOWN_ERROR;
     }
+
+    *job.output_len = ciphertext_len;
+    return STATUS_SUCCESS;
 }
 
-/**
- * Get version string of the crypto bridge
- */
-const char* crypto_bridge_version() {
-    return "1.0.0";
+// Classic confidentiality modes for any block cipher
+template <class Cipher>
+static int run_block_cipher(int mode, const CipherJob& job) {
+    switch (mode) {
+        case MODE_CBC:
+            return run_cipher<CryptoPP::CBC_Mode<Cipher> >(job, true);
+        case MODE_ECB:
+            return run_cipher<CryptoPP::ECB_Mode<Cipher> >(job, false);
+        case MODE_CFB:
+            return run_cipher<CryptoPP::CFB_Mode<Cipher> >(job, true);
+        case MODE_OFB:
+            return run_cipher<CryptoPP::OFB_Mode<Cipher> >(job, true);
+        case MODE_CTR:
+            return run_cipher<CryptoPP::CTR_Mode<Cipher> >(job, true);
+        default:
+            return STATUS_UNSUPPORTED_MODE;
+    }
 }
 
-} // extern "C"
+// Stream ciphers run in place of CTR mode
+template <class Cipher>
+static int run_stream_cipher(int mode, const CipherJob& job, bool uses_iv) {
+    if (mode != MODE_CTR) {
+        return STATUS_UNSUPPORTED_MODE;
+    }
+    return run_cipher<Cipher>(job, uses_iv);
+}
 
-// Helper function implementations
-static int validate_algorithm_key_size(int algorithm, int key_size_bits) {
+// 128-bit block ciphers additionally get the AEAD modes
+template <class Cipher>
+static int run_block_cipher_128(int mode, const CipherJob& job) {
+    switch (mode) {
+        case MODE_GCM:
+            if (job.gcm_tables == GCM_TABLES_64K) {
+                return run_aead<CryptoPP::GCM<Cipher, CryptoPP::GCM_64K_Tables> >(job);
+            }
+            return run_aead<CryptoPP::GCM<Cipher, CryptoPP::GCM_2K_Tables> >(job);
+        case MODE_OCB:
+            return run_aead<OCB<Cipher> >(job);
+        case MODE_EAX:
+            return run_aead<CryptoPP::EAX<Cipher> >(job);
+        case MODE_XTS:
+            return run_xts<Cipher>(job);
+        default:
+            return run_block_cipher<Cipher>(mode, job);
+    }
+}
+
+// XTS (IEEE 1619) over a run of sectors starting at job.start_sector; see
+// crypto_xts.h. A short last sector must hold at least one block.
+template <class Cipher>
+static int run_xts(const CipherJob& job) {
+    if (job.output_capacity < job.input_len) {
+        *job.output_len = job.input_len;
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+    if (!xts_process<Cipher>(job.operation == OPERATION_ENCRYPT, job.key, job.key_len,
+                             static_cast<unsigned long long>(job.start_sector),
+                             static_cast<size_t>(job.sector_size), job.input, job.output,
+                             static_cast<size_t>(job.input_len), job.threads)) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    *job.output_len = job.input_len;
+    return STATUS_SUCCESS;
+}
+
+// Threefish keyed once whose tweak is then rewritten block by block. Crypto++
+// only takes a tweak through SetKey, which reloads the key words and looks
+// the tweak up in a parameter list; the key words do not depend on the
+// tweak, so the position mode sets Threefish's tweak words t0, t1 and
+// t2 = t0 ^ t1 directly instead. Keying through the public Name::Tweak()
+// parameter per block would cost the position mode a key setup and a
+// parameter lookup per 64 bytes.
+//
+// This relies on Threefish_Base keeping the words in the protected m_tweak
+// and reading them in every ProcessAndXorBlock, as it does from Crypto++ 6.0
+// (which added Threefish) through 8.9. A release that changes either would
+// not fail to compile, only encrypt under the wrong tweak, so newer versions
+// must be checked against the public API before the bound is raised.
+#ifdef CRYPTOPP_VERSION
+static_assert(CRYPTOPP_VERSION >= 600 && CRYPTOPP_VERSION <= 890,
+              "TweakedThreefish sets Threefish's protected tweak words; check that "
+              "this Crypto++ release still keeps them in m_tweak before raising the bound");
+#endif
+template <class Base>
+class TweakedThreefish : public Base {
+public:
+    void set_tweak(CryptoPP::word64 position, CryptoPP::word64 domain) {
+        this->m_tweak[0] = position;
+        this->m_tweak[1] = domain;
+        this->m_tweak[2] = position ^ domain;
+    }
+};
+
+// Threefish supports the tweaked position mode and plain CTR
+template <class Cipher>
+static int run_threefish(int mode, const CipherJob& job) {
+    switch (mode) {
+        case MODE_TWEAK:
+            return run_tweak_mode<Cipher>(job);
+        case MODE_CTR:
+            return run_cipher<CryptoPP::CTR_Mode<Cipher> >(job, true);
+        default:
+            return STATUS_UNSUPPORTED_MODE;
+    }
+}
+
+// Tweaked position mode: block i of the call is processed under the tweak
+// (start_sector * blocks_per_sector + i, domain), with the domain word taken
+// from the IV. No block depends on another, so a call can start at any
+// sector, rewrite a single sector in place and spread over several cores.
+// Input ending in a partial block uses ciphertext stealing on its last two
+// blocks, as XTS does, so the output is exactly as long as the input; it
+// must hold at least one full block.
+template <class Cipher>
+static int run_tweak_mode(const CipherJob& job) {
+    const int block_size = Cipher::BLOCKSIZE;
+    if (job.sector_size % block_size != 0 || job.input_len < block_size) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (job.output_capacity < job.input_len) {
+        *job.output_len = job.input_len;
+        return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+    }
+
+    const size_t full_blocks = static_cast<size_t>(job.input_len / block_size);
+    const size_t total_blocks = full_blocks + (job.input_len % block_size ? 1 : 0);
+    const CryptoPP::word64 blocks_per_sector = static_cast<CryptoPP::word64>(job.sector_size / block_size);
+    const CryptoPP::word64 start_sector = static_cast<CryptoPP::word64>(job.start_sector);
+
+    // Tweak positions must not wrap around
+    const CryptoPP::word64 max_position = ~static_cast<CryptoPP::word64>(0);
+    if (start_sector > (max_position - total_blocks) / blocks_per_sector) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    const CryptoPP::word64 first_block = start_sector * blocks_per_sector;
+    const CryptoPP::word64 domain = load_le64(job.iv);
+
+    // The last full block is stolen from when a partial block follows, so
+    // it runs with the tail once the independent blocks are done
+    const bool steal = total_blocks > full_blocks;
+    const size_t independent_blocks = steal ? full_blocks - 1 : full_blocks;
+    if (job.operation == OPERATION_ENCRYPT) {
+        typedef TweakedThreefish<typename Cipher::Encryption> Encryption;
+        parallel_for(independent_blocks, TWEAK_GRAIN_BLOCKS, job.threads,
+                     [&](size_t begin, size_t end) {
+                         tweak_blocks<Encryption>(job, first_block, domain, begin, end);
+                     });
+        if (steal) {
+            tweak_tail<Encryption>(job, first_block, domain);
+        }
+    } else {
+        typedef TweakedThreefish<typename Cipher::Decryption> Decryption;
+        parallel_for(independent_blocks, TWEAK_GRAIN_BLOCKS, job.threads,
+                     [&](size_t begin, size_t end) {
+                         tweak_blocks<Decryption>(job, first_block, domain, begin, end);
+                     });
+        if (steal) {
+            tweak_tail<Decryption>(job, first_block, domain);
+        }
+    }
+
+    *job.output_len = job.input_len;
+    return STATUS_SUCCESS;
+}
+
+// Processes full blocks [begin, end) of a tweaked position mode job with
+// one keyed cipher
+template <class Tweaked>
+static void tweak_blocks(const CipherJob& job, CryptoPP::word64 first_block,
+                         CryptoPP::word64 domain, size_t begin, size_t end) {
+    const size_t block_size = Tweaked::BLOCKSIZE;
+
+    Tweaked cipher;
+    cipher.SetKey(job.key, job.key_len);
+
+    for (size_t i = begin; i < end; ++i) {
+        cipher.set_tweak(first_block + i, domain);
+        cipher.ProcessBlock(job.input + i * block_size, job.output + i * block_size);
+    }
+}
+
+// Ciphertext stealing over the last full block m-1 and the r-byte tail of a
+// tweaked position mode job. Encryption processes block m-1 under position
+// m-1, emits the head of the result as the tail and processes the tail
+// padded with the rest of the result under position m in place of block
+// m-1; decryption undoes the two steps in reverse order.
+template <class Tweaked>
+static void tweak_tail(const CipherJob& job, CryptoPP::word64 first_block,
+                       CryptoPP::word64 domain) {
+    const size_t block_size = Tweaked::BLOCKSIZE;
+    const size_t last = static_cast<size_t>(job.input_len) / block_size - 1;
+    const size_t remainder = static_cast<size_t>(job.input_len) % block_size;
+    const CryptoPP::word64 step = job.operation == OPERATION_ENCRYPT ? 0 : 1;
+
+    Tweaked cipher;
+    cipher.SetKey(job.key, job.key_len);
+
+    // Both blocks are read before either is written, so in-place calls work
+    CryptoPP::byte head[Tweaked::BLOCKSIZE];
+    CryptoPP::byte stolen[Tweaked::BLOCKSIZE];
+    const CryptoPP::byte* in = job.input + last * block_size;
+    CryptoPP::byte* out = job.output + last * block_size;
+
+    cipher.set_tweak(first_block + last + step, domain);
+    cipher.ProcessBlock(in, head);
+
+    std::memcpy(stolen, in + block_size, remainder);
+    std::memcpy(stolen + remainder, head + remainder, block_size - remainder);
+    cipher.set_tweak(first_block + last + (1 - step), domain);
+    cipher.ProcessBlock(stolen);
+
+    std::memcpy(out + block_size, head, remainder);
+    std::memcpy(out, stolen, block_size);
+
+    CryptoPP::SecureWipeBuffer(head, sizeof(head));
+    CryptoPP::SecureWipeBuffer(stolen, sizeof(stolen));
+}
+
+int validate_algorithm_key_size(int algorithm, int key_size_bits) {
     switch (algorithm) {
         case ALGORITHM_AES:
         case ALGORITHM_SERPENT:
@@ -1332,17 +2322,22 @@ static int validate_algorithm_key_size(int algorithm, int key_size_bits) {
             
         case ALGORITHM_GOST28147:
         case ALGORITHM_CHACHA20:
+        case ALGORITHM_XCHACHA20:
         case ALGORITHM_XSALSA20:
         case ALGORITHM_HC256:
         case ALGORITHM_PANAMA:
             return (key_size_bits == 256) ? STATUS_SUCCESS : STATUS_INVALID_KEY_SIZE;
             
         case ALGORITHM_SALSA20:
+            return (key_size_bits == 128 || key_size_bits == 256) 
+                   ? STATUS_SUCCESS : STATUS_INVALID_KEY_SIZE;
+
+        // Fixed key lengths in Crypto++
         case ALGORITHM_HC128:
         case ALGORITHM_RABBIT:
+            return (key_size_bits == 128) ? STATUS_SUCCESS : STATUS_INVALID_KEY_SIZE;
         case ALGORITHM_WAKE:
-            return (key_size_bits == 128 || key_size_bits == 256) 
-                   ? STATUS_SUCCESS : STATUS_INVALID_KEY_SIZE;
+            return (key_size_bits == 256) ? STATUS_SUCCESS : STATUS_INVALID_KEY_SIZE;
                    
         case ALGORITHM_SOSEMANUK:
             return (key_size_bits == 128 || key_size_bits == 256) 
@@ -1398,10 +2393,13 @@ static int validate_algorithm_key_size(int algorithm, int key_size_bits) {
     }
 }
 
-static int validate_algorithm_mode_combination(int algorithm, int mode) {
-    // Stream ciphers only support CTR-like operation
+int validate_algorithm_mode_combination(int algorithm, int mode) {
+    // Stream ciphers only support CTR-like operation; the ChaCha20 family
+    // additionally offers Poly1305 authentication
     switch (algorithm) {
         case ALGORITHM_CHACHA20:
+        case ALGORITHM_XCHACHA20:
+            return (mode == MODE_CTR || mode == MODE_POLY1305) ? STATUS_SUCCESS : STATUS_UNSUPPORTED_MODE;
         case ALGORITHM_SALSA20:
         case ALGORITHM_XSALSA20:
         case ALGORITHM_HC128:
@@ -1413,6 +2411,12 @@ static int validate_algorithm_mode_combination(int algorithm, int mode) {
         case ALGORITHM_PANAMA:
         case ALGORITHM_SEAL:
             return (mode == MODE_CTR) ? STATUS_SUCCESS : STATUS_UNSUPPORTED_MODE;
+
+        // Threefish runs length-preserving: tweaked position mode or CTR
+        case ALGORITHM_THREEFISH256:
+        case ALGORITHM_THREEFISH512:
+        case ALGORITHM_THREEFISH1024:
+            return (mode == MODE_TWEAK || mode == MODE_CTR) ? STATUS_SUCCESS : STATUS_UNSUPPORTED_MODE;
     }
     
     // Block cipher mode validation
@@ -1436,15 +2440,43 @@ static int validate_algorithm_mode_combination(int algorithm, int mode) {
                 default:
                     return STATUS_UNSUPPORTED_MODE;
             }
+
+        case MODE_XTS:
+            switch (algorithm) {
+                case ALGORITHM_AES:
+                case ALGORITHM_SERPENT:
+                case ALGORITHM_TWOFISH:
+                case ALGORITHM_CAMELLIA:
+                case ALGORITHM_ARIA:
+                    return STATUS_SUCCESS;
+                default:
+                    return STATUS_UNSUPPORTED_MODE;
+            }
+
+        case MODE_OCB:
+        case MODE_EAX:
+            // Single-pass AEAD for every 128-bit block cipher
+            switch (algorithm) {
+                case ALGORITHM_AES:
+                case ALGORITHM_SERPENT:
+                case ALGORITHM_TWOFISH:
+                case ALGORITHM_RC6:
+                case ALGORITHM_MARS:
+                case ALGORITHM_CAMELLIA:
+                case ALGORITHM_ARIA:
+                    return STATUS_SUCCESS;
+                default:
+                    return STATUS_UNSUPPORTED_MODE;
+            }
         
         default:
             return STATUS_UNSUPPORTED_MODE;
     }
 }
 
-static int derive_key_and_iv(const char* password, int password_len,
-                           unsigned char* key, int key_len,
-                           unsigned char* iv, int iv_len) {
+int derive_key_and_iv(const char* password, int password_len,
+                      unsigned char* key, int key_len,
+                      unsigned char* iv, int iv_len) {
     try {
         // Use PBKDF2 with SHA256 for key derivation
         CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> pbkdf2;
@@ -1471,4 +2503,18 @@ static int derive_key_and_iv(const char* password, int password_len,
     } catch (...) {
         return STATUS_CRYPTO_ERROR;
     }
-}
\ No newline at end of file
+}
+
+// Block size that CBC and ECB pad to
+int padding_block_size(int algorithm) {
+    switch (algorithm) {
+        case ALGORITHM_BLOWFISH:
+        case ALGORITHM_CAST128:
+        case ALGORITHM_IDEA:
+        case ALGORITHM_DES3:
+        case ALGORITHM_TEA:
+            return 8;
+        default:
+            return 16;
+    }
+}
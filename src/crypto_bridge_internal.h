@@ -0,0 +1,341 @@
+/*
+ * crypto_bridge_internal.h - Types shared by the crypto bridge's modules
+ *
+ * crypto_bridge.cpp holds the C entry points and the buffer cipher. The
+ * file, archive, chunk store, stream and job calls behind those entry
+ * points live in the modules of their formats and reach the cipher through
+ * the functions declared here. None of this is part of the C API, whose
+ * CRYPTO_* constants in include/crypto_bridge.h mirror these enums; the two
+ * headers are never included together.
+ */
+
+#ifndef CRYPTO_BRIDGE_INTERNAL_H
+#define CRYPTO_BRIDGE_INTERNAL_H
+
+#include "crypto_compat.h"
+#include "crypto_compress.h"
+#include "crypto_jobs.h"
+#include <new>
+
+class DigestStage;
+
+// Algorithm identifiers
+enum CryptoBridgeAlgorithm {
+    // Tier 1-2: Modern High Security
+    ALGORITHM_AES = 1,
+    ALGORITHM_SERPENT = 2,
+    ALGORITHM_TWOFISH = 3,
+    
+    // Tier 3: Strong Security - AES Finalists & Modern Ciphers  
+    ALGORITHM_RC6 = 4,
+    ALGORITHM_MARS = 5,
+    ALGORITHM_RC5 = 6,
+    ALGORITHM_SKIPJACK = 7,
+    
+    // Tier 4: Reliable Security - Established Algorithms
+    ALGORITHM_BLOWFISH = 8,
+    ALGORITHM_CAST128 = 9,
+    ALGORITHM_CAST256 = 10,
+    ALGORITHM_CAMELLIA = 11,
+    
+    // Tier 5: Stream Ciphers - High Performance
+    ALGORITHM_CHACHA20 = 12,
+    ALGORITHM_SALSA20 = 13,
+    ALGORITHM_XSALSA20 = 14,
+    ALGORITHM_HC128 = 15,
+    ALGORITHM_HC256 = 16,
+    ALGORITHM_RABBIT = 17,
+    ALGORITHM_SOSEMANUK = 18,
+    
+    // Tier 6: Specialized & National Algorithms
+    ALGORITHM_ARIA = 19,
+    ALGORITHM_SEED = 20,
+    ALGORITHM_SM4 = 21,
+    ALGORITHM_GOST28147 = 22,
+    
+    // Tier 7: Legacy Strong Algorithms
+    ALGORITHM_DES3 = 23,
+    ALGORITHM_IDEA = 24,
+    ALGORITHM_RC2 = 25,
+    ALGORITHM_SAFER = 26,
+    ALGORITHM_SAFER_PLUS = 27,
+    
+    // Tier 8: Historical & Compatibility
+    ALGORITHM_DES = 28,
+    ALGORITHM_RC4 = 29,
+    
+    // Tier 9: Experimental & Research
+    ALGORITHM_THREEFISH256 = 30,
+    ALGORITHM_THREEFISH512 = 31,
+    ALGORITHM_THREEFISH1024 = 32,
+    
+    // Tier 10: Additional Algorithms
+    ALGORITHM_TEA = 33,
+    ALGORITHM_XTEA = 34,
+    ALGORITHM_SHACAL2 = 35,
+    ALGORITHM_WAKE = 36,
+    
+    // Archive/Research Ciphers
+    ALGORITHM_SQUARE = 37,
+    ALGORITHM_SHARK = 38,
+    ALGORITHM_PANAMA = 39,
+    ALGORITHM_SEAL = 40,
+    ALGORITHM_LUCIFER = 41,
+    
+    // Modern lightweight ciphers (placeholders)
+    ALGORITHM_SIMON = 42,
+    ALGORITHM_SPECK = 43,
+
+    // Extended-nonce ChaCha20 (24-byte nonce)
+    ALGORITHM_XCHACHA20 = 44
+};
+
+// Mode identifiers  
+enum CryptoBridgeMode {
+    MODE_CBC = 1,
+    MODE_GCM = 2,
+    MODE_ECB = 3,
+    MODE_CFB = 4,
+    MODE_OFB = 5,
+    MODE_CTR = 6,
+    MODE_POLY1305 = 7,  // ChaCha20-Poly1305 / XChaCha20-Poly1305 AEAD
+    MODE_OCB = 8,       // RFC 7253 OCB, 128-bit block ciphers
+    MODE_EAX = 9,       // EAX, 128-bit block ciphers
+    MODE_TWEAK = 10,    // Threefish with the block position as tweak
+    MODE_XTS = 11       // IEEE 1619 XTS, one data unit per sector
+};
+
+// Operation type
+enum CryptoBridgeOperation {
+    OPERATION_ENCRYPT = 1,
+    OPERATION_DECRYPT = 2
+};
+
+// Status codes
+enum CryptoBridgeStatus {
+    STATUS_SUCCESS = 0,
+    STATUS_INVALID_PARAMS = -1,
+    STATUS_UNSUPPORTED_ALGORITHM = -2,
+    STATUS_UNSUPPORTED_MODE = -3,
+    STATUS_INVALID_KEY_SIZE = -4,
+    STATUS_MEMORY_ERROR = -5,
+    STATUS_CRYPTO_ERROR = -6,
+    STATUS_PASSWORD_TOO_SHORT = -7,
+    STATUS_OUTPUT_BUFFER_TOO_SMALL = -8,
+    STATUS_UNKNOWN_ERROR = -9,
+    STATUS_IO_ERROR = -10,
+    STATUS_CANCELLED = -11,
+    STATUS_PENDING = 1
+};
+
+// Context options
+enum CryptoBridgeOption {
+    OPTION_GCM_TABLES = 1,
+    OPTION_SECTOR_SIZE = 2,
+    OPTION_START_SECTOR = 3,
+    OPTION_THREADS = 4,
+    OPTION_STREAM_OFFSET = 5,
+    OPTION_COMPRESSION = 6,
+    OPTION_MAC = 7,
+    OPTION_NOTIFY_PORT = 8,
+    OPTION_JOB_PRIORITY = 9,
+    OPTION_AUTOTUNE = 10,
+    OPTION_MEMORY_BUDGET = 11
+};
+
+// Encrypt-then-MAC for the unauthenticated modes
+enum CryptoBridgeMac {
+    MAC_NONE = 0,
+    MAC_HMAC_SHA256 = 1,
+    MAC_BLAKE2B = 2
+};
+
+// GCM multiplication table sizes
+enum CryptoBridgeGcmTables {
+    GCM_TABLES_AUTO = 0,
+    GCM_TABLES_2K = 1,
+    GCM_TABLES_64K = 2
+};
+
+// Position-addressed modes count sectors of this many bytes by default
+static const int DEFAULT_SECTOR_SIZE = 4096;
+
+// Per-caller settings for crypto_bridge_process_ex (null context = defaults)
+struct CryptoBridgeContext {
+    int gcm_tables;
+    int sector_size;
+    long long start_sector;
+    int threads;
+    long long stream_offset;
+    int compression;
+    int mac;
+    long long notify_port;  // Dart port for job events, 0 = none
+    int job_priority;
+    int autotune;           // Tune tree segment size and threads (0 = off)
+    long long memory_budget;  // Cap on working buffers of file calls, 0 = none
+
+    CryptoBridgeContext()
+        : gcm_tables(GCM_TABLES_AUTO),
+          sector_size(DEFAULT_SECTOR_SIZE),
+          start_sector(0),
+          threads(0),
+          stream_offset(0),
+          compression(COMPRESSION_NONE),
+          mac(MAC_NONE),
+          notify_port(0),
+          job_priority(JOB_PRIORITY_NORMAL),
+          autotune(1),
+          memory_budget(0) {}
+};
+
+// Size in bytes of the authentication tag produced by AEAD modes
+static const int AUTH_TAG_SIZE = 16;
+
+// Key and IV derived up front for a series of process_buffer calls, which
+// then skip the password KDF
+struct SessionKeys {
+    const unsigned char* key;
+    const unsigned char* iv;
+};
+
+// Progress callback of crypto_bridge_process_tree
+typedef void (*CryptoBridgeTreeProgress)(long long files_done, long long files_total,
+                                         long long bytes_done, long long bytes_total,
+                                         void* user_data);
+
+// Input and output callbacks of crypto_bridge_process_stream
+typedef long long (*CryptoBridgeStreamRead)(void* user_data, unsigned char* buffer,
+                                            long long capacity);
+typedef int (*CryptoBridgeStreamWrite)(void* user_data, const unsigned char* data, long long len);
+
+// Event callback of the crypto_bridge_job_* functions
+typedef void (*CryptoBridgeJobCallback)(long long job_id, int event, int status,
+                                        long long done, long long total, void* user_data);
+
+// Runs `body` and turns what it throws into the status every entry point
+// and job body reports: a Crypto++ failure, an allocation failure, or
+// anything else
+template <class Body>
+auto guarded(const Body& body) -> decltype(body()) {
+    try {
+        return body();
+    } catch (const CryptoPP::Exception&) {
+        return STATUS_CRYPTO_ERROR;
+    } catch (const std::bad_alloc&) {
+        return STATUS_MEMORY_ERROR;
+    } catch (...) {
+        return STATUS_UNKNOWN_ERROR;
+    }
+}
+
+// Buffer cipher, in crypto_bridge.cpp
+
+// Body of crypto_bridge_process_ex. `digest`, if given, receives the
+// plaintext; `keys`, if given, replace the password KDF; `scratch`, if
+// given, holds the compressed frame.
+int process_buffer(const CryptoBridgeContext& options, int algorithm, int mode,
+                   int key_size_bits, int operation,
+                   const char* password, int password_len,
+                   const unsigned char* input_data, int input_len,
+                   unsigned char* output_data, int* output_len,
+                   unsigned char* iv, unsigned char* auth_tag,
+                   DigestStage* digest, const SessionKeys* keys, unsigned char* scratch);
+
+// PBKDF2 of the password into a key and an IV
+int derive_key_and_iv(const char* password, int password_len,
+                      unsigned char* key, int key_len,
+                      unsigned char* iv, int iv_len);
+
+// STATUS_SUCCESS, or why the algorithm cannot take the key size or mode
+int validate_algorithm_key_size(int algorithm, int key_size_bits);
+int validate_algorithm_mode_combination(int algorithm, int mode);
+
+// Algorithms with a cipher behind them
+bool algorithm_implemented(int algorithm);
+
+// Modes that can feed a digest and a MAC in the same pass as the cipher
+bool is_transform_mode(int mode);
+
+// Modes that append a 16-byte authentication tag instead of padding
+bool is_aead_mode(int mode);
+
+// Bytes of key material a mode derives (two keys for XTS)
+int derived_key_length(int mode, int key_size_bits);
+
+// Nonce/IV bytes derived for an algorithm
+int nonce_length(int algorithm);
+
+// Block size that CBC and ECB pad to
+int padding_block_size(int algorithm);
+
+// Bodies of the C entry points, in the modules named
+
+// crypto_tree.cpp; `control` is the background job running the tree, if any
+int process_tree(const CryptoBridgeContext& options, int algorithm, int mode,
+                 int key_size_bits, int operation,
+                 const char* password, int password_len,
+                 const char* source_dir, const char* dest_dir,
+                 CryptoBridgeTreeProgress progress, void* user_data, JobControl* control);
+
+// Key slot changes made by crypto_bridge_archive_*_password
+enum ArchivePasswordAction {
+    ARCHIVE_PASSWORD_ADD,
+    ARCHIVE_PASSWORD_CHANGE,
+    ARCHIVE_PASSWORD_REMOVE
+};
+
+// crypto_archive.cpp; `action` is an ArchivePasswordAction
+int process_archive_create(const CryptoBridgeContext& options, int algorithm, int mode,
+                           int key_size_bits, const char* password, int password_len,
+                           const char* source_dir, const char* archive_path,
+                           CryptoBridgeTreeProgress progress, void* user_data);
+int process_archive_list(const CryptoBridgeContext& options,
+                         const char* password, int password_len,
+                         const char* archive_path, char* listing, int* listing_len);
+int process_archive_extract(const CryptoBridgeContext& options,
+                            const char* password, int password_len,
+                            const char* archive_path, const char* entry_name,
+                            const char* dest_dir,
+                            CryptoBridgeTreeProgress progress, void* user_data);
+int process_archive_password(const char* archive_path,
+                             const char* password, int password_len,
+                             const char* new_password, int new_password_len, int action);
+
+// crypto_chunk_store.cpp
+int process_store_put(const CryptoBridgeContext& options,
+                      const char* password, int password_len, const char* store_dir,
+                      const char* source_path, const char* recipe_path,
+                      long long* stored_bytes);
+int process_store_get(const CryptoBridgeContext& options,
+                      const char* password, int password_len, const char* store_dir,
+                      const char* recipe_path, const char* dest_path);
+
+// crypto_segment.cpp
+int process_file_update(const CryptoBridgeContext& options, int algorithm, int mode,
+                        int key_size_bits, const char* password, int password_len,
+                        const char* plain_path, const char* encrypted_path,
+                        const long long* ranges, int range_count,
+                        long long* rewritten_bytes);
+
+// crypto_stream.cpp
+int process_stream(const CryptoBridgeContext& options, int algorithm, int mode,
+                   int key_size_bits, int operation,
+                   const char* password, int password_len,
+                   CryptoBridgeStreamRead read, CryptoBridgeStreamWrite write,
+                   void* user_data);
+
+// crypto_jobs.cpp; each returns the job id, and throws if the job cannot
+// be queued
+long long submit_buffer_job(const CryptoBridgeContext& options, int algorithm, int mode,
+                            int key_size_bits, int operation,
+                            const char* password, int password_len,
+                            const unsigned char* input_data, int input_len,
+                            unsigned char* iv, unsigned char* auth_tag,
+                            CryptoBridgeJobCallback callback, void* user_data);
+long long submit_tree_job(const CryptoBridgeContext& options, int algorithm, int mode,
+                          int key_size_bits, int operation,
+                          const char* password, int password_len,
+                          const char* source_dir, const char* dest_dir,
+                          CryptoBridgeJobCallback callback, void* user_data);
+
+#endif // CRYPTO_BRIDGE_INTERNAL_H
@@ -0,0 +1,241 @@
+/*
+ * crypto_buffer_pool.cpp - Reusable aligned I/O buffers for the FFI caller
+ */
+
+#include "crypto_buffer_pool.h"
+#include "crypto_compat.h"
+#include <cstdlib>
+
+#if defined(_WIN32)
+    #include <malloc.h>
+#elif defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
+// Idle buffers beyond this many bytes are returned to the system on release
+static const size_t kMaxIdleBytes = 256u * 1024u * 1024u;
+
+// Transparent huge pages are 2 MiB on every platform we ship
+static const size_t kHugePageSize = 2u * 1024u * 1024u;
+
+CryptoBufferPool& CryptoBufferPool::instance() {
+    static CryptoBufferPool pool;
+    return pool;
+}
+
+CryptoBufferPool::CryptoBufferPool() : idle_bytes_(0) {
+}
+
+CryptoBufferPool::~CryptoBufferPool() {
+    trim();
+}
+
+size_t CryptoBufferPool::class_capacity(size_t size) {
+    int size_class = kMinClass;
+    while (size_class <= kMaxClass && (static_cast<size_t>(1) << size_class) < size) {
+        ++size_class;
+    }
+    return size_class <= kMaxClass ? static_cast<size_t>(1) << size_class : 0;
+}
+
+unsigned char* CryptoBufferPool::acquire(size_t size, int flags) {
+    int size_class = kMinClass;
+    while (size_class <= kMaxClass && (static_cast<size_t>(1) << size_class) < size) {
+        ++size_class;
+    }
+    if (size_class > kMaxClass) {
+        return nullptr;
+    }
+
+    const size_t capacity = static_cast<size_t>(1) << size_class;
+    const bool huge = (flags & BUFFER_FLAG_HUGE_PAGES) != 0 && capacity >= kHugePageSize;
+    std::vector<unsigned char*>& idle = idle_[huge ? 1 : 0][size_class - kMinClass];
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle.empty()) {
+            unsigned char* buffer = idle.back();
+            idle.pop_back();
+            idle_bytes_ -= capacity;
+            Entry& entry = live_[buffer];
+            entry.size = size;
+            entry.idle = false;
+            return buffer;
+        }
+    }
+
+    unsigned char* buffer = allocate_pages(capacity, huge);
+    if (!buffer) {
+        return nullptr;
+    }
+
+    Entry entry;
+    entry.size_class = size_class;
+    entry.size = size;
+    entry.huge = huge;
+    entry.idle = false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_[buffer] = entry;
+    return buffer;
+}
+
+bool CryptoBufferPool::release(unsigned char* buffer) {
+    if (!buffer) {
+        return false;
+    }
+
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unordered_map<const unsigned char*, Entry>::iterator it = live_.find(buffer);
+        if (it == live_.end() || it->second.idle) {
+            return false;
+        }
+        // Claim the buffer now so a concurrent double release is rejected
+        it->second.idle = true;
+        entry = it->second;
+    }
+
+    // The buffer held plaintext or key-dependent data; never hand it out
+    // dirty. Bytes past the usable size were never written.
+    const size_t capacity = static_cast<size_t>(1) << entry.size_class;
+    CryptoPP::SecureWipeBuffer(buffer, entry.size);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_bytes_ + capacity <= kMaxIdleBytes) {
+            idle_[entry.huge ? 1 : 0][entry.size_class - kMinClass].push_back(buffer);
+            idle_bytes_ += capacity;
+            return true;
+        }
+        live_.erase(buffer);
+    }
+
+    free_pages(buffer, capacity, entry.huge);
+    return true;
+}
+
+bool CryptoBufferPool::grow(unsigned char* buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<const unsigned char*, Entry>::iterator it = live_.find(buffer);
+    if (it == live_.end() || it->second.idle ||
+        size > static_cast<size_t>(1) << it->second.size_class) {
+        return false;
+    }
+    if (size > it->second.size) {
+        it->second.size = size;
+    }
+    return true;
+}
+
+size_t CryptoBufferPool::capacity(const unsigned char* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<const unsigned char*, Entry>::const_iterator it = live_.find(buffer);
+    if (it == live_.end() || it->second.idle) {
+        return 0;
+    }
+    return it->second.size;
+}
+
+void CryptoBufferPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int huge = 0; huge < 2; ++huge) {
+        for (int i = 0; i < kClassCount; ++i) {
+            const size_t capacity = static_cast<size_t>(1) << (i + kMinClass);
+            std::vector<unsigned char*>& idle = idle_[huge][i];
+            for (size_t j = 0; j < idle.size(); ++j) {
+                live_.erase(idle[j]);
+                free_pages(idle[j], capacity, huge != 0);
+            }
+            idle.clear();
+        }
+    }
+    idle_bytes_ = 0;
+}
+
+unsigned char* CryptoBufferPool::allocate_result(size_t size) {
+    // A one-line header in front of the payload remembers the size for the
+    // wipe in free_result and keeps the payload 64-byte aligned
+    unsigned char* block = allocate_pages(kAlignment + size, false);
+    if (!block) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    return block + kAlignment;
+}
+
+void CryptoBufferPool::free_result(void* result) {
+    if (!result) {
+        return;
+    }
+    unsigned char* block = static_cast<unsigned char*>(result) - kAlignment;
+    const size_t size = *reinterpret_cast<size_t*>(block);
+    CryptoPP::SecureWipeBuffer(block, kAlignment + size);
+    free_pages(block, kAlignment + size, false);
+}
+
+unsigned char* CryptoBufferPool::allocate_pages(size_t capacity, bool huge) {
+#if defined(__linux__)
+    if (huge) {
+        void* pages = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pages == MAP_FAILED) {
+            return nullptr;
+        }
+    #ifdef MADV_HUGEPAGE
+        // Best effort: the kernel may still back the range with small pages
+        madvise(pages, capacity, MADV_HUGEPAGE);
+    #endif
+        return static_cast<unsigned char*>(pages);
+    }
+#else
+    (void)huge;
+#endif
+
+#if defined(_WIN32)
+    return static_cast<unsigned char*>(_aligned_malloc(capacity, kAlignment));
+#else
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, kAlignment, capacity) != 0) {
+        return nullptr;
+    }
+    return static_cast<unsigned char*>(buffer);
+#endif
+}
+
+void CryptoBufferPool::free_pages(unsigned char* buffer, size_t capacity, bool huge) {
+#if defined(__linux__)
+    if (huge) {
+        munmap(buffer, capacity);
+        return;
+    }
+#else
+    (void)capacity;
+    (void)huge;
+#endif
+
+#if defined(_WIN32)
+    _aligned_free(buffer);
+#else
+    std::free(buffer);
+#endif
+}
+
+bool MemoryBudget::acquire(size_t bytes) {
+    if (bytes > limit_) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (bytes > limit_ - used_) {
+        released_.wait(lock);
+    }
+    used_ += bytes;
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_ -= bytes;
+    released_.notify_all();
+}
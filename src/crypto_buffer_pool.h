@@ -0,0 +1,179 @@
+/*
+ * crypto_buffer_pool.h - Reusable aligned I/O buffers for the FFI caller
+ *
+ * The Dart side used to calloc fresh input/output buffers for every call,
+ * paying zero-fill and page faults over the whole payload each time. The
+ * pool hands out 64-byte aligned buffers rounded up to power-of-two size
+ * classes and keeps released buffers for reuse, so a steady stream of calls
+ * keeps writing into the same resident pages. Buffers are wiped on release
+ * because they carry plaintext; only the bytes asked for are usable, so
+ * only those are wiped, not the rest of the size class.
+ */
+
+#ifndef CRYPTO_BUFFER_POOL_H
+#define CRYPTO_BUFFER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+// Buffer flags (mirrors CryptoBridgeBufferFlags in crypto_bridge.h)
+enum CryptoBufferFlags {
+    BUFFER_FLAG_DEFAULT = 0,
+    BUFFER_FLAG_HUGE_PAGES = 1
+};
+
+class CryptoBufferPool {
+public:
+    static const size_t kAlignment = 64;
+
+    static CryptoBufferPool& instance();
+
+    // Returns a buffer of `size` usable bytes, or nullptr on failure.
+    // Contents are unspecified (not zeroed).
+    unsigned char* acquire(size_t size, int flags);
+
+    // Extends a live buffer to `size` usable bytes, keeping its contents.
+    // False if that does not fit its size class.
+    bool grow(unsigned char* buffer, size_t size);
+
+    // Wipes the usable bytes of a buffer and returns it to the pool. False
+    // if it did not come from acquire() or was already released.
+    bool release(unsigned char* buffer);
+
+    // Usable size of a buffer handed out by acquire(), 0 if unknown
+    size_t capacity(const unsigned char* buffer);
+
+    // Capacity acquire() hands out for `size` bytes, 0 if it is too large
+    static size_t class_capacity(size_t size);
+
+    // Frees every idle buffer
+    void trim();
+
+    // Individually owned, exactly sized buffers for results handed to the
+    // FFI caller. They bypass the size classes (results can be long lived)
+    // and are wiped when freed.
+    static unsigned char* allocate_result(size_t size);
+    static void free_result(void* result);
+
+private:
+    // Size classes run from 4 KiB (2^12) to 2 GiB (2^31)
+    static const int kMinClass = 12;
+    static const int kMaxClass = 31;
+    static const int kClassCount = kMaxClass - kMinClass + 1;
+
+    struct Entry {
+        int size_class;
+        size_t size;  // Usable bytes, the only ones that can hold data
+        bool huge;
+        bool idle;
+    };
+
+    CryptoBufferPool();
+    ~CryptoBufferPool();
+    CryptoBufferPool(const CryptoBufferPool&);
+    CryptoBufferPool& operator=(const CryptoBufferPool&);
+
+    static unsigned char* allocate_pages(size_t capacity, bool huge);
+    static void free_pages(unsigned char* buffer, size_t capacity, bool huge);
+
+    std::mutex mutex_;
+    std::vector<unsigned char*> idle_[2][kClassCount];
+    std::unordered_map<const unsigned char*, Entry> live_;
+    size_t idle_bytes_;
+};
+
+// Caps the pool memory that the buffers of one call hold at once. A buffer
+// takes its capacity from the budget before it is acquired and returns it
+// on release; a request waits while other buffers hold the memory it
+// needs, and fails at once if it exceeds the whole budget. Holders must
+// not wait for more while holding, or two of them could wait on each other.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limit) : limit_(limit), used_(0) {}
+
+    // Blocks until `bytes` fit; false if they never can
+    bool acquire(size_t bytes);
+    void release(size_t bytes);
+
+    size_t limit() const { return limit_; }
+
+private:
+    MemoryBudget(const MemoryBudget&);
+    MemoryBudget& operator=(const MemoryBudget&);
+
+    std::mutex mutex_;
+    std::condition_variable released_;
+    const size_t limit_;
+    size_t used_;
+};
+
+// Pool buffer owned by one scope: grows on demand and goes back to the
+// pool when the scope exits. With a budget, its capacity counts against it.
+class PooledBuffer {
+public:
+    explicit PooledBuffer(MemoryBudget* budget = nullptr)
+        : budget_(budget), data_(nullptr), capacity_(0), budgeted_(0) {}
+    ~PooledBuffer() {
+        release();
+    }
+
+    // Returns a buffer of at least `size` bytes; earlier contents are lost
+    // when it has to move to a larger size class. Throws std::bad_alloc on
+    // failure, or if `size` exceeds the budget.
+    unsigned char* reserve(size_t size) {
+        if (size > capacity_) {
+            CryptoBufferPool& pool = CryptoBufferPool::instance();
+            if (data_ && pool.grow(data_, size)) {
+                capacity_ = size;
+                return data_;
+            }
+            release();
+            const size_t budgeted = CryptoBufferPool::class_capacity(size);
+            if (budget_ && (budgeted == 0 || !budget_->acquire(budgeted))) {
+                throw std::bad_alloc();
+            }
+            data_ = pool.acquire(size, BUFFER_FLAG_DEFAULT);
+            if (!data_) {
+                if (budget_) {
+                    budget_->release(budgeted);
+                }
+                throw std::bad_alloc();
+            }
+            capacity_ = size;
+            budgeted_ = budgeted;
+        }
+        return data_;
+    }
+
+    // Hands the buffer back to the pool (and its share back to the budget)
+    // before the scope exits
+    void release() {
+        if (data_) {
+            CryptoBufferPool::instance().release(data_);
+            if (budget_) {
+                budget_->release(budgeted_);
+            }
+            data_ = nullptr;
+            capacity_ = 0;
+            budgeted_ = 0;
+        }
+    }
+
+    unsigned char* data() const { return data_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    PooledBuffer(const PooledBuffer&);
+    PooledBuffer& operator=(const PooledBuffer&);
+
+    MemoryBudget* budget_;
+    unsigned char* data_;
+    size_t capacity_;  // Usable bytes
+    size_t budgeted_;  // Size class taken from the budget
+};
+
+#endif // CRYPTO_BUFFER_POOL_H
@@ -0,0 +1,629 @@
+/*
+ * crypto_chunk_store.cpp - Deduplicating chunk store for the crypto bridge:
+ * the store format, and the put and get calls
+ */
+
+#include "crypto_chunk_store.h"
+#include "crypto_buffer_pool.h"
+#include "crypto_fs.h"
+#include "crypto_secure_pool.h"
+#include "crypto_tree.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+static const unsigned char kConfigMagic[4] = { 'C', 'T', 'K', 0x01 };
+static const unsigned char kRecipeMagic[4] = { 'C', 'T', 'P', 0x01 };
+
+static const unsigned char kKeysLabel[] = "CryptingTool chunk store keys";
+static const unsigned char kGearLabel[] = "CryptingTool chunk store gear";
+
+// Same work factor as the bridge's other password derivations
+static const unsigned int kKdfIterations = 10000;
+
+static const size_t kRecipeNonceSize = 12;
+static const size_t kRecipeTagSize = 16;
+static const size_t kRecipeEntrySize = CHUNK_ID_SIZE + 4;
+
+// Normalized chunking: boundaries are harder to hit before the normal size
+// and easier after it, which narrows the spread around the 1 MiB average.
+// The gear hash shifts left, so only its top bits cover a full window.
+static const size_t kNormalSize = 1024 * 1024;
+static const CryptoPP::word64 kMaskHard = ~0ULL << (64 - 22);
+static const CryptoPP::word64 kMaskEasy = ~0ULL << (64 - 18);
+
+static void store_le32(unsigned char* out, size_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static size_t load_le32(const unsigned char* in) {
+    size_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static void store_le64(unsigned char* out, unsigned long long value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static unsigned long long load_le64(const unsigned char* in) {
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+ChunkKeys::~ChunkKeys() {
+    CryptoPP::SecureWipeBuffer(id, sizeof(id));
+    CryptoPP::SecureWipeBuffer(cipher, sizeof(cipher));
+    CryptoPP::SecureWipeBuffer(recipe, sizeof(recipe));
+    CryptoPP::SecureWipeBuffer(check, sizeof(check));
+    CryptoPP::SecureWipeArray(gear, 256);
+}
+
+void write_chunk_store_config(const unsigned char* salt, const unsigned char* check,
+                              unsigned char* out) {
+    std::memcpy(out, kConfigMagic, sizeof(kConfigMagic));
+    std::memset(out + 4, 0, 4);
+    std::memcpy(out + 8, salt, CHUNK_SALT_SIZE);
+    std::memcpy(out + 8 + CHUNK_SALT_SIZE, check, CHUNK_CHECK_SIZE);
+}
+
+bool read_chunk_store_config(const unsigned char* in, unsigned char* salt, unsigned char* check) {
+    static const unsigned char zero[4] = { 0, 0, 0, 0 };
+    if (std::memcmp(in, kConfigMagic, sizeof(kConfigMagic)) != 0 ||
+        std::memcmp(in + 4, zero, sizeof(zero)) != 0) {
+        return false;
+    }
+    std::memcpy(salt, in + 8, CHUNK_SALT_SIZE);
+    std::memcpy(check, in + 8 + CHUNK_SALT_SIZE, CHUNK_CHECK_SIZE);
+    return true;
+}
+
+void derive_chunk_keys(const char* password, size_t password_len, const unsigned char* salt,
+                       ChunkKeys* keys) {
+    SecureBlock root(32);
+    CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> pbkdf2;
+    pbkdf2.DeriveKey(root.data(), root.size(), 0x00,
+                     reinterpret_cast<const CryptoPP::byte*>(password), password_len,
+                     salt, CHUNK_SALT_SIZE, kKdfIterations);
+
+    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+    SecureBlock material(sizeof(keys->id) + sizeof(keys->cipher) +
+                         sizeof(keys->recipe) + sizeof(keys->check));
+    hkdf.DeriveKey(material.data(), material.size(), root.data(), root.size(),
+                   salt, CHUNK_SALT_SIZE, kKeysLabel, sizeof(kKeysLabel) - 1);
+    const unsigned char* p = material.data();
+    std::memcpy(keys->id, p, sizeof(keys->id));
+    p += sizeof(keys->id);
+    std::memcpy(keys->cipher, p, sizeof(keys->cipher));
+    p += sizeof(keys->cipher);
+    std::memcpy(keys->recipe, p, sizeof(keys->recipe));
+    p += sizeof(keys->recipe);
+    std::memcpy(keys->check, p, sizeof(keys->check));
+
+    CryptoPP::SecByteBlock gear(256 * 8);
+    hkdf.DeriveKey(gear.data(), gear.size(), root.data(), root.size(),
+                   salt, CHUNK_SALT_SIZE, kGearLabel, sizeof(kGearLabel) - 1);
+    for (int i = 0; i < 256; ++i) {
+        keys->gear[i] = load_le64(gear.data() + 8 * i);
+    }
+}
+
+size_t find_chunk_boundary(const ChunkKeys& keys, const unsigned char* data, size_t len) {
+    const size_t limit = len < CHUNK_MAX_SIZE ? len : CHUNK_MAX_SIZE;
+    if (limit <= CHUNK_MIN_SIZE) {
+        return limit;
+    }
+
+    // Nothing before the minimum can be a boundary, so hashing starts there
+    const size_t normal = limit < kNormalSize ? limit : kNormalSize;
+    CryptoPP::word64 hash = 0;
+    size_t i = CHUNK_MIN_SIZE;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + keys.gear[data[i]];
+        if ((hash & kMaskHard) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; ++i) {
+        hash = (hash << 1) + keys.gear[data[i]];
+        if ((hash & kMaskEasy) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+void chunk_id(const ChunkKeys& keys, const unsigned char* data, size_t len, unsigned char* id) {
+    CryptoPP::HMAC<CryptoPP::SHA256> mac(keys.id, sizeof(keys.id));
+    mac.CalculateDigest(id, data, len);
+}
+
+void seal_chunk(const ChunkKeys& keys, const unsigned char* id,
+                const unsigned char* in, size_t len, unsigned char* out) {
+    CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption cipher;
+    cipher.SetKeyWithIV(keys.cipher, sizeof(keys.cipher), id, CryptoPP::AES::BLOCKSIZE);
+    cipher.ProcessData(out, in, len);
+}
+
+bool open_chunk(const ChunkKeys& keys, const unsigned char* id,
+                const unsigned char* in, size_t len, unsigned char* out) {
+    CryptoPP::CTR_Mode<CryptoPP::AES>::Decryption cipher;
+    cipher.SetKeyWithIV(keys.cipher, sizeof(keys.cipher), id, CryptoPP::AES::BLOCKSIZE);
+    cipher.ProcessData(out, in, len);
+
+    unsigned char actual[CHUNK_ID_SIZE];
+    chunk_id(keys, out, len, actual);
+    if (!CryptoPP::VerifyBufsEqual(actual, id, CHUNK_ID_SIZE)) {
+        CryptoPP::SecureWipeBuffer(out, len);
+        return false;
+    }
+    return true;
+}
+
+std::string chunk_object_name(const unsigned char* id) {
+    static const char digits[] = "0123456789abcdef";
+    std::string name;
+    name.reserve(8 + 2 * CHUNK_ID_SIZE + 1);
+    name += "objects/";
+    for (size_t i = 0; i < CHUNK_ID_SIZE; ++i) {
+        name += digits[id[i] >> 4];
+        name += digits[id[i] & 0x0F];
+        if (i == 0) {
+            name += '/';
+        }
+    }
+    return name;
+}
+
+void seal_recipe(const ChunkKeys& keys, unsigned long long size, const std::vector<ChunkRef>& chunks,
+                 std::vector<unsigned char>* out) {
+    std::vector<unsigned char> plain(12 + chunks.size() * kRecipeEntrySize);
+    store_le64(&plain[0], size);
+    store_le32(&plain[8], chunks.size());
+    unsigned char* p = &plain[12];
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        std::memcpy(p, chunks[i].id, CHUNK_ID_SIZE);
+        store_le32(p + CHUNK_ID_SIZE, chunks[i].length);
+        p += kRecipeEntrySize;
+    }
+
+    out->resize(sizeof(kRecipeMagic) + kRecipeNonceSize + plain.size() + kRecipeTagSize);
+    unsigned char* magic = &(*out)[0];
+    unsigned char* nonce = magic + sizeof(kRecipeMagic);
+    unsigned char* body = nonce + kRecipeNonceSize;
+    std::memcpy(magic, kRecipeMagic, sizeof(kRecipeMagic));
+    CryptoPP::AutoSeededRandomPool rng;
+    rng.GenerateBlock(nonce, kRecipeNonceSize);
+
+    CryptoPP::GCM<CryptoPP::AES>::Encryption cipher;
+    cipher.SetKeyWithIV(keys.recipe, sizeof(keys.recipe), nonce, kRecipeNonceSize);
+    cipher.EncryptAndAuthenticate(body, body + plain.size(), kRecipeTagSize,
+                                  nonce, static_cast<int>(kRecipeNonceSize),
+                                  magic, sizeof(kRecipeMagic), &plain[0], plain.size());
+}
+
+bool open_recipe(const ChunkKeys& keys, const unsigned char* in, size_t len,
+                 unsigned long long* size, std::vector<ChunkRef>* chunks) {
+    const size_t overhead = sizeof(kRecipeMagic) + kRecipeNonceSize + kRecipeTagSize;
+    if (len < overhead + 12 || std::memcmp(in, kRecipeMagic, sizeof(kRecipeMagic)) != 0) {
+        return false;
+    }
+    const unsigned char* nonce = in + sizeof(kRecipeMagic);
+    const unsigned char* body = nonce + kRecipeNonceSize;
+    const size_t body_len = len - overhead;
+
+    std::vector<unsigned char> plain(body_len);
+    CryptoPP::GCM<CryptoPP::AES>::Decryption cipher;
+    cipher.SetKeyWithIV(keys.recipe, sizeof(keys.recipe), nonce, kRecipeNonceSize);
+    if (!cipher.DecryptAndVerify(&plain[0], body + body_len, kRecipeTagSize,
+                                 nonce, static_cast<int>(kRecipeNonceSize),
+                                 in, sizeof(kRecipeMagic), body, body_len)) {
+        return false;
+    }
+
+    *size = load_le64(&plain[0]);
+    const size_t count = load_le32(&plain[8]);
+    if (count > (body_len - 12) / kRecipeEntrySize || body_len != 12 + count * kRecipeEntrySize) {
+        return false;
+    }
+
+    chunks->resize(count);
+    unsigned long long total = 0;
+    const unsigned char* p = &plain[12];
+    for (size_t i = 0; i < count; ++i) {
+        ChunkRef& chunk = (*chunks)[i];
+        std::memcpy(chunk.id, p, CHUNK_ID_SIZE);
+        chunk.length = load_le32(p + CHUNK_ID_SIZE);
+        if (chunk.length == 0 || chunk.length > CHUNK_MAX_SIZE) {
+            return false;
+        }
+        total += chunk.length;
+        p += kRecipeEntrySize;
+    }
+    return total == *size;
+}
+
+// Input a chunk store call holds in memory at once; its chunks are hashed
+// and sealed in parallel
+static const size_t STORE_WINDOW_BYTES = 32 * 1024 * 1024;
+
+// Trims the buffer pool when a budgeted chunk store call ends, as TreeJob
+// does; declared before the call's buffers so that it runs after them
+struct StorePoolTrim {
+    bool enabled;
+    ~StorePoolTrim() {
+        if (enabled) {
+            CryptoBufferPool::instance().trim();
+        }
+    }
+};
+
+// A chunk inside the current chunk store window
+struct StoreChunk {
+    size_t offset;
+    size_t length;
+};
+
+static int check_store_options(const CryptoBridgeContext& options);
+static int open_chunk_store(const std::string& store, const char* password, int password_len,
+                            bool create, ChunkKeys* keys);
+static int store_chunk(const std::string& store, const ChunkKeys& keys, const unsigned char* data,
+                       ChunkRef& ref, const std::string& temp_suffix,
+                       std::atomic<unsigned int>& temp_count, std::atomic<long long>& stored,
+                       MemoryBudget* budget);
+static bool stored_object_matches(const std::string& object, const unsigned char* sealed,
+                                  size_t len);
+static int load_chunk(const std::string& store, const ChunkKeys& keys, const ChunkRef& ref,
+                      unsigned char* out);
+static size_t store_window_size(const std::unique_ptr<MemoryBudget>& budget, size_t share);
+
+// Body of crypto_bridge_store_put. The file is read a window at a time;
+// each window is cut into chunks, which are hashed, checked against the
+// store and, if new, sealed in parallel.
+int process_store_put(const CryptoBridgeContext& options,
+                      const char* password, int password_len, const char* store_dir,
+                      const char* source_path, const char* recipe_path,
+                      long long* stored_bytes) {
+    if (!password || password_len <= 0 || !store_dir || !source_path || !recipe_path ||
+        !*store_dir || !*source_path || !*recipe_path) {
+        return STATUS_INVALID_PARAMS;
+    }
+    int status = check_store_options(options);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    const std::string store(store_dir);
+
+    ChunkKeys keys;
+    status = open_chunk_store(store, password, password_len, true, &keys);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    FsFile input(source_path, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    // Objects are written under a temporary name unique to this call
+    CryptoPP::AutoSeededRandomPool rng;
+    unsigned char token[8];
+    rng.GenerateBlock(token, sizeof(token));
+    char temp_suffix[2 * sizeof(token) + 6];
+    std::snprintf(temp_suffix, sizeof(temp_suffix), ".tmp%02x%02x%02x%02x%02x%02x%02x%02x",
+                  token[0], token[1], token[2], token[3], token[4], token[5], token[6], token[7]);
+    std::atomic<unsigned int> temp_count(0);
+    std::atomic<long long> stored(0);
+
+    // Under a budget the window takes at most half of it; sealing chunks
+    // waits for the rest
+    std::unique_ptr<MemoryBudget> budget;
+    if (options.memory_budget > 0) {
+        budget.reset(new MemoryBudget(static_cast<size_t>(options.memory_budget)));
+    }
+    const StorePoolTrim trim = { options.memory_budget > 0 };
+    const size_t window_size = store_window_size(budget, budget ? budget->limit() / 2 : 0);
+    PooledBuffer window(budget.get());
+    unsigned char* data = window.reserve(window_size);
+    std::vector<ChunkRef> refs;
+    std::vector<StoreChunk> chunks;
+    unsigned long long size = 0;
+    size_t filled = 0;
+    bool eof = false;
+
+    while (!eof || filled > 0) {
+        if (!eof) {
+            const size_t read = std::fread(data + filled, 1, window_size - filled, input.get());
+            filled += read;
+            size += read;
+            if (filled < window_size) {
+                if (std::ferror(input.get())) {
+                    return STATUS_IO_ERROR;
+                }
+                eof = true;
+            }
+        }
+
+        // A chunk that runs into the end of the window waits for more input
+        chunks.clear();
+        size_t pos = 0;
+        while (pos < filled) {
+            const size_t len = find_chunk_boundary(keys, data + pos, filled - pos);
+            if (!eof && pos + len == filled && len < CHUNK_MAX_SIZE) {
+                break;
+            }
+            StoreChunk chunk = { pos, len };
+            chunks.push_back(chunk);
+            pos += len;
+        }
+
+        const size_t first = refs.size();
+        refs.resize(first + chunks.size());
+        status = run_status_tasks(chunks.size(), options.threads, [&](size_t i) {
+            ChunkRef& ref = refs[first + i];
+            ref.length = chunks[i].length;
+            return store_chunk(store, keys, data + chunks[i].offset, ref, temp_suffix,
+                               temp_count, stored, budget.get());
+        });
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        std::memmove(data, data + pos, filled - pos);
+        filled -= pos;
+    }
+
+    std::vector<unsigned char> recipe;
+    seal_recipe(keys, size, refs, &recipe);
+    FsFile output(recipe_path, "wb");
+    if (!output.get() ||
+        std::fwrite(&recipe[0], 1, recipe.size(), output.get()) != recipe.size() ||
+        !output.close()) {
+        output.close();
+        fs_remove(recipe_path);
+        return STATUS_IO_ERROR;
+    }
+
+    if (stored_bytes) {
+        *stored_bytes = stored.load();
+    }
+    return STATUS_SUCCESS;
+}
+
+// Body of crypto_bridge_store_get. Chunks are fetched and opened a window at
+// a time in parallel, then written in order.
+int process_store_get(const CryptoBridgeContext& options,
+                      const char* password, int password_len, const char* store_dir,
+                      const char* recipe_path, const char* dest_path) {
+    if (!password || password_len <= 0 || !store_dir || !recipe_path || !dest_path ||
+        !*store_dir || !*recipe_path || !*dest_path) {
+        return STATUS_INVALID_PARAMS;
+    }
+    int status = check_store_options(options);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    const std::string store(store_dir);
+
+    ChunkKeys keys;
+    status = open_chunk_store(store, password, password_len, false, &keys);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    std::vector<unsigned char> sealed;
+    {
+        FsFile input(recipe_path, "rb");
+        if (!input.get()) {
+            return STATUS_IO_ERROR;
+        }
+        unsigned char block[64 * 1024];
+        size_t read;
+        while ((read = std::fread(block, 1, sizeof(block), input.get())) > 0) {
+            sealed.insert(sealed.end(), block, block + read);
+        }
+        if (std::ferror(input.get())) {
+            return STATUS_IO_ERROR;
+        }
+    }
+
+    unsigned long long size = 0;
+    std::vector<ChunkRef> refs;
+    if (sealed.empty() || !open_recipe(keys, &sealed[0], sealed.size(), &size, &refs)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    FsFile output(dest_path, "wb");
+    if (!output.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    // Chunks are opened in place, so a budget only bounds the window
+    std::unique_ptr<MemoryBudget> budget;
+    if (options.memory_budget > 0) {
+        budget.reset(new MemoryBudget(static_cast<size_t>(options.memory_budget)));
+    }
+    const StorePoolTrim trim = { options.memory_budget > 0 };
+    const size_t window_size = store_window_size(budget, budget ? budget->limit() : 0);
+    PooledBuffer window(budget.get());
+    unsigned char* data = window.reserve(window_size);
+    std::vector<StoreChunk> chunks;
+    for (size_t next = 0; next < refs.size() && status == STATUS_SUCCESS; next += chunks.size()) {
+        chunks.clear();
+        size_t used = 0;
+        while (next + chunks.size() < refs.size() &&
+               refs[next + chunks.size()].length <= window_size - used) {
+            StoreChunk chunk = { used, refs[next + chunks.size()].length };
+            chunks.push_back(chunk);
+            used += chunk.length;
+        }
+
+        status = run_status_tasks(chunks.size(), options.threads, [&](size_t i) {
+            return load_chunk(store, keys, refs[next + i], data + chunks[i].offset);
+        });
+        if (status == STATUS_SUCCESS && std::fwrite(data, 1, used, output.get()) != used) {
+            status = STATUS_IO_ERROR;
+        }
+    }
+
+    if (!output.close() && status == STATUS_SUCCESS) {
+        status = STATUS_IO_ERROR;
+    }
+    if (status != STATUS_SUCCESS) {
+        fs_remove(dest_path);
+    }
+    return status;
+}
+
+// The store's format fixes its cipher: chunks are sealed with AES-256-CTR
+// and authenticated by their ids, and objects are never compressed, so
+// context settings that would ask for anything else are refused rather
+// than ignored
+static int check_store_options(const CryptoBridgeContext& options) {
+    if (options.compression != COMPRESSION_NONE || options.mac != MAC_NONE) {
+        return STATUS_INVALID_PARAMS;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Loads a store's keys, creating the store first if asked to. A password
+// that does not match the store's key check is a crypto error, so a typo
+// never fills a store with objects nobody else can read.
+static int open_chunk_store(const std::string& store, const char* password, int password_len,
+                            bool create, ChunkKeys* keys) {
+    const std::string path = fs_join(store, "config");
+    unsigned char raw[CHUNK_STORE_CONFIG_SIZE];
+    unsigned char salt[CHUNK_SALT_SIZE];
+    unsigned char check[CHUNK_CHECK_SIZE];
+
+    FsFile config(path, "rb");
+    if (config.get()) {
+        if (std::fread(raw, 1, sizeof(raw), config.get()) != sizeof(raw) ||
+            !read_chunk_store_config(raw, salt, check)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        derive_chunk_keys(password, static_cast<size_t>(password_len), salt, keys);
+        if (!CryptoPP::VerifyBufsEqual(check, keys->check, CHUNK_CHECK_SIZE)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        return STATUS_SUCCESS;
+    }
+    if (!create) {
+        return STATUS_IO_ERROR;
+    }
+
+    if (!fs_make_directories(store)) {
+        return STATUS_IO_ERROR;
+    }
+    CryptoPP::AutoSeededRandomPool rng;
+    rng.GenerateBlock(salt, sizeof(salt));
+    derive_chunk_keys(password, static_cast<size_t>(password_len), salt, keys);
+    write_chunk_store_config(salt, keys->check, raw);
+
+    const std::string temp = path + ".tmp";
+    FsFile created(temp, "wb");
+    if (!created.get() || std::fwrite(raw, 1, sizeof(raw), created.get()) != sizeof(raw) ||
+        !created.close() || !fs_rename(temp, path)) {
+        created.close();
+        fs_remove(temp);
+        return STATUS_IO_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Names and seals one chunk and, unless the store already holds exactly
+// that object, adds it. Sealing is deterministic, so an object that differs
+// from the fresh seal (truncated, or damaged on disk) is replaced rather
+// than trusted until a later get fails on it.
+static int store_chunk(const std::string& store, const ChunkKeys& keys, const unsigned char* data,
+                       ChunkRef& ref, const std::string& temp_suffix,
+                       std::atomic<unsigned int>& temp_count, std::atomic<long long>& stored,
+                       MemoryBudget* budget) {
+    chunk_id(keys, data, ref.length, ref.id);
+    const std::string name = chunk_object_name(ref.id);
+    const std::string object = fs_join(store, name);
+
+    PooledBuffer buffer(budget);
+    unsigned char* sealed = buffer.reserve(ref.length);
+    seal_chunk(keys, ref.id, data, ref.length, sealed);
+
+    if (fs_exists(object) && stored_object_matches(object, sealed, ref.length)) {
+        return STATUS_SUCCESS;
+    }
+    if (!fs_make_directories(fs_join(store, name.substr(0, name.rfind('/'))))) {
+        return STATUS_IO_ERROR;
+    }
+
+    // Objects only appear under their final name once complete. Two writers
+    // of the same chunk produce the same bytes, so either rename may win.
+    char count[16];
+    std::snprintf(count, sizeof(count), "-%u", temp_count.fetch_add(1));
+    const std::string temp = object + temp_suffix + count;
+    FsFile file(temp, "wb");
+    if (!file.get() || std::fwrite(sealed, 1, ref.length, file.get()) != ref.length ||
+        !file.close() || !fs_rename(temp, object)) {
+        file.close();
+        fs_remove(temp);
+        return STATUS_IO_ERROR;
+    }
+    stored += static_cast<long long>(ref.length);
+    return STATUS_SUCCESS;
+}
+
+// True if the object holds exactly the `len` sealed bytes. Compared a block
+// at a time, so checking a chunk costs no buffer beyond the seal.
+static bool stored_object_matches(const std::string& object, const unsigned char* sealed,
+                                  size_t len) {
+    FsFile file(object, "rb");
+    if (!file.get()) {
+        return false;
+    }
+    unsigned char block[16 * 1024];
+    for (size_t pos = 0; pos < len;) {
+        const size_t want = std::min(sizeof(block), len - pos);
+        if (std::fread(block, 1, want, file.get()) != want ||
+            std::memcmp(block, sealed + pos, want) != 0) {
+            return false;
+        }
+        pos += want;
+    }
+    return std::fgetc(file.get()) == EOF;
+}
+
+// Reads and opens one chunk; objects that are truncated, oversized or do not
+// hash to their name are crypto errors
+static int load_chunk(const std::string& store, const ChunkKeys& keys, const ChunkRef& ref,
+                      unsigned char* out) {
+    FsFile object(fs_join(store, chunk_object_name(ref.id)), "rb");
+    if (!object.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (std::fread(out, 1, ref.length, object.get()) != ref.length ||
+        std::fgetc(object.get()) != EOF) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    return open_chunk(keys, ref.id, out, ref.length, out) ? STATUS_SUCCESS : STATUS_CRYPTO_ERROR;
+}
+
+// Window of a chunk store call: the largest power of two up to
+// STORE_WINDOW_BYTES within `share` of the budget, but never less than one
+// chunk
+static size_t store_window_size(const std::unique_ptr<MemoryBudget>& budget, size_t share) {
+    size_t window = STORE_WINDOW_BYTES;
+    while (budget && window > CHUNK_MAX_SIZE && window > share) {
+        window /= 2;
+    }
+    return window;
+}
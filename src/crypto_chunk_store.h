@@ -0,0 +1,98 @@
+/*
+ * crypto_chunk_store.h - Deduplicating chunk store for the crypto bridge
+ *
+ * Files are cut at content-defined boundaries, so an insertion or deletion
+ * only changes the chunks around it, and each chunk is stored once, however
+ * many files or backup runs contain it:
+ *
+ *   config                      "CTK" 0x01 | reserved (4) | salt (16) |
+ *                               key check (16)
+ *   objects/<2 hex>/<62 hex>    one sealed chunk, named by its id
+ *
+ * Boundaries come from a gear rolling hash whose table is derived from the
+ * password, so they do not reveal content to someone without it. A chunk's
+ * id is HMAC-SHA256 of its plaintext, and the chunk is sealed SIV-style:
+ * AES-256-CTR with the first 16 bytes of the id as IV. Identical chunks
+ * therefore seal to identical objects, and opening a chunk recomputes the
+ * id, which authenticates it.
+ *
+ * A file is rebuilt from its recipe, kept outside the store:
+ *
+ *   "CTP" 0x01 | nonce (12) | AES-256-GCM of
+ *       size (8) | chunk count (4) | (id (32) | length (4)) per chunk
+ *   | tag (16)
+ *
+ * All integers are little endian.
+ */
+
+#ifndef CRYPTO_CHUNK_STORE_H
+#define CRYPTO_CHUNK_STORE_H
+
+#include "crypto_compat.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+static const size_t CHUNK_ID_SIZE = 32;
+static const size_t CHUNK_SALT_SIZE = 16;
+static const size_t CHUNK_CHECK_SIZE = 16;
+static const size_t CHUNK_STORE_CONFIG_SIZE = 8 + CHUNK_SALT_SIZE + CHUNK_CHECK_SIZE;
+
+// Chunk size bounds; boundaries average about 1 MiB in between
+static const size_t CHUNK_MIN_SIZE = 256 * 1024;
+static const size_t CHUNK_MAX_SIZE = 4 * 1024 * 1024;
+
+// Keys of one store, all expanded from the password and the store's salt
+struct ChunkKeys {
+    unsigned char id[32];      // Chunk ids and SIV tags
+    unsigned char cipher[32];  // Chunk encryption
+    unsigned char recipe[32];  // Recipe encryption
+    unsigned char check[CHUNK_CHECK_SIZE];
+    CryptoPP::word64 gear[256];
+
+    ~ChunkKeys();
+};
+
+// One chunk of a file, in order
+struct ChunkRef {
+    unsigned char id[CHUNK_ID_SIZE];
+    size_t length;
+};
+
+void write_chunk_store_config(const unsigned char* salt, const unsigned char* check,
+                              unsigned char* out);
+
+// Parses CHUNK_STORE_CONFIG_SIZE bytes; false if they are not a store config
+bool read_chunk_store_config(const unsigned char* in, unsigned char* salt, unsigned char* check);
+
+// Runs the password KDF once and expands every store key from it
+void derive_chunk_keys(const char* password, size_t password_len, const unsigned char* salt,
+                       ChunkKeys* keys);
+
+// Length of the chunk that starts at `data`. If no boundary is found, the
+// result is min(len, CHUNK_MAX_SIZE), so a caller that has not reached the
+// end of its input must supply more data when the result equals `len`.
+size_t find_chunk_boundary(const ChunkKeys& keys, const unsigned char* data, size_t len);
+
+void chunk_id(const ChunkKeys& keys, const unsigned char* data, size_t len, unsigned char* id);
+
+// Seals or opens a chunk; `in` and `out` may be the same buffer. Opening
+// fails if the plaintext does not hash to `id`.
+void seal_chunk(const ChunkKeys& keys, const unsigned char* id,
+                const unsigned char* in, size_t len, unsigned char* out);
+bool open_chunk(const ChunkKeys& keys, const unsigned char* id,
+                const unsigned char* in, size_t len, unsigned char* out);
+
+// Object path relative to the store, '/' separated
+std::string chunk_object_name(const unsigned char* id);
+
+// Serializes and encrypts a recipe
+void seal_recipe(const ChunkKeys& keys, unsigned long long size, const std::vector<ChunkRef>& chunks,
+                 std::vector<unsigned char>* out);
+
+// Decrypts and parses a recipe. Fails if it does not authenticate, or if
+// the chunk lengths are out of bounds or do not add up to the size.
+bool open_recipe(const ChunkKeys& keys, const unsigned char* in, size_t len,
+                 unsigned long long* size, std::vector<ChunkRef>* chunks);
+
+#endif // CRYPTO_CHUNK_STORE_H
@@ -0,0 +1,215 @@
+/*
+ * crypto_compress.cpp - Compression stage ahead of encryption
+ */
+
+#include "crypto_compress.h"
+#include "crypto_compat.h"
+#include "crypto_parallel.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static const unsigned char kFrameMagic[4] = { 'C', 'T', 'Z', 0x01 };
+static const size_t kHeaderSize = 16;
+static const size_t kEntrySize = 4;
+static const unsigned int kRawChunkFlag = 0x80000000u;
+
+// Chunks are compressed independently; large enough for a good ratio,
+// small enough to spread a few MiB over several cores
+static const size_t kChunkSize = 256 * 1024;
+
+// Frames from other writers may use other chunk sizes up to this bound
+static const size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+// Level 1 keeps compression close to cipher speed on text-like data
+static const unsigned int kDeflateLevel = 1;
+
+// Bytes sampled per chunk for the entropy estimate
+static const size_t kEntropySamples = 4096;
+
+// Chunks above this many bits per byte are stored raw without compressing
+static const double kIncompressibleBits = 7.5;
+
+static void store_le32(unsigned char* out, size_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static size_t load_le32(const unsigned char* in) {
+    size_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// Order-0 entropy of a strided sample, in bits per byte
+static bool looks_incompressible(const unsigned char* data, size_t len) {
+    const size_t step = len > kEntropySamples ? len / kEntropySamples : 1;
+    unsigned int counts[256];
+    std::memset(counts, 0, sizeof(counts));
+
+    size_t samples = 0;
+    for (size_t i = 0; i < len; i += step) {
+        ++counts[data[i]];
+        ++samples;
+    }
+
+    double bits = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        if (counts[i]) {
+            const double p = static_cast<double>(counts[i]) / samples;
+            bits -= p * std::log2(p);
+        }
+    }
+    return bits > kIncompressibleBits;
+}
+
+// Compresses one chunk into `out` (room for `len` bytes); returns the
+// stored length, or 0 when the chunk should be stored raw
+static size_t deflate_chunk(const unsigned char* in, size_t len, unsigned char* out) {
+    if (looks_incompressible(in, len)) {
+        return 0;
+    }
+
+    // ArraySink stops writing at its capacity but keeps counting, so an
+    // expanding chunk is detected without a second buffer
+    CryptoPP::ArraySink* sink = new CryptoPP::ArraySink(out, len);
+    CryptoPP::Deflator deflator(sink, kDeflateLevel);
+    deflator.Put(in, len);
+    deflator.MessageEnd();
+
+    const CryptoPP::lword stored = sink->TotalPutLength();
+    return stored < len ? static_cast<size_t>(stored) : 0;
+}
+
+static bool inflate_chunk(const unsigned char* in, size_t stored, unsigned char* out, size_t len) {
+    CryptoPP::ArraySink* sink = new CryptoPP::ArraySink(out, len);
+    CryptoPP::Inflator inflator(sink);
+    inflator.Put(in, stored);
+    inflator.MessageEnd();
+    return sink->TotalPutLength() == len;
+}
+
+size_t compress_frame_bound(size_t input_len) {
+    const size_t chunks = (input_len + kChunkSize - 1) / kChunkSize;
+    return kHeaderSize + chunks * kEntrySize + input_len;
+}
+
+size_t compress_frame(int codec, const unsigned char* input, size_t input_len,
+                      unsigned char* frame, int threads) {
+    const size_t chunks = (input_len + kChunkSize - 1) / kChunkSize;
+    unsigned char* table = frame + kHeaderSize;
+    unsigned char* data = table + chunks * kEntrySize;
+
+    std::memcpy(frame, kFrameMagic, sizeof(kFrameMagic));
+    frame[4] = static_cast<unsigned char>(codec);
+    frame[5] = frame[6] = frame[7] = 0;
+    store_le32(frame + 8, kChunkSize);
+    store_le32(frame + 12, input_len);
+
+    // Every chunk first lands at its uncompressed position, which always
+    // has room for it, so chunks can be compressed concurrently
+    parallel_for(chunks, 1, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const size_t offset = i * kChunkSize;
+            const size_t len = input_len - offset < kChunkSize ? input_len - offset : kChunkSize;
+            const size_t stored = codec == COMPRESSION_DEFLATE
+                ? deflate_chunk(input + offset, len, data + offset) : 0;
+            if (stored) {
+                store_le32(table + i * kEntrySize, stored);
+            } else {
+                std::memcpy(data + offset, input + offset, len);
+                store_le32(table + i * kEntrySize, len | kRawChunkFlag);
+            }
+        }
+    });
+
+    // Close the gaps left by chunks that shrank
+    size_t cursor = 0;
+    for (size_t i = 0; i < chunks; ++i) {
+        const size_t stored = load_le32(table + i * kEntrySize) & ~kRawChunkFlag;
+        if (cursor != i * kChunkSize) {
+            std::memmove(data + cursor, data + i * kChunkSize, stored);
+        }
+        cursor += stored;
+    }
+    return static_cast<size_t>(data - frame) + cursor;
+}
+
+bool compressed_frame_size(const unsigned char* frame, size_t frame_len, size_t* original_len) {
+    if (frame_len < kHeaderSize || std::memcmp(frame, kFrameMagic, sizeof(kFrameMagic)) != 0) {
+        return false;
+    }
+    if (frame[4] != COMPRESSION_NONE && frame[4] != COMPRESSION_DEFLATE) {
+        return false;
+    }
+    const size_t chunk_size = load_le32(frame + 8);
+    if (chunk_size == 0 || chunk_size > kMaxChunkSize) {
+        return false;
+    }
+    *original_len = load_le32(frame + 12);
+    return true;
+}
+
+int compressed_frame_codec(const unsigned char* frame) {
+    return frame[4];
+}
+
+bool decompress_frame(const unsigned char* frame, size_t frame_len,
+                      unsigned char* output, int threads) {
+    size_t original_len = 0;
+    if (!compressed_frame_size(frame, frame_len, &original_len)) {
+        return false;
+    }
+    const int codec = frame[4];
+    const size_t chunk_size = load_le32(frame + 8);
+    const size_t chunks = (original_len + chunk_size - 1) / chunk_size;
+    if (chunks > (frame_len - kHeaderSize) / kEntrySize) {
+        return false;
+    }
+
+    const unsigned char* table = frame + kHeaderSize;
+    const unsigned char* data = table + chunks * kEntrySize;
+    const size_t data_len = frame_len - kHeaderSize - chunks * kEntrySize;
+
+    // Validate the table and check the chunks exactly fill the frame
+    std::vector<size_t> positions(chunks);
+    size_t total = 0;
+    for (size_t i = 0; i < chunks; ++i) {
+        const size_t entry = load_le32(table + i * kEntrySize);
+        const size_t stored = entry & ~kRawChunkFlag;
+        const size_t len = original_len - i * chunk_size < chunk_size
+            ? original_len - i * chunk_size : chunk_size;
+        const bool raw = (entry & kRawChunkFlag) != 0;
+        if (raw ? stored != len : (stored == 0 || stored >= len || codec != COMPRESSION_DEFLATE)) {
+            return false;
+        }
+        positions[i] = total;
+        total += stored;
+        if (total > data_len) {
+            return false;
+        }
+    }
+    if (total != data_len) {
+        return false;
+    }
+
+    std::atomic<bool> intact(true);
+    parallel_for(chunks, 1, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const size_t entry = load_le32(table + i * kEntrySize);
+            const size_t stored = entry & ~kRawChunkFlag;
+            const size_t offset = i * chunk_size;
+            const size_t len = original_len - offset < chunk_size ? original_len - offset : chunk_size;
+            if (entry & kRawChunkFlag) {
+                std::memcpy(output + offset, data + positions[i], len);
+            } else if (!inflate_chunk(data + positions[i], stored, output + offset, len)) {
+                intact.store(false, std::memory_order_relaxed);
+            }
+        }
+    });
+    return intact.load();
+}
@@ -0,0 +1,49 @@
+/*
+ * crypto_compress.h - Compression stage ahead of encryption
+ *
+ * Ciphertext does not compress, so text-like data (logs, CSV, dumps) is
+ * compressed before it reaches the cipher. The input is cut into fixed-size
+ * chunks that are compressed independently, in parallel, into a frame:
+ *
+ *   header   "CTZ" 0x01 | codec (1) | reserved (3) | chunk size (4) | original length (4)
+ *   table    one 4-byte entry per chunk: stored length, top bit set if stored raw
+ *   chunks   the stored chunks back to back
+ *
+ * All integers are little endian. Chunks whose sampled byte entropy shows
+ * they would not shrink (already compressed or encrypted data) are copied
+ * raw without running the compressor, as are chunks that did not get
+ * smaller.
+ */
+
+#ifndef CRYPTO_COMPRESS_H
+#define CRYPTO_COMPRESS_H
+
+#include <cstddef>
+
+// Compression codecs (recorded in the frame header)
+enum CompressionCodec {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_DEFLATE = 1
+};
+
+// Largest frame compress_frame can produce for `input_len` bytes
+size_t compress_frame_bound(size_t input_len);
+
+// Compresses `input` into `frame`, which must hold compress_frame_bound(input_len)
+// bytes, using up to `threads` threads (0 = hardware threads). Returns the
+// frame length.
+size_t compress_frame(int codec, const unsigned char* input, size_t input_len,
+                      unsigned char* frame, int threads);
+
+// Reads the original data length from a frame; false if the header is invalid
+bool compressed_frame_size(const unsigned char* frame, size_t frame_len, size_t* original_len);
+
+// Codec recorded in a frame header that compressed_frame_size accepts
+int compressed_frame_codec(const unsigned char* frame);
+
+// Restores the original data into `output`, which must hold
+// compressed_frame_size bytes. Returns false if the frame is malformed.
+bool decompress_frame(const unsigned char* frame, size_t frame_len,
+                      unsigned char* output, int threads);
+
+#endif // CRYPTO_COMPRESS_H
@@ -0,0 +1,235 @@
+/*
+ * crypto_fs.cpp - Directory walking and file access for the crypto bridge
+ */
+
+// 64-bit file offsets on 32-bit POSIX targets (armeabi-v7a, x86)
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "crypto_fs.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static const char kNativeSeparator = '\\';
+#else
+static const char kNativeSeparator = '/';
+#endif
+
+static bool entry_less(const FsEntry& a, const FsEntry& b) {
+    return a.path < b.path;
+}
+
+static bool is_separator(char c) {
+    return c == '/' || c == kNativeSeparator;
+}
+
+// Appends the entries of one directory; subdirectories go to `pending`
+static bool list_directory(const std::string& root, const std::string& relative,
+                           std::vector<FsEntry>* entries, std::vector<std::string>* pending) {
+    const std::string directory = relative.empty() ? root : fs_join(root, relative);
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA((directory + "\\*").c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        const std::string name = data.cFileName;
+        if (name == "." || name == ".." || (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+            continue;
+        }
+        FsEntry entry;
+        entry.path = relative.empty() ? name : relative + "/" + name;
+        entry.directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        entry.size = entry.directory ? 0
+            : (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        if (entry.directory) {
+            pending->push_back(entry.path);
+        }
+        entries->push_back(entry);
+    } while (FindNextFileA(handle, &data));
+    FindClose(handle);
+    return true;
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return false;
+    }
+    while (struct dirent* item = readdir(dir)) {
+        const std::string name = item->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        struct stat info;
+        if (lstat(fs_join(directory, name).c_str(), &info) != 0) {
+            continue;
+        }
+        if (!S_ISREG(info.st_mode) && !S_ISDIR(info.st_mode)) {
+            continue;
+        }
+        FsEntry entry;
+        entry.path = relative.empty() ? name : relative + "/" + name;
+        entry.directory = S_ISDIR(info.st_mode);
+        entry.size = entry.directory ? 0 : static_cast<unsigned long long>(info.st_size);
+        if (entry.directory) {
+            pending->push_back(entry.path);
+        }
+        entries->push_back(entry);
+    }
+    closedir(dir);
+    return true;
+#endif
+}
+
+bool fs_walk(const std::string& root, std::vector<FsEntry>* entries) {
+    entries->clear();
+    std::vector<std::string> pending(1, std::string());
+    while (!pending.empty()) {
+        const std::string relative = pending.back();
+        pending.pop_back();
+        // A subdirectory that vanished or is unreadable fails the walk too,
+        // so a tree is never processed with files silently missing
+        if (!list_directory(root, relative, entries, &pending)) {
+            return false;
+        }
+    }
+    std::sort(entries->begin(), entries->end(), entry_less);
+    return true;
+}
+
+std::string fs_join(const std::string& directory, const std::string& relative) {
+    if (directory.empty()) {
+        return relative;
+    }
+    std::string result = directory;
+    if (!is_separator(result[result.size() - 1])) {
+        result += kNativeSeparator;
+    }
+    for (size_t i = 0; i < relative.size(); ++i) {
+        result += relative[i] == '/' ? kNativeSeparator : relative[i];
+    }
+    return result;
+}
+
+bool fs_is_directory(const std::string& path) {
+#ifdef _WIN32
+    const DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+bool fs_make_directories(const std::string& path) {
+    if (path.empty() || fs_is_directory(path)) {
+        return !path.empty();
+    }
+
+    // Create each missing component from the top down
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i < path.size() && !is_separator(path[i])) {
+            continue;
+        }
+        const std::string prefix = path.substr(0, i);
+        if (fs_is_directory(prefix)) {
+            continue;
+        }
+#ifdef _WIN32
+        if (!CreateDirectoryA(prefix.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) {
+            return false;
+        }
+#else
+        if (mkdir(prefix.c_str(), 0777) != 0 && errno != EEXIST) {
+            return false;
+        }
+#endif
+    }
+    return fs_is_directory(path);
+}
+
+std::FILE* fs_open(const std::string& path, const char* mode) {
+    return std::fopen(path.c_str(), mode);
+}
+
+bool fs_seek(std::FILE* file, unsigned long long offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool fs_remove(const std::string& path) {
+    return std::remove(path.c_str()) == 0;
+}
+
+bool fs_exists(const std::string& path) {
+#ifdef _WIN32
+    return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+#endif
+}
+
+bool fs_rename(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool fs_file_size(const std::string& path, unsigned long long* size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+    *size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return false;
+    }
+    *size = static_cast<unsigned long long>(info.st_size);
+#endif
+    return true;
+}
+
+bool fs_truncate(std::FILE* file, unsigned long long size) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+    return ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool fs_sync(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
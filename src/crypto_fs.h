@@ -0,0 +1,88 @@
+/*
+ * crypto_fs.h - Directory walking and file access for the crypto bridge
+ *
+ * The tree and archive APIs read whole directory trees natively, so the
+ * caller does not pay one FFI round trip per file. Paths are narrow strings
+ * in the platform's native encoding; relative paths always use '/' as the
+ * separator. Only regular files and directories are visited: symbolic
+ * links, devices and sockets are skipped, which also rules out cycles.
+ */
+
+#ifndef CRYPTO_FS_H
+#define CRYPTO_FS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// One item found below a walked root
+struct FsEntry {
+    std::string path;         // Relative to the root, '/' separated
+    unsigned long long size;  // File size in bytes (0 for directories)
+    bool directory;
+};
+
+// Lists every file and directory below `root`, sorted by path so that a
+// directory comes before its contents. False if `root` cannot be read.
+bool fs_walk(const std::string& root, std::vector<FsEntry>* entries);
+
+// Joins a directory and a relative '/' separated path
+std::string fs_join(const std::string& directory, const std::string& relative);
+
+// Creates `path` and any missing parents; true if it exists afterwards
+bool fs_make_directories(const std::string& path);
+
+// True if `path` names an existing directory
+bool fs_is_directory(const std::string& path);
+
+// fopen for large files
+std::FILE* fs_open(const std::string& path, const char* mode);
+
+// Moves to an absolute byte offset; offsets past 2 GiB work on every platform
+bool fs_seek(std::FILE* file, unsigned long long offset);
+
+// Deletes a file; false if it did not exist or could not be removed
+bool fs_remove(const std::string& path);
+
+// True if `path` names an existing file or directory
+bool fs_exists(const std::string& path);
+
+// Renames a file, replacing `to` if it exists
+bool fs_rename(const std::string& from, const std::string& to);
+
+// Size of a regular file; false if it cannot be read
+bool fs_file_size(const std::string& path, unsigned long long* size);
+
+// Flushes an open file and cuts it to `size` bytes
+bool fs_truncate(std::FILE* file, unsigned long long size);
+
+// Flushes an open file and waits until the system has it on disk
+bool fs_sync(std::FILE* file);
+
+// Open file closed when the scope exits
+class FsFile {
+public:
+    FsFile(const std::string& path, const char* mode) : file_(fs_open(path, mode)) {}
+    ~FsFile() {
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    std::FILE* get() const { return file_; }
+
+    // Closes the file now; false if buffered writes could not be flushed
+    bool close() {
+        std::FILE* file = file_;
+        file_ = nullptr;
+        return file && std::fclose(file) == 0;
+    }
+
+private:
+    FsFile(const FsFile&);
+    FsFile& operator=(const FsFile&);
+
+    std::FILE* file_;
+};
+
+#endif // CRYPTO_FS_H
@@ -0,0 +1,193 @@
+/*
+ * crypto_hash.cpp - Message digests for the crypto bridge
+ */
+
+#include "crypto_hash.h"
+#include "crypto_buffer_pool.h"
+#include "crypto_parallel.h"
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+// Bytes per tree leaf
+static const size_t kLeafSize = 1024 * 1024;
+
+// File reads are a whole number of leaves, so read boundaries never split one
+static const size_t kFileBlockSize = 8 * kLeafSize;
+
+static const unsigned char kLeafPrefix = 0x00;
+static const unsigned char kNodePrefix = 0x01;
+
+static CryptoPP::HashTransformation* new_hash(int algorithm) {
+    switch (algorithm) {
+        case HASH_SHA256:
+            return new CryptoPP::SHA256;
+        case HASH_SHA512:
+            return new CryptoPP::SHA512;
+        case HASH_SHA3_256:
+            return new CryptoPP::SHA3_256;
+        case HASH_SHA3_512:
+            return new CryptoPP::SHA3_512;
+        case HASH_BLAKE2B:
+            return new CryptoPP::BLAKE2b;
+        default:
+            return nullptr;
+    }
+}
+
+int hash_digest_size(int algorithm) {
+    switch (algorithm) {
+        case HASH_SHA256:
+        case HASH_SHA3_256:
+            return 32;
+        case HASH_SHA512:
+        case HASH_SHA3_512:
+        case HASH_BLAKE2B:
+            return 64;
+        default:
+            return 0;
+    }
+}
+
+DigestStage::DigestStage(int algorithm, int mode, int threads)
+    : algorithm_(algorithm),
+      mode_(mode),
+      threads_(threads),
+      hash_(new_hash(algorithm)),
+      leaf_fill_(0) {
+    if (mode_ == HASH_MODE_TREE) {
+        start_leaf();
+    }
+}
+
+unsigned int DigestStage::digest_size() const {
+    return static_cast<unsigned int>(hash_digest_size(algorithm_));
+}
+
+void DigestStage::start_leaf() {
+    hash_->Update(&kLeafPrefix, 1);
+    leaf_fill_ = 0;
+}
+
+void DigestStage::finish_leaf() {
+    const size_t offset = leaves_.size();
+    leaves_.resize(offset + digest_size());
+    hash_->Final(&leaves_[offset]);
+}
+
+void DigestStage::update(const unsigned char* data, size_t len) {
+    if (mode_ != HASH_MODE_TREE) {
+        hash_->Update(data, len);
+        return;
+    }
+
+    while (len > 0) {
+        if (leaf_fill_ == kLeafSize) {
+            finish_leaf();
+            start_leaf();
+        }
+
+        // Whole leaves at a leaf boundary are hashed in parallel
+        if (leaf_fill_ == 0 && len > kLeafSize) {
+            // Keep the last leaf open: it may continue in the next update
+            const size_t count = (len - 1) / kLeafSize;
+            const size_t digest_len = digest_size();
+            const size_t offset = leaves_.size();
+            leaves_.resize(offset + count * digest_len);
+            unsigned char* out = &leaves_[offset];
+
+            parallel_for(count, 1, threads_, [&](size_t begin, size_t end) {
+                std::unique_ptr<CryptoPP::HashTransformation> leaf(new_hash(algorithm_));
+                for (size_t i = begin; i < end; ++i) {
+                    leaf->Update(&kLeafPrefix, 1);
+                    leaf->Update(data + i * kLeafSize, kLeafSize);
+                    leaf->Final(out + i * digest_len);
+                }
+            });
+            data += count * kLeafSize;
+            len -= count * kLeafSize;
+        }
+
+        const size_t take = len < kLeafSize - leaf_fill_ ? len : kLeafSize - leaf_fill_;
+        hash_->Update(data, take);
+        leaf_fill_ += take;
+        data += take;
+        len -= take;
+    }
+}
+
+void DigestStage::restart() {
+    hash_->Restart();
+    leaves_.clear();
+    leaf_fill_ = 0;
+    if (mode_ == HASH_MODE_TREE) {
+        start_leaf();
+    }
+}
+
+void DigestStage::final(unsigned char* digest) {
+    if (mode_ != HASH_MODE_TREE) {
+        hash_->Final(digest);
+        return;
+    }
+
+    // The open leaf is the last one (an empty input has a single empty leaf)
+    finish_leaf();
+
+    const size_t digest_len = digest_size();
+    size_t nodes = leaves_.size() / digest_len;
+    unsigned char* level = &leaves_[0];
+    while (nodes > 1) {
+        size_t parents = 0;
+        for (size_t i = 0; i + 1 < nodes; i += 2) {
+            hash_->Update(&kNodePrefix, 1);
+            hash_->Update(level + i * digest_len, 2 * digest_len);
+            hash_->Final(level + parents * digest_len);
+            ++parents;
+        }
+        if (nodes % 2) {
+            std::memmove(level + parents * digest_len, level + (nodes - 1) * digest_len, digest_len);
+            ++parents;
+        }
+        nodes = parents;
+    }
+    std::memcpy(digest, level, digest_len);
+}
+
+bool hash_file(int algorithm, int mode, const char* path, int threads, unsigned char* digest) {
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    CryptoBufferPool& pool = CryptoBufferPool::instance();
+    unsigned char* buffer = pool.acquire(kFileBlockSize, BUFFER_FLAG_HUGE_PAGES);
+    if (!buffer) {
+        std::fclose(file);
+        throw std::bad_alloc();
+    }
+
+    bool ok = true;
+    try {
+        DigestStage stage(algorithm, mode, threads);
+        for (;;) {
+            const size_t got = std::fread(buffer, 1, kFileBlockSize, file);
+            stage.update(buffer, got);
+            if (got < kFileBlockSize) {
+                ok = std::ferror(file) == 0;
+                break;
+            }
+        }
+        if (ok) {
+            stage.final(digest);
+        }
+    } catch (...) {
+        pool.release(buffer);
+        std::fclose(file);
+        throw;
+    }
+
+    pool.release(buffer);
+    std::fclose(file);
+    return ok;
+}
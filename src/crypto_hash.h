@@ -0,0 +1,81 @@
+/*
+ * crypto_hash.h - Message digests for the crypto bridge
+ *
+ * Plain mode is the standard digest of the data. Tree mode splits the data
+ * into 1 MiB leaves that are hashed independently (and in parallel), then
+ * combines them pairwise up to a single root:
+ *
+ *   leaf   = H(0x00 || chunk)
+ *   parent = H(0x01 || left || right)   (an odd node moves up unchanged)
+ *
+ * Tree digests are therefore not equal to plain digests of the same data,
+ * but any run over the same bytes produces the same root, whether the data
+ * arrived in one buffer, from a file, or slice by slice from the encrypt
+ * pipeline.
+ */
+
+#ifndef CRYPTO_HASH_H
+#define CRYPTO_HASH_H
+
+#include "crypto_compat.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Digest algorithms
+enum HashAlgorithm {
+    HASH_SHA256 = 1,
+    HASH_SHA512 = 2,
+    HASH_SHA3_256 = 3,
+    HASH_SHA3_512 = 4,
+    HASH_BLAKE2B = 5
+};
+
+// Digest construction
+enum HashMode {
+    HASH_MODE_PLAIN = 0,
+    HASH_MODE_TREE = 1
+};
+
+// Largest digest any algorithm produces
+static const int HASH_MAX_DIGEST_SIZE = 64;
+
+// Digest length in bytes, or 0 for an unknown algorithm
+int hash_digest_size(int algorithm);
+
+// Incremental digest over data fed in any number of pieces
+class DigestStage {
+public:
+    // `threads` bounds the workers used for whole leaves in tree mode
+    // (0 = hardware threads). The algorithm and mode must be valid.
+    DigestStage(int algorithm, int mode, int threads);
+
+    void update(const unsigned char* data, size_t len);
+
+    // Drops everything fed so far, as if newly constructed
+    void restart();
+
+    // Writes digest_size() bytes; the stage cannot be updated afterwards
+    void final(unsigned char* digest);
+
+    unsigned int digest_size() const;
+
+private:
+    DigestStage(const DigestStage&);
+    DigestStage& operator=(const DigestStage&);
+
+    void start_leaf();
+    void finish_leaf();
+
+    int algorithm_;
+    int mode_;
+    int threads_;
+    std::unique_ptr<CryptoPP::HashTransformation> hash_;
+    size_t leaf_fill_;
+    std::vector<unsigned char> leaves_;  // Finished leaf digests, back to back
+};
+
+// Digest of the file at `path`; false if it cannot be opened or read
+bool hash_file(int algorithm, int mode, const char* path, int threads, unsigned char* digest);
+
+#endif // CRYPTO_HASH_H
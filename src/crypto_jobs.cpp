@@ -0,0 +1,519 @@
+/*
+ * crypto_jobs.cpp - Background jobs for the crypto bridge: the job queue,
+ * and the buffer and tree jobs the bridge submits to it
+ */
+
+#include "crypto_jobs.h"
+#include "crypto_bridge_internal.h"
+#include "crypto_buffer_pool.h"
+#include "crypto_secure_pool.h"
+#include "crypto_topology.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Slots reserved for small jobs, on top of the shared ones
+static const size_t kFastLaneSlots = 1;
+
+// The parts of Dart_CObject (dart_native_api.h) needed to post an Int64List
+static const int kDartCObjectTypedData = 7;  // Dart_CObject_kTypedData
+static const int kDartTypedDataInt64 = 8;    // Dart_TypedData_kInt64
+
+struct DartCObject {
+    int type;
+    union {
+        struct {
+            int type;
+            intptr_t length;  // In elements
+            const uint8_t* values;
+        } as_typed_data;
+        void* reserved[5];  // Size of the largest member of the real union
+    } value;
+};
+
+static std::atomic<DartPostCObject> dart_post(nullptr);
+
+JobQueue& JobQueue::instance() {
+    // Never destroyed: detached workers may still be running at exit
+    static JobQueue* queue = new JobQueue();
+    return *queue;
+}
+
+JobQueue::JobQueue()
+    : next_id_(1),
+      concurrency_(JOB_DEFAULT_CONCURRENCY),
+      shared_running_(0),
+      fast_running_(0),
+      threads_(0),
+      idle_(0) {
+}
+
+long long JobQueue::submit(const JobBody& body, const JobListener& listener,
+                           int priority, unsigned long long size) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->body = body;
+    job->listener = listener;
+    job->priority = priority;
+    job->small = size <= JOB_FAST_LANE_BYTES;
+    job->lane = LANE_NONE;
+    job->cancelled = false;
+    job->paused = false;
+    job->status = JOB_STATUS_PENDING;
+    job->done = 0;
+    job->total = 0;
+    job->result = nullptr;
+    job->result_len = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (threads_ == 0) {
+        // The first worker is started here so that a failure reaches the
+        // caller; later ones are started by dispatch() as needed
+        std::thread(&JobQueue::worker_main, this).detach();
+        ++threads_;
+        ++idle_;
+    }
+    job->id = next_id_++;
+    jobs_[job->id] = job;
+
+    // Highest priority first, in submission order within a priority
+    std::vector<std::shared_ptr<Job> >::iterator it = pending_.begin();
+    while (it != pending_.end() && (*it)->priority >= priority) {
+        ++it;
+    }
+    pending_.insert(it, job);
+    dispatch();
+    return job->id;
+}
+
+bool JobQueue::poll(long long id, int* status, long long* done, long long* total) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<long long, std::shared_ptr<Job> >::iterator it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return false;
+    }
+    *status = it->second->status;
+    *done = it->second->done;
+    *total = it->second->total;
+    return true;
+}
+
+bool JobQueue::cancel(long long id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<long long, std::shared_ptr<Job> >::iterator it = jobs_.find(id);
+    if (it == jobs_.end() || it->second->status != JOB_STATUS_PENDING) {
+        return false;
+    }
+    it->second->cancelled = true;
+    dispatch();
+    return true;
+}
+
+void JobQueue::set_concurrency(int jobs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    concurrency_ = static_cast<size_t>(std::max(1, std::min(jobs, JOB_MAX_CONCURRENCY)));
+    dispatch();
+}
+
+bool JobQueue::take_result(long long id, unsigned char** data, size_t* len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<long long, std::shared_ptr<Job> >::iterator it = jobs_.find(id);
+    if (it == jobs_.end() || it->second->status == JOB_STATUS_PENDING || !it->second->result) {
+        return false;
+    }
+    *data = it->second->result;
+    *len = it->second->result_len;
+    it->second->result = nullptr;
+    it->second->result_len = 0;
+    return true;
+}
+
+bool JobQueue::release(long long id) {
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unordered_map<long long, std::shared_ptr<Job> >::iterator it = jobs_.find(id);
+        if (it == jobs_.end() || it->second->status == JOB_STATUS_PENDING) {
+            return false;
+        }
+        job = it->second;
+        jobs_.erase(it);
+    }
+    CryptoBufferPool::free_result(job->result);
+    job->result = nullptr;
+    return true;
+}
+
+bool JobQueue::acquire_lane(Job& job) {
+    if (job.small && fast_running_ < kFastLaneSlots) {
+        job.lane = LANE_FAST;
+        ++fast_running_;
+        return true;
+    }
+    if (shared_running_ < concurrency_) {
+        job.lane = LANE_SHARED;
+        ++shared_running_;
+        return true;
+    }
+    return false;
+}
+
+void JobQueue::release_lane(Job& job) {
+    if (job.lane == LANE_FAST) {
+        --fast_running_;
+    } else if (job.lane == LANE_SHARED) {
+        --shared_running_;
+    }
+    job.lane = LANE_NONE;
+}
+
+// A queued job can start if it was cancelled (it then only reports), if
+// the fast lane takes it, or if a shared slot is free and no paused job of
+// at least its priority is waiting for that slot
+bool JobQueue::can_start(const Job& job) const {
+    if (job.cancelled || (job.small && fast_running_ < kFastLaneSlots)) {
+        return true;
+    }
+    if (shared_running_ >= concurrency_) {
+        return false;
+    }
+    for (size_t i = 0; i < paused_.size(); ++i) {
+        if (!paused_[i]->cancelled && paused_[i]->priority >= job.priority) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if a queued job of higher priority than `job` has no slot to start in
+bool JobQueue::should_yield(const Job& job) const {
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (!pending_[i]->cancelled && pending_[i]->priority > job.priority &&
+            !can_start(*pending_[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// True if a job of higher priority than `job` is waiting: queued, or
+// paused for a slot
+bool JobQueue::outranked(const Job& job) const {
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (!pending_[i]->cancelled && pending_[i]->priority > job.priority) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < paused_.size(); ++i) {
+        if (paused_[i].get() != &job && !paused_[i]->cancelled &&
+            paused_[i]->priority > job.priority) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<JobQueue::Job> JobQueue::take_next() {
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (!can_start(*pending_[i])) {
+            continue;
+        }
+        std::shared_ptr<Job> job = pending_[i];
+        pending_.erase(pending_.begin() + static_cast<std::ptrdiff_t>(i));
+        if (!job->cancelled) {
+            acquire_lane(*job);
+        }
+        return job;
+    }
+    return std::shared_ptr<Job>();
+}
+
+// Wakes paused jobs to recheck their slot, and gets a worker to the next
+// job that can start
+void JobQueue::dispatch() {
+    resumed_.notify_all();
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (!can_start(*pending_[i])) {
+            continue;
+        }
+        if (idle_ > 0) {
+            ready_.notify_one();
+            return;
+        }
+        try {
+            std::thread(&JobQueue::worker_main, this).detach();
+            ++threads_;
+            ++idle_;
+        } catch (...) {
+            // The job starts when a running worker comes free
+        }
+        return;
+    }
+}
+
+void JobQueue::worker_main() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Counted as idle by whoever started this thread
+    for (;;) {
+        std::shared_ptr<Job> job = take_next();
+        if (!job) {
+            ready_.wait(lock);
+            continue;
+        }
+        --idle_;
+        dispatch();
+        lock.unlock();
+        // Per job, so that a new core limit reaches running workers
+        pin_io_thread();
+        run(job);
+        lock.lock();
+    }
+}
+
+void JobQueue::run(const std::shared_ptr<Job>& job) {
+    int status = JOB_STATUS_CANCELLED;
+    {
+        // The body owns copies of the caller's arguments (the password
+        // among them), so it is destroyed before completion is announced
+        JobBody body;
+        body.swap(job->body);
+        bool cancelled = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelled = job->cancelled;
+        }
+        if (!cancelled) {
+            JobControl control(*this, job);
+            try {
+                status = body(control);
+            } catch (...) {
+                status = JOB_STATUS_FAILED;
+            }
+        }
+    }
+
+    long long done = 0;
+    long long total = 0;
+    JobListener listener;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        release_lane(*job);
+        job->status = status;
+        done = job->done;
+        total = job->total;
+        listener.swap(job->listener);
+        // This worker is about to look for its next job itself
+        ++idle_;
+        dispatch();
+    }
+    if (listener) {
+        listener(job->id, JOB_EVENT_DONE, status, done, total);
+    }
+}
+
+void JobControl::progress(long long done, long long total) {
+    JobListener listener;
+    {
+        std::lock_guard<std::mutex> lock(queue_.mutex_);
+        job_->done = done;
+        job_->total = total;
+        listener = job_->listener;
+    }
+    if (listener) {
+        listener(job_->id, JOB_EVENT_PROGRESS, JOB_STATUS_PENDING, done, total);
+    }
+}
+
+bool JobControl::checkpoint() {
+    std::unique_lock<std::mutex> lock(queue_.mutex_);
+    JobQueue::Job& job = *job_;
+    std::vector<std::shared_ptr<JobQueue::Job> >& paused = queue_.paused_;
+    for (;;) {
+        if (job.cancelled || !job.paused) {
+            if (job.paused) {
+                job.paused = false;
+                paused.erase(std::find(paused.begin(), paused.end(), job_));
+                queue_.dispatch();
+            }
+            if (job.cancelled) {
+                return false;
+            }
+            // Only shared slots are handed over; the fast lane is never
+            // short of small jobs for long
+            if (job.lane != JobQueue::LANE_SHARED || !queue_.should_yield(job)) {
+                return true;
+            }
+            queue_.release_lane(job);
+            job.paused = true;
+            paused.push_back(job_);
+            queue_.dispatch();
+        } else if (!queue_.outranked(job) && queue_.shared_running_ < queue_.concurrency_) {
+            // Threads of this job waiting here all resume with this slot
+            job.lane = JobQueue::LANE_SHARED;
+            ++queue_.shared_running_;
+            job.paused = false;
+            paused.erase(std::find(paused.begin(), paused.end(), job_));
+            queue_.dispatch();
+            return true;
+        }
+        queue_.resumed_.wait(lock);
+    }
+}
+
+void JobControl::set_result(unsigned char* data, size_t len) {
+    std::lock_guard<std::mutex> lock(queue_.mutex_);
+    CryptoBufferPool::free_result(job_->result);
+    job_->result = data;
+    job_->result_len = len;
+}
+
+void set_dart_post_cobject(DartPostCObject post) {
+    dart_post.store(post);
+}
+
+JobListener dart_port_listener(long long port) {
+    return [port](long long id, int event, int status, long long done, long long total) {
+        const DartPostCObject post = dart_post.load();
+        if (!post) {
+            return;
+        }
+        // Posting copies the values, so they can live on the stack
+        const int64_t values[5] = { id, event, status, done, total };
+        DartCObject message;
+        message.type = kDartCObjectTypedData;
+        message.value.as_typed_data.type = kDartTypedDataInt64;
+        message.value.as_typed_data.length = 5;
+        message.value.as_typed_data.values = reinterpret_cast<const uint8_t*>(values);
+        post(port, &message);
+    };
+}
+
+static long long submit_job(const CryptoBridgeContext& options, unsigned long long size,
+                            const JobBody& body, CryptoBridgeJobCallback callback,
+                            void* user_data);
+static int run_buffer_job(JobControl& control, const CryptoBridgeContext& options, int algorithm,
+                          int mode, int key_size_bits, int operation,
+                          const SecureBlock& password,
+                          const unsigned char* input_data, int input_len,
+                          unsigned char* iv, unsigned char* auth_tag);
+static void report_tree_job(long long files_done, long long files_total,
+                            long long bytes_done, long long bytes_total, void* user_data);
+
+// Body of crypto_bridge_job_process. The job keeps its own copy of the
+// options and the password, since the caller's may be gone by the time it
+// runs.
+long long submit_buffer_job(const CryptoBridgeContext& options, int algorithm, int mode,
+                            int key_size_bits, int operation,
+                            const char* password, int password_len,
+                            const unsigned char* input_data, int input_len,
+                            unsigned char* iv, unsigned char* auth_tag,
+                            CryptoBridgeJobCallback callback, void* user_data) {
+    std::shared_ptr<SecureBlock> secret = std::make_shared<SecureBlock>(
+        password, static_cast<size_t>(password_len));
+    return submit_job(options, static_cast<unsigned long long>(input_len),
+                      [=](JobControl& control) {
+        return guarded([&]() {
+            return run_buffer_job(control, options, algorithm, mode, key_size_bits, operation,
+                                  *secret, input_data, input_len, iv, auth_tag);
+        });
+    }, callback, user_data);
+}
+
+// Body of crypto_bridge_job_process_tree; the job reports the tree's byte
+// counts as its progress
+long long submit_tree_job(const CryptoBridgeContext& options, int algorithm, int mode,
+                          int key_size_bits, int operation,
+                          const char* password, int password_len,
+                          const char* source_dir, const char* dest_dir,
+                          CryptoBridgeJobCallback callback, void* user_data) {
+    std::shared_ptr<SecureBlock> secret = std::make_shared<SecureBlock>(
+        password, static_cast<size_t>(password_len));
+    const std::string source(source_dir);
+    const std::string target(dest_dir);
+    return submit_job(options, JOB_SIZE_UNKNOWN, [=](JobControl& control) {
+        return guarded([&]() {
+            return process_tree(options, algorithm, mode, key_size_bits, operation,
+                                reinterpret_cast<const char*>(secret->data()),
+                                static_cast<int>(secret->size()),
+                                source.c_str(), target.c_str(), report_tree_job, &control,
+                                &control);
+        });
+    }, callback, user_data);
+}
+
+// Sends a job's events to its C callback, or else to the context's Dart
+// port, and queues it at the context's priority. `size` is the input size
+// if known, which lets small jobs take the fast lane.
+static long long submit_job(const CryptoBridgeContext& options, unsigned long long size,
+                            const JobBody& body, CryptoBridgeJobCallback callback,
+                            void* user_data) {
+    JobListener listener;
+    if (callback) {
+        listener = [callback, user_data](long long id, int event, int status,
+                                         long long done, long long total) {
+            callback(id, event, status, done, total, user_data);
+        };
+    } else if (options.notify_port != 0) {
+        listener = dart_port_listener(options.notify_port);
+    }
+    return JobQueue::instance().submit(body, listener, options.job_priority, size);
+}
+
+// Runs a buffer job. The result is sized for padding and an
+// appended tag (or the worst-case compressed frame); a decompressed result
+// that turns out larger reports its size, and the call runs once more.
+static int run_buffer_job(JobControl& control, const CryptoBridgeContext& options, int algorithm,
+                          int mode, int key_size_bits, int operation,
+                          const SecureBlock& password,
+                          const unsigned char* input_data, int input_len,
+                          unsigned char* iv, unsigned char* auth_tag) {
+    // The worker sits on an I/O core; the cipher itself runs here
+    ComputeCorePin pin;
+    control.progress(0, input_len);
+
+    size_t capacity = static_cast<size_t>(input_len) + 2 * AUTH_TAG_SIZE;
+    if (options.compression != COMPRESSION_NONE && operation == OPERATION_ENCRYPT) {
+        capacity = compress_frame_bound(static_cast<size_t>(input_len)) + 2 * AUTH_TAG_SIZE;
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (!control.checkpoint()) {
+            return STATUS_CANCELLED;
+        }
+        if (capacity > static_cast<size_t>(INT_MAX)) {
+            return STATUS_INVALID_PARAMS;
+        }
+        std::unique_ptr<unsigned char, void (*)(void*)> result(
+            CryptoBufferPool::allocate_result(capacity), CryptoBufferPool::free_result);
+        if (!result) {
+            return STATUS_MEMORY_ERROR;
+        }
+
+        int result_len = static_cast<int>(capacity);
+        const int status = process_buffer(options, algorithm, mode, key_size_bits, operation,
+                                          reinterpret_cast<const char*>(password.data()),
+                                          static_cast<int>(password.size()),
+                                          input_data, input_len, result.get(), &result_len,
+                                          iv, auth_tag, nullptr, nullptr, nullptr);
+        if (status == STATUS_SUCCESS) {
+            control.set_result(result.release(), static_cast<size_t>(result_len));
+            control.progress(input_len, input_len);
+            return STATUS_SUCCESS;
+        }
+        if (status != STATUS_OUTPUT_BUFFER_TOO_SMALL ||
+            static_cast<size_t>(result_len) <= capacity) {
+            return status;
+        }
+        capacity = static_cast<size_t>(result_len);
+    }
+    return STATUS_OUTPUT_BUFFER_TOO_SMALL;
+}
+
+// Progress callback that forwards a tree job's byte counts to its job
+static void report_tree_job(long long, long long,
+                            long long bytes_done, long long bytes_total, void* user_data) {
+    static_cast<JobControl*>(user_data)->progress(bytes_done, bytes_total);
+}
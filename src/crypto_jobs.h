@@ -0,0 +1,200 @@
+/*
+ * crypto_jobs.h - Background jobs for the crypto bridge
+ *
+ * Every FFI entry point blocks its caller, and under Flutter the caller is
+ * the UI isolate. A job runs one such call on a native worker thread
+ * instead: submitting returns a job id at once, and the job's listener
+ * hears about progress and completion from the worker. Finished jobs keep
+ * their status and result until the caller releases them.
+ *
+ * Jobs run in priority order, at most a configurable number at a time.
+ * Small jobs also have a reserved fast lane, so an interactive request
+ * never queues behind bulk work. Long jobs call JobControl::checkpoint at
+ * chunk boundaries: there a cancelled job stops, and a job that a waiting
+ * job of higher priority outranks gives up its slot until that job has
+ * started.
+ *
+ * The queue knows nothing about ciphers. The buffer and tree jobs at the
+ * end of crypto_jobs.cpp wrap the bridge's calls into job bodies.
+ * Listeners are either plain C callbacks or, for Dart, a native port that
+ * receives each event as an Int64List through Dart_PostCObject.
+ */
+
+#ifndef CRYPTO_JOBS_H
+#define CRYPTO_JOBS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Status of a job that has not finished (mirrors CRYPTO_STATUS_PENDING)
+static const int JOB_STATUS_PENDING = 1;
+
+// Status of a job whose body threw (mirrors CRYPTO_STATUS_UNKNOWN_ERROR)
+static const int JOB_STATUS_FAILED = -9;
+
+// Status of a job cancelled before or while running (mirrors CRYPTO_STATUS_CANCELLED)
+static const int JOB_STATUS_CANCELLED = -11;
+
+// Jobs of at most this many input bytes may use the fast lane
+static const unsigned long long JOB_FAST_LANE_BYTES = 1024 * 1024;
+
+// Size hint for jobs whose input size is not known up front
+static const unsigned long long JOB_SIZE_UNKNOWN = ~0ULL;
+
+// Bounds and default of the number of jobs running at once, fast lane aside
+static const int JOB_MAX_CONCURRENCY = 64;
+static const int JOB_DEFAULT_CONCURRENCY = 2;
+
+// Events a listener receives (mirrors CryptoBridgeJobEvent)
+enum JobEvent {
+    JOB_EVENT_PROGRESS = 1,
+    JOB_EVENT_DONE = 2
+};
+
+// Priorities (mirrors CryptoBridgeJobPriority); higher runs first
+enum JobPriority {
+    JOB_PRIORITY_BACKGROUND = 0,
+    JOB_PRIORITY_NORMAL = 1,
+    JOB_PRIORITY_INTERACTIVE = 2
+};
+
+// Called on a worker thread. `status` is JOB_STATUS_PENDING for progress.
+typedef std::function<void(long long id, int event, int status,
+                           long long done, long long total)> JobListener;
+
+// Dart_PostCObject from dart_native_api.h, as handed out by NativeApi.postCObject
+typedef bool (*DartPostCObject)(long long port, void* message);
+
+class JobControl;
+
+// Runs on a worker thread and returns the job's final status; bridge
+// bodies map exceptions to status codes through guarded(), like every
+// entry point does
+typedef std::function<int(JobControl&)> JobBody;
+
+class JobQueue {
+public:
+    static JobQueue& instance();
+
+    // Queues a job and returns its id (> 0). `size` is the input size in
+    // bytes, or JOB_SIZE_UNKNOWN, and decides whether the job may use the
+    // fast lane. Throws if no worker thread can be started.
+    long long submit(const JobBody& body, const JobListener& listener,
+                     int priority, unsigned long long size);
+
+    // Status of a job (JOB_STATUS_PENDING until it finishes) and its latest
+    // progress; false if the id is unknown
+    bool poll(long long id, int* status, long long* done, long long* total);
+
+    // Asks a job to stop. A queued job finishes with JOB_STATUS_CANCELLED
+    // without running; a running one stops at its next checkpoint. False if
+    // the job is unknown or already finished.
+    bool cancel(long long id);
+
+    // Sets how many jobs may run at once outside the fast lane
+    void set_concurrency(int jobs);
+
+    // Hands the result of a finished job to the caller, who frees it with
+    // CryptoBufferPool::free_result. False if the job is unknown, still
+    // running, or has no result.
+    bool take_result(long long id, unsigned char** data, size_t* len);
+
+    // Forgets a finished job and frees a result nobody took; false if the
+    // job is unknown or still running
+    bool release(long long id);
+
+private:
+    friend class JobControl;
+
+    // Slot a job holds while it runs
+    enum Lane {
+        LANE_NONE,
+        LANE_FAST,
+        LANE_SHARED
+    };
+
+    struct Job {
+        long long id;
+        JobBody body;
+        JobListener listener;
+        int priority;
+        bool small;       // May use the fast lane
+        Lane lane;
+        bool cancelled;
+        bool paused;      // Gave up its slot at a checkpoint
+        int status;
+        long long done;
+        long long total;
+        unsigned char* result;
+        size_t result_len;
+    };
+
+    JobQueue();
+    JobQueue(const JobQueue&);
+    JobQueue& operator=(const JobQueue&);
+
+    void worker_main();
+    void run(const std::shared_ptr<Job>& job);
+
+    // All of these expect mutex_ to be held
+    bool acquire_lane(Job& job);
+    void release_lane(Job& job);
+    bool can_start(const Job& job) const;
+    bool should_yield(const Job& job) const;
+    bool outranked(const Job& job) const;
+    std::shared_ptr<Job> take_next();
+    void dispatch();
+
+    std::mutex mutex_;
+    std::condition_variable ready_;    // Workers waiting for a job
+    std::condition_variable resumed_;  // Paused jobs waiting for a slot
+    std::vector<std::shared_ptr<Job> > pending_;
+    std::vector<std::shared_ptr<Job> > paused_;
+    std::unordered_map<long long, std::shared_ptr<Job> > jobs_;
+    long long next_id_;
+    size_t concurrency_;
+    size_t shared_running_;
+    size_t fast_running_;
+    size_t threads_;
+    size_t idle_;
+};
+
+// What a running body can do with its job
+class JobControl {
+public:
+    // Records progress and passes it to the listener
+    void progress(long long done, long long total);
+
+    // Call at chunk boundaries, from any thread working for the job. Blocks
+    // while the job is paused for one of higher priority; false once the
+    // job is cancelled, in which case the body should return
+    // JOB_STATUS_CANCELLED.
+    bool checkpoint();
+
+    // Gives the job a result allocated with CryptoBufferPool::allocate_result
+    void set_result(unsigned char* data, size_t len);
+
+private:
+    friend class JobQueue;
+
+    JobControl(JobQueue& queue, const std::shared_ptr<JobQueue::Job>& job)
+        : queue_(queue), job_(job) {}
+    JobControl(const JobControl&);
+    JobControl& operator=(const JobControl&);
+
+    JobQueue& queue_;
+    std::shared_ptr<JobQueue::Job> job_;
+};
+
+// Registers Dart_PostCObject; port listeners drop events until it is set
+void set_dart_post_cobject(DartPostCObject post);
+
+// Listener that posts [id, event, status, done, total] to a Dart port
+JobListener dart_port_listener(long long port);
+
+#endif // CRYPTO_JOBS_H
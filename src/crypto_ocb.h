@@ -0,0 +1,276 @@
+/*
+ * crypto_ocb.h - OCB authenticated encryption (RFC 7253) for the crypto bridge
+ *
+ * Crypto++ ships GCM, EAX and CCM but no OCB. OCB authenticates while it
+ * encrypts: every block costs one cipher call plus a few XORs, and the
+ * per-block offsets are independent, so batches of blocks go through the
+ * cipher's pipelined AdvancedProcessBlocks path (AES-NI, ARMv8 AES, ...).
+ *
+ * OCB<Cipher>::Encryption / ::Decryption expose the subset of Crypto++'s
+ * AuthenticatedSymmetricCipher interface that run_aead uses, so the mode
+ * plugs into the bridge exactly like CryptoPP::GCM<Cipher>. Cipher must have
+ * a 128-bit block.
+ */
+
+#ifndef CRYPTO_OCB_H
+#define CRYPTO_OCB_H
+
+#include "crypto_compat.h"
+#include <cstddef>
+#include <cstring>
+
+template <class Cipher, bool Encrypt>
+class OCBCipher {
+public:
+    static const unsigned int kBlockSize = 16;
+    // RFC 7253 recommends 96-bit nonces; longer IVs contribute their first 12 bytes
+    static const unsigned int kNonceSize = 12;
+
+    OCBCipher() {}
+    ~OCBCipher() {
+        CryptoPP::SecureWipeBuffer(l_star_, kBlockSize);
+        CryptoPP::SecureWipeBuffer(l_dollar_, kBlockSize);
+        CryptoPP::SecureWipeBuffer(&l_[0][0], sizeof(l_));
+    }
+
+    unsigned int IVSize() const { return kNonceSize; }
+
+    // The nonce is taken per message by EncryptAndAuthenticate/DecryptAndVerify
+    void SetKeyWithIV(const CryptoPP::byte* key, size_t key_len,
+                      const CryptoPP::byte* iv, size_t iv_len) {
+        (void)iv;
+        (void)iv_len;
+        encryptor_.SetKey(key, key_len);
+        if (!Encrypt) {
+            decryptor_.SetKey(key, key_len);
+        }
+
+        // L_* = E_K(0^128), L_$ = double(L_*), L_i = double(L_{i-1})
+        std::memset(l_star_, 0, kBlockSize);
+        encryptor_.ProcessBlock(l_star_);
+        double_block(l_star_, l_dollar_);
+        double_block(l_dollar_, l_[0]);
+        for (int i = 1; i < kMaxL; ++i) {
+            double_block(l_[i - 1], l_[i]);
+        }
+    }
+
+    void EncryptAndAuthenticate(CryptoPP::byte* ciphertext, CryptoPP::byte* mac, size_t mac_size,
+                                const CryptoPP::byte* iv, int iv_len,
+                                const CryptoPP::byte* aad, size_t aad_len,
+                                const CryptoPP::byte* message, size_t message_len) {
+        CryptoPP::byte tag[kBlockSize];
+        crypt(iv, iv_len, mac_size, aad, aad_len, message, ciphertext, message_len, tag);
+        std::memcpy(mac, tag, mac_size);
+        CryptoPP::SecureWipeBuffer(tag, kBlockSize);
+    }
+
+    bool DecryptAndVerify(CryptoPP::byte* message, const CryptoPP::byte* mac, size_t mac_size,
+                          const CryptoPP::byte* iv, int iv_len,
+                          const CryptoPP::byte* aad, size_t aad_len,
+                          const CryptoPP::byte* ciphertext, size_t ciphertext_len) {
+        CryptoPP::byte tag[kBlockSize];
+        crypt(iv, iv_len, mac_size, aad, aad_len, ciphertext, message, ciphertext_len, tag);
+        const bool verified = CryptoPP::VerifyBufsEqual(tag, mac, mac_size);
+        CryptoPP::SecureWipeBuffer(tag, kBlockSize);
+        // Unauthenticated plaintext never reaches the caller
+        if (!verified) {
+            CryptoPP::SecureWipeBuffer(message, ciphertext_len);
+        }
+        return verified;
+    }
+
+private:
+    // Enough L_i for 2^32 blocks, far beyond the bridge's int-sized inputs
+    static const int kMaxL = 32;
+    // Blocks handed to the cipher per AdvancedProcessBlocks call
+    static const size_t kBatchBlocks = 16;
+
+    OCBCipher(const OCBCipher&);
+    OCBCipher& operator=(const OCBCipher&);
+
+    static void xor_block(CryptoPP::byte* out, const CryptoPP::byte* a, const CryptoPP::byte* b) {
+        for (unsigned int i = 0; i < kBlockSize; ++i) {
+            out[i] = a[i] ^ b[i];
+        }
+    }
+
+    // Multiplication by x in GF(2^128), big-endian as in RFC 7253
+    static void double_block(const CryptoPP::byte* in, CryptoPP::byte* out) {
+        const CryptoPP::byte carry = in[0] >> 7;
+        for (unsigned int i = 0; i < kBlockSize - 1; ++i) {
+            out[i] = static_cast<CryptoPP::byte>((in[i] << 1) | (in[i + 1] >> 7));
+        }
+        out[kBlockSize - 1] = static_cast<CryptoPP::byte>((in[kBlockSize - 1] << 1) ^ (carry * 0x87));
+    }
+
+    static int ntz(size_t value) {
+        int zeros = 0;
+        while ((value & 1) == 0) {
+            value >>= 1;
+            ++zeros;
+        }
+        return zeros;
+    }
+
+    // Offset_0 from the nonce (RFC 7253 section 4.2)
+    void initial_offset(const CryptoPP::byte* iv, int iv_len, size_t mac_size,
+                        CryptoPP::byte* offset) const {
+        const size_t nonce_len = iv_len < static_cast<int>(kNonceSize)
+            ? static_cast<size_t>(iv_len) : kNonceSize;
+
+        CryptoPP::byte nonce[kBlockSize];
+        std::memset(nonce, 0, kBlockSize);
+        nonce[0] = static_cast<CryptoPP::byte>(((mac_size * 8) % 128) << 1);
+        nonce[kBlockSize - 1 - nonce_len] |= 0x01;
+        std::memcpy(nonce + kBlockSize - nonce_len, iv, nonce_len);
+
+        const unsigned int bottom = nonce[kBlockSize - 1] & 0x3F;
+        nonce[kBlockSize - 1] &= 0xC0;
+
+        CryptoPP::byte stretch[kBlockSize + 8];
+        encryptor_.ProcessBlock(nonce, stretch);
+        for (unsigned int i = 0; i < 8; ++i) {
+            stretch[kBlockSize + i] = stretch[i] ^ stretch[i + 1];
+        }
+
+        const unsigned int byte_shift = bottom / 8;
+        const unsigned int bit_shift = bottom % 8;
+        for (unsigned int i = 0; i < kBlockSize; ++i) {
+            unsigned int value = static_cast<unsigned int>(stretch[i + byte_shift]) << bit_shift;
+            if (bit_shift) {
+                value |= stretch[i + byte_shift + 1] >> (8 - bit_shift);
+            }
+            offset[i] = static_cast<CryptoPP::byte>(value);
+        }
+        CryptoPP::SecureWipeBuffer(stretch, sizeof(stretch));
+    }
+
+    // HASH(K, A) from RFC 7253 section 4.1
+    void hash_aad(const CryptoPP::byte* aad, size_t aad_len, CryptoPP::byte* sum) const {
+        std::memset(sum, 0, kBlockSize);
+        if (!aad || aad_len == 0) {
+            return;
+        }
+
+        CryptoPP::byte offset[kBlockSize];
+        CryptoPP::byte block[kBlockSize];
+        std::memset(offset, 0, kBlockSize);
+
+        const size_t full_blocks = aad_len / kBlockSize;
+        for (size_t i = 1; i <= full_blocks; ++i) {
+            xor_block(offset, offset, l_[ntz(i)]);
+            xor_block(block, aad + (i - 1) * kBlockSize, offset);
+            encryptor_.ProcessBlock(block);
+            xor_block(sum, sum, block);
+        }
+
+        const size_t remaining = aad_len % kBlockSize;
+        if (remaining) {
+            xor_block(offset, offset, l_star_);
+            std::memset(block, 0, kBlockSize);
+            std::memcpy(block, aad + full_blocks * kBlockSize, remaining);
+            block[remaining] = 0x80;
+            xor_block(block, block, offset);
+            encryptor_.ProcessBlock(block);
+            xor_block(sum, sum, block);
+        }
+    }
+
+    // Encrypts or decrypts `len` bytes (in may equal out) and computes the full tag
+    void crypt(const CryptoPP::byte* iv, int iv_len, size_t mac_size,
+               const CryptoPP::byte* aad, size_t aad_len,
+               const CryptoPP::byte* in, CryptoPP::byte* out, size_t len,
+               CryptoPP::byte* tag) const {
+        CryptoPP::byte offset[kBlockSize];
+        CryptoPP::byte checksum[kBlockSize];
+        CryptoPP::byte offsets[kBatchBlocks * kBlockSize];
+        CryptoPP::byte blocks[kBatchBlocks * kBlockSize];
+
+        initial_offset(iv, iv_len, mac_size, offset);
+        std::memset(checksum, 0, kBlockSize);
+
+        const CryptoPP::BlockCipher& cipher = Encrypt
+            ? static_cast<const CryptoPP::BlockCipher&>(encryptor_)
+            : static_cast<const CryptoPP::BlockCipher&>(decryptor_);
+
+        // Full blocks: C_i = Offset_i xor E_K(P_i xor Offset_i), in batches
+        const size_t full_blocks = len / kBlockSize;
+        size_t index = 0;
+        while (index < full_blocks) {
+            const size_t batch = full_blocks - index < kBatchBlocks ? full_blocks - index : kBatchBlocks;
+            const CryptoPP::byte* src = in + index * kBlockSize;
+            CryptoPP::byte* dst = out + index * kBlockSize;
+
+            for (size_t j = 0; j < batch; ++j) {
+                xor_block(offset, offset, l_[ntz(index + j + 1)]);
+                std::memcpy(offsets + j * kBlockSize, offset, kBlockSize);
+                if (Encrypt) {
+                    xor_block(checksum, checksum, src + j * kBlockSize);
+                }
+                xor_block(blocks + j * kBlockSize, src + j * kBlockSize, offset);
+            }
+
+            cipher.AdvancedProcessBlocks(blocks, offsets, dst, batch * kBlockSize,
+                                         CryptoPP::BlockTransformation::BT_AllowParallel);
+
+            if (!Encrypt) {
+                for (size_t j = 0; j < batch; ++j) {
+                    xor_block(checksum, checksum, dst + j * kBlockSize);
+                }
+            }
+            index += batch;
+        }
+
+        // Final partial block: XOR with a pad derived from Offset_*
+        const size_t remaining = len % kBlockSize;
+        if (remaining) {
+            const CryptoPP::byte* src = in + full_blocks * kBlockSize;
+            CryptoPP::byte* dst = out + full_blocks * kBlockSize;
+            CryptoPP::byte pad[kBlockSize];
+
+            xor_block(offset, offset, l_star_);
+            encryptor_.ProcessBlock(offset, pad);
+
+            CryptoPP::byte last[kBlockSize];
+            std::memset(last, 0, kBlockSize);
+            for (size_t i = 0; i < remaining; ++i) {
+                last[i] = Encrypt ? src[i] : static_cast<CryptoPP::byte>(src[i] ^ pad[i]);
+                dst[i] = src[i] ^ pad[i];
+            }
+            last[remaining] = 0x80;
+            xor_block(checksum, checksum, last);
+
+            CryptoPP::SecureWipeBuffer(pad, kBlockSize);
+            CryptoPP::SecureWipeBuffer(last, kBlockSize);
+        }
+
+        // Tag = E_K(Checksum xor Offset xor L_$) xor HASH(K, A)
+        CryptoPP::byte aad_sum[kBlockSize];
+        hash_aad(aad, aad_len, aad_sum);
+        xor_block(tag, checksum, offset);
+        xor_block(tag, tag, l_dollar_);
+        encryptor_.ProcessBlock(tag);
+        xor_block(tag, tag, aad_sum);
+
+        CryptoPP::SecureWipeBuffer(offset, kBlockSize);
+        CryptoPP::SecureWipeBuffer(checksum, kBlockSize);
+        CryptoPP::SecureWipeBuffer(offsets, sizeof(offsets));
+        CryptoPP::SecureWipeBuffer(blocks, sizeof(blocks));
+    }
+
+    typename Cipher::Encryption encryptor_;
+    typename Cipher::Decryption decryptor_;
+    CryptoPP::byte l_star_[kBlockSize];
+    CryptoPP::byte l_dollar_[kBlockSize];
+    CryptoPP::byte l_[kMaxL][kBlockSize];
+};
+
+// Mirrors Crypto++'s mode naming: OCB<AES>::Encryption, OCB<AES>::Decryption
+template <class Cipher>
+struct OCB {
+    typedef OCBCipher<Cipher, true> Encryption;
+    typedef OCBCipher<Cipher, false> Decryption;
+};
+
+#endif // CRYPTO_OCB_H
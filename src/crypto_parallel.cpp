@@ -0,0 +1,343 @@
+/*
+ * crypto_parallel.cpp - Data-parallel loops for the crypto bridge
+ */
+
+#include "crypto_parallel.h"
+#include "crypto_topology.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Upper bound for explicit thread requests
+static const int kMaxThreads = 256;
+
+// Upper bound for the threads kept by the parallel_for pool
+static const size_t kMaxPoolThreads = kMaxThreads;
+
+// Tasks waiting for one parallel_tasks worker
+struct TaskQueue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+};
+
+// Next task for worker `self`: the front of its own queue, otherwise the
+// back of another worker's queue. False once every queue is empty.
+static bool next_task(std::vector<TaskQueue>& queues, size_t self, size_t* task) {
+    {
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+        if (!queues[self].tasks.empty()) {
+            *task = queues[self].tasks.front();
+            queues[self].tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        TaskQueue& victim = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+// One parallel_for call. The caller and the pool threads that join it
+// claim chunks from next_chunk. Helpers hold it by shared pointer, so one
+// that picks it up after the call returned finds no chunk left and never
+// reaches the caller's body.
+struct ParallelLoop {
+    ParallelLoop(const std::function<void(size_t, size_t)>& loop_body, size_t loop_count,
+                 size_t loop_grain, size_t loop_chunks)
+        : body(&loop_body),
+          count(loop_count),
+          grain(loop_grain),
+          chunks(loop_chunks),
+          next_chunk(0),
+          failed(false),
+          helpers(0) {}
+
+    const std::function<void(size_t, size_t)>* body;
+    size_t count;
+    size_t grain;
+    size_t chunks;
+    std::atomic<size_t> next_chunk;
+    std::atomic<bool> failed;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t helpers;                  // Pool threads working on the loop
+    std::exception_ptr first_error;
+};
+
+// Compute threads kept for parallel_for. They are started when a call asks
+// for more helpers than are idle, stay pinned to their core between calls,
+// and wait for the next loop instead of exiting.
+struct WorkerPool {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<ParallelLoop> > queue;  // One entry per helper wanted
+    size_t threads;
+    size_t idle;
+};
+
+static WorkerPool& worker_pool() {
+    // Never destroyed: its threads wait on it until the process exits
+    static WorkerPool* pool = []() {
+        WorkerPool* created = new WorkerPool();
+        created->threads = 0;
+        created->idle = 0;
+        return created;
+    }();
+    return *pool;
+}
+
+static void run_chunks(ParallelLoop& loop) {
+    while (!loop.failed.load(std::memory_order_relaxed)) {
+        const size_t chunk = loop.next_chunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= loop.chunks) {
+            return;
+        }
+        const size_t begin = chunk * loop.grain;
+        const size_t end = begin + loop.grain < loop.count ? begin + loop.grain : loop.count;
+        try {
+            (*loop.body)(begin, end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(loop.mutex);
+            if (!loop.first_error) {
+                loop.first_error = std::current_exception();
+            }
+            loop.failed.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+static void pool_thread_main() {
+    WorkerPool& pool = worker_pool();
+    unsigned int pinned_version = cpu_core_limit_version();
+    std::unique_ptr<ComputeCorePin> pin(new ComputeCorePin());
+
+    // Counted as idle from the moment it was started
+    for (;;) {
+        std::shared_ptr<ParallelLoop> loop;
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.wake.wait(lock, [&]() { return !pool.queue.empty(); });
+            --pool.idle;
+            loop = pool.queue.front();
+            pool.queue.pop_front();
+        }
+
+        // Follow a core limit set since this thread was pinned
+        const unsigned int version = cpu_core_limit_version();
+        if (version != pinned_version) {
+            pin.reset();
+            pin.reset(new ComputeCorePin());
+            pinned_version = version;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(loop->mutex);
+            ++loop->helpers;
+        }
+        run_chunks(*loop);
+
+        // Idle again before the caller returns, so its next call does not
+        // start threads for helpers that are about to be free
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            ++pool.idle;
+        }
+        std::lock_guard<std::mutex> lock(loop->mutex);
+        if (--loop->helpers == 0) {
+            loop->done.notify_all();
+        }
+    }
+}
+
+// Queues `helpers` requests to join `loop`, starting pool threads when
+// fewer are idle than requests are waiting
+static void offer_loop(const std::shared_ptr<ParallelLoop>& loop, size_t helpers) {
+    WorkerPool& pool = worker_pool();
+    size_t start = 0;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        for (size_t i = 0; i < helpers; ++i) {
+            pool.queue.push_back(loop);
+        }
+        const size_t waiting = pool.queue.size();
+        if (waiting > pool.idle) {
+            start = waiting - pool.idle;
+            if (start > kMaxPoolThreads - pool.threads) {
+                start = kMaxPoolThreads - pool.threads;
+            }
+            pool.threads += start;
+            pool.idle += start;
+        }
+    }
+    pool.wake.notify_all();
+
+    for (size_t i = 0; i < start; ++i) {
+        try {
+            std::thread(pool_thread_main).detach();
+        } catch (...) {
+            // The threads already running, and the caller, still drain the loop
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.threads -= start - i;
+            pool.idle -= start - i;
+            break;
+        }
+    }
+}
+
+// Drops the requests for `loop` that no pool thread has taken yet
+static void withdraw_loop(const std::shared_ptr<ParallelLoop>& loop) {
+    WorkerPool& pool = worker_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.queue.erase(std::remove(pool.queue.begin(), pool.queue.end(), loop), pool.queue.end());
+}
+
+int resolve_thread_count(int requested) {
+    if (requested > 0) {
+        return requested < kMaxThreads ? requested : kMaxThreads;
+    }
+    return cpu_core_count();
+}
+
+void parallel_for(size_t count, size_t grain, int threads,
+                  const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    const size_t chunks = (count + grain - 1) / grain;
+    size_t workers = static_cast<size_t>(resolve_thread_count(threads));
+    if (workers > chunks) {
+        workers = chunks;
+    }
+    if (workers <= 1) {
+        body(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelLoop> loop = std::make_shared<ParallelLoop>(body, count, grain, chunks);
+    offer_loop(loop, workers - 1);
+
+    // The calling thread is left where it is and claims chunks like the
+    // helpers, so the range drains even if no helper ever joins
+    run_chunks(*loop);
+    withdraw_loop(loop);
+    {
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->done.wait(lock, [&]() { return loop->helpers == 0; });
+    }
+
+    if (loop->first_error) {
+        std::rethrow_exception(loop->first_error);
+    }
+}
+
+void parallel_tasks(size_t count, int threads, const std::function<void(size_t)>& task,
+                    const std::function<void()>& on_wait, int wait_interval_ms) {
+    if (count == 0) {
+        return;
+    }
+
+    size_t workers = static_cast<size_t>(resolve_thread_count(threads));
+    if (workers > count) {
+        workers = count;
+    }
+
+    // Contiguous runs keep neighbouring tasks on one worker
+    std::vector<TaskQueue> queues(workers);
+    for (size_t w = 0; w < workers; ++w) {
+        for (size_t i = count * w / workers; i < count * (w + 1) / workers; ++i) {
+            queues[w].tasks.push_back(i);
+        }
+    }
+
+    std::atomic<bool> failed(false);
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+
+    std::function<void(size_t)> worker = [&](size_t self) {
+        size_t index = 0;
+        while (!failed.load(std::memory_order_relaxed) && next_task(queues, self, &index)) {
+            try {
+                task(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!first_error) {
+                    first_error = std::current_exception();
+                }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::mutex done_mutex;
+    std::condition_variable done_signal;
+    size_t running = 0;
+
+    std::function<void(size_t)> thread_main = [&](size_t self) {
+        {
+            ComputeCorePin pin;
+            worker(self);
+        }
+        std::lock_guard<std::mutex> lock(done_mutex);
+        --running;
+        done_signal.notify_all();
+    };
+
+    const bool caller_waits = static_cast<bool>(on_wait);
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    try {
+        for (size_t w = caller_waits ? 0 : 1; w < workers; ++w) {
+            {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                ++running;
+            }
+            pool.push_back(std::thread(thread_main, w));
+        }
+    } catch (...) {
+        // The thread that failed to start was already counted. Its queue,
+        // and those of the workers after it, are drained by stealing.
+        std::lock_guard<std::mutex> lock(done_mutex);
+        --running;
+    }
+
+    if (!caller_waits || pool.empty()) {
+        worker(0);
+    } else {
+        const std::chrono::milliseconds interval(wait_interval_ms > 0 ? wait_interval_ms : 1);
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(done_mutex);
+                if (done_signal.wait_for(lock, interval, [&]() { return running == 0; })) {
+                    break;
+                }
+            }
+            on_wait();
+        }
+    }
+
+    for (size_t i = 0; i < pool.size(); ++i) {
+        pool[i].join();
+    }
+
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * crypto_parallel.h - Data-parallel loops for the crypto bridge
+ *
+ * Position-addressed modes (tweaked Threefish, XTS sectors, ...) have no
+ * dependency between blocks, so one call can be spread over several cores.
+ * parallel_for splits an index range into chunks that worker threads pull
+ * from a shared counter; the calling thread works too, so a single-chunk
+ * range never involves another thread. Its workers come from a pool that
+ * starts and pins them on first use and keeps them for later calls, so
+ * hashing many small files does not start a thread per file.
+ *
+ * parallel_tasks runs independent tasks of uneven cost (files of a tree).
+ * Each worker starts with its own contiguous run of tasks, so neighbouring
+ * tasks share a worker, and a worker that runs dry steals from the far end
+ * of another worker's queue instead of idling.
+ */
+
+#ifndef CRYPTO_PARALLEL_H
+#define CRYPTO_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads to use for `requested` (0 = one per usable core, see
+// crypto_topology.h). Threads started by the loops below are pinned to
+// compute cores.
+int resolve_thread_count(int requested);
+
+// Calls body(begin, end) for consecutive chunks of at most `grain` items
+// covering [0, count), on up to `threads` threads (0 = usable cores).
+// Returns once every chunk has run. If a chunk throws, no new chunks are
+// started and the first exception is rethrown on the calling thread.
+void parallel_for(size_t count, size_t grain, int threads,
+                  const std::function<void(size_t, size_t)>& body);
+
+// Calls task(i) for every i in [0, count) on up to `threads` worker threads
+// (0 = usable cores) with work stealing, and returns once all have run.
+// When `on_wait` is set, the calling thread does not run tasks itself but
+// calls on_wait about every `wait_interval_ms` milliseconds until the
+// workers finish, so callbacks reach the caller on its own thread. If a
+// task throws, no new tasks are started and the first exception is
+// rethrown on the calling thread.
+void parallel_tasks(size_t count, int threads, const std::function<void(size_t)>& task,
+                    const std::function<void()>& on_wait, int wait_interval_ms);
+
+#endif // CRYPTO_PARALLEL_H
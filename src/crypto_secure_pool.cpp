@@ -0,0 +1,164 @@
+/*
+ * crypto_secure_pool.cpp - Locked memory for key material
+ */
+
+#include "crypto_secure_pool.h"
+#include "crypto_compat.h"
+#include <cstring>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+static size_t page_size() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    const long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? static_cast<size_t>(size) : 4096;
+#endif
+}
+
+// Maps `size` bytes with no access at all
+static unsigned char* map_region(size_t size) {
+#if defined(_WIN32)
+    return static_cast<unsigned char*>(
+        VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_NOACCESS));
+#else
+    void* region = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return region == MAP_FAILED ? nullptr : static_cast<unsigned char*>(region);
+#endif
+}
+
+static bool open_slots(unsigned char* slots, size_t size) {
+#if defined(_WIN32)
+    DWORD previous = 0;
+    return VirtualProtect(slots, size, PAGE_READWRITE, &previous) != 0;
+#else
+    return mprotect(slots, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+// Best effort: RLIMIT_MEMLOCK or the working set quota may refuse
+static bool lock_slots(unsigned char* slots, size_t size) {
+#if defined(_WIN32)
+    return VirtualLock(slots, size) != 0;
+#else
+    #if defined(MADV_DONTDUMP)
+        madvise(slots, size, MADV_DONTDUMP);
+    #endif
+    return mlock(slots, size) == 0;
+#endif
+}
+
+static void unmap_region(unsigned char* region, size_t size) {
+#if defined(_WIN32)
+    (void)size;
+    VirtualFree(region, 0, MEM_RELEASE);
+#else
+    munmap(region, size);
+#endif
+}
+
+SecurePool& SecurePool::instance() {
+    // Never destroyed: thread arenas may still return slots at exit
+    static SecurePool* pool = new SecurePool();
+    return *pool;
+}
+
+SecurePool::SecurePool()
+    : region_(nullptr), region_size_(0), slots_(nullptr), fallbacks_(0), locked_(false) {
+    const size_t page = page_size();
+    const size_t slots_size = (SECURE_POOL_SLOTS * SECURE_SLOT_SIZE + page - 1) / page * page;
+    region_size_ = slots_size + 2 * page;
+    region_ = map_region(region_size_);
+    if (!region_) {
+        region_size_ = 0;
+        return;
+    }
+    slots_ = region_ + page;
+    if (!open_slots(slots_, slots_size)) {
+        unmap_region(region_, region_size_);
+        region_ = slots_ = nullptr;
+        region_size_ = 0;
+        return;
+    }
+    locked_ = lock_slots(slots_, slots_size);
+
+    // Handed out from the back, so the first slots go first
+    free_.reserve(SECURE_POOL_SLOTS);
+    for (size_t i = SECURE_POOL_SLOTS; i > 0; --i) {
+        free_.push_back(slots_ + (i - 1) * SECURE_SLOT_SIZE);
+    }
+}
+
+unsigned char* SecurePool::acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        return nullptr;
+    }
+    unsigned char* slot = free_.back();
+    free_.pop_back();
+    return slot;
+}
+
+void SecurePool::release(unsigned char* slot) noexcept {
+    if (!slot) {
+        return;
+    }
+    CryptoPP::SecureWipeBuffer(slot, SECURE_SLOT_SIZE);
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(slot);
+}
+
+void SecurePool::note_fallback() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++fallbacks_;
+}
+
+SecurePoolStats SecurePool::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SecurePoolStats stats;
+    stats.slots = slots_ ? static_cast<long long>(SECURE_POOL_SLOTS) : 0;
+    stats.in_use = stats.slots - static_cast<long long>(free_.size());
+    stats.fallbacks = fallbacks_;
+    stats.locked = locked_;
+    return stats;
+}
+
+SecureBlock::SecureBlock(size_t size) : data_(nullptr), size_(size), pooled_(false) {
+    allocate();
+}
+
+SecureBlock::SecureBlock(const void* data, size_t size) : data_(nullptr), size_(size), pooled_(false) {
+    allocate();
+    if (size_ > 0) {
+        std::memcpy(data_, data, size_);
+    }
+}
+
+SecureBlock::~SecureBlock() {
+    if (pooled_) {
+        SecurePool::instance().release(data_);
+    } else {
+        CryptoPP::SecureWipeBuffer(data_, size_);
+        delete[] data_;
+    }
+}
+
+void SecureBlock::allocate() {
+    SecurePool& pool = SecurePool::instance();
+    if (size_ <= SECURE_SLOT_SIZE) {
+        data_ = pool.acquire();
+        pooled_ = data_ != nullptr;
+    }
+    if (!pooled_) {
+        pool.note_fallback();
+        data_ = new unsigned char[size_ > 0 ? size_ : 1];
+    }
+}
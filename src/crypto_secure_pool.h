@@ -0,0 +1,93 @@
+/*
+ * crypto_secure_pool.h - Locked memory for key material
+ *
+ * Keys, IVs, master keys and the passwords of queued jobs are the bytes the
+ * bridge must never let reach swap or a core dump. They are small, so one
+ * region set up on first use holds all of them:
+ *
+ *   guard page | SECURE_POOL_SLOTS slots of SECURE_SLOT_SIZE bytes | guard page
+ *
+ * The slots are locked into RAM (mlock/VirtualLock) and kept out of core
+ * dumps where the system allows it; the guard pages are inaccessible, so a
+ * run off either end faults instead of reading a neighbour's memory. After
+ * setup, taking and returning a slot is a free-list operation under a
+ * mutex, without system calls. Slots are wiped when returned.
+ *
+ * The pool is deliberately small, to stay within the default locked-memory
+ * limit of unprivileged processes (64 KiB on older Linux kernels and on
+ * Android). A secret larger than a slot, or one asked for while every slot
+ * is taken, is served from ordinary memory that is still wiped on release;
+ * such fallbacks are counted. If the system refuses to lock the region the
+ * slots are used all the same and the stats report them as unlocked.
+ */
+
+#ifndef CRYPTO_SECURE_POOL_H
+#define CRYPTO_SECURE_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+static const size_t SECURE_SLOT_SIZE = 1024;
+static const size_t SECURE_POOL_SLOTS = 32;
+
+struct SecurePoolStats {
+    long long slots;      // Slots in the region (0 if it could not be mapped)
+    long long in_use;     // Slots handed out right now
+    long long fallbacks;  // Secrets served from ordinary memory so far
+    bool locked;          // The slots are locked into RAM
+};
+
+class SecurePool {
+public:
+    static SecurePool& instance();
+
+    // Returns one slot of SECURE_SLOT_SIZE bytes, or null if none is free
+    unsigned char* acquire();
+
+    // Wipes a slot from acquire() and makes it free again. Never throws:
+    // the free list has room for every slot, so it does not allocate.
+    void release(unsigned char* slot) noexcept;
+
+    // Counts a secret that had to live in ordinary memory
+    void note_fallback();
+
+    SecurePoolStats stats();
+
+private:
+    SecurePool();
+    SecurePool(const SecurePool&);
+    SecurePool& operator=(const SecurePool&);
+
+    std::mutex mutex_;
+    unsigned char* region_;   // Whole mapping, guard pages included
+    size_t region_size_;
+    unsigned char* slots_;    // First slot, just past the leading guard page
+    std::vector<unsigned char*> free_;
+    long long fallbacks_;
+    bool locked_;
+};
+
+// Secret of a fixed size that lives in a pool slot when one is available,
+// and in wiped heap memory otherwise
+class SecureBlock {
+public:
+    explicit SecureBlock(size_t size);
+    SecureBlock(const void* data, size_t size);
+    ~SecureBlock();
+
+    unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    SecureBlock(const SecureBlock&);
+    SecureBlock& operator=(const SecureBlock&);
+
+    void allocate();
+
+    unsigned char* data_;
+    size_t size_;
+    bool pooled_;
+};
+
+#endif // CRYPTO_SECURE_POOL_H
@@ -0,0 +1,618 @@
+/*
+ * crypto_segment.cpp - Segmented file format for the crypto bridge, and its
+ * in-place file update call
+ */
+
+#include "crypto_segment.h"
+#include "crypto_arena.h"
+#include "crypto_compat.h"
+#include "crypto_fs.h"
+#include "crypto_tree.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const unsigned char kSegmentMagic[4] = { 'C', 'T', 'S', 0x01 };
+
+// HKDF info prefix; the header and the segment number follow
+static const unsigned char kSegmentLabel[] = "CryptingTool segment";
+
+static void store_le64(unsigned char* out, unsigned long long value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static unsigned long long load_le64(const unsigned char* in) {
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+void store_segment_le32(unsigned char* out, size_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+size_t load_segment_le32(const unsigned char* in) {
+    size_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+void write_segment_header(const SegmentHeader& header, unsigned char* out) {
+    std::memcpy(out, kSegmentMagic, sizeof(kSegmentMagic));
+    out[4] = static_cast<unsigned char>(header.flags);
+    out[5] = out[6] = out[7] = 0;
+    store_segment_le32(out + 8, header.segment_size);
+    store_le64(out + 12, header.plaintext_len);
+    std::memcpy(out + 20, header.salt, SEGMENT_SALT_SIZE);
+}
+
+static bool parse_header(const unsigned char* in, SegmentHeader* header) {
+    if (std::memcmp(in, kSegmentMagic, sizeof(kSegmentMagic)) != 0 || in[5] || in[6] || in[7]) {
+        return false;
+    }
+    header->flags = in[4];
+    header->segment_size = load_segment_le32(in + 8);
+    header->plaintext_len = load_le64(in + 12);
+    std::memcpy(header->salt, in + 20, SEGMENT_SALT_SIZE);
+    return header->segment_size > 0 && header->segment_size <= SEGMENT_MAX_SIZE;
+}
+
+bool read_segment_header(const unsigned char* in, SegmentHeader* header) {
+    // Digest tables need fixed-size records, which compression rules out
+    return parse_header(in, header) &&
+           (header->flags & ~(SEGMENT_FLAG_COMPRESSED | SEGMENT_FLAG_DIGESTS)) == 0 &&
+           header->flags != (SEGMENT_FLAG_COMPRESSED | SEGMENT_FLAG_DIGESTS);
+}
+
+bool read_stream_header(const unsigned char* in, SegmentHeader* header) {
+    StreamParams params;
+    return parse_header(in, header) &&
+           (header->flags & ~SEGMENT_FLAG_COMPRESSED) == SEGMENT_FLAG_STREAM &&
+           unpack_stream_params(header->plaintext_len, &params);
+}
+
+unsigned long long pack_stream_params(const StreamParams& params) {
+    unsigned char field[8] = { 0 };
+    field[0] = static_cast<unsigned char>(params.algorithm);
+    field[1] = static_cast<unsigned char>(params.mode);
+    field[2] = static_cast<unsigned char>(params.mac);
+    field[4] = static_cast<unsigned char>(params.key_size_bits);
+    field[5] = static_cast<unsigned char>(params.key_size_bits >> 8);
+    return load_le64(field);
+}
+
+bool unpack_stream_params(unsigned long long field, StreamParams* params) {
+    unsigned char bytes[8];
+    store_le64(bytes, field);
+    params->algorithm = bytes[0];
+    params->mode = bytes[1];
+    params->mac = bytes[2];
+    params->key_size_bits = bytes[4] | (bytes[5] << 8);
+    return params->algorithm != 0 && params->mode != 0 && params->key_size_bits != 0 &&
+           bytes[3] == 0 && bytes[6] == 0 && bytes[7] == 0;
+}
+
+unsigned long long segment_count(const SegmentHeader& header) {
+    return (header.plaintext_len + header.segment_size - 1) / header.segment_size;
+}
+
+size_t segment_length(const SegmentHeader& header, unsigned long long index) {
+    const unsigned long long offset = index * header.segment_size;
+    const unsigned long long remaining = header.plaintext_len - offset;
+    return remaining < header.segment_size ? static_cast<size_t>(remaining) : header.segment_size;
+}
+
+void derive_segment_keys(const unsigned char* master, size_t master_len,
+                         const SegmentHeader& header, unsigned long long index,
+                         unsigned long long version, unsigned char* out, size_t out_len) {
+    unsigned char info[sizeof(kSegmentLabel) - 1 + SEGMENT_HEADER_SIZE + 8 + 8];
+    size_t info_len = sizeof(kSegmentLabel) - 1 + SEGMENT_HEADER_SIZE + 8;
+    std::memcpy(info, kSegmentLabel, sizeof(kSegmentLabel) - 1);
+
+    SegmentHeader bound = header;
+    if ((header.flags & SEGMENT_FLAG_DIGESTS) && index != SEGMENT_TABLE_INDEX) {
+        bound.plaintext_len = 0;
+    }
+    write_segment_header(bound, info + sizeof(kSegmentLabel) - 1);
+    store_le64(info + sizeof(kSegmentLabel) - 1 + SEGMENT_HEADER_SIZE, index);
+    if (header.flags & (SEGMENT_FLAG_DIGESTS | SEGMENT_FLAG_STREAM)) {
+        store_le64(info + info_len, version);
+        info_len += 8;
+    }
+
+    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+    hkdf.DeriveKey(out, out_len, master, master_len, header.salt, SEGMENT_SALT_SIZE,
+                   info, info_len);
+}
+
+void segment_digest(const unsigned char* data, size_t len, unsigned char* digest) {
+    CryptoPP::SHA256 hash;
+    hash.CalculateDigest(digest, data, len);
+}
+
+size_t segment_table_length(unsigned long long segments) {
+    return 8 + static_cast<size_t>(segments) * (8 + SEGMENT_DIGEST_SIZE);
+}
+
+void write_segment_table(const std::vector<SegmentDigest>& table, unsigned char* out) {
+    store_le64(out, table.size());
+    out += 8;
+    for (size_t i = 0; i < table.size(); ++i) {
+        store_le64(out, table[i].version);
+        std::memcpy(out + 8, table[i].digest, SEGMENT_DIGEST_SIZE);
+        out += 8 + SEGMENT_DIGEST_SIZE;
+    }
+}
+
+bool read_segment_table(const unsigned char* in, size_t len, unsigned long long segments,
+                        std::vector<SegmentDigest>* table) {
+    if (len < 8 || load_le64(in) != segments || segments > len / (8 + SEGMENT_DIGEST_SIZE) ||
+        len != segment_table_length(segments)) {
+        return false;
+    }
+    table->resize(static_cast<size_t>(segments));
+    in += 8;
+    for (size_t i = 0; i < table->size(); ++i) {
+        (*table)[i].version = load_le64(in);
+        std::memcpy((*table)[i].digest, in + 8, SEGMENT_DIGEST_SIZE);
+        in += 8 + SEGMENT_DIGEST_SIZE;
+    }
+    return true;
+}
+
+// Bytes of an encrypted file that an in-place update is about to overwrite
+struct JournalRegion {
+    unsigned long long offset;
+    unsigned long long length;
+};
+
+// Segment work in crypto_bridge_file_update
+enum UpdateAction {
+    UPDATE_SKIP = 0,     // Outside every changed range
+    UPDATE_COMPARE = 1,  // Rewritten only if its digest changed
+    UPDATE_REWRITE = 2   // New, or its length changed
+};
+
+static int segment_changed(const TreeJob& job, const SegmentHeader& header,
+                           unsigned long long index, const std::string& plain_path,
+                           const SegmentDigest& entry, bool* changed);
+static int update_segment(const TreeJob& job, const SegmentHeader& header, unsigned long long index,
+                          const std::string& plain_path, const std::string& encrypted_path,
+                          unsigned long long version, SegmentDigest& entry,
+                          std::atomic<long long>& rewritten);
+static std::string update_journal_path(const std::string& target);
+static int write_update_journal(const std::string& target, unsigned long long length,
+                                const std::vector<JournalRegion>& regions);
+static int restore_update_journal(const std::string& target);
+
+// Body of crypto_bridge_file_update. Segment records have fixed positions,
+// so a changed segment is resealed in place under a new version; the digest
+// table and header are rewritten last. A file that has no digest table yet
+// is written from scratch with one, to a temporary file renamed over it.
+//
+// In place, the changed segments are found first, and everything the
+// update will overwrite (their records, the header, the old table and any
+// records cut off by a shrink) is saved to an undo journal before the first
+// write. A failed update puts those bytes back before returning; if the
+// process dies instead, the next update restores the file from the journal
+// before it starts.
+int process_file_update(const CryptoBridgeContext& options, int algorithm, int mode,
+                        int key_size_bits, const char* password, int password_len,
+                        const char* plain_path, const char* encrypted_path,
+                        const long long* ranges, int range_count,
+                        long long* rewritten_bytes) {
+    if (!plain_path || !encrypted_path || !*plain_path || !*encrypted_path ||
+        range_count < 0 || (range_count > 0 && !ranges)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    for (int i = 0; i < 2 * range_count; ++i) {
+        if (ranges[i] < 0) {
+            return STATUS_INVALID_PARAMS;
+        }
+    }
+    // Compressed records vary in size and could not be rewritten in place
+    if (options.compression != COMPRESSION_NONE) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    TreeJob job;
+    int status = prepare_tree_job(job, options, algorithm, mode, key_size_bits, OPERATION_ENCRYPT,
+                                  password, password_len);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    unsigned long long plain_size = 0;
+    if (!fs_file_size(plain_path, &plain_size)) {
+        return STATUS_IO_ERROR;
+    }
+
+    const std::string target(encrypted_path);
+    status = restore_update_journal(target);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    SegmentHeader old_header;
+    std::vector<SegmentDigest> table;
+    unsigned long long old_length = 0;
+    bool in_place = false;
+    {
+        FsFile existing(target, "rb");
+        unsigned char raw[SEGMENT_HEADER_SIZE];
+        if (existing.get() && std::fread(raw, 1, sizeof(raw), existing.get()) == sizeof(raw) &&
+            read_segment_header(raw, &old_header) && (old_header.flags & SEGMENT_FLAG_DIGESTS)) {
+            // A table that does not open means a wrong password or setting;
+            // rewriting the file from scratch would silently re-key it
+            status = load_segment_table(job, existing.get(), old_header, &table);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+            if (!fs_file_size(target, &old_length)) {
+                return STATUS_IO_ERROR;
+            }
+            in_place = true;
+        }
+    }
+
+    CryptoPP::AutoSeededRandomPool rng;
+    SegmentHeader header;
+    if (in_place) {
+        header = old_header;
+    } else {
+        header.flags = SEGMENT_FLAG_DIGESTS;
+        header.segment_size = budget_segment_size(job, SEGMENT_DEFAULT_SIZE);
+        rng.GenerateBlock(header.salt, SEGMENT_SALT_SIZE);
+    }
+    header.plaintext_len = plain_size;
+    const unsigned long long segments = segment_count(header);
+    if (segments > static_cast<unsigned long long>(INT_MAX / 2) / (8 + SEGMENT_DIGEST_SIZE)) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    const size_t count = static_cast<size_t>(segments);
+    std::vector<unsigned char> action(count, range_count > 0 ? UPDATE_SKIP : UPDATE_COMPARE);
+    for (int r = 0; r < range_count; ++r) {
+        const unsigned long long offset = static_cast<unsigned long long>(ranges[2 * r]);
+        const unsigned long long length = static_cast<unsigned long long>(ranges[2 * r + 1]);
+        if (length == 0 || offset / header.segment_size >= segments) {
+            continue;
+        }
+        const unsigned long long last = (offset + length - 1) / header.segment_size;
+        for (unsigned long long i = offset / header.segment_size; i <= last && i < segments; ++i) {
+            action[static_cast<size_t>(i)] = UPDATE_COMPARE;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!in_place || i >= table.size() ||
+            segment_length(old_header, i) != segment_length(header, i)) {
+            action[i] = UPDATE_REWRITE;
+        }
+    }
+    table.resize(count);
+
+    // Segments to compare are read and hashed before anything is written,
+    // so the journal knows which records the update replaces. A changed
+    // segment is read once more to be sealed.
+    std::vector<size_t> compare;
+    for (size_t i = 0; i < count; ++i) {
+        if (action[i] == UPDATE_COMPARE) {
+            compare.push_back(i);
+        }
+    }
+    const std::string plain(plain_path);
+    status = run_status_tasks(compare.size(), job.workers, [&](size_t t) {
+        const size_t i = compare[t];
+        bool changed = false;
+        const int result = segment_changed(job, header, i, plain, table[i], &changed);
+        action[i] = changed ? UPDATE_REWRITE : UPDATE_SKIP;
+        return result;
+    });
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    std::vector<size_t> work;
+    for (size_t i = 0; i < count; ++i) {
+        if (action[i] == UPDATE_REWRITE) {
+            work.push_back(i);
+        }
+    }
+
+    // A fresh salt makes version 0 unique; rewrites in place draw random
+    // versions so a segment's key is never reused for new content
+    std::vector<unsigned long long> versions(count, 0);
+    if (in_place && count > 0) {
+        rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(&versions[0]),
+                          count * sizeof(versions[0]));
+        for (size_t i = 0; i < count; ++i) {
+            versions[i] |= 1;
+        }
+    }
+
+    const unsigned long long table_offset = segment_record_offset(job, header, segments);
+    const std::string output = in_place ? target : target + ".tmp";
+    if (in_place) {
+        // Everything from the first table offset on is either the old table,
+        // the new one or records a shrink cuts off; below it, only the
+        // records of changed segments are overwritten. Records past the old
+        // end need no saving: the restore cuts the file back.
+        const unsigned long long tail = std::min(
+            std::min(table_offset, segment_record_offset(job, old_header, segment_count(old_header))),
+            old_length);
+        std::vector<JournalRegion> regions;
+        const JournalRegion header_region = { 0, SEGMENT_HEADER_SIZE };
+        regions.push_back(header_region);
+        for (size_t t = 0; t < work.size(); ++t) {
+            const unsigned long long offset = segment_record_offset(job, header, work[t]);
+            const unsigned long long end = std::min(
+                tail, offset + SEGMENT_RECORD_PREFIX +
+                          sealed_segment_length(job, segment_length(header, work[t])));
+            if (offset < end) {
+                const JournalRegion region = { offset, end - offset };
+                regions.push_back(region);
+            }
+        }
+        if (tail < old_length) {
+            const JournalRegion region = { tail, old_length - tail };
+            regions.push_back(region);
+        }
+        status = write_update_journal(target, old_length, regions);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+    } else {
+        FsFile created(output, "wb");
+        if (!created.get() || !created.close()) {
+            return STATUS_IO_ERROR;
+        }
+    }
+
+    std::atomic<long long> rewritten(0);
+    status = run_status_tasks(work.size(), job.workers, [&](size_t t) {
+        const size_t i = work[t];
+        return update_segment(job, header, i, plain, output, versions[i], table[i], rewritten);
+    });
+
+    if (status == STATUS_SUCCESS) {
+        const size_t plain_len = segment_table_length(segments);
+        PooledBuffer buffer(job.budget.get());
+        unsigned char* data = buffer.reserve(sealed_segment_length(job, plain_len));
+        write_segment_table(table, data);
+
+        unsigned char prefix[SEGMENT_TABLE_PREFIX];
+        CryptoPP::word64 table_version = 0;
+        rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(&table_version), sizeof(table_version));
+        store_le64(prefix + 4, table_version);
+
+        int sealed = static_cast<int>(buffer.capacity());
+        status = transform_segment(job, OPERATION_ENCRYPT, header, SEGMENT_TABLE_INDEX,
+                                   table_version, data, static_cast<int>(plain_len), data, &sealed,
+                                   nullptr);
+        if (status == STATUS_SUCCESS) {
+            store_segment_le32(prefix, static_cast<size_t>(sealed));
+            unsigned char raw[SEGMENT_HEADER_SIZE];
+            write_segment_header(header, raw);
+
+            FsFile file(output, "r+b");
+            if (!file.get() || !fs_seek(file.get(), table_offset) ||
+                std::fwrite(prefix, 1, sizeof(prefix), file.get()) != sizeof(prefix) ||
+                std::fwrite(data, 1, sealed, file.get()) != static_cast<size_t>(sealed) ||
+                !fs_seek(file.get(), 0) ||
+                std::fwrite(raw, 1, sizeof(raw), file.get()) != sizeof(raw) ||
+                !fs_truncate(file.get(), table_offset + sizeof(prefix) + sealed) ||
+                !fs_sync(file.get()) || !file.close()) {
+                status = STATUS_IO_ERROR;
+            }
+        }
+    }
+
+    if (in_place) {
+        // Dropping the journal commits the update. If it cannot be dropped,
+        // the next update would undo this one, so report the failure and
+        // let the caller repeat the call.
+        if (status == STATUS_SUCCESS) {
+            if (!fs_remove(update_journal_path(target))) {
+                status = STATUS_IO_ERROR;
+            }
+        } else {
+            restore_update_journal(target);
+        }
+    } else {
+        if (status == STATUS_SUCCESS && !fs_rename(output, target)) {
+            status = STATUS_IO_ERROR;
+        }
+        if (status != STATUS_SUCCESS) {
+            fs_remove(output);
+        }
+    }
+    if (status == STATUS_SUCCESS && rewritten_bytes) {
+        *rewritten_bytes = rewritten.load();
+    }
+    return status;
+}
+
+// Reads one plaintext segment and tells whether it still matches its digest
+static int segment_changed(const TreeJob& job, const SegmentHeader& header,
+                           unsigned long long index, const std::string& plain_path,
+                           const SegmentDigest& entry, bool* changed) {
+    const size_t len = segment_length(header, index);
+    PooledBuffer buffer(job.budget.get());
+    unsigned char* data = buffer.reserve(len);
+
+    FsFile input(plain_path, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (!fs_seek(input.get(), index * header.segment_size) ||
+        std::fread(data, 1, len, input.get()) != len) {
+        return STATUS_IO_ERROR;  // The plaintext shrank while being read
+    }
+
+    unsigned char digest[SEGMENT_DIGEST_SIZE];
+    segment_digest(data, len, digest);
+    *changed = std::memcmp(digest, entry.digest, SEGMENT_DIGEST_SIZE) != 0;
+    return STATUS_SUCCESS;
+}
+
+// Reads one plaintext segment and seals it under `version` into its record
+// slot
+static int update_segment(const TreeJob& job, const SegmentHeader& header, unsigned long long index,
+                          const std::string& plain_path, const std::string& encrypted_path,
+                          unsigned long long version, SegmentDigest& entry,
+                          std::atomic<long long>& rewritten) {
+    const size_t len = segment_length(header, index);
+    PooledBuffer buffer(job.budget.get());
+    const size_t bound = segment_record_bound(header.segment_size);
+    unsigned char* data = buffer.reserve(segment_work_size(header));
+
+    FsFile input(plain_path, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (!fs_seek(input.get(), index * header.segment_size) ||
+        std::fread(data, 1, len, input.get()) != len) {
+        return STATUS_IO_ERROR;  // The plaintext shrank while being read
+    }
+
+    unsigned char digest[SEGMENT_DIGEST_SIZE];
+    segment_digest(data, len, digest);
+
+    int sealed = static_cast<int>(bound);
+    const int status = transform_segment(job, OPERATION_ENCRYPT, header, index, version,
+                                         data, static_cast<int>(len), data, &sealed,
+                                         segment_scratch(header, data));
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (static_cast<size_t>(sealed) != sealed_segment_length(job, len)) {
+        return STATUS_UNKNOWN_ERROR;
+    }
+
+    unsigned char prefix[SEGMENT_RECORD_PREFIX];
+    store_segment_le32(prefix, static_cast<size_t>(sealed));
+    FsFile output(encrypted_path, "r+b");
+    if (!output.get() || !fs_seek(output.get(), segment_record_offset(job, header, index)) ||
+        std::fwrite(prefix, 1, sizeof(prefix), output.get()) != sizeof(prefix) ||
+        std::fwrite(data, 1, sealed, output.get()) != static_cast<size_t>(sealed) ||
+        !output.close()) {
+        return STATUS_IO_ERROR;
+    }
+
+    entry.version = version;
+    std::memcpy(entry.digest, digest, SEGMENT_DIGEST_SIZE);
+    rewritten += static_cast<long long>(len);
+    return STATUS_SUCCESS;
+}
+
+// Undo journal of an in-place update, next to the file it protects:
+//
+//   "CTJ" 0x01 | file length (8) | region count (4) |
+//   per region: offset (8) | length (8) | the bytes it held
+//
+// It holds ciphertext only, so restoring needs no key.
+static const unsigned char kJournalMagic[4] = { 'C', 'T', 'J', 0x01 };
+static const size_t kJournalHeaderSize = 4 + 8 + 4;
+static const size_t kJournalRegionSize = 8 + 8;
+
+static std::string update_journal_path(const std::string& target) {
+    return target + ".journal";
+}
+
+// Copies `length` bytes between two open files, each at its position
+static bool copy_file_bytes(std::FILE* from, std::FILE* to, unsigned long long length) {
+    unsigned char block[64 * 1024];
+    while (length > 0) {
+        const size_t len = static_cast<size_t>(std::min<unsigned long long>(length, sizeof(block)));
+        if (std::fread(block, 1, len, from) != len || std::fwrite(block, 1, len, to) != len) {
+            return false;
+        }
+        length -= len;
+    }
+    return true;
+}
+
+// Saves the length of `target` and the bytes of `regions`. The journal only
+// appears under its name once it is complete and on disk, so a journal that
+// exists is always safe to restore.
+static int write_update_journal(const std::string& target, unsigned long long length,
+                                const std::vector<JournalRegion>& regions) {
+    const std::string journal = update_journal_path(target);
+    const std::string temp = journal + ".tmp";
+    FsFile source(target, "rb");
+    FsFile output(temp, "wb");
+    if (!source.get() || !output.get()) {
+        output.close();
+        fs_remove(temp);
+        return STATUS_IO_ERROR;
+    }
+
+    unsigned char head[kJournalHeaderSize];
+    std::memcpy(head, kJournalMagic, sizeof(kJournalMagic));
+    store_le64(head + 4, length);
+    store_segment_le32(head + 12, regions.size());
+    bool written = std::fwrite(head, 1, sizeof(head), output.get()) == sizeof(head);
+    for (size_t i = 0; written && i < regions.size(); ++i) {
+        unsigned char entry[kJournalRegionSize];
+        store_le64(entry, regions[i].offset);
+        store_le64(entry + 8, regions[i].length);
+        written = std::fwrite(entry, 1, sizeof(entry), output.get()) == sizeof(entry) &&
+                  fs_seek(source.get(), regions[i].offset) &&
+                  copy_file_bytes(source.get(), output.get(), regions[i].length);
+    }
+    if (!written || !fs_sync(output.get()) || !output.close() || !fs_rename(temp, journal)) {
+        output.close();
+        fs_remove(temp);
+        return STATUS_IO_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+// Puts back the bytes an unfinished update overwrote, cuts the file to its
+// old length and drops the journal. Without a journal there is nothing to
+// do; one left half-written never reached its name, and the file was not
+// touched after it.
+static int restore_update_journal(const std::string& target) {
+    const std::string journal = update_journal_path(target);
+    fs_remove(journal + ".tmp");
+    if (!fs_exists(journal)) {
+        return STATUS_SUCCESS;
+    }
+
+    FsFile input(journal, "rb");
+    FsFile file(target, "r+b");
+    unsigned char head[kJournalHeaderSize];
+    if (!input.get() || !file.get() ||
+        std::fread(head, 1, sizeof(head), input.get()) != sizeof(head) ||
+        std::memcmp(head, kJournalMagic, sizeof(kJournalMagic)) != 0) {
+        return STATUS_IO_ERROR;
+    }
+    const size_t regions = load_segment_le32(head + 12);
+    for (size_t i = 0; i < regions; ++i) {
+        unsigned char entry[kJournalRegionSize];
+        if (std::fread(entry, 1, sizeof(entry), input.get()) != sizeof(entry) ||
+            !fs_seek(file.get(), load_le64(entry)) ||
+            !copy_file_bytes(input.get(), file.get(), load_le64(entry + 8))) {
+            return STATUS_IO_ERROR;
+        }
+    }
+    if (!fs_truncate(file.get(), load_le64(head + 4)) || !fs_sync(file.get()) || !file.close()) {
+        return STATUS_IO_ERROR;
+    }
+    input.close();
+    return fs_remove(journal) ? STATUS_SUCCESS : STATUS_IO_ERROR;
+}
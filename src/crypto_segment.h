@@ -0,0 +1,150 @@
+/*
+ * crypto_segment.h - Segmented file format for the crypto bridge
+ *
+ * Files written by the tree engine are cut into fixed-size plaintext
+ * segments that are encrypted independently, so one large file can be
+ * spread over several workers and any segment can be read on its own:
+ *
+ *   header   "CTS" 0x01 | flags (1) | reserved (3) | segment size (4) |
+ *            plaintext length (8) | salt (16)
+ *   records  one per segment: stored length (4) | sealed segment
+ *
+ * All integers are little endian. Every segment has its own key and IV,
+ * expanded with HKDF from the job's password-derived key material, the
+ * header and the segment number. A fresh random salt per file keeps
+ * keystreams from repeating across files and runs, and because the header
+ * feeds the expansion, editing it, or moving a record to another position
+ * or file, yields keys that do not match.
+ *
+ * Files that can be updated in place carry a digest table after the last
+ * record:
+ *
+ *   table    stored length (4) | version (8) | sealed table
+ *   sealed   segment count (8) | (version (8) | SHA-256 (32)) per segment
+ *
+ * Their records are uncompressed, so each one has a fixed position and a
+ * changed segment can be rewritten where it is. A rewritten segment gets a
+ * fresh random version, which joins its key expansion so that no key is
+ * ever used for two plaintexts; the plaintext length is left out of the
+ * expansion of data segments, so growing or shrinking the file does not
+ * re-key the segments before the edit. The table itself is sealed under the
+ * full header and its own version, which binds the length and every
+ * segment's version.
+ *
+ * Streams, whose length is not known when the header is written, set the
+ * stream flag and keep their cipher settings where files keep the
+ * plaintext length:
+ *
+ *   settings algorithm (1) | mode (1) | MAC (1) | 0 | key size in bits (2) | 0 (2)
+ *
+ * so they decrypt without the caller repeating them, and since the header
+ * feeds the key expansion, a changed setting yields keys that do not match.
+ * Their records run to the end of the input; every segment but the last
+ * holds a full segment of plaintext. The last one is sealed under version
+ * SEGMENT_FINAL_VERSION, the others under 0, so a stream cut short at a
+ * record boundary does not decrypt. A stream without data holds a single
+ * empty last segment, so even one cut short after its header does not.
+ */
+
+#ifndef CRYPTO_SEGMENT_H
+#define CRYPTO_SEGMENT_H
+
+#include <cstddef>
+#include <vector>
+
+// Header flags
+enum SegmentFlags {
+    SEGMENT_FLAG_COMPRESSED = 1,  // Each segment holds a compressed frame
+    SEGMENT_FLAG_DIGESTS = 2,     // Fixed-size records followed by a digest table
+    SEGMENT_FLAG_STREAM = 4       // Length unknown up front; the last record is marked
+};
+
+static const size_t SEGMENT_HEADER_SIZE = 36;
+static const size_t SEGMENT_RECORD_PREFIX = 4;
+static const size_t SEGMENT_SALT_SIZE = 16;
+
+// Segment size used for new files
+static const size_t SEGMENT_DEFAULT_SIZE = 4 * 1024 * 1024;
+
+// Largest segment size accepted from a header
+static const size_t SEGMENT_MAX_SIZE = 64 * 1024 * 1024;
+
+// Digest table position in the key expansion, never used by a segment
+static const unsigned long long SEGMENT_TABLE_INDEX = ~0ULL;
+
+// Stored length and version ahead of the sealed digest table
+static const size_t SEGMENT_TABLE_PREFIX = 4 + 8;
+
+static const size_t SEGMENT_DIGEST_SIZE = 32;
+
+// Key expansion version of the last segment of a stream
+static const unsigned long long SEGMENT_FINAL_VERSION = 1;
+
+struct SegmentHeader {
+    unsigned int flags;
+    size_t segment_size;
+    unsigned long long plaintext_len;
+    unsigned char salt[SEGMENT_SALT_SIZE];
+};
+
+// Cipher settings recorded in a stream header
+struct StreamParams {
+    int algorithm;
+    int mode;
+    int key_size_bits;
+    int mac;
+};
+
+// Digest table entry of one segment
+struct SegmentDigest {
+    unsigned long long version;  // 0 until the segment is first rewritten
+    unsigned char digest[SEGMENT_DIGEST_SIZE];
+};
+
+// Serialises a header into SEGMENT_HEADER_SIZE bytes
+void write_segment_header(const SegmentHeader& header, unsigned char* out);
+
+// Parses SEGMENT_HEADER_SIZE bytes; false if they are not a valid header
+// of a file
+bool read_segment_header(const unsigned char* in, SegmentHeader* header);
+
+// Same for the header of a stream, whose plaintext length field must hold
+// stream settings
+bool read_stream_header(const unsigned char* in, SegmentHeader* header);
+
+// Packs stream settings into a plaintext length field
+unsigned long long pack_stream_params(const StreamParams& params);
+
+// Unpacks them; false if the field does not hold stream settings
+bool unpack_stream_params(unsigned long long field, StreamParams* params);
+
+// Number of segments (0 for an empty file)
+unsigned long long segment_count(const SegmentHeader& header);
+
+// Plaintext length of segment `index`
+size_t segment_length(const SegmentHeader& header, unsigned long long index);
+
+// Expands `master` into `out_len` bytes of key material for one segment,
+// or for the digest table at SEGMENT_TABLE_INDEX. `version` must be 0 for
+// files without a digest table; streams use 0 or SEGMENT_FINAL_VERSION.
+void derive_segment_keys(const unsigned char* master, size_t master_len,
+                         const SegmentHeader& header, unsigned long long index,
+                         unsigned long long version, unsigned char* out, size_t out_len);
+
+// SHA-256 of one segment's plaintext
+void segment_digest(const unsigned char* data, size_t len, unsigned char* digest);
+
+// Plaintext length of the digest table of `segments` segments
+size_t segment_table_length(unsigned long long segments);
+
+// Serialises a digest table into segment_table_length(table.size()) bytes
+void write_segment_table(const std::vector<SegmentDigest>& table, unsigned char* out);
+
+// Parses a digest table; false unless it holds exactly `segments` entries
+bool read_segment_table(const unsigned char* in, size_t len, unsigned long long segments,
+                        std::vector<SegmentDigest>* table);
+
+void store_segment_le32(unsigned char* out, size_t value);
+size_t load_segment_le32(const unsigned char* in);
+
+#endif // CRYPTO_SEGMENT_H
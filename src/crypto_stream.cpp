@@ -0,0 +1,214 @@
+/*
+ * crypto_stream.cpp - Streaming call of the crypto bridge: the segmented
+ * format written to and read from caller callbacks
+ */
+
+#include "crypto_tree.h"
+#include "crypto_arena.h"
+#include "crypto_parallel.h"
+#include "crypto_tuner.h"
+#include <algorithm>
+
+static int read_stream_bytes(CryptoBridgeStreamRead read, void* user_data,
+                             unsigned char* out, size_t len, size_t* got);
+
+// Body of crypto_bridge_process_stream. The stream is written in the
+// segmented format with the stream flag set and the cipher settings in the
+// header, which decryption follows instead of the caller's. Records are
+// read a window at a time, sealed or opened in place on the job's workers
+// and written in order; the last record read waits for the next window
+// until the input shows whether it ends the stream, since it is sealed
+// differently.
+int process_stream(const CryptoBridgeContext& options, int algorithm, int mode,
+                   int key_size_bits, int operation,
+                   const char* password, int password_len,
+                   CryptoBridgeStreamRead read, CryptoBridgeStreamWrite write,
+                   void* user_data) {
+    if (!read || !write) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    const bool encrypting = operation == OPERATION_ENCRYPT;
+    SegmentHeader header;
+    unsigned char raw[SEGMENT_HEADER_SIZE];
+    StreamParams params = { algorithm, mode, key_size_bits, options.mac };
+    int status = STATUS_SUCCESS;
+    if (!encrypting) {
+        size_t got = 0;
+        status = read_stream_bytes(read, user_data, raw, sizeof(raw), &got);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+        if (got != sizeof(raw) || !read_stream_header(raw, &header)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        unpack_stream_params(header.plaintext_len, &params);
+        if (params.mac != MAC_NONE && params.mac != MAC_HMAC_SHA256 && params.mac != MAC_BLAKE2B) {
+            return STATUS_CRYPTO_ERROR;
+        }
+    }
+    CryptoBridgeContext stream_options = options;
+    stream_options.mac = params.mac;
+
+    // The master key material is wiped when this scope closes
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    TreeJob job;
+    status = prepare_tree_job(job, stream_options, params.algorithm, params.mode,
+                              params.key_size_bits, operation, password, password_len);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    if (encrypting) {
+        header.flags = SEGMENT_FLAG_STREAM |
+                       (options.compression != COMPRESSION_NONE ? SEGMENT_FLAG_COMPRESSED : 0);
+        header.segment_size = options.autotune
+                                  ? AutoTuner::instance().lookup(algorithm, mode, key_size_bits,
+                                                                 true).segment_size
+                                  : SEGMENT_DEFAULT_SIZE;
+        header.plaintext_len = pack_stream_params(params);
+        CryptoPP::AutoSeededRandomPool rng;
+        rng.GenerateBlock(header.salt, SEGMENT_SALT_SIZE);
+    }
+
+    // A window needs one slot per worker and one for the held-back record.
+    // Each slot holds one record, prefix included, and the frame scratch of
+    // the worker that transforms it.
+    int window = resolve_thread_count(job.workers);
+    if (job.budget) {
+        const size_t limit = job.budget->limit();
+        while (encrypting && header.segment_size > BUDGET_MIN_SEGMENT_SIZE &&
+               2 * CryptoBufferPool::class_capacity(SEGMENT_RECORD_PREFIX +
+                                                    segment_work_size(header)) > limit) {
+            header.segment_size /= 2;
+        }
+        const size_t capacity = CryptoBufferPool::class_capacity(
+            SEGMENT_RECORD_PREFIX + segment_work_size(header));
+        if (capacity == 0 || limit / capacity < 2) {
+            return STATUS_MEMORY_ERROR;
+        }
+        window = static_cast<int>(std::min<size_t>(static_cast<size_t>(window), limit / capacity - 1));
+    }
+
+    if (encrypting) {
+        write_segment_header(header, raw);
+        if (write(user_data, raw, sizeof(raw)) != 0) {
+            return STATUS_IO_ERROR;
+        }
+    }
+
+    const size_t bound = segment_record_bound(header.segment_size);
+    std::vector<std::unique_ptr<PooledBuffer> > slots(static_cast<size_t>(window) + 1);
+    std::vector<size_t> lengths(slots.size());
+    for (size_t i = 0; i < slots.size(); ++i) {
+        slots[i].reset(new PooledBuffer(job.budget.get()));
+        slots[i]->reserve(SEGMENT_RECORD_PREFIX + segment_work_size(header));
+    }
+
+    unsigned long long index = 0;
+    size_t filled = 0;
+    bool end = false;
+    while (!end) {
+        // Plaintext is read a segment at a time; ciphertext a record at a time
+        while (filled < slots.size() && !end) {
+            unsigned char* slot = slots[filled]->data();
+            size_t got = 0;
+            bool record = false;
+            if (encrypting) {
+                status = read_stream_bytes(read, user_data, slot + SEGMENT_RECORD_PREFIX,
+                                           header.segment_size, &got);
+                end = got < header.segment_size;
+                // A stream without data still seals its empty last segment
+                record = got > 0 || (index == 0 && filled == 0);
+            } else {
+                status = read_stream_bytes(read, user_data, slot, SEGMENT_RECORD_PREFIX, &got);
+                end = got == 0;
+                record = !end;
+                if (status == STATUS_SUCCESS && record) {
+                    if (got != SEGMENT_RECORD_PREFIX || load_segment_le32(slot) > bound) {
+                        return STATUS_CRYPTO_ERROR;
+                    }
+                    const size_t stored = load_segment_le32(slot);
+                    status = read_stream_bytes(read, user_data, slot + SEGMENT_RECORD_PREFIX,
+                                               stored, &got);
+                    if (status == STATUS_SUCCESS && got != stored) {
+                        return STATUS_CRYPTO_ERROR;
+                    }
+                }
+            }
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+            if (record) {
+                lengths[filled++] = got;
+            }
+        }
+        if (filled == 0) {
+            // A header without records was cut short
+            return STATUS_CRYPTO_ERROR;
+        }
+
+        const size_t count = end ? filled : filled - 1;
+        status = run_status_tasks(count, job.workers, [&](size_t i) {
+            unsigned char* record = slots[i]->data() + SEGMENT_RECORD_PREFIX;
+            const bool last = end && i + 1 == count;
+            int len = static_cast<int>(bound);
+            const int result = transform_segment(job, operation, header, index + i,
+                                                 last ? SEGMENT_FINAL_VERSION : 0,
+                                                 record, static_cast<int>(lengths[i]), record, &len,
+                                                 segment_scratch(header, record));
+            if (result != STATUS_SUCCESS) {
+                return result;
+            }
+            if (encrypting) {
+                store_segment_le32(slots[i]->data(), static_cast<size_t>(len));
+                lengths[i] = SEGMENT_RECORD_PREFIX + static_cast<size_t>(len);
+            } else {
+                // Only the last segment may be short, and only a stream's
+                // only segment empty
+                if (len < 0 || static_cast<size_t>(len) > header.segment_size ||
+                    (!last && static_cast<size_t>(len) != header.segment_size) ||
+                    (len == 0 && index + i != 0)) {
+                    return static_cast<int>(STATUS_CRYPTO_ERROR);
+                }
+                lengths[i] = static_cast<size_t>(len);
+            }
+            return static_cast<int>(STATUS_SUCCESS);
+        });
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            const unsigned char* data = slots[i]->data() + (encrypting ? 0 : SEGMENT_RECORD_PREFIX);
+            if (lengths[i] > 0 && write(user_data, data, static_cast<long long>(lengths[i])) != 0) {
+                return STATUS_IO_ERROR;
+            }
+        }
+        index += count;
+        if (!end) {
+            std::swap(slots[0], slots[filled - 1]);
+            lengths[0] = lengths[filled - 1];
+            filled = 1;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+// Calls `read` until `len` bytes arrived or the input ended
+static int read_stream_bytes(CryptoBridgeStreamRead read, void* user_data,
+                             unsigned char* out, size_t len, size_t* got) {
+    *got = 0;
+    while (*got < len) {
+        const long long result = read(user_data, out + *got, static_cast<long long>(len - *got));
+        if (result < 0 || result > static_cast<long long>(len - *got)) {
+            return STATUS_IO_ERROR;
+        }
+        if (result == 0) {
+            break;
+        }
+        *got += static_cast<size_t>(result);
+    }
+    return STATUS_SUCCESS;
+}
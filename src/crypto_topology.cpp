@@ -0,0 +1,255 @@
+/*
+ * crypto_topology.cpp - CPU topology and thread placement for the crypto bridge
+ */
+
+#include "crypto_topology.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+    #include <sched.h>
+#endif
+
+// Cache levels below cpuN/cache are numbered index0, index1, ...
+static const int kMaxCacheIndex = 16;
+
+// A core is an efficiency core only below this share of the fastest core's
+// capacity, so turbo bins and binning differences within one cluster do not
+// split it (percent)
+static const unsigned long long kEfficiencyCapacityPercent = 80;
+
+struct CoreState {
+    std::mutex mutex;
+    std::vector<CpuCore> cores;  // Every core found, in placement order
+    std::vector<bool> enabled;   // Within the caller's limit
+    std::vector<int> busy;       // Compute threads pinned to each core
+    unsigned int limit_version;  // Bumped by every set_cpu_core_limit
+};
+
+#if defined(__linux__)
+static bool read_sysfs_number(const std::string& path, unsigned long long* value) {
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+    const bool read = std::fscanf(file, "%llu", value) == 1;
+    std::fclose(file);
+    return read;
+}
+
+// First CPU of a list such as "0-3,8-11"; -1 if it cannot be read
+static int read_sysfs_first_cpu(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) {
+        return -1;
+    }
+    int cpu = -1;
+    if (std::fscanf(file, "%d", &cpu) != 1) {
+        cpu = -1;
+    }
+    std::fclose(file);
+    return cpu;
+}
+
+static void describe_core(int id, CpuCore* core) {
+    const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+    core->id = id;
+    // cpu_capacity (arm64) already accounts for the microarchitecture;
+    // the maximum frequency is the next best thing
+    core->capacity = 0;
+    if (!read_sysfs_number(base + "/cpu_capacity", &core->capacity)) {
+        read_sysfs_number(base + "/cpufreq/cpuinfo_max_freq", &core->capacity);
+    }
+    core->cache_group = id;
+    unsigned long long last_level = 0;
+    for (int i = 0; i < kMaxCacheIndex; ++i) {
+        const std::string cache = base + "/cache/index" + std::to_string(i);
+        unsigned long long level = 0;
+        if (!read_sysfs_number(cache + "/level", &level)) {
+            break;
+        }
+        const int first = read_sysfs_first_cpu(cache + "/shared_cpu_list");
+        if (level >= last_level && first >= 0) {
+            last_level = level;
+            core->cache_group = first;
+        }
+    }
+}
+#endif
+
+static void discover_cores(std::vector<CpuCore>* cores) {
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int id = 0; id < CPU_SETSIZE; ++id) {
+            if (CPU_ISSET(id, &allowed)) {
+                CpuCore core;
+                describe_core(id, &core);
+                cores->push_back(core);
+            }
+        }
+    }
+#endif
+    if (cores->empty()) {
+        const unsigned int hardware = std::thread::hardware_concurrency();
+        for (int id = 0; id < static_cast<int>(hardware > 0 ? hardware : 1); ++id) {
+            CpuCore core;
+            core.id = id;
+            core.capacity = 0;
+            core.cache_group = 0;
+            cores->push_back(core);
+        }
+    }
+
+    // Efficiency cores are those well below the fastest, when every core's
+    // capacity is known
+    unsigned long long slowest = cores->front().capacity;
+    unsigned long long fastest = slowest;
+    for (size_t i = 1; i < cores->size(); ++i) {
+        slowest = std::min(slowest, (*cores)[i].capacity);
+        fastest = std::max(fastest, (*cores)[i].capacity);
+    }
+    for (size_t i = 0; i < cores->size(); ++i) {
+        (*cores)[i].performance = slowest == 0 ||
+            (*cores)[i].capacity * 100 >= fastest * kEfficiencyCapacityPercent;
+    }
+
+    std::sort(cores->begin(), cores->end(), [](const CpuCore& a, const CpuCore& b) {
+        if (a.performance != b.performance) {
+            return a.performance;
+        }
+        if (a.capacity != b.capacity) {
+            return a.capacity > b.capacity;
+        }
+        if (a.cache_group != b.cache_group) {
+            return a.cache_group < b.cache_group;
+        }
+        return a.id < b.id;
+    });
+}
+
+static CoreState& core_state() {
+    // Never destroyed: detached job workers may still unpin at exit
+    static CoreState* state = []() {
+        CoreState* created = new CoreState();
+        discover_cores(&created->cores);
+        created->enabled.assign(created->cores.size(), true);
+        created->busy.assign(created->cores.size(), 0);
+        created->limit_version = 0;
+        return created;
+    }();
+    return *state;
+}
+
+#if defined(__linux__)
+static void set_thread_affinity(const std::vector<int>& ids) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        CPU_SET(ids[i], &set);
+    }
+    // Best effort: a container or a cpuset may forbid the change
+    sched_setaffinity(0, sizeof(set), &set);
+}
+#else
+static void set_thread_affinity(const std::vector<int>& ids) {
+    (void)ids;
+}
+#endif
+
+std::vector<CpuCore> cpu_cores() {
+    CoreState& state = core_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    std::vector<CpuCore> cores;
+    for (size_t i = 0; i < state.cores.size(); ++i) {
+        if (state.enabled[i]) {
+            cores.push_back(state.cores[i]);
+        }
+    }
+    return cores;
+}
+
+int cpu_core_count() {
+    CoreState& state = core_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    const int count = static_cast<int>(std::count(state.enabled.begin(), state.enabled.end(), true));
+    return count > 0 ? count : 1;
+}
+
+bool set_cpu_core_limit(const std::vector<int>& ids) {
+    CoreState& state = core_state();
+    std::vector<bool> enabled(state.cores.size(), ids.empty());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        size_t found = 0;
+        while (found < state.cores.size() && state.cores[found].id != ids[i]) {
+            ++found;
+        }
+        if (found == state.cores.size()) {
+            return false;
+        }
+        enabled[found] = true;
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.enabled.swap(enabled);
+    ++state.limit_version;
+    return true;
+}
+
+unsigned int cpu_core_limit_version() {
+    CoreState& state = core_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.limit_version;
+}
+
+ComputeCorePin::ComputeCorePin() : slot_(-1) {
+    CoreState& state = core_state();
+    int core = -1;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        // Least busy core; ties go to the earlier one in placement order,
+        // so a pool fills the performance cores of one cache group first
+        for (size_t i = 0; i < state.cores.size(); ++i) {
+            if (state.enabled[i] && (slot_ < 0 || state.busy[i] < state.busy[slot_])) {
+                slot_ = static_cast<int>(i);
+            }
+        }
+        if (slot_ < 0) {
+            return;
+        }
+        ++state.busy[slot_];
+        core = state.cores[slot_].id;
+    }
+    set_thread_affinity(std::vector<int>(1, core));
+}
+
+ComputeCorePin::~ComputeCorePin() {
+    if (slot_ >= 0) {
+        CoreState& state = core_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        --state.busy[slot_];
+    }
+}
+
+void pin_io_thread() {
+    CoreState& state = core_state();
+    std::vector<int> efficiency;
+    std::vector<int> all;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (size_t i = 0; i < state.cores.size(); ++i) {
+            if (state.enabled[i]) {
+                all.push_back(state.cores[i].id);
+                if (!state.cores[i].performance) {
+                    efficiency.push_back(state.cores[i].id);
+                }
+            }
+        }
+    }
+    if (!all.empty()) {
+        set_thread_affinity(efficiency.empty() ? all : efficiency);
+    }
+}
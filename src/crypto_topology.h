@@ -0,0 +1,69 @@
+/*
+ * crypto_topology.h - CPU topology and thread placement for the crypto bridge
+ *
+ * Unpinned workers migrate between cores, taking their cache with them, and
+ * on big.LITTLE phones the scheduler may well run bulk cipher work on the
+ * efficiency cluster. The bridge therefore reads the core layout once (on
+ * Linux and Android from sysfs: capacity or maximum frequency per core, and
+ * which cores share the last cache level) and places its own threads:
+ *
+ *   compute  cipher workers of parallel_for and parallel_tasks are each
+ *            pinned to one core, the least busy one, performance cores
+ *            first and cores sharing a cache next to each other
+ *   io       job workers, which mostly wait on files and on other threads,
+ *            are confined to the efficiency cores
+ *
+ * A core counts as an efficiency core only when its capacity is below 80%
+ * of the fastest core's, so systems whose cores differ only by frequency
+ * bins have performance cores alone. The caller can restrict the bridge to
+ * a subset of the cores; threads it starts afterwards, the pooled compute
+ * threads and the default thread count follow the restriction. Elsewhere
+ * than Linux the layout is a flat list of hardware threads and pinning
+ * does nothing.
+ */
+
+#ifndef CRYPTO_TOPOLOGY_H
+#define CRYPTO_TOPOLOGY_H
+
+#include <cstddef>
+#include <vector>
+
+struct CpuCore {
+    int id;                       // Kernel CPU number
+    unsigned long long capacity;  // Relative speed; 0 if unknown
+    int cache_group;              // Lowest id sharing this core's last cache level
+    bool performance;
+};
+
+// Cores the bridge may use, performance cores first, then by cache group
+std::vector<CpuCore> cpu_cores();
+
+// Number of cores the bridge may use (at least 1)
+int cpu_core_count();
+
+// Limits the bridge to the listed cores; an empty list lifts the limit.
+// False, with the limit unchanged, if a listed core is not available.
+bool set_cpu_core_limit(const std::vector<int>& ids);
+
+// Changes with every set_cpu_core_limit call, so long-lived threads can
+// tell when to pin themselves again
+unsigned int cpu_core_limit_version();
+
+// Pins the calling thread to one compute core while in scope. Only for
+// threads the bridge started itself: the pin is not undone on exit.
+class ComputeCorePin {
+public:
+    ComputeCorePin();
+    ~ComputeCorePin();
+
+private:
+    ComputeCorePin(const ComputeCorePin&);
+    ComputeCorePin& operator=(const ComputeCorePin&);
+
+    int slot_;  // Index into the busy counts, or -1 if not pinned
+};
+
+// Confines the calling thread, one the bridge started, to the I/O cores
+void pin_io_thread();
+
+#endif // CRYPTO_TOPOLOGY_H
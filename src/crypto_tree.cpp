@@ -0,0 +1,723 @@
+/*
+ * crypto_tree.cpp - Tree engine of the crypto bridge
+ */
+
+#include "crypto_tree.h"
+#include "crypto_arena.h"
+#include "crypto_fs.h"
+#include "crypto_parallel.h"
+#include "crypto_tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+static int plan_tree_file(TreeJob& job, TreeFile& file, CryptoPP::RandomNumberGenerator& rng);
+static void run_tree_task(TreeJob& job, std::vector<TreeFile>& files,
+                          const std::vector<TreePiece>& task, const TreePieceRunner& run_piece);
+static unsigned long long tree_piece_bytes(const TreeFile& file, const TreePiece& piece);
+static int encrypt_tree_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                              PooledBuffer& buffer);
+static int decrypt_tree_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                              PooledBuffer& buffer);
+static size_t tree_worker_bytes(const TreeJob& job, size_t segment_size);
+
+static unsigned long long load_le64(const unsigned char* in) {
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// Body of crypto_bridge_process_tree. Files are cut into segments of the
+// segmented format; small files are packed into shared tasks and large ones
+// split across several, and the tasks run on a work-stealing pool. The
+// password KDF runs once for the whole tree.
+int process_tree(const CryptoBridgeContext& options, int algorithm, int mode,
+                 int key_size_bits, int operation,
+                 const char* password, int password_len,
+                 const char* source_dir, const char* dest_dir,
+                 CryptoBridgeTreeProgress progress, void* user_data, JobControl* control) {
+    if (!source_dir || !dest_dir) {
+        return STATUS_INVALID_PARAMS;
+    }
+    const std::string source(source_dir);
+    const std::string target(dest_dir);
+    if (source.empty() || target.empty() || source == target) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    // The master key material is wiped when this scope closes
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    TreeJob job;
+    int status = prepare_tree_job(job, options, algorithm, mode, key_size_bits, operation,
+                                  password, password_len);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    job.control = control;
+    if (control && options.threads == 0) {
+        // Bulk work in the background leaves a core to the fast lane
+        job.workers = std::min(resolve_thread_count(job.workers),
+                               std::max(1, resolve_thread_count(0) - 1));
+    }
+    std::unique_ptr<TunerSession> tuning;
+    if (options.autotune) {
+        tuning.reset(new TunerSession(algorithm, mode, key_size_bits,
+                                      operation == OPERATION_ENCRYPT, options.threads == 0,
+                                      resolve_thread_count(job.workers), job.bytes_done));
+        job.tuning = tuning.get();
+    }
+
+    std::vector<FsEntry> entries;
+    if (!fs_walk(source, &entries) || !fs_make_directories(target)) {
+        return STATUS_IO_ERROR;
+    }
+
+    size_t file_count = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].directory) {
+            if (!fs_make_directories(fs_join(target, entries[i].path))) {
+                return STATUS_IO_ERROR;
+            }
+        } else {
+            ++file_count;
+        }
+    }
+
+    std::vector<TreeFile> files(file_count);
+    std::vector<std::vector<TreePiece> > tasks;
+    CryptoPP::AutoSeededRandomPool rng;
+    unsigned long long batch_bytes = 0;
+    long long bytes_total = 0;
+
+    size_t index = 0;
+    for (size_t i = 0; i < entries.size() && status == STATUS_SUCCESS; ++i) {
+        if (entries[i].directory) {
+            continue;
+        }
+        TreeFile& file = files[index];
+        file.source = fs_join(source, entries[i].path);
+        file.target = fs_join(target, entries[i].path);
+        file.input_size = entries[i].size;
+        bytes_total += static_cast<long long>(file.input_size);
+        status = plan_tree_file(job, file, rng);
+        if (status == STATUS_SUCCESS) {
+            add_tree_pieces(tasks, file, index, &batch_bytes);
+        }
+        ++index;
+    }
+    if (status != STATUS_SUCCESS) {
+        remove_unfinished_files(files);
+        return status;
+    }
+
+    const bool encrypting = operation == OPERATION_ENCRYPT;
+    status = run_tree_tasks(job, files, tasks, bytes_total, progress, user_data,
+                            [&](const TreePiece& piece, PooledBuffer& buffer) {
+        return encrypting ? encrypt_tree_piece(job, files[piece.file], piece, buffer)
+                          : decrypt_tree_piece(job, files[piece.file], piece, buffer);
+    });
+    if (tuning && status == STATUS_SUCCESS) {
+        tuning->finish();
+    }
+    return status;
+}
+
+// Validates the settings of a tree or archive job and derives its master
+// key material from the password, once for the whole job. The material is
+// carved from the calling thread's arena, so the caller holds a Scope.
+int prepare_tree_job(TreeJob& job, const CryptoBridgeContext& options, int algorithm,
+                     int mode, int key_size_bits, int operation,
+                     const char* password, int password_len) {
+    const int status = configure_tree_job(job, options, algorithm, mode, key_size_bits, operation,
+                                          password, password_len);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    return derive_tree_master(job, password, password_len);
+}
+
+// Validates the password and settings of a job and fills in everything but
+// its master key material
+int configure_tree_job(TreeJob& job, const CryptoBridgeContext& options, int algorithm,
+                       int mode, int key_size_bits, int operation,
+                       const char* password, int password_len) {
+    if (!password || (operation != OPERATION_ENCRYPT && operation != OPERATION_DECRYPT)) {
+        return STATUS_INVALID_PARAMS;
+    }
+    if (password_len < 8) {
+        return STATUS_PASSWORD_TOO_SHORT;
+    }
+
+    int validation_result = validate_algorithm_key_size(algorithm, key_size_bits);
+    if (validation_result != STATUS_SUCCESS) {
+        return validation_result;
+    }
+    validation_result = validate_algorithm_mode_combination(algorithm, mode);
+    if (validation_result != STATUS_SUCCESS) {
+        return validation_result;
+    }
+    if (!algorithm_implemented(algorithm)) {
+        return STATUS_UNSUPPORTED_ALGORITHM;
+    }
+
+    // XTS and Tweak cannot end a file in a partial block shorter than one
+    // cipher block, which arbitrary files do; they are meant for sector-sized
+    // data
+    if (mode == MODE_XTS || mode == MODE_TWEAK) {
+        return STATUS_UNSUPPORTED_MODE;
+    }
+
+    // Same restrictions as process_buffer, checked before touching any file
+    if (options.mac != MAC_NONE && !is_transform_mode(mode)) {
+        return STATUS_INVALID_PARAMS;
+    }
+
+    job.options = options;
+    job.algorithm = algorithm;
+    job.mode = mode;
+    job.key_size_bits = key_size_bits;
+    job.operation = operation;
+    job.workers = options.threads;
+    if (options.memory_budget > 0) {
+        job.budget.reset(new MemoryBudget(static_cast<size_t>(options.memory_budget)));
+        const size_t per_worker = tree_worker_bytes(job, budget_segment_size(job, SEGMENT_DEFAULT_SIZE));
+        const size_t fit = job.budget->limit() / per_worker;
+        job.workers = static_cast<int>(std::max<size_t>(1, std::min<size_t>(
+            fit, static_cast<size_t>(resolve_thread_count(job.workers)))));
+    }
+    job.key_len = derived_key_length(mode, key_size_bits);
+    job.iv_len = nonce_length(algorithm);
+
+    // Segments are independent of each other, and the tasks already keep
+    // every core busy, so no single segment spreads over threads
+    job.options.threads = 1;
+    job.options.start_sector = 0;
+    job.options.stream_offset = 0;
+    return STATUS_SUCCESS;
+}
+
+// Derives a job's master key material from the password into the calling
+// thread's arena
+int derive_tree_master(TreeJob& job, const char* password, int password_len) {
+    unsigned char* master = CryptoArena::thread_instance().allocate_secret(job.key_len + job.iv_len);
+    const int derive_result = derive_key_and_iv(password, password_len,
+                                                master, job.key_len,
+                                                master + job.key_len, job.iv_len);
+    if (derive_result != STATUS_SUCCESS) {
+        return derive_result;
+    }
+    job.master = master;
+    job.master_len = job.key_len + job.iv_len;
+    return STATUS_SUCCESS;
+}
+
+// Fills in a tree file's header and decides whether it is split. The
+// output of a split file is created here, before its tasks write into it.
+static int plan_tree_file(TreeJob& job, TreeFile& file, CryptoPP::RandomNumberGenerator& rng) {
+    SegmentHeader& header = file.header;
+    const bool encrypting = job.operation == OPERATION_ENCRYPT;
+
+    if (encrypting) {
+        header.flags = job.options.compression != COMPRESSION_NONE ? SEGMENT_FLAG_COMPRESSED : 0;
+        header.segment_size = budget_segment_size(
+            job, job.tuning ? job.tuning->segment_size_for(file.input_size) : SEGMENT_DEFAULT_SIZE);
+        header.plaintext_len = file.input_size;
+        rng.GenerateBlock(header.salt, SEGMENT_SALT_SIZE);
+        file.split = !(header.flags & SEGMENT_FLAG_COMPRESSED) &&
+                     segment_count(header) > TREE_SPLIT_SEGMENTS;
+    } else if (file.input_size > TREE_BATCH_BYTES) {
+        // Only large files are worth reading ahead; small ones read their
+        // header in their task
+        FsFile input(file.source, "rb");
+        unsigned char raw[SEGMENT_HEADER_SIZE];
+        if (!input.get()) {
+            return STATUS_IO_ERROR;
+        }
+        if (std::fread(raw, 1, sizeof(raw), input.get()) != sizeof(raw) ||
+            !read_segment_header(raw, &header)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        file.split = !(header.flags & SEGMENT_FLAG_COMPRESSED) &&
+                     segment_count(header) > TREE_SPLIT_SEGMENTS;
+        if (file.split && (header.flags & SEGMENT_FLAG_DIGESTS)) {
+            // Pieces need the versions; loading the table also checks that
+            // it ends the file
+            const int status = load_segment_table(job, input.get(), header, &file.table);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+            job.bytes_done += static_cast<long long>(
+                file.input_size - segment_record_offset(job, header, segment_count(header)));
+        } else if (file.split &&
+                   segment_record_offset(job, header, segment_count(header)) != file.input_size) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        if (file.split) {
+            job.bytes_done += static_cast<long long>(SEGMENT_HEADER_SIZE);
+        }
+    }
+
+    if (!file.split) {
+        return STATUS_SUCCESS;
+    }
+
+    FsFile output(file.target, "wb");
+    if (!output.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (encrypting) {
+        unsigned char raw[SEGMENT_HEADER_SIZE];
+        write_segment_header(header, raw);
+        if (std::fwrite(raw, 1, sizeof(raw), output.get()) != sizeof(raw)) {
+            return STATUS_IO_ERROR;
+        }
+    }
+    return output.close() ? STATUS_SUCCESS : STATUS_IO_ERROR;
+}
+
+// Queues the pieces of one file. A whole file joins the current batch
+// until it holds TREE_BATCH_BYTES; a split file gets one task per run of
+// TREE_SPLIT_SEGMENTS segments.
+void add_tree_pieces(std::vector<std::vector<TreePiece> >& tasks, TreeFile& file,
+                     size_t index, unsigned long long* batch_bytes) {
+    if (!file.split) {
+        if (tasks.empty() || *batch_bytes >= TREE_BATCH_BYTES) {
+            tasks.push_back(std::vector<TreePiece>());
+            *batch_bytes = 0;
+        }
+        TreePiece piece = { index, 0, 0 };
+        tasks.back().push_back(piece);
+        *batch_bytes += file.input_size;
+        file.pending.store(1);
+        return;
+    }
+
+    const unsigned long long segments = segment_count(file.header);
+    int pieces = 0;
+    for (unsigned long long first = 0; first < segments; first += TREE_SPLIT_SEGMENTS) {
+        const unsigned long long left = segments - first;
+        TreePiece piece = { index, first, left < TREE_SPLIT_SEGMENTS ? left : TREE_SPLIT_SEGMENTS };
+        tasks.push_back(std::vector<TreePiece>(1, piece));
+        ++pieces;
+    }
+    file.pending.store(pieces);
+}
+
+// Runs every task on the work-stealing pool and returns the job's status.
+// Progress is reported from the calling thread; on failure, unfinished
+// outputs are removed.
+int run_tree_tasks(TreeJob& job, std::vector<TreeFile>& files,
+                   const std::vector<std::vector<TreePiece> >& tasks, long long bytes_total,
+                   CryptoBridgeTreeProgress progress, void* user_data,
+                   const TreePieceRunner& run_piece) {
+    long long files_total = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].pending.load() > 0) {
+            ++files_total;
+        }
+    }
+
+    const std::function<void()> report = [&]() {
+        progress(job.files_done.load(), files_total, job.bytes_done.load(), bytes_total, user_data);
+    };
+
+    parallel_tasks(tasks.size(), job.workers, [&](size_t task) {
+        run_tree_task(job, files, tasks[task], run_piece);
+    }, progress ? report : std::function<void()>(), TREE_PROGRESS_INTERVAL_MS);
+
+    if (progress) {
+        report();
+    }
+
+    const int status = job.status.load();
+    if (status != STATUS_SUCCESS) {
+        remove_unfinished_files(files);
+    }
+    return status;
+}
+
+// Runs the pieces of one task. The first failure anywhere in the job stops
+// every task at its next piece.
+static void run_tree_task(TreeJob& job, std::vector<TreeFile>& files,
+                          const std::vector<TreePiece>& task, const TreePieceRunner& run_piece) {
+    PooledBuffer buffer(job.budget.get());
+    for (size_t i = 0; i < task.size(); ++i) {
+        if (job.status.load(std::memory_order_relaxed) != STATUS_SUCCESS) {
+            return;
+        }
+        // Pieces are the chunk boundaries at which a background job can be
+        // cancelled, or paused for one of higher priority
+        if (job.control && !job.control->checkpoint()) {
+            int expected = STATUS_SUCCESS;
+            job.status.compare_exchange_strong(expected, STATUS_CANCELLED);
+            return;
+        }
+
+        TreeFile& file = files[task[i].file];
+        if (job.tuning) {
+            job.tuning->enter();
+        }
+        const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        const int status = guarded([&]() { return run_piece(task[i], buffer); });
+        if (job.tuning) {
+            if (status == STATUS_SUCCESS && job.operation == OPERATION_ENCRYPT) {
+                job.tuning->sample(file.header.segment_size, file.input_size,
+                                   tree_piece_bytes(file, task[i]),
+                                   std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - started).count());
+            }
+            job.tuning->leave();
+        }
+        if (job.budget) {
+            // Nothing is held while waiting for the budget at the next piece
+            buffer.release();
+        }
+
+        if (status != STATUS_SUCCESS) {
+            file.failed.store(true);
+            int expected = STATUS_SUCCESS;
+            job.status.compare_exchange_strong(expected, status);
+            return;
+        }
+        if (file.pending.fetch_sub(1) == 1) {
+            ++job.files_done;
+        }
+    }
+}
+
+// Input bytes a piece covers, once the file's header is known
+static unsigned long long tree_piece_bytes(const TreeFile& file, const TreePiece& piece) {
+    if (!file.split) {
+        return file.input_size;
+    }
+    const unsigned long long begin = piece.first_segment * file.header.segment_size;
+    const unsigned long long end = begin + piece.segments * file.header.segment_size;
+    return std::min(end, file.input_size) - std::min(begin, file.input_size);
+}
+
+// Never leaves half-written output behind: removes the outputs of files
+// that failed and of split files that did not finish every piece
+void remove_unfinished_files(const std::vector<TreeFile>& files) {
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].target.empty()) {
+            continue;
+        }
+        if (files[i].failed.load() || (files[i].split && files[i].pending.load() != 0)) {
+            fs_remove(files[i].target);
+        }
+    }
+}
+
+// Encrypts one piece. A whole file is written from the start with its
+// header; a piece of a split file writes its records at their fixed offsets.
+static int encrypt_tree_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                              PooledBuffer& buffer) {
+    const SegmentHeader& header = file.header;
+    const unsigned long long first = piece.first_segment;
+    const unsigned long long count = file.split ? piece.segments : segment_count(header);
+
+    FsFile input(file.source, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+    FsFile output(file.target, file.split ? "r+b" : "wb");
+    if (!output.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    if (file.split) {
+        if (!fs_seek(input.get(), first * header.segment_size) ||
+            !fs_seek(output.get(), segment_record_offset(job, header, first))) {
+            return STATUS_IO_ERROR;
+        }
+    } else {
+        unsigned char raw[SEGMENT_HEADER_SIZE];
+        write_segment_header(header, raw);
+        if (std::fwrite(raw, 1, sizeof(raw), output.get()) != sizeof(raw)) {
+            return STATUS_IO_ERROR;
+        }
+    }
+
+    const size_t bound = segment_record_bound(header.segment_size);
+    unsigned char* data = buffer.reserve(segment_work_size(header));
+    unsigned char* scratch = segment_scratch(header, data);
+    for (unsigned long long i = first; i < first + count; ++i) {
+        const size_t len = segment_length(header, i);
+        if (std::fread(data, 1, len, input.get()) != len) {
+            return STATUS_IO_ERROR;  // The file shrank since the walk
+        }
+
+        int sealed = static_cast<int>(bound);
+        const int status = process_segment(job, header, i, data, static_cast<int>(len), data, &sealed,
+                                           scratch);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+        if (file.split && static_cast<size_t>(sealed) != sealed_segment_length(job, len)) {
+            return STATUS_UNKNOWN_ERROR;
+        }
+
+        unsigned char prefix[SEGMENT_RECORD_PREFIX];
+        store_segment_le32(prefix, static_cast<size_t>(sealed));
+        if (std::fwrite(prefix, 1, sizeof(prefix), output.get()) != sizeof(prefix) ||
+            std::fwrite(data, 1, sealed, output.get()) != static_cast<size_t>(sealed)) {
+            return STATUS_IO_ERROR;
+        }
+        job.bytes_done += static_cast<long long>(len);
+    }
+
+    return output.close() ? STATUS_SUCCESS : STATUS_IO_ERROR;
+}
+
+// Decrypts one piece. Anything that does not parse as the segmented format,
+// or does not authenticate, is reported as a crypto error.
+static int decrypt_tree_piece(TreeJob& job, const TreeFile& file, const TreePiece& piece,
+                              PooledBuffer& buffer) {
+    FsFile input(file.source, "rb");
+    if (!input.get()) {
+        return STATUS_IO_ERROR;
+    }
+
+    SegmentHeader header = file.header;
+    unsigned long long first = piece.first_segment;
+    unsigned long long count = piece.segments;
+    std::vector<SegmentDigest> loaded;
+    const std::vector<SegmentDigest>* table = &file.table;
+    if (!file.split) {
+        unsigned char raw[SEGMENT_HEADER_SIZE];
+        if (std::fread(raw, 1, sizeof(raw), input.get()) != sizeof(raw) ||
+            !read_segment_header(raw, &header)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        first = 0;
+        count = segment_count(header);
+        job.bytes_done += static_cast<long long>(SEGMENT_HEADER_SIZE);
+
+        if (header.flags & SEGMENT_FLAG_DIGESTS) {
+            const int status = load_segment_table(job, input.get(), header, &loaded);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+            table = &loaded;
+            job.bytes_done += static_cast<long long>(
+                file.input_size - segment_record_offset(job, header, count));
+        }
+    }
+    if (!fs_seek(input.get(), segment_record_offset(job, header, first))) {
+        return STATUS_IO_ERROR;
+    }
+    const bool versioned = (header.flags & SEGMENT_FLAG_DIGESTS) != 0;
+
+    FsFile output(file.target, file.split ? "r+b" : "wb");
+    if (!output.get()) {
+        return STATUS_IO_ERROR;
+    }
+    if (file.split && !fs_seek(output.get(), first * header.segment_size)) {
+        return STATUS_IO_ERROR;
+    }
+
+    const size_t bound = segment_record_bound(header.segment_size);
+    unsigned char* data = buffer.reserve(segment_work_size(header));
+    unsigned char* scratch = segment_scratch(header, data);
+    for (unsigned long long i = first; i < first + count; ++i) {
+        unsigned char prefix[SEGMENT_RECORD_PREFIX];
+        if (std::fread(prefix, 1, sizeof(prefix), input.get()) != sizeof(prefix)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        const size_t stored = load_segment_le32(prefix);
+        if (stored == 0 || stored > bound ||
+            (versioned && stored != sealed_segment_length(job, segment_length(header, i))) ||
+            std::fread(data, 1, stored, input.get()) != stored) {
+            return STATUS_CRYPTO_ERROR;
+        }
+
+        int len = static_cast<int>(bound);
+        const unsigned long long version = versioned ? (*table)[static_cast<size_t>(i)].version : 0;
+        const int status = transform_segment(job, job.operation, header, i, version,
+                                             data, static_cast<int>(stored), data, &len, scratch);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+        if (static_cast<size_t>(len) != segment_length(header, i)) {
+            return STATUS_CRYPTO_ERROR;
+        }
+        if (std::fwrite(data, 1, len, output.get()) != static_cast<size_t>(len)) {
+            return STATUS_IO_ERROR;
+        }
+        job.bytes_done += static_cast<long long>(sizeof(prefix) + stored);
+    }
+
+    // A whole file must end with its last record, or with its digest table
+    if (!file.split && !versioned && std::fgetc(input.get()) != EOF) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    return output.close() ? STATUS_SUCCESS : STATUS_IO_ERROR;
+}
+
+// Reads and opens the digest table that ends a file. A table that is
+// missing, does not authenticate or is followed by more data is a crypto
+// error.
+int load_segment_table(const TreeJob& job, std::FILE* file, const SegmentHeader& header,
+                       std::vector<SegmentDigest>* table) {
+    const unsigned long long segments = segment_count(header);
+    if (segments > static_cast<unsigned long long>(INT_MAX / 2) / (8 + SEGMENT_DIGEST_SIZE)) {
+        return STATUS_CRYPTO_ERROR;
+    }
+    const size_t plain_len = segment_table_length(segments);
+    const size_t sealed_len = sealed_segment_length(job, plain_len);
+
+    unsigned char prefix[SEGMENT_TABLE_PREFIX];
+    if (!fs_seek(file, segment_record_offset(job, header, segments)) ||
+        std::fread(prefix, 1, sizeof(prefix), file) != sizeof(prefix) ||
+        load_segment_le32(prefix) != sealed_len) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    PooledBuffer buffer(job.budget.get());
+    unsigned char* data = buffer.reserve(sealed_len);
+    if (std::fread(data, 1, sealed_len, file) != sealed_len || std::fgetc(file) != EOF) {
+        return STATUS_CRYPTO_ERROR;
+    }
+
+    int len = static_cast<int>(buffer.capacity());
+    const int status = transform_segment(job, OPERATION_DECRYPT, header, SEGMENT_TABLE_INDEX,
+                                         load_le64(prefix + 4), data, static_cast<int>(sealed_len),
+                                         data, &len, nullptr);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    return read_segment_table(data, static_cast<size_t>(len), segments, table)
+        ? STATUS_SUCCESS : STATUS_CRYPTO_ERROR;
+}
+
+// Runs `count` independent tasks and returns the first failure
+int run_status_tasks(size_t count, int threads, const std::function<int(size_t)>& task) {
+    std::atomic<int> status(STATUS_SUCCESS);
+    parallel_tasks(count, threads, [&](size_t i) {
+        if (status.load(std::memory_order_relaxed) != STATUS_SUCCESS) {
+            return;
+        }
+        const int result = guarded([&]() { return task(i); });
+        if (result != STATUS_SUCCESS) {
+            int expected = STATUS_SUCCESS;
+            status.compare_exchange_strong(expected, result);
+        }
+    }, std::function<void()>(), 0);
+    return status.load();
+}
+
+// Encrypts or decrypts one segment under the keys of its position, as
+// process_buffer does (`output` may equal `input`). `scratch` is the frame
+// area of a segment_work_size buffer (see segment_scratch), or null to let
+// a compressed segment allocate its own.
+int process_segment(const TreeJob& job, const SegmentHeader& header, unsigned long long index,
+                    const unsigned char* input, int input_len,
+                    unsigned char* output, int* output_len, unsigned char* scratch) {
+    return transform_segment(job, job.operation, header, index, 0, input, input_len,
+                             output, output_len, scratch);
+}
+
+// Same as process_segment, for a given direction and segment version
+int transform_segment(const TreeJob& job, int operation, const SegmentHeader& header,
+                      unsigned long long index, unsigned long long version,
+                      const unsigned char* input, int input_len,
+                      unsigned char* output, int* output_len, unsigned char* scratch) {
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+    unsigned char* material = arena.allocate_secret(job.key_len + job.iv_len);
+    derive_segment_keys(job.master, job.master_len, header, index, version,
+                        material, job.key_len + job.iv_len);
+
+    SessionKeys keys;
+    keys.key = material;
+    keys.iv = material + job.key_len;
+
+    // Decryption follows the header, not the caller's context
+    CryptoBridgeContext options = job.options;
+    options.compression = (header.flags & SEGMENT_FLAG_COMPRESSED) ? COMPRESSION_DEFLATE
+                                                                  : COMPRESSION_NONE;
+
+    const int status = process_buffer(options, job.algorithm, job.mode, job.key_size_bits,
+                                      operation, nullptr, 0, input, input_len,
+                                      output, output_len, nullptr, nullptr, nullptr, &keys,
+                                      scratch);
+    return status;
+}
+
+// Buffer size that holds any record of a segment: the plaintext or its
+// compressed frame, plus padding and tags
+size_t segment_record_bound(size_t segment_size) {
+    return compress_frame_bound(segment_size) + 2 * AUTH_TAG_SIZE + 128;
+}
+
+// Buffer a worker reserves to seal or open segments under `header`: one
+// record, followed by a record-sized frame area when the segments are
+// compressed. Both come from one reservation, so a worker never waits on
+// the budget while it holds part of what it needs.
+size_t segment_work_size(const SegmentHeader& header) {
+    const size_t bound = segment_record_bound(header.segment_size);
+    return (header.flags & SEGMENT_FLAG_COMPRESSED) ? 2 * bound : bound;
+}
+
+// The frame area of a segment_work_size buffer, or null if the segments
+// are not compressed
+unsigned char* segment_scratch(const SegmentHeader& header, unsigned char* buffer) {
+    return (header.flags & SEGMENT_FLAG_COMPRESSED)
+        ? buffer + segment_record_bound(header.segment_size) : nullptr;
+}
+
+// Budgeted memory a tree worker holds while it seals or opens segments of
+// `segment_size`: its segment_work_size buffer as the pool rounds it
+static size_t tree_worker_bytes(const TreeJob& job, size_t segment_size) {
+    const size_t bound = segment_record_bound(segment_size);
+    return CryptoBufferPool::class_capacity(
+        job.options.compression != COMPRESSION_NONE ? 2 * bound : bound);
+}
+
+// Largest segment size up to `segment_size` with which one worker fits the
+// job's memory budget
+size_t budget_segment_size(const TreeJob& job, size_t segment_size) {
+    if (!job.budget) {
+        return segment_size;
+    }
+    while (segment_size > BUDGET_MIN_SEGMENT_SIZE &&
+           tree_worker_bytes(job, segment_size) > job.budget->limit()) {
+        segment_size /= 2;
+    }
+    return segment_size;
+}
+
+// Sealed length of an uncompressed segment of `len` bytes
+size_t sealed_segment_length(const TreeJob& job, size_t len) {
+    size_t sealed = len;
+    if (job.mode == MODE_CBC || job.mode == MODE_ECB) {
+        const size_t block_size = static_cast<size_t>(padding_block_size(job.algorithm));
+        sealed = len - len % block_size + block_size;
+    } else if (is_aead_mode(job.mode)) {
+        sealed += AUTH_TAG_SIZE;
+    }
+    if (job.options.mac != MAC_NONE) {
+        sealed += AUTH_TAG_SIZE;
+    }
+    return sealed;
+}
+
+// File offset of record `index` in an uncompressed segmented file; for
+// index == segment_count this is the expected file size
+unsigned long long segment_record_offset(const TreeJob& job, const SegmentHeader& header,
+                                         unsigned long long index) {
+    const unsigned long long segments = segment_count(header);
+    const unsigned long long full = SEGMENT_RECORD_PREFIX +
+                                    sealed_segment_length(job, header.segment_size);
+    if (index < segments) {
+        return SEGMENT_HEADER_SIZE + index * full;
+    }
+    if (segments == 0) {
+        return SEGMENT_HEADER_SIZE;
+    }
+    return SEGMENT_HEADER_SIZE + (segments - 1) * full + SEGMENT_RECORD_PREFIX +
+           sealed_segment_length(job, segment_length(header, segments - 1));
+}
@@ -0,0 +1,167 @@
+/*
+ * crypto_tree.h - Tree engine of the crypto bridge
+ *
+ * A tree call encrypts or decrypts every file below a directory in the
+ * segmented file format. Files are planned into pieces (runs of segments):
+ * small files are batched into shared tasks, large ones split over several,
+ * and the tasks run on the work-stealing pool with the password KDF paid
+ * once for the whole job. Archives, in-place updates and streams seal their
+ * segments through the same job state and segment helpers.
+ */
+
+#ifndef CRYPTO_TREE_H
+#define CRYPTO_TREE_H
+
+#include "crypto_bridge_internal.h"
+#include "crypto_buffer_pool.h"
+#include "crypto_segment.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TunerSession;
+
+// Small files are packed into tree tasks of about this many bytes, so the
+// per-task cost is paid once per batch rather than once per file
+static const unsigned long long TREE_BATCH_BYTES = 8 * 1024 * 1024;
+
+// Files with more segments than this are split into tasks of this many
+// segments each, so one large file keeps several workers busy
+static const unsigned long long TREE_SPLIT_SEGMENTS = 4;
+
+// Interval between progress callbacks of a tree job
+static const int TREE_PROGRESS_INTERVAL_MS = 100;
+
+// Segments of new files are halved down to this size to fit a budget
+static const size_t BUDGET_MIN_SEGMENT_SIZE = 64 * 1024;
+
+// One file of a tree job
+struct TreeFile {
+    std::string source;
+    std::string target;
+    unsigned long long input_size;
+    SegmentHeader header;      // Known up front when encrypting and for split files
+    bool split;                // Spread over several tasks; the output exists up front
+    std::atomic<int> pending;  // Pieces not yet finished
+    std::atomic<bool> failed;
+    std::vector<SegmentDigest> table;  // Segment versions of a split file with a digest table
+
+    TreeFile() : input_size(0), split(false), pending(0), failed(false) {}
+};
+
+// A run of segments of one file. A tree task is one or more pieces.
+struct TreePiece {
+    size_t file;
+    unsigned long long first_segment;
+    unsigned long long segments;
+};
+
+// Shared state of one tree, archive, update or stream call
+struct TreeJob {
+    CryptoBridgeContext options;  // Settings for each segment
+    int algorithm;
+    int mode;
+    int key_size_bits;
+    int operation;
+    const unsigned char* master;  // Password-derived key and IV, or an archive key
+    int master_len;
+    int key_len;
+    int iv_len;
+    int workers;                  // Pool size (CRYPTO_OPTION_THREADS)
+    std::atomic<long long> bytes_done;
+    std::atomic<long long> files_done;
+    std::atomic<int> status;      // First failure; STATUS_SUCCESS while running
+    JobControl* control;          // Background job running the tree, if any
+    TunerSession* tuning;         // Autotuning of a tree job, if enabled
+    std::unique_ptr<MemoryBudget> budget;  // CRYPTO_OPTION_MEMORY_BUDGET, if set
+
+    TreeJob()
+        : bytes_done(0), files_done(0), status(STATUS_SUCCESS), control(nullptr), tuning(nullptr) {}
+    ~TreeJob() {
+        if (budget) {
+            // Idle pool buffers count towards the caller's memory too
+            CryptoBufferPool::instance().trim();
+        }
+    }
+};
+
+// Processes one piece of a tree or archive job
+typedef std::function<int(const TreePiece&, PooledBuffer&)> TreePieceRunner;
+
+// Validates a job's password and settings and derives its master key
+// material into the calling thread's arena, whose Scope the caller holds
+int prepare_tree_job(TreeJob& job, const CryptoBridgeContext& options, int algorithm,
+                     int mode, int key_size_bits, int operation,
+                     const char* password, int password_len);
+
+// Same, without deriving the master key material
+int configure_tree_job(TreeJob& job, const CryptoBridgeContext& options, int algorithm,
+                       int mode, int key_size_bits, int operation,
+                       const char* password, int password_len);
+
+// Derives the master key material of a configured job
+int derive_tree_master(TreeJob& job, const char* password, int password_len);
+
+// Queues the pieces of one file: whole files are batched into tasks of
+// about TREE_BATCH_BYTES, split files get a task per TREE_SPLIT_SEGMENTS
+void add_tree_pieces(std::vector<std::vector<TreePiece> >& tasks, TreeFile& file,
+                     size_t index, unsigned long long* batch_bytes);
+
+// Runs the tasks on the work-stealing pool, reporting progress from the
+// calling thread, and returns the first failure. Unfinished outputs are
+// removed on failure.
+int run_tree_tasks(TreeJob& job, std::vector<TreeFile>& files,
+                   const std::vector<std::vector<TreePiece> >& tasks, long long bytes_total,
+                   CryptoBridgeTreeProgress progress, void* user_data,
+                   const TreePieceRunner& run_piece);
+
+// Removes the outputs of failed files and of unfinished split files
+void remove_unfinished_files(const std::vector<TreeFile>& files);
+
+// Reads and opens the digest table that ends a file
+int load_segment_table(const TreeJob& job, std::FILE* file, const SegmentHeader& header,
+                       std::vector<SegmentDigest>* table);
+
+// Runs `count` independent tasks and returns the first failure
+int run_status_tasks(size_t count, int threads, const std::function<int(size_t)>& task);
+
+// Encrypts or decrypts one segment under the keys of its position, as
+// process_buffer does (`output` may equal `input`). `scratch` is the
+// frame area of a segment_work_size buffer, or null.
+int process_segment(const TreeJob& job, const SegmentHeader& header, unsigned long long index,
+                    const unsigned char* input, int input_len,
+                    unsigned char* output, int* output_len, unsigned char* scratch);
+
+// Same, for a given direction and segment version
+int transform_segment(const TreeJob& job, int operation, const SegmentHeader& header,
+                      unsigned long long index, unsigned long long version,
+                      const unsigned char* input, int input_len,
+                      unsigned char* output, int* output_len, unsigned char* scratch);
+
+// Buffer size that holds any record of a segment
+size_t segment_record_bound(size_t segment_size);
+
+// Buffer a worker reserves to seal or open segments under `header`: a
+// record, plus a frame area when they are compressed
+size_t segment_work_size(const SegmentHeader& header);
+
+// The frame area of a segment_work_size buffer, or null
+unsigned char* segment_scratch(const SegmentHeader& header, unsigned char* buffer);
+
+// Largest segment size up to `segment_size` with which one worker fits
+// the job's memory budget
+size_t budget_segment_size(const TreeJob& job, size_t segment_size);
+
+// Sealed length of an uncompressed segment of `len` bytes
+size_t sealed_segment_length(const TreeJob& job, size_t len);
+
+// File offset of record `index` in an uncompressed segmented file; for
+// index == segment_count this is the expected file size
+unsigned long long segment_record_offset(const TreeJob& job, const SegmentHeader& header,
+                                         unsigned long long index);
+
+#endif // CRYPTO_TREE_H
@@ -0,0 +1,331 @@
+/*
+ * crypto_tuner.cpp - Segment size and thread count autotuning for tree jobs
+ */
+
+#include "crypto_tuner.h"
+#include "crypto_fs.h"
+#include "crypto_segment.h"
+#include "crypto_topology.h"
+#include <cstdio>
+
+// Length of one throughput window, and the pieces per worker it must see
+static const double kWindowSeconds = 0.25;
+static const int kWindowPiecesPerThread = 2;
+
+// A step must beat the best window by this factor to count as better
+static const double kImprovement = 1.05;
+
+// Samples beyond this many probe quotas are halved so the profile follows
+// changes of the host (a new disk, thermal limits)
+static const unsigned long long kSampleCap = 16 * TUNER_PROBE_BYTES;
+
+// Same bound as CRYPTO_OPTION_THREADS
+static const int kMaxProfileThreads = 256;
+
+static const char kProfileTag[] = "cryptingtool-tuner";
+static const int kProfileVersion = 2;
+
+// Version 1 profiles were keyed by algorithm and mode only
+static long long profile_key(int algorithm, int mode, int key_size_bits, bool encrypting) {
+    const long long cipher = static_cast<long long>(algorithm) * 1000 + mode;
+    return (cipher * 10000 + key_size_bits) * 2 + (encrypting ? 0 : 1);
+}
+
+// Fastest segment size with a full probe quota, else the format default
+static size_t best_segment_size(const TunerSample samples[TUNER_SEGMENT_CANDIDATES]) {
+    size_t best = SEGMENT_DEFAULT_SIZE;
+    double best_rate = 0;
+    for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+        if (samples[i].bytes >= TUNER_PROBE_BYTES && samples[i].seconds > 0 &&
+            samples[i].bytes / samples[i].seconds > best_rate) {
+            best_rate = samples[i].bytes / samples[i].seconds;
+            best = TUNER_SEGMENT_SIZES[i];
+        }
+    }
+    return best;
+}
+
+AutoTuner& AutoTuner::instance() {
+    static AutoTuner tuner;
+    return tuner;
+}
+
+TunerProfile AutoTuner::lookup(int algorithm, int mode, int key_size_bits, bool encrypting) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TunerProfile profile = { SEGMENT_DEFAULT_SIZE, 0, 0 };
+    std::map<long long, Entry>::const_iterator it =
+        entries_.find(profile_key(algorithm, mode, key_size_bits, encrypting));
+    if (it != entries_.end()) {
+        profile.segment_size = best_segment_size(it->second.samples);
+        profile.threads = it->second.threads;
+        profile.mb_per_s = it->second.mb_per_s;
+    }
+    return profile;
+}
+
+void AutoTuner::probe_quotas(int algorithm, int mode, int key_size_bits, bool encrypting,
+                             unsigned long long quotas[TUNER_SEGMENT_CANDIDATES]) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<long long, Entry>::const_iterator it =
+        entries_.find(profile_key(algorithm, mode, key_size_bits, encrypting));
+    for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+        const unsigned long long have = it != entries_.end() ? it->second.samples[i].bytes : 0;
+        quotas[i] = have < TUNER_PROBE_BYTES ? TUNER_PROBE_BYTES - have : 0;
+    }
+}
+
+void AutoTuner::record(int algorithm, int mode, int key_size_bits, bool encrypting,
+                       const TunerSample samples[TUNER_SEGMENT_CANDIDATES], int threads,
+                       double mb_per_s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const long long key = profile_key(algorithm, mode, key_size_bits, encrypting);
+    std::map<long long, Entry>::iterator it = entries_.find(key);
+    if (it == entries_.end()) {
+        Entry entry = {};
+        it = entries_.insert(std::make_pair(key, entry)).first;
+    }
+    Entry& entry = it->second;
+    for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+        entry.samples[i].bytes += samples[i].bytes;
+        entry.samples[i].seconds += samples[i].seconds;
+        if (entry.samples[i].bytes > kSampleCap) {
+            entry.samples[i].bytes /= 2;
+            entry.samples[i].seconds /= 2;
+        }
+    }
+    if (threads > 0) {
+        entry.threads = threads;
+    }
+    entry.mb_per_s = mb_per_s;
+    save();
+}
+
+bool AutoTuner::set_profile_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    entries_.clear();
+    if (path_.empty() || !fs_exists(path_)) {
+        return true;
+    }
+    if (!load()) {
+        entries_.clear();
+        return false;
+    }
+    return true;
+}
+
+bool AutoTuner::load() {
+    FsFile file(path_, "r");
+    if (!file.get()) {
+        return false;
+    }
+    char tag[sizeof(kProfileTag)] = {};
+    int version = 0;
+    int cores = 0;
+    if (std::fscanf(file.get(), "%18s %d %d", tag, &version, &cores) != 3 ||
+        std::string(tag) != kProfileTag) {
+        return false;
+    }
+    if (version != kProfileVersion || cores != cpu_core_count()) {
+        // Keyed another way, measured on other hardware, or under another
+        // core limit; the next tuned job replaces it
+        return true;
+    }
+    long long key = 0;
+    Entry entry = {};
+    while (std::fscanf(file.get(), "%lld %d %lf", &key, &entry.threads, &entry.mb_per_s) == 3) {
+        for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+            if (std::fscanf(file.get(), "%llu %lf", &entry.samples[i].bytes,
+                            &entry.samples[i].seconds) != 2 ||
+                entry.samples[i].seconds < 0) {
+                return false;
+            }
+        }
+        if (entry.threads < 0 || entry.threads > kMaxProfileThreads) {
+            return false;
+        }
+        entries_[key] = entry;
+    }
+    return std::feof(file.get()) != 0;
+}
+
+// Best effort: a profile that cannot be written is kept in memory
+void AutoTuner::save() {
+    if (path_.empty()) {
+        return;
+    }
+    const std::string temporary = path_ + ".tmp";
+    FsFile file(temporary, "w");
+    if (!file.get()) {
+        return;
+    }
+    std::fprintf(file.get(), "%s %d %d\n", kProfileTag, kProfileVersion, cpu_core_count());
+    for (std::map<long long, Entry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it) {
+        std::fprintf(file.get(), "%lld %d %.3f", it->first, it->second.threads, it->second.mb_per_s);
+        for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+            std::fprintf(file.get(), " %llu %.6f", it->second.samples[i].bytes,
+                         it->second.samples[i].seconds);
+        }
+        std::fprintf(file.get(), "\n");
+    }
+    if (!file.close() || !fs_rename(temporary, path_)) {
+        fs_remove(temporary);
+    }
+}
+
+TunerSession::TunerSession(int algorithm, int mode, int key_size_bits, bool encrypting,
+                           bool tune_threads, int max_threads,
+                           const std::atomic<long long>& bytes_done)
+    : algorithm_(algorithm),
+      mode_(mode),
+      key_size_bits_(key_size_bits),
+      encrypting_(encrypting),
+      tune_segments_(encrypting),
+      tune_threads_(tune_threads && max_threads > 1),
+      max_threads_(max_threads),
+      bytes_done_(bytes_done),
+      started_(Clock::now()),
+      measuring_(false),
+      running_(0),
+      reversed_(false),
+      settled_(false),
+      best_rate_(-1),
+      start_bytes_(0),
+      window_start_(started_),
+      window_bytes_(0),
+      window_pieces_(0) {
+    const TunerProfile profile =
+        AutoTuner::instance().lookup(algorithm, mode, key_size_bits, encrypting);
+    best_segment_size_ = profile.segment_size;
+    for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+        quotas_[i] = 0;
+        samples_[i].bytes = 0;
+        samples_[i].seconds = 0;
+    }
+    if (tune_segments_) {
+        AutoTuner::instance().probe_quotas(algorithm, mode, key_size_bits, encrypting, quotas_);
+    }
+
+    // Start where the last job settled and look both ways from there
+    limit_ = max_threads_;
+    if (tune_threads_ && profile.threads > 0 && profile.threads < max_threads_) {
+        limit_ = profile.threads;
+    }
+    best_limit_ = limit_;
+    direction_ = limit_ < max_threads_ ? 1 : -1;
+    settled_ = !tune_threads_;
+}
+
+size_t TunerSession::segment_size_for(unsigned long long input_size) {
+    if (!tune_segments_ || input_size < TUNER_MIN_FILE_BYTES) {
+        return best_segment_size_;
+    }
+    for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+        if (quotas_[i] > 0) {
+            quotas_[i] = quotas_[i] > input_size ? quotas_[i] - input_size : 0;
+            return TUNER_SEGMENT_SIZES[i];
+        }
+    }
+    return best_segment_size_;
+}
+
+void TunerSession::enter() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!measuring_) {
+        // Planning may already have counted bytes; time starts with the work
+        measuring_ = true;
+        started_ = window_start_ = Clock::now();
+        start_bytes_ = window_bytes_ = bytes_done_.load();
+    }
+    while (running_ >= limit_) {
+        slot_free_.wait(lock);
+    }
+    ++running_;
+}
+
+void TunerSession::leave() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --running_;
+    ++window_pieces_;
+    if (!settled_) {
+        retune(Clock::now());
+    }
+    slot_free_.notify_all();
+}
+
+void TunerSession::sample(size_t segment_size, unsigned long long input_size,
+                          unsigned long long bytes, double seconds) {
+    if (!tune_segments_ || input_size < TUNER_MIN_FILE_BYTES) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < TUNER_SEGMENT_CANDIDATES; ++i) {
+        if (TUNER_SEGMENT_SIZES[i] == segment_size) {
+            samples_[i].bytes += bytes;
+            samples_[i].seconds += seconds;
+        }
+    }
+}
+
+void TunerSession::finish() {
+    int threads = 0;
+    long long start_bytes = 0;
+    Clock::time_point started;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tune_threads_ && best_rate_ >= 0) {
+            threads = best_limit_;
+        }
+        start_bytes = start_bytes_;
+        started = started_;
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    const double mb_per_s = seconds > 0 ? (bytes_done_.load() - start_bytes) / seconds / 1e6 : 0;
+    AutoTuner::instance().record(algorithm_, mode_, key_size_bits_, encrypting_, samples_,
+                                 threads, mb_per_s);
+}
+
+// Ends a window once it is long enough and saw enough pieces, then moves
+// the limit: on in the same direction while it helps, once the other way
+// from the best limit when it stops helping, and back to the best after that
+void TunerSession::retune(Clock::time_point now) {
+    const double seconds = std::chrono::duration<double>(now - window_start_).count();
+    if (seconds < kWindowSeconds || window_pieces_ < kWindowPiecesPerThread * limit_) {
+        return;
+    }
+    const long long bytes = bytes_done_.load();
+    const double rate = (bytes - window_bytes_) / seconds;
+    window_start_ = now;
+    window_bytes_ = bytes;
+    window_pieces_ = 0;
+
+    if (best_rate_ < 0 || rate > best_rate_ * kImprovement) {
+        best_rate_ = rate;
+        best_limit_ = limit_;
+    } else if (!reversed_) {
+        reversed_ = true;
+        direction_ = -direction_;
+    } else {
+        limit_ = best_limit_;
+        settled_ = true;
+        return;
+    }
+
+    int next = best_limit_ + direction_;
+    if (next < 1 || next > max_threads_) {
+        if (reversed_) {
+            limit_ = best_limit_;
+            settled_ = true;
+            return;
+        }
+        reversed_ = true;
+        direction_ = -direction_;
+        next = best_limit_ + direction_;
+        if (next < 1 || next > max_threads_) {
+            limit_ = best_limit_;
+            settled_ = true;
+            return;
+        }
+    }
+    limit_ = next;
+}
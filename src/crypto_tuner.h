@@ -0,0 +1,163 @@
+/*
+ * crypto_tuner.h - Segment size and thread count autotuning for tree jobs
+ *
+ * How fast a tree encrypts depends on the cipher, the caches and the disk,
+ * so fixed figures are wrong somewhere. A TunerSession watches one tree
+ * job while it runs:
+ *
+ *   threads   the pool starts at its full size, but only `limit` workers
+ *             run pieces at a time. Every window of about 250 ms the
+ *             session compares the job's throughput with the best so far
+ *             and moves the limit one step, up or down, until neither
+ *             direction helps.
+ *   segments  while a segment size of AutoTuner's candidates has too few
+ *             samples, large files early in an encrypting job are planned
+ *             with it; the rest use the best size known. Each piece's
+ *             bytes per thread-second count towards its size.
+ *
+ * When the job ends the session folds what it saw into the AutoTuner
+ * profile, keyed by algorithm, mode, key size and direction (more rounds
+ * and decryption run at other speeds), so the next job of the same kind
+ * starts from the settled values. The profile can be kept in a file: it holds nothing
+ * secret, and is dropped when the host's core count changes.
+ */
+
+#ifndef CRYPTO_TUNER_H
+#define CRYPTO_TUNER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Segment sizes the tuner chooses from
+static const size_t TUNER_SEGMENT_SIZES[] = {
+    1024 * 1024, 2 * 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024
+};
+static const size_t TUNER_SEGMENT_CANDIDATES = 4;
+
+// Input each candidate segment size gets before it is trusted
+static const unsigned long long TUNER_PROBE_BYTES = 64ULL * 1024 * 1024;
+
+// Files below this size are one or two segments whatever the size, so they
+// neither probe nor count
+static const unsigned long long TUNER_MIN_FILE_BYTES = 16ULL * 1024 * 1024;
+
+// Bytes and thread-seconds spent sealing with one segment size
+struct TunerSample {
+    unsigned long long bytes;
+    double seconds;
+};
+
+// What the profile knows about one algorithm, mode, key size and direction
+struct TunerProfile {
+    size_t segment_size;  // Best measured, or the format default
+    int threads;          // Settled worker count; 0 if never measured
+    double mb_per_s;      // Throughput of the last tuned job; 0 if none
+};
+
+class AutoTuner {
+public:
+    static AutoTuner& instance();
+
+    TunerProfile lookup(int algorithm, int mode, int key_size_bits, bool encrypting);
+
+    // Sizes still short of TUNER_PROBE_BYTES, and the bytes each one lacks
+    void probe_quotas(int algorithm, int mode, int key_size_bits, bool encrypting,
+                      unsigned long long quotas[TUNER_SEGMENT_CANDIDATES]);
+
+    // Adds a finished job's samples. `threads` is 0 if the job did not tune
+    // its thread count.
+    void record(int algorithm, int mode, int key_size_bits, bool encrypting,
+                const TunerSample samples[TUNER_SEGMENT_CANDIDATES], int threads,
+                double mb_per_s);
+
+    // Keeps the profile in `path`, loading it now if it exists; an empty
+    // path keeps it in memory only. False if the file exists but cannot be
+    // read as a profile, which then starts empty.
+    bool set_profile_path(const std::string& path);
+
+private:
+    struct Entry {
+        TunerSample samples[TUNER_SEGMENT_CANDIDATES];
+        int threads;
+        double mb_per_s;
+    };
+
+    AutoTuner() {}
+    AutoTuner(const AutoTuner&);
+    AutoTuner& operator=(const AutoTuner&);
+
+    // Both expect mutex_ to be held
+    bool load();
+    void save();
+
+    std::mutex mutex_;
+    std::map<long long, Entry> entries_;
+    std::string path_;
+};
+
+// Tuning state of one tree job
+class TunerSession {
+public:
+    // `bytes_done` is the job's progress counter; `max_threads` its pool
+    // size. Segment sizes are only tuned when encrypting.
+    TunerSession(int algorithm, int mode, int key_size_bits, bool encrypting, bool tune_threads,
+                 int max_threads, const std::atomic<long long>& bytes_done);
+
+    // Segment size for a file being planned (planning runs on one thread)
+    size_t segment_size_for(unsigned long long input_size);
+
+    // Around each piece: enter blocks while `limit` workers are busy
+    void enter();
+    void leave();
+
+    // Time a worker spent sealing `bytes` of a file with `segment_size` segments
+    void sample(size_t segment_size, unsigned long long input_size,
+                unsigned long long bytes, double seconds);
+
+    // Records the job in the profile; call once, after a successful job
+    void finish();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    TunerSession(const TunerSession&);
+    TunerSession& operator=(const TunerSession&);
+
+    // Expects mutex_ to be held
+    void retune(Clock::time_point now);
+
+    const int algorithm_;
+    const int mode_;
+    const int key_size_bits_;
+    const bool encrypting_;
+    const bool tune_segments_;
+    const bool tune_threads_;
+    const int max_threads_;
+    const std::atomic<long long>& bytes_done_;
+    size_t best_segment_size_;
+    unsigned long long quotas_[TUNER_SEGMENT_CANDIDATES];
+
+    std::mutex mutex_;
+    std::condition_variable slot_free_;
+    TunerSample samples_[TUNER_SEGMENT_CANDIDATES];
+    Clock::time_point started_;  // First piece of the job
+    bool measuring_;
+    int limit_;
+    int running_;
+    int direction_;
+    bool reversed_;   // Already tried the other direction from the best limit
+    bool settled_;
+    int best_limit_;
+    double best_rate_;
+    long long start_bytes_;
+    Clock::time_point window_start_;
+    long long window_bytes_;
+    int window_pieces_;
+};
+
+#endif // CRYPTO_TUNER_H
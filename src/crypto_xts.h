@@ -0,0 +1,98 @@
+/*
+ * crypto_xts.h - XTS (IEEE 1619) over runs of sectors for the crypto bridge
+ *
+ * Each sector is one data unit whose tweak is its sector number (little
+ * endian), so sectors can be read and rewritten independently and a run of
+ * them is spread over several cores. A short last sector uses ciphertext
+ * stealing and must hold at least one block.
+ *
+ * The bridge's XTS mode runs through xts_process with its derived key; the
+ * function takes raw keys so the IEEE 1619 test vectors can be checked
+ * against it directly.
+ */
+
+#ifndef CRYPTO_XTS_H
+#define CRYPTO_XTS_H
+
+#include "crypto_arena.h"
+#include "crypto_compat.h"
+#include "crypto_parallel.h"
+#include <cstddef>
+#include <cstring>
+
+// Bytes of sectors per parallel work item
+static const size_t XTS_GRAIN_BYTES = 256 * 1024;
+
+// Processes sectors [begin, end) of a run with one keyed cipher. `key`
+// holds the data key followed by the tweak key.
+template <class Mode>
+void xts_sectors(const CryptoPP::byte* key, size_t key_len, unsigned long long start_sector,
+                 size_t sector_size, const CryptoPP::byte* input, CryptoPP::byte* output,
+                 size_t len, size_t begin, size_t end) {
+    CryptoPP::byte tweak[16];
+    std::memset(tweak, 0, sizeof(tweak));
+
+    Mode xts;
+    xts.SetKeyWithIV(key, key_len, tweak, sizeof(tweak));
+
+    CryptoArena& arena = CryptoArena::thread_instance();
+    CryptoArena::Scope arena_scope(arena);
+
+    for (size_t sector = begin; sector < end; ++sector) {
+        const size_t offset = sector * sector_size;
+        const size_t sector_len = len - offset < sector_size ? len - offset : sector_size;
+        const CryptoPP::byte* in = input + offset;
+        CryptoPP::byte* out = output + offset;
+
+        const unsigned long long number = start_sector + sector;
+        for (int i = 0; i < 8; ++i) {
+            tweak[i] = static_cast<CryptoPP::byte>(number >> (8 * i));
+        }
+        xts.Resynchronize(tweak, sizeof(tweak));
+
+        if (sector_len % xts.MandatoryBlockSize() == 0) {
+            xts.ProcessData(out, in, sector_len);
+            continue;
+        }
+
+        // Ciphertext stealing reads back blocks it has written, so an
+        // in-place partial sector is staged through scratch memory first
+        if (in == out) {
+            CryptoPP::byte* staged = arena.allocate(sector_len);
+            std::memcpy(staged, in, sector_len);
+            in = staged;
+        }
+        xts.ProcessLastBlock(out, sector_len, in, sector_len);
+    }
+}
+
+// Encrypts or decrypts `len` bytes as consecutive sectors of `sector_size`
+// bytes, the first being sector `start_sector`, on up to `threads` threads.
+// `output` may equal `input`. False, with nothing processed, if the last
+// sector is shorter than one block.
+template <class Cipher>
+bool xts_process(bool encrypt, const CryptoPP::byte* key, size_t key_len,
+                 unsigned long long start_sector, size_t sector_size,
+                 const CryptoPP::byte* input, CryptoPP::byte* output, size_t len, int threads) {
+    const size_t tail = len % sector_size;
+    if (tail != 0 && tail < static_cast<size_t>(Cipher::BLOCKSIZE)) {
+        return false;
+    }
+
+    const size_t sectors = (len + sector_size - 1) / sector_size;
+    const size_t grain = sector_size < XTS_GRAIN_BYTES ? XTS_GRAIN_BYTES / sector_size : 1;
+    if (encrypt) {
+        parallel_for(sectors, grain, threads, [&](size_t begin, size_t end) {
+            xts_sectors<typename CryptoPP::XTS_Mode<Cipher>::Encryption>(
+                key, key_len, start_sector, sector_size, input, output, len, begin, end);
+        });
+    } else {
+        parallel_for(sectors, grain, threads, [&](size_t begin, size_t end) {
+            xts_sectors<typename CryptoPP::XTS_Mode<Cipher>::Decryption>(
+                key, key_len, start_sector, sector_size, input, output, len, begin, end);
+        });
+    }
+    return true;
+}
+
+#endif // CRYPTO_XTS_H
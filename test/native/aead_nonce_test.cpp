@@ -0,0 +1,110 @@
+/*
+ * aead_nonce_test.cpp - Poly1305, OCB and EAX never reuse a nonce
+ *
+ * Password-keyed calls in these modes take a random nonce per message, so
+ * two encryptions of the same plaintext under the same password must
+ * differ. The nonce comes back through `iv`, or ahead of the ciphertext
+ * when `iv` is null, and either form must open again; a changed nonce or
+ * ciphertext must not.
+ */
+
+#include "crypto_bridge.h"
+#include "native_test.h"
+#include <cstring>
+#include <vector>
+
+static const char kPassword[] = "aead nonce test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+
+static int seal(int algorithm, int mode, const std::vector<unsigned char>& input,
+                unsigned char* iv, std::vector<unsigned char>& sealed) {
+    sealed.assign(input.size() + 32, 0);
+    int sealed_len = static_cast<int>(sealed.size());
+    const int status = crypto_bridge_process(algorithm, mode, 256, CRYPTO_OPERATION_ENCRYPT,
+                                             kPassword, kPasswordLen, input.data(),
+                                             static_cast<int>(input.size()), sealed.data(),
+                                             &sealed_len, iv, nullptr);
+    sealed.resize(status == CRYPTO_STATUS_SUCCESS ? static_cast<size_t>(sealed_len) : 0);
+    return status;
+}
+
+static int open_sealed(int algorithm, int mode, const std::vector<unsigned char>& sealed,
+                       unsigned char* iv, std::vector<unsigned char>& opened) {
+    opened.assign(sealed.size(), 0);
+    int opened_len = static_cast<int>(opened.size());
+    const int status = crypto_bridge_process(algorithm, mode, 256, CRYPTO_OPERATION_DECRYPT,
+                                             kPassword, kPasswordLen, sealed.data(),
+                                             static_cast<int>(sealed.size()), opened.data(),
+                                             &opened_len, iv, nullptr);
+    opened.resize(status == CRYPTO_STATUS_SUCCESS ? static_cast<size_t>(opened_len) : 0);
+    return status;
+}
+
+// nonce_len is what a null iv prepends to the ciphertext
+static void check_mode(int algorithm, int mode, size_t nonce_len) {
+    std::vector<unsigned char> input(1000);
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<unsigned char>(i * 13 + 1);
+    }
+
+    // Through the iv buffer: fresh nonces, same length as before
+    unsigned char iv1[16];
+    unsigned char iv2[16];
+    std::vector<unsigned char> sealed1;
+    std::vector<unsigned char> sealed2;
+    std::vector<unsigned char> opened;
+    CHECK(seal(algorithm, mode, input, iv1, sealed1) == CRYPTO_STATUS_SUCCESS);
+    CHECK(seal(algorithm, mode, input, iv2, sealed2) == CRYPTO_STATUS_SUCCESS);
+    CHECK(sealed1.size() == input.size() + 16);
+    CHECK(std::memcmp(iv1, iv2, nonce_len) != 0);
+    CHECK(sealed1 != sealed2);
+
+    CHECK(open_sealed(algorithm, mode, sealed1, iv1, opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == input);
+    CHECK(open_sealed(algorithm, mode, sealed2, iv2, opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == input);
+
+    // Another message's nonce does not open it
+    CHECK(open_sealed(algorithm, mode, sealed1, iv2, opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+
+    // Without an iv buffer the nonce leads the ciphertext
+    CHECK(seal(algorithm, mode, input, nullptr, sealed1) == CRYPTO_STATUS_SUCCESS);
+    CHECK(seal(algorithm, mode, input, nullptr, sealed2) == CRYPTO_STATUS_SUCCESS);
+    CHECK(sealed1.size() == input.size() + 16 + nonce_len);
+    CHECK(std::memcmp(sealed1.data(), sealed2.data(), nonce_len) != 0);
+    CHECK(open_sealed(algorithm, mode, sealed1, nullptr, opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == input);
+
+    sealed1[0] ^= 1;
+    CHECK(open_sealed(algorithm, mode, sealed1, nullptr, opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+    sealed1[0] ^= 1;
+    sealed1[nonce_len] ^= 1;
+    CHECK(open_sealed(algorithm, mode, sealed1, nullptr, opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+
+    // In place, both ways
+    std::vector<unsigned char> buffer(input.size() + 16 + nonce_len);
+    std::memcpy(buffer.data(), input.data(), input.size());
+    int len = static_cast<int>(buffer.size());
+    CHECK(crypto_bridge_process(algorithm, mode, 256, CRYPTO_OPERATION_ENCRYPT, kPassword,
+                                kPasswordLen, buffer.data(), static_cast<int>(input.size()),
+                                buffer.data(), &len, nullptr, nullptr) == CRYPTO_STATUS_SUCCESS);
+    CHECK(len == static_cast<int>(buffer.size()));
+    len = static_cast<int>(buffer.size());
+    CHECK(crypto_bridge_process(algorithm, mode, 256, CRYPTO_OPERATION_DECRYPT, kPassword,
+                                kPasswordLen, buffer.data(), len, buffer.data(), &len,
+                                nullptr, nullptr) == CRYPTO_STATUS_SUCCESS);
+    CHECK(len == static_cast<int>(input.size()));
+    CHECK(std::memcmp(buffer.data(), input.data(), input.size()) == 0);
+
+    // A ciphertext shorter than its nonce is rejected
+    std::vector<unsigned char> stub(nonce_len - 1, 0);
+    CHECK(open_sealed(algorithm, mode, stub, nullptr, opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+}
+
+int main() {
+    check_mode(CRYPTO_ALGORITHM_CHACHA20, CRYPTO_MODE_POLY1305, 12);
+    check_mode(CRYPTO_ALGORITHM_XCHACHA20, CRYPTO_MODE_POLY1305, 16);
+    check_mode(CRYPTO_ALGORITHM_AES, CRYPTO_MODE_OCB, 12);
+    check_mode(CRYPTO_ALGORITHM_AES, CRYPTO_MODE_EAX, 16);
+    return test_result();
+}
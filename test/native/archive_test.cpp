@@ -0,0 +1,209 @@
+/*
+ * archive_test.cpp - Archive create, list, extract and unsafe names
+ *
+ * Packs a small tree (a file, an empty directory and a nested file of
+ * several segments) and checks the listing, a full extraction and a single
+ * entry. Listing and extraction take the cipher from the header whatever
+ * the caller passes, and an edited cipher field fails. Names that could
+ * escape the extraction directory or break the listing are rejected by the
+ * index parser and refused when creating. Files are created in the working
+ * directory.
+ */
+
+#include "crypto_archive.h"
+#include "crypto_bridge.h"
+#include "crypto_fs.h"
+#include "native_test.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+static const char kPassword[] = "archive test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+static const char kRoot[] = "archive_test_files";
+static const size_t kNestedSize = 2 * SEGMENT_DEFAULT_SIZE + 777;
+
+static Bytes pattern(size_t len, unsigned int seed) {
+    Bytes out(len);
+    unsigned long long state = 0x9e3779b97f4a7c15ULL + seed;
+    for (size_t i = 0; i < len; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        out[i] = static_cast<unsigned char>(state >> 32);
+    }
+    return out;
+}
+
+static bool write_file(const std::string& path, const Bytes& data) {
+    std::FILE* file = fs_open(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = data.empty() || std::fwrite(&data[0], 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && written;
+}
+
+static bool read_file(const std::string& path, Bytes* data) {
+    unsigned long long size = 0;
+    if (!fs_file_size(path, &size)) {
+        return false;
+    }
+    std::FILE* file = fs_open(path, "rb");
+    if (!file) {
+        return false;
+    }
+    data->resize(static_cast<size_t>(size));
+    const bool read = data->empty() || std::fread(&(*data)[0], 1, data->size(), file) == data->size();
+    std::fclose(file);
+    return read;
+}
+
+static int list(const std::string& archive, int algorithm, int mode, int key_size_bits,
+                const char* password, std::string* listing) {
+    char text[1024];
+    int text_len = sizeof(text);
+    const int status = crypto_bridge_archive_list(nullptr, algorithm, mode, key_size_bits,
+                                                  password, static_cast<int>(std::strlen(password)),
+                                                  archive.c_str(), text, &text_len);
+    listing->assign(status == CRYPTO_STATUS_SUCCESS ? text : "");
+    return status;
+}
+
+static int extract(const std::string& archive, const char* entry, const std::string& target) {
+    return crypto_bridge_archive_extract(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                         kPassword, kPasswordLen, archive.c_str(), entry,
+                                         target.c_str(), nullptr, nullptr);
+}
+
+static void check_round_trip(const std::string& source, const std::string& archive,
+                             const Bytes& small, const Bytes& nested) {
+    CryptoBridgeContext* context = crypto_bridge_context_create();
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_MAC,
+                                           CRYPTO_MAC_HMAC_SHA256) == CRYPTO_STATUS_SUCCESS);
+    CHECK(crypto_bridge_archive_create(context, CRYPTO_ALGORITHM_SERPENT, CRYPTO_MODE_CBC, 192,
+                                       kPassword, kPasswordLen, source.c_str(), archive.c_str(),
+                                       nullptr, nullptr) == CRYPTO_STATUS_SUCCESS);
+    crypto_bridge_context_destroy(context);
+
+    // The caller's cipher arguments and MAC do not matter when reading
+    const std::string expected = std::to_string(small.size()) + "\ta.txt\n0\tempty/\n0\tsub/\n" +
+                                 std::to_string(nested.size()) + "\tsub/b.bin\n";
+    std::string listing;
+    CHECK(list(archive, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256, kPassword, &listing) ==
+          CRYPTO_STATUS_SUCCESS);
+    CHECK(listing == expected);
+
+    char tiny[4];
+    int tiny_len = sizeof(tiny);
+    CHECK(crypto_bridge_archive_list(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                     kPassword, kPasswordLen, archive.c_str(), tiny, &tiny_len) ==
+          CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL);
+    CHECK(tiny_len == static_cast<int>(expected.size()) + 1);
+
+    CHECK(list(archive, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256, "not the password",
+               &listing) == CRYPTO_STATUS_CRYPTO_ERROR);
+
+    // Everything
+    const std::string all = std::string(kRoot) + "/all";
+    Bytes data;
+    CHECK(extract(archive, nullptr, all) == CRYPTO_STATUS_SUCCESS);
+    CHECK(read_file(fs_join(all, "a.txt"), &data) && data == small);
+    CHECK(read_file(fs_join(all, "sub/b.bin"), &data) && data == nested);
+    CHECK(fs_is_directory(fs_join(all, "empty")));
+
+    // One entry, leaving the others alone
+    const std::string one = std::string(kRoot) + "/one";
+    CHECK(extract(archive, "sub/b.bin", one) == CRYPTO_STATUS_SUCCESS);
+    CHECK(read_file(fs_join(one, "sub/b.bin"), &data) && data == nested);
+    CHECK(!fs_exists(fs_join(one, "a.txt")));
+    CHECK(extract(archive, "missing", one) == CRYPTO_STATUS_INVALID_PARAMS);
+}
+
+// Editing any part of the recorded cipher makes the index fail
+static void check_edited_cipher(const std::string& archive) {
+    Bytes original;
+    CHECK(read_file(archive, &original));
+    if (original.size() < ARCHIVE_HEADER_SIZE) {
+        return;
+    }
+    // Algorithm, mode, MAC and key size
+    const size_t fields[] = { 40, 41, 42, 44 };
+    const std::string edited = std::string(kRoot) + "/edited.cta";
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        Bytes data = original;
+        data[fields[i]] ^= 0x01;
+        CHECK(write_file(edited, data));
+        std::string listing;
+        CHECK(list(edited, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256, kPassword, &listing) ==
+              CRYPTO_STATUS_CRYPTO_ERROR);
+    }
+}
+
+// Index names that would escape the target or break the listing
+static void check_unsafe_names() {
+    const char* unsafe[] = { "../evil", "/etc/passwd", "a/../../evil", "a//b", "./a", "a/.",
+                             "c:evil", "a\\..\\evil", "tab\tname", "line\nbreak", "" };
+    const char* safe[] = { "a", "a/b/c.txt", "..a", "a..", "name with spaces" };
+
+    ArchiveHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.segment_size = SEGMENT_DEFAULT_SIZE;
+    header.index_offset = ARCHIVE_HEADER_SIZE;
+
+    std::vector<ArchiveEntry> entries(1);
+    entries[0].flags = 0;
+    entries[0].size = 0;
+    std::memset(entries[0].salt, 0, sizeof(entries[0].salt));
+    for (size_t i = 0; i < sizeof(unsafe) / sizeof(unsafe[0]); ++i) {
+        CHECK(!archive_name_is_safe(unsafe[i]));
+        entries[0].name = unsafe[i];
+        std::vector<unsigned char> index;
+        std::vector<ArchiveEntry> parsed;
+        write_archive_index(entries, &index);
+        CHECK(!read_archive_index(&index[0], index.size(), header, &parsed));
+    }
+    for (size_t i = 0; i < sizeof(safe) / sizeof(safe[0]); ++i) {
+        CHECK(archive_name_is_safe(safe[i]));
+        entries[0].name = safe[i];
+        std::vector<unsigned char> index;
+        std::vector<ArchiveEntry> parsed;
+        write_archive_index(entries, &index);
+        CHECK(read_archive_index(&index[0], index.size(), header, &parsed));
+        CHECK(parsed.size() == 1 && parsed[0].name == safe[i]);
+    }
+}
+
+// A tree holding a name that the index would refuse is not packed
+static void check_refused_tree() {
+#if !defined(_WIN32)
+    const std::string source = std::string(kRoot) + "/tabbed";
+    const std::string archive = std::string(kRoot) + "/tabbed.cta";
+    CHECK(fs_make_directories(source));
+    CHECK(write_file(fs_join(source, "tab\tname"), pattern(10, 3)));
+    CHECK(crypto_bridge_archive_create(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                       kPassword, kPasswordLen, source.c_str(), archive.c_str(),
+                                       nullptr, nullptr) == CRYPTO_STATUS_INVALID_PARAMS);
+    CHECK(!fs_exists(archive));
+#endif
+}
+
+int main() {
+    const std::string source = std::string(kRoot) + "/source";
+    const std::string archive = std::string(kRoot) + "/test.cta";
+    const Bytes small = pattern(5, 1);
+    const Bytes nested = pattern(kNestedSize, 2);
+    CHECK(fs_make_directories(fs_join(source, "empty")));
+    CHECK(fs_make_directories(fs_join(source, "sub")));
+    CHECK(write_file(fs_join(source, "a.txt"), small));
+    CHECK(write_file(fs_join(source, "sub/b.bin"), nested));
+
+    check_round_trip(source, archive, small, nested);
+    check_edited_cipher(archive);
+    check_unsafe_names();
+    check_refused_tree();
+    return test_result();
+}
@@ -0,0 +1,85 @@
+/*
+ * arena_test.cpp - Steady-state crypto_bridge_process calls leave the
+ * scratch arena alone
+ *
+ * After the first call of a given shape has grown the calling thread's
+ * arena, identical calls must be served from it without going back to the
+ * system allocator. Closing a scope must not be able to throw.
+ */
+
+#include "crypto_arena.h"
+#include "crypto_bridge.h"
+#include "native_test.h"
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Scopes close during unwinding; a throwing rewind would terminate
+static_assert(noexcept(std::declval<CryptoArena::Scope&>().~Scope()),
+              "closing an arena scope must not throw");
+
+static const char kPassword[] = "arena test password";
+static const int kCalls = 64;
+
+static long long arena_allocations() {
+    long long allocations = 0;
+    long long reserved = 0;
+    long long high_water = 0;
+    CHECK(crypto_bridge_arena_stats(&allocations, &reserved, &high_water) == CRYPTO_STATUS_SUCCESS);
+    return allocations;
+}
+
+// Encrypts and decrypts `input` once, in place when `in_place` is set
+static void round_trip(int algorithm, int mode, int key_size_bits,
+                       const std::vector<unsigned char>& input, bool in_place) {
+    std::vector<unsigned char> sealed(input.size() + 64);
+    std::vector<unsigned char> opened(sealed.size());
+    unsigned char iv[16];
+    std::memcpy(sealed.data(), input.data(), input.size());
+
+    int sealed_len = static_cast<int>(sealed.size());
+    CHECK(crypto_bridge_process(algorithm, mode, key_size_bits, CRYPTO_OPERATION_ENCRYPT,
+                                kPassword, static_cast<int>(sizeof(kPassword) - 1),
+                                in_place ? sealed.data() : input.data(),
+                                static_cast<int>(input.size()), sealed.data(), &sealed_len,
+                                iv, nullptr) == CRYPTO_STATUS_SUCCESS);
+
+    unsigned char* out = in_place ? sealed.data() : opened.data();
+    int opened_len = static_cast<int>(opened.size());
+    CHECK(crypto_bridge_process(algorithm, mode, key_size_bits, CRYPTO_OPERATION_DECRYPT,
+                                kPassword, static_cast<int>(sizeof(kPassword) - 1),
+                                sealed.data(), sealed_len, out, &opened_len,
+                                iv, nullptr) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened_len == static_cast<int>(input.size()));
+    CHECK(std::memcmp(out, input.data(), input.size()) == 0);
+}
+
+static void check_flat(int algorithm, int mode, int key_size_bits, size_t size, bool in_place) {
+    std::vector<unsigned char> input(size);
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<unsigned char>(i * 31 + 7);
+    }
+
+    // The first call may grow the arena to its working set
+    round_trip(algorithm, mode, key_size_bits, input, in_place);
+    const long long warmed = arena_allocations();
+
+    for (int i = 0; i < kCalls; ++i) {
+        round_trip(algorithm, mode, key_size_bits, input, in_place);
+    }
+    if (arena_allocations() != warmed) {
+        std::fprintf(stderr, "algorithm %d mode %d: %lld arena allocations after warm-up\n",
+                     algorithm, mode, arena_allocations() - warmed);
+    }
+    CHECK(arena_allocations() == warmed);
+}
+
+int main() {
+    check_flat(CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CBC, 256, 1000, false);
+    check_flat(CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CBC, 256, 4096, true);
+    check_flat(CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 128, 65536, false);
+    check_flat(CRYPTO_ALGORITHM_AES, CRYPTO_MODE_GCM, 256, 4096, true);
+    check_flat(CRYPTO_ALGORITHM_CHACHA20, CRYPTO_MODE_CTR, 256, 3000, false);
+    check_flat(CRYPTO_ALGORITHM_BLOWFISH, CRYPTO_MODE_ECB, 128, 777, false);
+    return test_result();
+}
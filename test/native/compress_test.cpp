@@ -0,0 +1,205 @@
+/*
+ * compress_test.cpp - Compression frames through encryption and back
+ *
+ * Compressible data must shrink and round-trip, whether or not the
+ * decrypting context sets CRYPTO_OPTION_COMPRESSION: decryption follows
+ * the codec the frame records, never returns the frame itself, and a
+ * digest of the decrypted data covers the expanded plaintext. A context
+ * set to DEFLATE refuses a frame recording another codec. Chunks whose
+ * sampled entropy marks them incompressible are stored raw.
+ */
+
+#include "crypto_bridge.h"
+#include "crypto_compress.h"
+#include "native_test.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+static const char kPassword[] = "compress test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+static const size_t kChunk = 256 * 1024;
+static const size_t kFrameHeader = 16;
+static const size_t kFrameEntry = 4;
+
+static int process(CryptoBridgeContext* context, int mode, int operation, const Bytes& input,
+                   Bytes* output) {
+    int output_len = static_cast<int>(output->size());
+    const int status = crypto_bridge_process_ex(context, CRYPTO_ALGORITHM_AES, mode, 256,
+                                                operation, kPassword, kPasswordLen,
+                                                input.data(), static_cast<int>(input.size()),
+                                                output->data(), &output_len, nullptr, nullptr);
+    if (status == CRYPTO_STATUS_SUCCESS) {
+        output->resize(static_cast<size_t>(output_len));
+    } else if (status == CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL) {
+        output->assign(static_cast<size_t>(output_len), 0);
+    }
+    return status;
+}
+
+static int seal(CryptoBridgeContext* context, int mode, const Bytes& plain, Bytes* sealed) {
+    sealed->assign(plain.size() + 1024, 0);
+    return process(context, mode, CRYPTO_OPERATION_ENCRYPT, plain, sealed);
+}
+
+// Decrypts into a buffer the size of the ciphertext, then once more into
+// the size the first call reports
+static int open_sealed(CryptoBridgeContext* context, int mode, const Bytes& sealed, Bytes* opened) {
+    opened->assign(sealed.size(), 0);
+    const int status = process(context, mode, CRYPTO_OPERATION_DECRYPT, sealed, opened);
+    if (status != CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL) {
+        return status;
+    }
+    return process(context, mode, CRYPTO_OPERATION_DECRYPT, sealed, opened);
+}
+
+// Log-like lines, which deflate well
+static Bytes text(size_t len) {
+    Bytes out;
+    char line[64];
+    for (unsigned int i = 0; out.size() < len; ++i) {
+        const int n = std::snprintf(line, sizeof(line), "%08u INFO request served in %u ms\n",
+                                    i, i % 97);
+        out.insert(out.end(), line, line + n);
+    }
+    out.resize(len);
+    return out;
+}
+
+static Bytes noise(size_t len) {
+    Bytes out(len);
+    unsigned long long state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < len; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        out[i] = static_cast<unsigned char>(state >> 32);
+    }
+    return out;
+}
+
+static size_t frame_overhead(size_t len) {
+    return kFrameHeader + (len + kChunk - 1) / kChunk * kFrameEntry;
+}
+
+static bool starts_with_frame(const Bytes& data) {
+    size_t original_len = 0;
+    return compressed_frame_size(data.data(), data.size(), &original_len);
+}
+
+static void check_round_trip(CryptoBridgeContext* deflate, CryptoBridgeContext* plain_context,
+                             int mode) {
+    const Bytes plain = text(3 * kChunk + 1000);
+    Bytes sealed;
+    Bytes opened;
+    CHECK(seal(deflate, mode, plain, &sealed) == CRYPTO_STATUS_SUCCESS);
+    CHECK(sealed.size() < plain.size() / 2);
+
+    CHECK(open_sealed(deflate, mode, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+
+    // Without the option, the frame header still decides
+    CHECK(open_sealed(plain_context, mode, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+
+    // A buffer too small for the expanded data reports its size and holds
+    // none of the frame
+    Bytes small(sealed.size(), 0);
+    int small_len = static_cast<int>(small.size());
+    CHECK(crypto_bridge_process_ex(plain_context, CRYPTO_ALGORITHM_AES, mode, 256,
+                                   CRYPTO_OPERATION_DECRYPT, kPassword, kPasswordLen,
+                                   sealed.data(), static_cast<int>(sealed.size()), small.data(),
+                                   &small_len, nullptr, nullptr) ==
+          CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL);
+    CHECK(small_len == static_cast<int>(plain.size()));
+    CHECK(std::count(small.begin(), small.end(), 0) == static_cast<long>(small.size()));
+}
+
+static void check_digest(CryptoBridgeContext* deflate, CryptoBridgeContext* plain_context) {
+    const Bytes plain = text(2 * kChunk + 5);
+    Bytes sealed(plain.size() + 1024);
+    Bytes opened(plain.size());
+    unsigned char sealed_digest[64];
+    unsigned char opened_digest[64];
+    int sealed_len = static_cast<int>(sealed.size());
+    int opened_len = static_cast<int>(opened.size());
+    int digest_len = sizeof(sealed_digest);
+
+    CHECK(crypto_bridge_process_digest(deflate, CRYPTO_HASH_SHA256, CRYPTO_HASH_MODE_TREE,
+                                       CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                       CRYPTO_OPERATION_ENCRYPT, kPassword, kPasswordLen,
+                                       plain.data(), static_cast<int>(plain.size()),
+                                       sealed.data(), &sealed_len, nullptr, nullptr,
+                                       sealed_digest, &digest_len) == CRYPTO_STATUS_SUCCESS);
+    digest_len = sizeof(opened_digest);
+    CHECK(crypto_bridge_process_digest(plain_context, CRYPTO_HASH_SHA256, CRYPTO_HASH_MODE_TREE,
+                                       CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                       CRYPTO_OPERATION_DECRYPT, kPassword, kPasswordLen,
+                                       sealed.data(), sealed_len, opened.data(), &opened_len,
+                                       nullptr, nullptr, opened_digest, &digest_len) ==
+          CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+    CHECK(std::equal(sealed_digest, sealed_digest + 32, opened_digest));
+}
+
+// A frame recording no codec decrypts without the option but not with
+// DEFLATE set
+static void check_codec_mismatch(CryptoBridgeContext* deflate, CryptoBridgeContext* plain_context) {
+    const Bytes plain = text(kChunk + 7);
+    Bytes frame(compress_frame_bound(plain.size()));
+    frame.resize(compress_frame(COMPRESSION_NONE, plain.data(), plain.size(), frame.data(), 1));
+
+    Bytes sealed;
+    Bytes opened;
+    CHECK(seal(plain_context, CRYPTO_MODE_CTR, frame, &sealed) == CRYPTO_STATUS_SUCCESS);
+    CHECK(open_sealed(deflate, CRYPTO_MODE_CTR, sealed, &opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+    CHECK(open_sealed(plain_context, CRYPTO_MODE_CTR, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+    CHECK(!starts_with_frame(opened));
+}
+
+// Noise is stored raw without running the compressor; text next to it
+// still shrinks
+static void check_entropy_skip(CryptoBridgeContext* deflate, CryptoBridgeContext* plain_context) {
+    const Bytes random = noise(2 * kChunk + 300);
+    Bytes sealed;
+    Bytes opened;
+    CHECK(seal(deflate, CRYPTO_MODE_CTR, random, &sealed) == CRYPTO_STATUS_SUCCESS);
+    CHECK(sealed.size() == random.size() + frame_overhead(random.size()));
+    CHECK(open_sealed(plain_context, CRYPTO_MODE_CTR, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == random);
+
+    Bytes mixed = text(kChunk);
+    mixed.insert(mixed.end(), random.begin(), random.begin() + kChunk);
+    Bytes frame(compress_frame_bound(mixed.size()));
+    frame.resize(compress_frame(COMPRESSION_DEFLATE, mixed.data(), mixed.size(), frame.data(), 2));
+    const unsigned char* table = frame.data() + kFrameHeader;
+    CHECK((table[3] & 0x80) == 0);
+    CHECK((table[kFrameEntry + 3] & 0x80) != 0);
+    CHECK(frame.size() < mixed.size() + frame_overhead(mixed.size()) - kChunk / 2);
+
+    Bytes restored(mixed.size());
+    CHECK(decompress_frame(frame.data(), frame.size(), restored.data(), 2));
+    CHECK(restored == mixed);
+}
+
+int main() {
+    CryptoBridgeContext* deflate = crypto_bridge_context_create();
+    CryptoBridgeContext* plain_context = crypto_bridge_context_create();
+    CHECK(deflate != nullptr && plain_context != nullptr);
+    CHECK(crypto_bridge_context_set_option(deflate, CRYPTO_OPTION_COMPRESSION,
+                                           CRYPTO_COMPRESSION_DEFLATE) == CRYPTO_STATUS_SUCCESS);
+
+    check_round_trip(deflate, plain_context, CRYPTO_MODE_CTR);
+    check_round_trip(deflate, plain_context, CRYPTO_MODE_CBC);
+    check_round_trip(deflate, plain_context, CRYPTO_MODE_OCB);
+    check_digest(deflate, plain_context);
+    check_codec_mismatch(deflate, plain_context);
+    check_entropy_skip(deflate, plain_context);
+
+    crypto_bridge_context_destroy(plain_context);
+    crypto_bridge_context_destroy(deflate);
+    return test_result();
+}
@@ -0,0 +1,100 @@
+/*
+ * keystream_test.cpp - Keystream offsets against a whole-stream run
+ *
+ * For CTR block ciphers and the stream ciphers that can seek, processing
+ * bytes N.. at offset N must give bytes N.. of processing the whole stream,
+ * for offsets inside, at and across block boundaries and deep into the
+ * stream, and decrypting at the offset must restore the plaintext. A stream cipher that cannot seek refuses any offset but 0.
+ */
+
+#include "crypto_bridge.h"
+#include "native_test.h"
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+static const char kPassword[] = "keystream test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+
+struct SeekableCipher {
+    int algorithm;
+    int key_size_bits;
+};
+
+static const SeekableCipher kCiphers[] = {
+    {CRYPTO_ALGORITHM_AES, 256},
+    {CRYPTO_ALGORITHM_SERPENT, 256},
+    {CRYPTO_ALGORITHM_CHACHA20, 256},
+    {CRYPTO_ALGORITHM_SALSA20, 256},
+    {CRYPTO_ALGORITHM_XSALSA20, 256},
+    {CRYPTO_ALGORITHM_SEAL, 160},
+};
+
+static int process_at(CryptoBridgeContext* context, int algorithm, int key_size_bits,
+                      int operation, long long offset, const unsigned char* input,
+                      int input_len, unsigned char* output) {
+    int output_len = input_len;
+    const int status = crypto_bridge_process_at(context, algorithm, CRYPTO_MODE_CTR,
+                                                key_size_bits, operation, kPassword,
+                                                kPasswordLen, offset, input, input_len,
+                                                output, &output_len);
+    if (status == CRYPTO_STATUS_SUCCESS) {
+        CHECK(output_len == input_len);
+    }
+    return status;
+}
+
+static Bytes pattern(size_t len) {
+    Bytes out(len);
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = static_cast<unsigned char>(i * 13 + (i >> 8));
+    }
+    return out;
+}
+
+static void check_offsets(CryptoBridgeContext* context, const SeekableCipher& cipher) {
+    const Bytes plain = pattern(1024 * 1024 + 77);
+    const int len = static_cast<int>(plain.size());
+
+    Bytes whole(plain.size());
+    CHECK(process_at(context, cipher.algorithm, cipher.key_size_bits, CRYPTO_OPERATION_ENCRYPT,
+                     0, plain.data(), len, whole.data()) == CRYPTO_STATUS_SUCCESS);
+    CHECK(whole != plain);
+
+    const int offsets[] = {1, 15, 16, 17, 63, 64, 65, 4096 + 3, 512 * 1024 + 9, len - 1};
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+        const int offset = offsets[i];
+        const int rest = len - offset;
+        Bytes part(static_cast<size_t>(rest));
+        CHECK(process_at(context, cipher.algorithm, cipher.key_size_bits,
+                         CRYPTO_OPERATION_ENCRYPT, offset, plain.data() + offset, rest,
+                         part.data()) == CRYPTO_STATUS_SUCCESS);
+        CHECK(part == Bytes(whole.begin() + offset, whole.end()));
+
+        CHECK(process_at(context, cipher.algorithm, cipher.key_size_bits,
+                         CRYPTO_OPERATION_DECRYPT, offset, part.data(), rest,
+                         part.data()) == CRYPTO_STATUS_SUCCESS);
+        CHECK(part == Bytes(plain.begin() + offset, plain.end()));
+    }
+}
+
+int main() {
+    CryptoBridgeContext* context = crypto_bridge_context_create();
+    CHECK(context != nullptr);
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_AUTOTUNE, 0) == CRYPTO_STATUS_SUCCESS);
+
+    for (size_t i = 0; i < sizeof(kCiphers) / sizeof(kCiphers[0]); ++i) {
+        check_offsets(context, kCiphers[i]);
+    }
+
+    // HC-128 can only run its keystream from the start
+    const Bytes plain = pattern(1000);
+    Bytes out(plain.size());
+    CHECK(process_at(context, CRYPTO_ALGORITHM_HC128, 128, CRYPTO_OPERATION_ENCRYPT, 0,
+                     plain.data(), 1000, out.data()) == CRYPTO_STATUS_SUCCESS);
+    CHECK(process_at(context, CRYPTO_ALGORITHM_HC128, 128, CRYPTO_OPERATION_ENCRYPT, 16,
+                     plain.data(), 1000, out.data()) == CRYPTO_STATUS_INVALID_PARAMS);
+
+    crypto_bridge_context_destroy(context);
+    return test_result();
+}
@@ -0,0 +1,198 @@
+/*
+ * memory_budget_test.cpp - Budgeted calls stay within their memory budget
+ *
+ * Encrypts and decrypts a compressible file ten times the budget, with
+ * compression on, through a tree call ("tree") or a stream call ("stream"),
+ * and checks that the process's peak resident set grew by no more than the
+ * budget plus a fixed allowance for code, thread stacks, codec state and
+ * allocator slack. Each kind runs in its own process so one does not raise
+ * the peak of the other. Files are created in the working directory.
+ */
+
+#include "crypto_bridge.h"
+#include "native_test.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kPassword[] = "memory budget test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+static const long long kBudget = 8LL * 1024 * 1024;
+static const long long kFileSize = 10 * kBudget;
+static const long long kBaseline = 16LL * 1024 * 1024;
+
+// Peak resident set size of the process so far, in bytes
+static long long peak_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<long long>(usage.ru_maxrss);
+#else
+    return static_cast<long long>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// Writes `size` bytes of log-like text a small buffer at a time
+static bool write_text_file(const std::string& path, long long size) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    std::vector<char> chunk;
+    long long written = 0;
+    long long line = 0;
+    while (written < size) {
+        chunk.clear();
+        while (chunk.size() < 64 * 1024) {
+            char text[96];
+            const int len = std::snprintf(text, sizeof(text),
+                                          "%010lld INFO worker=%lld request served in %lld ms\n",
+                                          line, line % 8, (line * 37) % 1000);
+            chunk.insert(chunk.end(), text, text + len);
+            ++line;
+        }
+        const size_t len = static_cast<size_t>(
+            std::min<long long>(size - written, static_cast<long long>(chunk.size())));
+        if (std::fwrite(&chunk[0], 1, len, file) != len) {
+            std::fclose(file);
+            return false;
+        }
+        written += static_cast<long long>(len);
+    }
+    return std::fclose(file) == 0;
+}
+
+static bool same_files(const std::string& a, const std::string& b) {
+    std::FILE* fa = std::fopen(a.c_str(), "rb");
+    std::FILE* fb = std::fopen(b.c_str(), "rb");
+    bool same = fa && fb;
+    std::vector<char> ba(1024 * 1024);
+    std::vector<char> bb(ba.size());
+    while (same) {
+        const size_t na = std::fread(&ba[0], 1, ba.size(), fa);
+        const size_t nb = std::fread(&bb[0], 1, bb.size(), fb);
+        same = na == nb && std::memcmp(&ba[0], &bb[0], na) == 0;
+        if (na == 0) {
+            break;
+        }
+    }
+    if (fa) {
+        std::fclose(fa);
+    }
+    if (fb) {
+        std::fclose(fb);
+    }
+    return same;
+}
+
+struct StreamFiles {
+    std::FILE* input;
+    std::FILE* output;
+};
+
+static long long read_stream(void* user_data, unsigned char* buffer, long long capacity) {
+    std::FILE* file = static_cast<StreamFiles*>(user_data)->input;
+    const size_t got = std::fread(buffer, 1, static_cast<size_t>(capacity), file);
+    return std::ferror(file) ? -1 : static_cast<long long>(got);
+}
+
+static int write_stream(void* user_data, const unsigned char* data, long long len) {
+    std::FILE* file = static_cast<StreamFiles*>(user_data)->output;
+    return std::fwrite(data, 1, static_cast<size_t>(len), file) == static_cast<size_t>(len) ? 0 : -1;
+}
+
+static int run_stream(CryptoBridgeContext* context, int operation,
+                      const std::string& from, const std::string& to) {
+    StreamFiles files;
+    files.input = std::fopen(from.c_str(), "rb");
+    files.output = std::fopen(to.c_str(), "wb");
+    int status = CRYPTO_STATUS_IO_ERROR;
+    if (files.input && files.output) {
+        status = crypto_bridge_process_stream(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_GCM, 256,
+                                              operation, kPassword, kPasswordLen,
+                                              read_stream, write_stream, &files);
+    }
+    if (files.input) {
+        std::fclose(files.input);
+    }
+    if (files.output && std::fclose(files.output) != 0 && status == CRYPTO_STATUS_SUCCESS) {
+        status = CRYPTO_STATUS_IO_ERROR;
+    }
+    return status;
+}
+
+static int run_tree(CryptoBridgeContext* context, int operation,
+                    const std::string& from, const std::string& to) {
+    return crypto_bridge_process_tree(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_GCM, 256,
+                                      operation, kPassword, kPasswordLen,
+                                      from.c_str(), to.c_str(), nullptr, nullptr);
+}
+
+int main(int argc, char** argv) {
+    const std::string kind = argc > 1 ? argv[1] : "";
+    if (kind != "tree" && kind != "stream") {
+        std::fprintf(stderr, "usage: %s tree|stream\n", argv[0]);
+        return 2;
+    }
+
+    // Trees work on directories, streams on single files
+    const std::string prefix = "memory_budget_" + kind;
+    const bool tree = kind == "tree";
+    const std::string plain_dir = prefix + "_plain";
+    const std::string sealed_dir = prefix + "_sealed";
+    const std::string opened_dir = prefix + "_opened";
+    const std::string plain = tree ? plain_dir + "/data.log" : prefix + ".log";
+    const std::string sealed = tree ? sealed_dir + "/data.log" : prefix + ".sealed";
+    const std::string opened = tree ? opened_dir + "/data.log" : prefix + ".opened";
+    if (tree) {
+        mkdir(plain_dir.c_str(), 0700);
+    }
+    CHECK(write_text_file(plain, kFileSize));
+
+    CryptoBridgeContext* context = crypto_bridge_context_create();
+    CHECK(context != nullptr);
+    const long long options[][2] = {
+        {CRYPTO_OPTION_MEMORY_BUDGET, kBudget},
+        {CRYPTO_OPTION_THREADS, 8},
+        {CRYPTO_OPTION_AUTOTUNE, 0},
+        {CRYPTO_OPTION_COMPRESSION, CRYPTO_COMPRESSION_DEFLATE},
+    };
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i) {
+        CHECK(crypto_bridge_context_set_option(context, static_cast<int>(options[i][0]),
+                                               options[i][1]) == CRYPTO_STATUS_SUCCESS);
+    }
+
+    const long long before = peak_rss();
+    if (tree) {
+        CHECK(run_tree(context, CRYPTO_OPERATION_ENCRYPT, plain_dir, sealed_dir) ==
+              CRYPTO_STATUS_SUCCESS);
+        CHECK(run_tree(context, CRYPTO_OPERATION_DECRYPT, sealed_dir, opened_dir) ==
+              CRYPTO_STATUS_SUCCESS);
+    } else {
+        CHECK(run_stream(context, CRYPTO_OPERATION_ENCRYPT, plain, sealed) == CRYPTO_STATUS_SUCCESS);
+        CHECK(run_stream(context, CRYPTO_OPERATION_DECRYPT, sealed, opened) == CRYPTO_STATUS_SUCCESS);
+    }
+    const long long growth = peak_rss() - before;
+    crypto_bridge_context_destroy(context);
+
+    CHECK(same_files(plain, opened));
+    if (growth > kBudget + kBaseline) {
+        std::fprintf(stderr, "%s: peak RSS grew by %lld bytes\n", kind.c_str(), growth);
+    }
+    CHECK(growth <= kBudget + kBaseline);
+
+    std::remove(plain.c_str());
+    std::remove(sealed.c_str());
+    std::remove(opened.c_str());
+    if (tree) {
+        rmdir(plain_dir.c_str());
+        rmdir(sealed_dir.c_str());
+        rmdir(opened_dir.c_str());
+    }
+    return test_result();
+}
@@ -0,0 +1,34 @@
+/*
+ * native_test.h - Minimal checks for the native bridge tests
+ *
+ * Each test is a small executable registered with CTest. CHECK reports a
+ * failed expression with its location and carries on, so one run lists
+ * every failure; main returns test_result(), which is non-zero if any
+ * check failed.
+ */
+
+#ifndef NATIVE_TEST_H
+#define NATIVE_TEST_H
+
+#include <cstdio>
+
+static int g_test_failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                         #condition);                                             \
+            ++g_test_failures;                                                    \
+        }                                                                         \
+    } while (0)
+
+static int test_result() {
+    if (g_test_failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", g_test_failures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // NATIVE_TEST_H
@@ -0,0 +1,136 @@
+/*
+ * ocb_test.cpp - OCB against the RFC 7253 Appendix A test vectors
+ *
+ * The sample results use AES-128 with K = 000102...0F, 128-bit tags,
+ * nonces BBAA9988776655443322110N and A, P prefixes of 000102...; they
+ * cover the empty message, partial and full blocks, and AAD-only input.
+ * Each vector is checked out of place and in place in both directions,
+ * and a tampered ciphertext or tag must fail and leave no plaintext behind.
+ */
+
+#include "crypto_ocb.h"
+#include "native_test.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef std::vector<CryptoPP::byte> Bytes;
+
+static const size_t kTagSize = 16;
+
+struct OcbVector {
+    unsigned int nonce;  // Last nonce byte
+    size_t aad_len;
+    size_t plain_len;
+    const char* sealed;  // C || T, hex
+};
+
+// RFC 7253 Appendix A, AES-128 with a 128-bit tag
+static const OcbVector kVectors[] = {
+    {0x00, 0, 0, "785407BFFFC8AD9EDCC5520AC9111EE6"},
+    {0x01, 8, 8, "6820B3657B6F615A5725BDA0D3B4EB3A257C9AF1F8F03009"},
+    {0x02, 8, 0, "81017F8203F081277152FADE694A0A00"},
+    {0x03, 0, 8, "45DD69F8F5AAE72414054CD1F35D82760B2CD00D2F99BFA9"},
+    {0x04, 16, 16, "571D535B60B277188BE5147170A9A22C3AD7A4FF3835B8C5701C1CCEC8FC3358"},
+    {0x05, 16, 0, "8CF761B6902EF764462AD86498CA6B97"},
+    {0x06, 0, 16, "5CE88EC2E0692706A915C00AEB8B2396F40E1C743F52436BDF06D8FA1ECA343D"},
+    {0x07, 24, 24, "1CA2207308C87C010756104D8840CE1952F09673A448A122"
+                   "C92C62241051F57356D7F3C90BB0E07F"},
+    {0x08, 24, 0, "6DC225A071FC1B9F7C69F93B0F1E10DE"},
+    {0x09, 0, 24, "221BD0DE7FA6FE993ECCD769460A0AF2D6CDED0C395B1C3C"
+                  "E725F32494B9F914D85C0B1EB38357FF"},
+    {0x0A, 32, 32, "BD6F6C496201C69296C11EFD138A467ABD3C707924B964DEAFFC40319AF5A485"
+                   "40FBBA186C5553C68AD9F592A79A4240"},
+    {0x0B, 32, 0, "FE80690BEE8A485D11F32965BC9D2A32"},
+    {0x0C, 0, 32, "2942BFC773BDA23CABC6ACFD9BFD5835BD300F0973792EF46040C53F1432BCDF"
+                  "B5E1DDE3BC18A5F840B52E653444D5DF"},
+    {0x0D, 40, 40, "D5CA91748410C1751FF8A2F618255B68A0A12E093FF454606E59F9C1D0DDC54B"
+                   "65E8628E568BAD7AED07BA06A4A69483A7035490C5769E60"},
+    {0x0E, 40, 0, "C5CD9D1850C141E358649994EE701B68"},
+    {0x0F, 0, 40, "4412923493C57D5DE0D700F753CCE0D1D2D95060122E9F15A5DDBFC5787E50B5"
+                  "CC55EE507BCB084E479AD363AC366B95A98CA5F3000B1479"},
+};
+
+static Bytes from_hex(const char* hex) {
+    Bytes out;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        out.push_back(static_cast<CryptoPP::byte>(std::stoul(std::string(hex + i, 2), nullptr, 16)));
+    }
+    return out;
+}
+
+static Bytes counting(size_t len) {
+    Bytes out(len);
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = static_cast<CryptoPP::byte>(i);
+    }
+    return out;
+}
+
+static void check_vector(const OcbVector& vector) {
+    CryptoPP::byte key[16];
+    for (int i = 0; i < 16; ++i) {
+        key[i] = static_cast<CryptoPP::byte>(i);
+    }
+    CryptoPP::byte nonce[12] = {0xBB, 0xAA, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00};
+    nonce[11] = static_cast<CryptoPP::byte>(vector.nonce);
+
+    const Bytes aad = counting(vector.aad_len);
+    const Bytes plain = counting(vector.plain_len);
+    const Bytes expected = from_hex(vector.sealed);
+    CHECK(expected.size() == vector.plain_len + kTagSize);
+    const Bytes expected_tag(expected.end() - kTagSize, expected.end());
+
+    OCB<CryptoPP::AES>::Encryption encryptor;
+    OCB<CryptoPP::AES>::Decryption decryptor;
+    encryptor.SetKeyWithIV(key, sizeof(key), nonce, sizeof(nonce));
+    decryptor.SetKeyWithIV(key, sizeof(key), nonce, sizeof(nonce));
+
+    // The +1 keeps data() valid for the empty message
+    for (int in_place = 0; in_place < 2; ++in_place) {
+        Bytes sealed(vector.plain_len + 1);
+        Bytes tag(kTagSize);
+        if (in_place) {
+            std::copy(plain.begin(), plain.end(), sealed.begin());
+        }
+        encryptor.EncryptAndAuthenticate(sealed.data(), tag.data(), kTagSize, nonce, sizeof(nonce),
+                                         aad.data(), aad.size(),
+                                         in_place ? sealed.data() : plain.data(), plain.size());
+        CHECK(Bytes(sealed.begin(), sealed.begin() + vector.plain_len) ==
+              Bytes(expected.begin(), expected.end() - kTagSize));
+        CHECK(tag == expected_tag);
+
+        Bytes opened(vector.plain_len + 1);
+        CryptoPP::byte* out = in_place ? sealed.data() : opened.data();
+        CHECK(decryptor.DecryptAndVerify(out, expected_tag.data(), kTagSize, nonce, sizeof(nonce),
+                                         aad.data(), aad.size(),
+                                         in_place ? sealed.data() : expected.data(),
+                                         vector.plain_len));
+        CHECK(Bytes(out, out + vector.plain_len) == plain);
+    }
+
+    // A flipped tag bit, or ciphertext bit where there is one, fails and
+    // wipes what was decrypted
+    Bytes bad_tag = expected_tag;
+    bad_tag[kTagSize - 1] ^= 0x01;
+    Bytes opened(vector.plain_len + 1, 0xFF);
+    CHECK(!decryptor.DecryptAndVerify(opened.data(), bad_tag.data(), kTagSize, nonce, sizeof(nonce),
+                                      aad.data(), aad.size(), expected.data(), vector.plain_len));
+    CHECK(Bytes(opened.begin(), opened.begin() + vector.plain_len) == Bytes(vector.plain_len, 0));
+
+    if (vector.plain_len) {
+        Bytes tampered(expected.begin(), expected.end() - kTagSize);
+        tampered[0] ^= 0x80;
+        CHECK(!decryptor.DecryptAndVerify(tampered.data(), expected_tag.data(), kTagSize,
+                                          nonce, sizeof(nonce), aad.data(), aad.size(),
+                                          tampered.data(), tampered.size()));
+        CHECK(tampered == Bytes(vector.plain_len, 0));
+    }
+}
+
+int main() {
+    for (size_t i = 0; i < sizeof(kVectors) / sizeof(kVectors[0]); ++i) {
+        check_vector(kVectors[i]);
+    }
+    return test_result();
+}
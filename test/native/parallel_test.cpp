@@ -0,0 +1,90 @@
+/*
+ * parallel_test.cpp - parallel_for coverage, errors, nesting and thread reuse
+ *
+ * Every index must run exactly once per call, an exception in one chunk
+ * must reach the caller and leave the loop usable, and loops nested in
+ * chunks of another must finish. Helpers come from a kept pool: many calls
+ * in a row see a handful of helper threads, not a new set per call.
+ */
+
+#include "crypto_parallel.h"
+#include "native_test.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+static const int kThreads = 8;
+
+static void check_coverage() {
+    const size_t count = 10007;
+    std::vector<std::atomic<int> > hits(count);
+    for (int round = 0; round < 50; ++round) {
+        for (size_t i = 0; i < count; ++i) {
+            hits[i].store(0);
+        }
+        parallel_for(count, 13, kThreads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                hits[i].fetch_add(1);
+            }
+        });
+        size_t once = 0;
+        for (size_t i = 0; i < count; ++i) {
+            once += hits[i].load() == 1;
+        }
+        CHECK(once == count);
+    }
+}
+
+static void check_error() {
+    bool thrown = false;
+    try {
+        parallel_for(1000, 1, kThreads, [](size_t begin, size_t) {
+            if (begin == 500) {
+                throw std::runtime_error("chunk failed");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    std::atomic<size_t> total(0);
+    parallel_for(1000, 7, kThreads, [&](size_t begin, size_t end) { total += end - begin; });
+    CHECK(total.load() == 1000);
+}
+
+static void check_nested() {
+    std::atomic<size_t> total(0);
+    parallel_for(16, 1, kThreads, [&](size_t, size_t) {
+        parallel_for(1000, 10, kThreads, [&](size_t begin, size_t end) { total += end - begin; });
+    });
+    CHECK(total.load() == 16 * 1000);
+}
+
+static void check_reuse() {
+    const std::thread::id caller = std::this_thread::get_id();
+    std::mutex mutex;
+    std::set<std::thread::id> helpers;
+    for (int call = 0; call < 100; ++call) {
+        parallel_for(64, 1, kThreads, [&](size_t, size_t) {
+            std::this_thread::yield();
+            if (std::this_thread::get_id() != caller) {
+                std::lock_guard<std::mutex> lock(mutex);
+                helpers.insert(std::this_thread::get_id());
+            }
+        });
+    }
+    CHECK(!helpers.empty() && helpers.size() < kThreads);
+}
+
+int main() {
+    // First, while the pool holds only the threads one call asks for
+    check_reuse();
+    check_coverage();
+    check_error();
+    check_nested();
+    return test_result();
+}
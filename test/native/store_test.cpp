@@ -0,0 +1,166 @@
+/*
+ * store_test.cpp - Chunk store round trips, repairs and refused settings
+ *
+ * A file stored twice writes its chunks once and rebuilds exactly. An
+ * object damaged on disk fails the next get, and storing the file again
+ * replaces just that object. Contexts asking for compression or a MAC,
+ * which the store's fixed cipher cannot honour, are refused, as is a wrong
+ * password. Files are created in the working directory.
+ */
+
+#include "crypto_bridge.h"
+#include "crypto_fs.h"
+#include "native_test.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+static const char kPassword[] = "store test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+static const char kRoot[] = "store_test_files";
+static const size_t kFileSize = 5 * 1024 * 1024 + 321;
+
+static Bytes pattern(size_t len, unsigned int seed) {
+    Bytes out(len);
+    unsigned long long state = 0x9e3779b97f4a7c15ULL + seed;
+    for (size_t i = 0; i < len; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        out[i] = static_cast<unsigned char>(state >> 32);
+    }
+    return out;
+}
+
+static bool write_file(const std::string& path, const Bytes& data) {
+    std::FILE* file = fs_open(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = data.empty() || std::fwrite(&data[0], 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && written;
+}
+
+static bool read_file(const std::string& path, Bytes* data) {
+    unsigned long long size = 0;
+    if (!fs_file_size(path, &size)) {
+        return false;
+    }
+    std::FILE* file = fs_open(path, "rb");
+    if (!file) {
+        return false;
+    }
+    data->resize(static_cast<size_t>(size));
+    const bool read = data->empty() || std::fread(&(*data)[0], 1, data->size(), file) == data->size();
+    std::fclose(file);
+    return read;
+}
+
+// Paths of every object in the store
+static std::vector<std::string> objects(const std::string& store) {
+    std::vector<FsEntry> entries;
+    std::vector<std::string> paths;
+    fs_walk(fs_join(store, "objects"), &entries);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].directory) {
+            paths.push_back(fs_join(fs_join(store, "objects"), entries[i].path));
+        }
+    }
+    return paths;
+}
+
+static int put(CryptoBridgeContext* context, const std::string& store, const std::string& source,
+               const std::string& recipe, long long* stored) {
+    return crypto_bridge_store_put(context, kPassword, kPasswordLen, store.c_str(), source.c_str(),
+                                   recipe.c_str(), stored);
+}
+
+static int get(CryptoBridgeContext* context, const std::string& store, const std::string& recipe,
+               const std::string& dest) {
+    return crypto_bridge_store_get(context, kPassword, kPasswordLen, store.c_str(), recipe.c_str(),
+                                   dest.c_str());
+}
+
+static void check_round_trip_and_repair(const std::string& store, const std::string& source,
+                                        const Bytes& plain) {
+    const std::string recipe = std::string(kRoot) + "/file.recipe";
+    const std::string dest = std::string(kRoot) + "/rebuilt.bin";
+    long long stored = -1;
+    Bytes data;
+
+    CHECK(put(nullptr, store, source, recipe, &stored) == CRYPTO_STATUS_SUCCESS);
+    CHECK(stored == static_cast<long long>(plain.size()));
+    CHECK(get(nullptr, store, recipe, dest) == CRYPTO_STATUS_SUCCESS);
+    CHECK(read_file(dest, &data) && data == plain);
+
+    CHECK(put(nullptr, store, source, recipe, &stored) == CRYPTO_STATUS_SUCCESS);
+    CHECK(stored == 0);
+
+    const std::vector<std::string> paths = objects(store);
+    CHECK(paths.size() > 1);
+    if (paths.empty()) {
+        return;
+    }
+
+    // A flipped byte, then a lost tail: each fails the get and is replaced
+    // by the next put, which writes only that object
+    Bytes object;
+    CHECK(read_file(paths[0], &object) && !object.empty());
+    if (object.empty()) {
+        return;
+    }
+    Bytes damaged = object;
+    damaged[damaged.size() / 2] ^= 0x80;
+    Bytes truncated(object.begin(), object.end() - 1);
+    const Bytes* broken[] = { &damaged, &truncated };
+    for (size_t i = 0; i < 2; ++i) {
+        CHECK(write_file(paths[0], *broken[i]));
+        CHECK(get(nullptr, store, recipe, dest) == CRYPTO_STATUS_CRYPTO_ERROR);
+        CHECK(!fs_exists(dest));
+
+        CHECK(put(nullptr, store, source, recipe, &stored) == CRYPTO_STATUS_SUCCESS);
+        CHECK(stored == static_cast<long long>(object.size()));
+        CHECK(read_file(paths[0], &data) && data == object);
+        CHECK(get(nullptr, store, recipe, dest) == CRYPTO_STATUS_SUCCESS);
+        CHECK(read_file(dest, &data) && data == plain);
+    }
+}
+
+static void check_refused(const std::string& store, const std::string& source) {
+    const std::string recipe = std::string(kRoot) + "/refused.recipe";
+    const std::string dest = std::string(kRoot) + "/refused.bin";
+    const int options[] = { CRYPTO_OPTION_COMPRESSION, CRYPTO_OPTION_MAC };
+    const long long values[] = { CRYPTO_COMPRESSION_DEFLATE, CRYPTO_MAC_HMAC_SHA256 };
+    for (size_t i = 0; i < 2; ++i) {
+        CryptoBridgeContext* context = crypto_bridge_context_create();
+        CHECK(crypto_bridge_context_set_option(context, options[i], values[i]) ==
+              CRYPTO_STATUS_SUCCESS);
+        CHECK(put(context, store, source, recipe, nullptr) == CRYPTO_STATUS_INVALID_PARAMS);
+        CHECK(!fs_exists(recipe));
+        CHECK(get(context, store, std::string(kRoot) + "/file.recipe", dest) ==
+              CRYPTO_STATUS_INVALID_PARAMS);
+        crypto_bridge_context_destroy(context);
+    }
+
+    CHECK(crypto_bridge_store_put(nullptr, "not the password", 16, store.c_str(), source.c_str(),
+                                  recipe.c_str(), nullptr) == CRYPTO_STATUS_CRYPTO_ERROR);
+}
+
+int main() {
+    const std::string store = std::string(kRoot) + "/store";
+    const std::string source = std::string(kRoot) + "/source.bin";
+    const Bytes plain = pattern(kFileSize, 1);
+    CHECK(fs_make_directories(kRoot));
+    fs_remove(fs_join(store, "config"));
+    const std::vector<std::string> stale = objects(store);
+    for (size_t i = 0; i < stale.size(); ++i) {
+        fs_remove(stale[i]);
+    }
+    CHECK(write_file(source, plain));
+
+    check_round_trip_and_repair(store, source, plain);
+    check_refused(store, source);
+    return test_result();
+}
@@ -0,0 +1,167 @@
+/*
+ * stream_test.cpp - Stream round trips, recorded settings and truncation
+ *
+ * Empty input, exactly one segment, an exact multiple of segments and a
+ * short last segment must round-trip, and empty input must still seal one
+ * record. Decryption follows the settings in the header whatever the
+ * caller passes, and an edited setting fails. A stream cut at any record
+ * boundary, including right after its header, must not decrypt.
+ */
+
+#include "crypto_bridge.h"
+#include "crypto_segment.h"
+#include "native_test.h"
+#include <algorithm>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+static const char kPassword[] = "stream test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+static const size_t kSegment = SEGMENT_DEFAULT_SIZE;
+static const size_t kTagSize = 16;
+
+// Reads from one byte vector and appends to another
+struct StreamBuffers {
+    const Bytes* input;
+    size_t offset;
+    Bytes output;
+};
+
+static long long read_buffer(void* user_data, unsigned char* buffer, long long capacity) {
+    StreamBuffers* buffers = static_cast<StreamBuffers*>(user_data);
+    const size_t left = buffers->input->size() - buffers->offset;
+    const size_t len = std::min(left, static_cast<size_t>(capacity));
+    std::copy(buffers->input->begin() + buffers->offset,
+              buffers->input->begin() + buffers->offset + len, buffer);
+    buffers->offset += len;
+    return static_cast<long long>(len);
+}
+
+static int write_buffer(void* user_data, const unsigned char* data, long long len) {
+    StreamBuffers* buffers = static_cast<StreamBuffers*>(user_data);
+    buffers->output.insert(buffers->output.end(), data, data + len);
+    return 0;
+}
+
+static int run(CryptoBridgeContext* context, int algorithm, int mode, int key_size_bits,
+               int operation, const Bytes& input, Bytes* output) {
+    StreamBuffers buffers;
+    buffers.input = &input;
+    buffers.offset = 0;
+    const int status = crypto_bridge_process_stream(context, algorithm, mode, key_size_bits,
+                                                    operation, kPassword, kPasswordLen,
+                                                    read_buffer, write_buffer, &buffers);
+    output->swap(buffers.output);
+    return status;
+}
+
+static int seal(CryptoBridgeContext* context, int algorithm, int mode, const Bytes& plain,
+                Bytes* sealed) {
+    return run(context, algorithm, mode, 256, CRYPTO_OPERATION_ENCRYPT, plain, sealed);
+}
+
+static int open_sealed(CryptoBridgeContext* context, const Bytes& sealed, Bytes* opened) {
+    return run(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_GCM, 256, CRYPTO_OPERATION_DECRYPT,
+               sealed, opened);
+}
+
+static Bytes pattern(size_t len) {
+    Bytes out(len);
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = static_cast<unsigned char>(i * 31 + (i >> 12));
+    }
+    return out;
+}
+
+// Offsets just past the header and past each record
+static std::vector<size_t> record_ends(const Bytes& sealed) {
+    std::vector<size_t> ends(1, SEGMENT_HEADER_SIZE);
+    size_t offset = SEGMENT_HEADER_SIZE;
+    while (offset + SEGMENT_RECORD_PREFIX <= sealed.size()) {
+        offset += SEGMENT_RECORD_PREFIX + load_segment_le32(&sealed[offset]);
+        ends.push_back(offset);
+    }
+    return ends;
+}
+
+// AES-GCM round trip of `len` bytes in `segments` records
+static void check_round_trip(CryptoBridgeContext* context, size_t len, size_t segments) {
+    const Bytes plain = pattern(len);
+    Bytes sealed;
+    Bytes opened;
+    CHECK(seal(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_GCM, plain, &sealed) ==
+          CRYPTO_STATUS_SUCCESS);
+    CHECK(sealed.size() ==
+          SEGMENT_HEADER_SIZE + len + segments * (SEGMENT_RECORD_PREFIX + kTagSize));
+    const std::vector<size_t> ends = record_ends(sealed);
+    CHECK(ends.size() == segments + 1 && ends.back() == sealed.size());
+
+    CHECK(open_sealed(context, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+
+    // Every cut at a record boundary before the end, the header alone
+    // included, loses the last segment
+    for (size_t i = 0; i + 1 < ends.size(); ++i) {
+        const Bytes cut(sealed.begin(), sealed.begin() + ends[i]);
+        CHECK(open_sealed(context, cut, &opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+    }
+}
+
+// Empty input in a mode without a tag, where the empty record is stored empty
+static void check_empty(CryptoBridgeContext* context, int algorithm, int mode) {
+    const Bytes plain;
+    Bytes sealed;
+    Bytes opened(1);
+    CHECK(seal(context, algorithm, mode, plain, &sealed) == CRYPTO_STATUS_SUCCESS);
+    CHECK(record_ends(sealed).size() == 2);
+    CHECK(open_sealed(context, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened.empty());
+}
+
+int main() {
+    CryptoBridgeContext* context = crypto_bridge_context_create();
+    CHECK(context != nullptr);
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_THREADS, 4) == CRYPTO_STATUS_SUCCESS);
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_AUTOTUNE, 0) == CRYPTO_STATUS_SUCCESS);
+
+    check_round_trip(context, 0, 1);
+    check_round_trip(context, 1, 1);
+    check_round_trip(context, kSegment, 1);
+    check_round_trip(context, kSegment + 1, 2);
+    check_round_trip(context, 2 * kSegment, 2);
+    check_round_trip(context, 5 * kSegment / 2, 3);
+
+    check_empty(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR);
+    check_empty(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CBC);
+
+    // Decryption takes the cipher, key size and MAC from the header, not
+    // from the caller (open_sealed always passes AES-GCM-256)
+    const Bytes plain = pattern(kSegment + 100);
+    Bytes sealed;
+    Bytes opened;
+    CHECK(run(context, CRYPTO_ALGORITHM_SERPENT, CRYPTO_MODE_CBC, 128, CRYPTO_OPERATION_ENCRYPT,
+              plain, &sealed) == CRYPTO_STATUS_SUCCESS);
+    CHECK(open_sealed(context, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_MAC, CRYPTO_MAC_BLAKE2B) ==
+          CRYPTO_STATUS_SUCCESS);
+    CHECK(seal(context, CRYPTO_ALGORITHM_CHACHA20, CRYPTO_MODE_CTR, plain, &sealed) ==
+          CRYPTO_STATUS_SUCCESS);
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_MAC, CRYPTO_MAC_NONE) ==
+          CRYPTO_STATUS_SUCCESS);
+    CHECK(open_sealed(context, sealed, &opened) == CRYPTO_STATUS_SUCCESS);
+    CHECK(opened == plain);
+
+    // The settings feed the key expansion: an edited key size (bytes 16-17
+    // of the header) does not authenticate
+    CHECK(seal(context, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_GCM, plain, &sealed) ==
+          CRYPTO_STATUS_SUCCESS);
+    sealed[16] = 128 & 0xFF;
+    sealed[17] = 128 >> 8;
+    CHECK(open_sealed(context, sealed, &opened) == CRYPTO_STATUS_CRYPTO_ERROR);
+
+    crypto_bridge_context_destroy(context);
+    return test_result();
+}
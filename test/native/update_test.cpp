@@ -0,0 +1,249 @@
+/*
+ * update_test.cpp - In-place file updates, their accounting and recovery
+ *
+ * A file is created by its first update and then brought up to date through
+ * a series of edits: none, one segment, changed ranges (which leave edits
+ * outside them alone), growth and shrinkage. Each reports the resealed
+ * bytes it should and decrypts to its plaintext. On POSIX systems a file
+ * size limit makes an update fail partway through, which must leave the
+ * file byte for byte as it was, and a child process killed mid-update must
+ * leave a journal that the next update restores. Files are created in the
+ * working directory.
+ */
+
+#include "crypto_bridge.h"
+#include "crypto_fs.h"
+#include "crypto_segment.h"
+#include "native_test.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+typedef std::vector<unsigned char> Bytes;
+
+static const char kPassword[] = "update test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+static const char kRoot[] = "update_test_files";
+static const size_t kSegment = SEGMENT_DEFAULT_SIZE;
+
+static const std::string kPlain = std::string(kRoot) + "/plain.bin";
+static const std::string kEncryptedDir = std::string(kRoot) + "/encrypted";
+static const std::string kEncrypted = kEncryptedDir + "/file.bin";
+static const std::string kDecryptedDir = std::string(kRoot) + "/decrypted";
+
+static Bytes pattern(size_t len, unsigned int seed) {
+    Bytes out(len);
+    unsigned long long state = 0x9e3779b97f4a7c15ULL + seed;
+    for (size_t i = 0; i < len; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        out[i] = static_cast<unsigned char>(state >> 32);
+    }
+    return out;
+}
+
+static bool write_file(const std::string& path, const Bytes& data) {
+    std::FILE* file = fs_open(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = data.empty() || std::fwrite(&data[0], 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && written;
+}
+
+static bool read_file(const std::string& path, Bytes* data) {
+    unsigned long long size = 0;
+    if (!fs_file_size(path, &size)) {
+        return false;
+    }
+    std::FILE* file = fs_open(path, "rb");
+    if (!file) {
+        return false;
+    }
+    data->resize(static_cast<size_t>(size));
+    const bool read = data->empty() || std::fread(&(*data)[0], 1, data->size(), file) == data->size();
+    std::fclose(file);
+    return read;
+}
+
+// Writes `plain` as the plaintext and updates the encrypted file from it
+static int update(const Bytes& plain, const long long* ranges, int range_count,
+                  long long* rewritten) {
+    if (!write_file(kPlain, plain)) {
+        return CRYPTO_STATUS_IO_ERROR;
+    }
+    *rewritten = -1;
+    return crypto_bridge_file_update(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                     kPassword, kPasswordLen, kPlain.c_str(), kEncrypted.c_str(),
+                                     ranges, range_count, rewritten);
+}
+
+static bool decrypts_to(const Bytes& plain) {
+    Bytes data;
+    fs_remove(kDecryptedDir + "/file.bin");
+    return crypto_bridge_process_tree(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256,
+                                      CRYPTO_OPERATION_DECRYPT, kPassword, kPasswordLen,
+                                      kEncryptedDir.c_str(), kDecryptedDir.c_str(), nullptr,
+                                      nullptr) == CRYPTO_STATUS_SUCCESS &&
+           read_file(kDecryptedDir + "/file.bin", &data) && data == plain;
+}
+
+static void reset() {
+    CHECK(fs_make_directories(kEncryptedDir));
+    fs_remove(kEncrypted);
+    fs_remove(kEncrypted + ".journal");
+}
+
+static void check_edits() {
+    reset();
+    long long rewritten = 0;
+
+    Bytes plain = pattern(2 * kSegment + kSegment / 2, 1);
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == static_cast<long long>(plain.size()));
+    CHECK(decrypts_to(plain));
+
+    // Unchanged
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == 0);
+    CHECK(decrypts_to(plain));
+
+    // One byte in the middle segment
+    plain[kSegment + 100] ^= 0x01;
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == static_cast<long long>(kSegment));
+    CHECK(decrypts_to(plain));
+
+    // Ranges: an edit outside them is not even looked at, one inside is
+    const Bytes before = plain;
+    plain[2 * kSegment + 7] ^= 0x01;
+    const long long first[] = { 0, 10, static_cast<long long>(10 * kSegment), 1 };
+    CHECK(update(plain, first, 2, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == 0);
+    CHECK(decrypts_to(before));
+    const long long last[] = { static_cast<long long>(2 * kSegment), 8 };
+    CHECK(update(plain, last, 1, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == static_cast<long long>(kSegment / 2));
+    CHECK(decrypts_to(plain));
+
+    // Growth reseals the old short tail and everything new
+    const Bytes more = pattern(2 * kSegment - kSegment / 4, 2);
+    plain.insert(plain.end(), more.begin(), more.end());
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == static_cast<long long>(2 * kSegment + kSegment / 4));
+    CHECK(decrypts_to(plain));
+
+    // Shrinkage reseals only the new short tail
+    plain.resize(kSegment + kSegment / 3);
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == static_cast<long long>(kSegment / 3));
+    CHECK(decrypts_to(plain));
+
+    // Down to nothing and back
+    plain.clear();
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == 0);
+    CHECK(decrypts_to(plain));
+    plain = pattern(100, 3);
+    CHECK(update(plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(rewritten == 100);
+    CHECK(decrypts_to(plain));
+    CHECK(!fs_exists(kEncrypted + ".journal"));
+}
+
+#ifndef _WIN32
+// Caps the size of files this process writes, or lifts the cap (0)
+static void limit_file_size(unsigned long long bytes) {
+    struct rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    limit.rlim_cur = bytes > 0 ? static_cast<rlim_t>(bytes) : limit.rlim_max;
+    setrlimit(RLIMIT_FSIZE, &limit);
+}
+
+// Grows the file past a size limit: segments written past it fail after
+// others, and the old table, have been overwritten
+static void check_failed_update() {
+    reset();
+    long long rewritten = 0;
+    const Bytes old_plain = pattern(kSegment + kSegment / 2, 4);
+    CHECK(update(old_plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    Bytes old_file;
+    CHECK(read_file(kEncrypted, &old_file));
+
+    Bytes new_plain = pattern(3 * kSegment + kSegment / 2, 5);
+    std::copy(old_plain.begin() + 1000, old_plain.end(), new_plain.begin() + 1000);
+    CHECK(write_file(kPlain, new_plain));
+
+    std::signal(SIGXFSZ, SIG_IGN);
+    limit_file_size(old_file.size() + kSegment / 2);
+    const int status = crypto_bridge_file_update(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR,
+                                                 256, kPassword, kPasswordLen, kPlain.c_str(),
+                                                 kEncrypted.c_str(), nullptr, 0, &rewritten);
+    limit_file_size(0);
+    std::signal(SIGXFSZ, SIG_DFL);
+
+    CHECK(status == CRYPTO_STATUS_IO_ERROR);
+    Bytes restored;
+    CHECK(read_file(kEncrypted, &restored) && restored == old_file);
+    CHECK(!fs_exists(kEncrypted + ".journal"));
+    CHECK(decrypts_to(old_plain));
+
+    CHECK(update(new_plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(decrypts_to(new_plain));
+}
+
+// The same update in a child that the size limit kills outright; runs
+// before anything else so the child starts without pool threads
+static void check_interrupted_update() {
+    reset();
+    const Bytes old_plain = pattern(kSegment + kSegment / 2, 6);
+    Bytes new_plain = pattern(3 * kSegment + kSegment / 2, 7);
+    std::copy(old_plain.begin() + 1000, old_plain.end(), new_plain.begin() + 1000);
+
+    const pid_t child = fork();
+    if (child == 0) {
+        long long rewritten = 0;
+        Bytes old_file;
+        if (update(old_plain, nullptr, 0, &rewritten) != CRYPTO_STATUS_SUCCESS ||
+            !read_file(kEncrypted, &old_file) || !write_file(kPlain, new_plain)) {
+            _exit(1);
+        }
+        limit_file_size(old_file.size() + kSegment / 2);
+        crypto_bridge_file_update(nullptr, CRYPTO_ALGORITHM_AES, CRYPTO_MODE_CTR, 256, kPassword,
+                                  kPasswordLen, kPlain.c_str(), kEncrypted.c_str(), nullptr, 0,
+                                  &rewritten);
+        _exit(0);
+    }
+
+    int wait_status = 0;
+    CHECK(child > 0 && waitpid(child, &wait_status, 0) == child);
+    CHECK(WIFSIGNALED(wait_status) && WTERMSIG(wait_status) == SIGXFSZ);
+    CHECK(fs_exists(kEncrypted + ".journal"));
+
+    long long rewritten = 0;
+    CHECK(update(new_plain, nullptr, 0, &rewritten) == CRYPTO_STATUS_SUCCESS);
+    CHECK(!fs_exists(kEncrypted + ".journal"));
+    CHECK(decrypts_to(new_plain));
+}
+#endif
+
+int main() {
+    CHECK(fs_make_directories(kRoot));
+#ifndef _WIN32
+    check_interrupted_update();
+#endif
+    check_edits();
+#ifndef _WIN32
+    check_failed_update();
+#endif
+    return test_result();
+}
@@ -0,0 +1,197 @@
+/*
+ * xts_test.cpp - XTS against the IEEE 1619 test vectors and sector slices
+ *
+ * The XTS-AES-128 vectors cover whole blocks, a 512-byte data unit and
+ * ciphertext stealing over 17 to 20 bytes; each is checked out of place
+ * and in place in both directions. A run of sectors must equal the same
+ * sectors processed one at a time, and crypto_bridge_process_sectors
+ * called from a start sector must return the matching slice of a call
+ * over the whole buffer.
+ */
+
+#include "crypto_bridge.h"
+#include "crypto_xts.h"
+#include "native_test.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef std::vector<CryptoPP::byte> Bytes;
+
+static const char kPassword[] = "xts test password";
+static const int kPasswordLen = static_cast<int>(sizeof(kPassword) - 1);
+
+struct XtsVector {
+    const char* key1;
+    const char* key2;
+    unsigned long long data_unit;
+    const char* plain;   // Hex, or empty for plain_len bytes of 000102...FF00...
+    size_t plain_len;
+    const char* sealed;  // Hex
+};
+
+// IEEE 1619-2007 Annex B, XTS-AES-128
+static const XtsVector kVectors[] = {
+    // Vector 2
+    {"11111111111111111111111111111111", "22222222222222222222222222222222", 0x3333333333ULL,
+     "4444444444444444444444444444444444444444444444444444444444444444", 0,
+     "c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0"},
+    // Vector 3
+    {"fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "22222222222222222222222222222222", 0x3333333333ULL,
+     "4444444444444444444444444444444444444444444444444444444444444444", 0,
+     "af85336b597afc1a900b2eb21ec949d292df4c047e0b21532186a5971a227a89"},
+    // Vector 4, one 512-byte data unit
+    {"27182818284590452353602874713526", "31415926535897932384626433832795", 0, "", 512,
+     "27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89c"
+     "c78cf7f5e543445f8333d8fa7f56000005279fa5d8b5e4ad40e736ddb4d35412"
+     "328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce"
+     "93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad0265"
+     "5ea92dc4c4e41a8952c651d33174be51a10c421110e6d81588ede82103a252d8"
+     "a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434"
+     "1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c"
+     "5ccf2a55d705ddcd86d449511ceb7ec30bf12b1fa35b913f9f747a8afd1b130e"
+     "94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc"
+     "1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3"
+     "e7ff72b1e99785ca0a7e7720c5b36dc6d72cac9574c8cbbc2f801e23e56fd344"
+     "b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd"
+     "74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752"
+     "afe656bb3c17256a9f6e9bf19fdd5a38fc82bbe872c5539edb609ef4f79c203e"
+     "bb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18d"
+     "eb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568"},
+    // Vectors 15-18, ciphertext stealing; the standard lists the data unit
+    // number as its little-endian bytes 9a78563412
+    {"fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789aULL,
+     "", 17, "6c1625db4671522d3d7599601de7ca09ed"},
+    {"fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789aULL,
+     "", 18, "d069444b7a7e0cab09e24447d24deb1fedbf"},
+    {"fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789aULL,
+     "", 19, "e5df1351c0544ba1350b3363cd8ef4beedbf9d"},
+    {"fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", 0x123456789aULL,
+     "", 20, "9d84c813f719aa2c7be3f66171c7c5c2edbf9dac"},
+};
+
+static Bytes from_hex(const char* hex) {
+    Bytes out;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        out.push_back(static_cast<CryptoPP::byte>(std::stoul(std::string(hex + i, 2), nullptr, 16)));
+    }
+    return out;
+}
+
+static Bytes counting(size_t len) {
+    Bytes out(len);
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = static_cast<CryptoPP::byte>(i);
+    }
+    return out;
+}
+
+static bool xts(bool encrypt, const Bytes& key, unsigned long long data_unit, size_t sector_size,
+                const Bytes& input, Bytes* output) {
+    output->assign(input.size(), 0);
+    return xts_process<CryptoPP::AES>(encrypt, key.data(), key.size(), data_unit, sector_size,
+                                      input.data(), output->data(), input.size(), 2);
+}
+
+static void check_vector(const XtsVector& vector) {
+    Bytes key = from_hex(vector.key1);
+    const Bytes key2 = from_hex(vector.key2);
+    key.insert(key.end(), key2.begin(), key2.end());
+    const Bytes plain = vector.plain[0] ? from_hex(vector.plain) : counting(vector.plain_len);
+    const Bytes sealed = from_hex(vector.sealed);
+    // Each vector is a single data unit
+    const size_t sector_size = plain.size();
+
+    Bytes out;
+    CHECK(xts(true, key, vector.data_unit, sector_size, plain, &out));
+    CHECK(out == sealed);
+    CHECK(xts(false, key, vector.data_unit, sector_size, sealed, &out));
+    CHECK(out == plain);
+
+    Bytes buffer = plain;
+    CHECK(xts_process<CryptoPP::AES>(true, key.data(), key.size(), vector.data_unit, sector_size,
+                                     buffer.data(), buffer.data(), buffer.size(), 1));
+    CHECK(buffer == sealed);
+    CHECK(xts_process<CryptoPP::AES>(false, key.data(), key.size(), vector.data_unit, sector_size,
+                                     buffer.data(), buffer.data(), buffer.size(), 1));
+    CHECK(buffer == plain);
+}
+
+// Sectors processed in one run equal the same sectors one at a time,
+// including a stolen tail on the last
+static void check_sector_run() {
+    const Bytes key = from_hex("27182818284590452353602874713526"
+                               "31415926535897932384626433832795");
+    const size_t sector_size = 512;
+    const unsigned long long first = 41;
+    const Bytes plain = counting(3 * sector_size + 20);
+
+    Bytes run;
+    CHECK(xts(true, key, first, sector_size, plain, &run));
+    for (size_t offset = 0, sector = first; offset < plain.size(); offset += sector_size, ++sector) {
+        const size_t len = std::min(sector_size, plain.size() - offset);
+        const Bytes part(plain.begin() + offset, plain.begin() + offset + len);
+        Bytes sealed;
+        CHECK(xts(true, key, sector, sector_size, part, &sealed));
+        CHECK(Bytes(run.begin() + offset, run.begin() + offset + len) == sealed);
+    }
+
+    // A tail shorter than one block is refused
+    Bytes out;
+    CHECK(!xts(true, key, first, sector_size, Bytes(sector_size + 15), &out));
+}
+
+static int process_sectors(CryptoBridgeContext* context, int operation, long long start_sector,
+                           const unsigned char* input, int input_len, unsigned char* output) {
+    int output_len = input_len;
+    const int status = crypto_bridge_process_sectors(context, CRYPTO_ALGORITHM_AES,
+                                                     CRYPTO_MODE_XTS, 256, operation,
+                                                     kPassword, kPasswordLen, start_sector,
+                                                     input, input_len, output, &output_len);
+    if (status == CRYPTO_STATUS_SUCCESS) {
+        CHECK(output_len == input_len);
+    }
+    return status;
+}
+
+// Through the public API, sectors from a start sector match the same
+// slice of the whole buffer in both directions
+static void check_process_sectors(CryptoBridgeContext* context) {
+    const int sector_size = 4096;
+    const int sectors = 8;
+    const Bytes plain = counting(sectors * sector_size);
+    const int len = static_cast<int>(plain.size());
+
+    Bytes sealed(plain.size());
+    CHECK(process_sectors(context, CRYPTO_OPERATION_ENCRYPT, 0, plain.data(), len,
+                          sealed.data()) == CRYPTO_STATUS_SUCCESS);
+
+    for (int first = 1; first < sectors; first += 3) {
+        const size_t offset = static_cast<size_t>(first) * sector_size;
+        const int slice_len = len - static_cast<int>(offset);
+        Bytes slice(static_cast<size_t>(slice_len));
+        CHECK(process_sectors(context, CRYPTO_OPERATION_ENCRYPT, first, plain.data() + offset,
+                              slice_len, slice.data()) == CRYPTO_STATUS_SUCCESS);
+        CHECK(Bytes(sealed.begin() + offset, sealed.end()) == slice);
+
+        CHECK(process_sectors(context, CRYPTO_OPERATION_DECRYPT, first, sealed.data() + offset,
+                              slice_len, slice.data()) == CRYPTO_STATUS_SUCCESS);
+        CHECK(Bytes(plain.begin() + offset, plain.end()) == slice);
+    }
+}
+
+int main() {
+    for (size_t i = 0; i < sizeof(kVectors) / sizeof(kVectors[0]); ++i) {
+        check_vector(kVectors[i]);
+    }
+    check_sector_run();
+
+    CryptoBridgeContext* context = crypto_bridge_context_create();
+    CHECK(context != nullptr);
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_THREADS, 4) == CRYPTO_STATUS_SUCCESS);
+    CHECK(crypto_bridge_context_set_option(context, CRYPTO_OPTION_SECTOR_SIZE, 4096) ==
+          CRYPTO_STATUS_SUCCESS);
+    check_process_sectors(context);
+    crypto_bridge_context_destroy(context);
+    return test_result();
+}
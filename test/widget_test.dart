@@ -164,6 +164,20 @@ void main() {
             reason: '${algorithm.displayName} should support GCM mode');
       }
       
+      // ChaCha20 variants offer Poly1305 authentication
+      expect(EncryptionAlgorithm.chacha20.getSupportedModes(), contains(OperationMode.poly1305));
+      expect(EncryptionAlgorithm.xchacha20.getSupportedModes(), contains(OperationMode.poly1305));
+      expect(OperationMode.poly1305.isAead, isTrue);
+      
+      // 128-bit block ciphers without GCM still get single-pass AEAD
+      expect(EncryptionAlgorithm.rc6.getSupportedModes(), contains(OperationMode.ocb));
+      expect(OperationMode.ocb.isAead, isTrue);
+      
+      // Threefish uses its tweak for random-access encryption
+      expect(EncryptionAlgorithm.threefish512.getSupportedModes(), contains(OperationMode.tweak));
+      expect(EncryptionAlgorithm.aes256.getSupportedModes(), contains(OperationMode.xts));
+      expect(OperationMode.xts.isAead, isFalse);
+      
       // Test that AES256 supports 256-bit key size
       final aes256KeySizes = EncryptionAlgorithm.aes256.getSupportedKeySizes();
       expect(aes256KeySizes, contains(256));
@@ -189,8 +203,8 @@ void main() {
       expect(LogLevel.values.length, equals(4));
       expect(ProcessingStatus.values.length, equals(6));
       // Corrected: The number of algorithms is much larger than 6.
-      expect(EncryptionAlgorithm.values.length, equals(49)); 
-      expect(OperationMode.values.length, equals(6));
+      expect(EncryptionAlgorithm.values.length, equals(50)); 
+      expect(OperationMode.values.length, equals(11));
       
       // Test the actual color palette from the theme
       final palette = AppTheme.getPalette();
@@ -0,0 +1,441 @@
+/*
+ * cryptingtool_cli.cpp - Command-line front end of the crypto bridge
+ *
+ * Lets servers use the library in cron jobs and shell pipelines:
+ *
+ *   tar c data | CRYPTINGTOOL_PASSWORD=... cryptingtool-cli encrypt | upload
+ *
+ * encrypt, decrypt and verify stream through crypto_bridge_process_stream,
+ * so memory stays bounded whatever the input size; hash and bench wrap the
+ * digest and benchmark calls. The password is taken from an environment
+ * variable or a file, never from the command line, where other users could
+ * read it. Throughput goes to stderr, so stdout stays free for data.
+ */
+
+#include "crypto_bridge.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+static const char kPasswordEnv[] = "CRYPTINGTOOL_PASSWORD";
+
+struct NamedId {
+    const char* name;
+    int id;
+};
+
+static const NamedId kAlgorithms[] = {
+    { "aes", CRYPTO_ALGORITHM_AES }, { "serpent", CRYPTO_ALGORITHM_SERPENT },
+    { "twofish", CRYPTO_ALGORITHM_TWOFISH }, { "rc6", CRYPTO_ALGORITHM_RC6 },
+    { "mars", CRYPTO_ALGORITHM_MARS }, { "camellia", CRYPTO_ALGORITHM_CAMELLIA },
+    { "chacha20", CRYPTO_ALGORITHM_CHACHA20 }, { "xchacha20", CRYPTO_ALGORITHM_XCHACHA20 },
+    { "aria", CRYPTO_ALGORITHM_ARIA }, { "sm4", CRYPTO_ALGORITHM_SM4 },
+    { "threefish256", CRYPTO_ALGORITHM_THREEFISH256 },
+    { "threefish512", CRYPTO_ALGORITHM_THREEFISH512 },
+    { "threefish1024", CRYPTO_ALGORITHM_THREEFISH1024 },
+};
+
+static const NamedId kModes[] = {
+    { "cbc", CRYPTO_MODE_CBC }, { "gcm", CRYPTO_MODE_GCM }, { "ecb", CRYPTO_MODE_ECB },
+    { "cfb", CRYPTO_MODE_CFB }, { "ofb", CRYPTO_MODE_OFB }, { "ctr", CRYPTO_MODE_CTR },
+    { "poly1305", CRYPTO_MODE_POLY1305 }, { "ocb", CRYPTO_MODE_OCB }, { "eax", CRYPTO_MODE_EAX },
+    { "tweak", CRYPTO_MODE_TWEAK },
+};
+
+static const NamedId kHashes[] = {
+    { "sha256", CRYPTO_HASH_SHA256 }, { "sha512", CRYPTO_HASH_SHA512 },
+    { "sha3-256", CRYPTO_HASH_SHA3_256 }, { "sha3-512", CRYPTO_HASH_SHA3_512 },
+    { "blake2b", CRYPTO_HASH_BLAKE2B },
+};
+
+static const NamedId kMacs[] = {
+    { "none", CRYPTO_MAC_NONE }, { "hmac-sha256", CRYPTO_MAC_HMAC_SHA256 },
+    { "blake2b", CRYPTO_MAC_BLAKE2B },
+};
+
+struct Options {
+    std::string command;
+    int algorithm = CRYPTO_ALGORITHM_AES;
+    int mode = CRYPTO_MODE_GCM;
+    int key_size_bits = 256;
+    int hash = CRYPTO_HASH_SHA256;
+    bool tree_hash = false;
+    bool cipher_given = false;
+    long long threads = 0;
+    long long memory_budget = 0;
+    bool compress = false;
+    int mac = CRYPTO_MAC_NONE;
+    std::string password_file;
+    int bench_size = 1024 * 1024;
+    int bench_iterations = 64;
+    bool quiet = false;
+    std::vector<std::string> paths;
+};
+
+// Byte counts of a stream call, and the files it reads and writes
+struct StreamIo {
+    std::FILE* input;
+    std::FILE* output;  // Null to discard the output (verify)
+    long long bytes_in;
+    long long bytes_out;
+};
+
+static void usage() {
+    std::fprintf(stderr,
+        "usage: cryptingtool-cli encrypt|decrypt|verify [options] [input [output]]\n"
+        "       cryptingtool-cli hash [--hash NAME] [--tree] [input]\n"
+        "       cryptingtool-cli bench [-a NAME -m NAME] [--size BYTES] [--iterations N]\n"
+        "\n"
+        "Input and output default to stdin and stdout; '-' names them explicitly.\n"
+        "The password is read from $%s, or from the first line of --password-file.\n"
+        "decrypt and verify take the cipher, key size, MAC and compression from the\n"
+        "stream; -a, -m, -k, -c and --mac only apply to encrypt.\n"
+        "\n"
+        "  -a, --algorithm NAME   aes (default), serpent, twofish, chacha20, ...\n"
+        "  -m, --mode NAME        gcm (default), cbc, ctr, poly1305, ocb, eax, ...\n"
+        "  -k, --key-size BITS    key size (default 256)\n"
+        "  -t, --threads N        worker threads (default: one per core)\n"
+        "  -c, --compress         DEFLATE before encrypting\n"
+        "      --mac NAME         hmac-sha256 or blake2b for unauthenticated modes\n"
+        "      --memory-budget MIB  cap on working buffers\n"
+        "      --password-file F  read the password from F\n"
+        "      --hash NAME        sha256 (default), sha512, sha3-256, sha3-512, blake2b\n"
+        "      --tree             Merkle tree digest on all cores\n"
+        "  -q, --quiet            no throughput report\n",
+        kPasswordEnv);
+}
+
+static bool lookup(const NamedId* table, size_t count, const char* name, int* id) {
+    for (size_t i = 0; i < count; ++i) {
+        if (std::strcmp(table[i].name, name) == 0) {
+            *id = table[i].id;
+            return true;
+        }
+    }
+    // Identifiers of crypto_bridge.h are accepted as well
+    char* end = nullptr;
+    const long value = std::strtol(name, &end, 10);
+    if (end != name && *end == '\0' && value >= 0) {
+        *id = static_cast<int>(value);
+        return true;
+    }
+    return false;
+}
+
+static bool parse_number(const char* text, long long* value) {
+    char* end = nullptr;
+    *value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && *value >= 0;
+}
+
+static bool parse_args(int argc, char** argv, Options* options) {
+    if (argc < 2) {
+        return false;
+    }
+    options->command = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        long long number = 0;
+        if (arg == "-q" || arg == "--quiet") {
+            options->quiet = true;
+        } else if (arg == "-c" || arg == "--compress") {
+            options->compress = true;
+        } else if (arg == "--tree") {
+            options->tree_hash = true;
+        } else if (arg == "-" || arg[0] != '-') {
+            options->paths.push_back(arg);
+        } else if (!has_value) {
+            return false;
+        } else if (arg == "-a" || arg == "--algorithm") {
+            if (!lookup(kAlgorithms, sizeof(kAlgorithms) / sizeof(kAlgorithms[0]), argv[++i],
+                        &options->algorithm)) {
+                return false;
+            }
+            options->cipher_given = true;
+        } else if (arg == "-m" || arg == "--mode") {
+            if (!lookup(kModes, sizeof(kModes) / sizeof(kModes[0]), argv[++i], &options->mode)) {
+                return false;
+            }
+            options->cipher_given = true;
+        } else if (arg == "--hash") {
+            if (!lookup(kHashes, sizeof(kHashes) / sizeof(kHashes[0]), argv[++i], &options->hash)) {
+                return false;
+            }
+        } else if (arg == "--mac") {
+            if (!lookup(kMacs, sizeof(kMacs) / sizeof(kMacs[0]), argv[++i], &options->mac)) {
+                return false;
+            }
+        } else if (arg == "--password-file") {
+            options->password_file = argv[++i];
+        } else if (!parse_number(argv[++i], &number)) {
+            return false;
+        } else if (arg == "-k" || arg == "--key-size") {
+            options->key_size_bits = static_cast<int>(number);
+        } else if (arg == "-t" || arg == "--threads") {
+            options->threads = number;
+        } else if (arg == "--memory-budget") {
+            options->memory_budget = number * 1024 * 1024;
+        } else if (arg == "--size") {
+            options->bench_size = static_cast<int>(number);
+        } else if (arg == "--iterations") {
+            options->bench_iterations = static_cast<int>(number);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char* status_name(int status) {
+    switch (status) {
+        case CRYPTO_STATUS_INVALID_PARAMS: return "invalid parameters";
+        case CRYPTO_STATUS_UNSUPPORTED_ALGORITHM: return "unsupported algorithm";
+        case CRYPTO_STATUS_UNSUPPORTED_MODE: return "unsupported mode";
+        case CRYPTO_STATUS_INVALID_KEY_SIZE: return "invalid key size";
+        case CRYPTO_STATUS_MEMORY_ERROR: return "out of memory";
+        case CRYPTO_STATUS_CRYPTO_ERROR: return "wrong password, or damaged or truncated input";
+        case CRYPTO_STATUS_PASSWORD_TOO_SHORT: return "password too short";
+        case CRYPTO_STATUS_IO_ERROR: return "read or write failed";
+        default: return "unexpected error";
+    }
+}
+
+// Password from --password-file (first line) or the environment
+static bool read_password(const Options& options, std::string* password) {
+    if (options.password_file.empty()) {
+        const char* value = std::getenv(kPasswordEnv);
+        if (!value || !*value) {
+            return false;
+        }
+        password->assign(value);
+        return true;
+    }
+    std::FILE* file = std::fopen(options.password_file.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+    int c;
+    while ((c = std::fgetc(file)) != EOF && c != '\n' && c != '\r') {
+        password->push_back(static_cast<char>(c));
+    }
+    std::fclose(file);
+    return !password->empty();
+}
+
+static void wipe(std::string* secret) {
+    volatile char* p = secret->empty() ? nullptr : &(*secret)[0];
+    for (size_t i = 0; i < secret->size(); ++i) {
+        p[i] = 0;
+    }
+    secret->clear();
+}
+
+static long long read_input(void* user_data, unsigned char* buffer, long long capacity) {
+    StreamIo* io = static_cast<StreamIo*>(user_data);
+    const size_t got = std::fread(buffer, 1, static_cast<size_t>(capacity), io->input);
+    if (got == 0 && std::ferror(io->input)) {
+        return -1;
+    }
+    io->bytes_in += static_cast<long long>(got);
+    return static_cast<long long>(got);
+}
+
+static int write_output(void* user_data, const unsigned char* data, long long len) {
+    StreamIo* io = static_cast<StreamIo*>(user_data);
+    if (io->output && std::fwrite(data, 1, static_cast<size_t>(len), io->output) !=
+                          static_cast<size_t>(len)) {
+        return -1;
+    }
+    io->bytes_out += len;
+    return 0;
+}
+
+static bool is_std(const Options& options, size_t index) {
+    return options.paths.size() <= index || options.paths[index] == "-";
+}
+
+static void set_binary(std::FILE* file) {
+#if defined(_WIN32)
+    _setmode(_fileno(file), _O_BINARY);
+#else
+    (void)file;
+#endif
+}
+
+static void report(const Options& options, const char* what, long long bytes, double seconds) {
+    if (options.quiet) {
+        return;
+    }
+    std::fprintf(stderr, "%s: %lld bytes in %.3f s (%.1f MB/s)\n", what, bytes, seconds,
+                 seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+}
+
+static int run_stream(const Options& options, CryptoBridgeContext* context) {
+    std::string password;
+    if (!read_password(options, &password)) {
+        std::fprintf(stderr, "cryptingtool-cli: set $%s or pass --password-file\n", kPasswordEnv);
+        return 2;
+    }
+    const bool verify = options.command == "verify";
+    const int operation = options.command == "encrypt" ? CRYPTO_OPERATION_ENCRYPT
+                                                       : CRYPTO_OPERATION_DECRYPT;
+
+    StreamIo io = { stdin, verify ? nullptr : stdout, 0, 0 };
+    if (!is_std(options, 0)) {
+        io.input = std::fopen(options.paths[0].c_str(), "rb");
+    } else {
+        set_binary(stdin);
+    }
+    const bool output_file = !verify && !is_std(options, 1);
+    if (output_file) {
+        io.output = std::fopen(options.paths[1].c_str(), "wb");
+    } else if (!verify) {
+        set_binary(stdout);
+    }
+    if (!io.input || (!verify && !io.output)) {
+        std::fprintf(stderr, "cryptingtool-cli: cannot open %s\n",
+                     !io.input ? options.paths[0].c_str() : options.paths[1].c_str());
+        wipe(&password);
+        return 1;
+    }
+
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    int status = crypto_bridge_process_stream(context, options.algorithm, options.mode,
+                                              options.key_size_bits, operation, password.data(),
+                                              static_cast<int>(password.size()),
+                                              read_input, write_output, &io);
+    wipe(&password);
+    if (io.output && std::fflush(io.output) != 0 && status == CRYPTO_STATUS_SUCCESS) {
+        status = CRYPTO_STATUS_IO_ERROR;
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (io.input != stdin) {
+        std::fclose(io.input);
+    }
+    if (output_file) {
+        if (std::fclose(io.output) != 0 && status == CRYPTO_STATUS_SUCCESS) {
+            status = CRYPTO_STATUS_IO_ERROR;
+        }
+        if (status != CRYPTO_STATUS_SUCCESS) {
+            std::remove(options.paths[1].c_str());
+        }
+    }
+
+    if (status != CRYPTO_STATUS_SUCCESS) {
+        std::fprintf(stderr, "cryptingtool-cli: %s failed: %s\n", options.command.c_str(),
+                     status_name(status));
+        return 1;
+    }
+    // Throughput counts the plaintext side
+    report(options, options.command.c_str(),
+           operation == CRYPTO_OPERATION_ENCRYPT ? io.bytes_in : io.bytes_out, seconds);
+    if (verify && !options.quiet) {
+        std::fprintf(stderr, "verify: OK\n");
+    }
+    return 0;
+}
+
+static int run_hash(const Options& options, CryptoBridgeContext* context) {
+#if defined(_WIN32)
+    if (is_std(options, 0)) {
+        std::fprintf(stderr, "cryptingtool-cli: hash needs a file name on Windows\n");
+        return 2;
+    }
+    const std::string path = options.paths[0];
+#else
+    const std::string path = is_std(options, 0) ? "/dev/stdin" : options.paths[0];
+#endif
+    unsigned char digest[64];
+    int digest_len = sizeof(digest);
+    const int status = crypto_bridge_hash_file(
+        context, options.hash, options.tree_hash ? CRYPTO_HASH_MODE_TREE : CRYPTO_HASH_MODE_PLAIN,
+        path.c_str(), digest, &digest_len);
+    if (status != CRYPTO_STATUS_SUCCESS) {
+        std::fprintf(stderr, "cryptingtool-cli: hash failed: %s\n", status_name(status));
+        return 1;
+    }
+    for (int i = 0; i < digest_len; ++i) {
+        std::printf("%02x", digest[i]);
+    }
+    std::printf("  %s\n", is_std(options, 0) ? "-" : options.paths[0].c_str());
+    return 0;
+}
+
+static int run_bench(const Options& options, CryptoBridgeContext* context) {
+    if (options.cipher_given) {
+        double mb_per_s = 0;
+        const int status = crypto_bridge_benchmark(context, options.algorithm, options.mode,
+                                                   options.key_size_bits, options.bench_size,
+                                                   options.bench_iterations, &mb_per_s);
+        if (status != CRYPTO_STATUS_SUCCESS) {
+            std::fprintf(stderr, "cryptingtool-cli: bench failed: %s\n", status_name(status));
+            return 1;
+        }
+        std::printf("%.1f MB/s\n", mb_per_s);
+        return 0;
+    }
+
+    std::vector<char> report_text(64 * 1024);
+    int len = static_cast<int>(report_text.size());
+    int status = crypto_bridge_benchmark_suite(options.bench_size, options.bench_iterations,
+                                               &report_text[0], &len);
+    if (status == CRYPTO_STATUS_OUTPUT_BUFFER_TOO_SMALL) {
+        report_text.resize(static_cast<size_t>(len));
+        status = crypto_bridge_benchmark_suite(options.bench_size, options.bench_iterations,
+                                               &report_text[0], &len);
+    }
+    if (status != CRYPTO_STATUS_SUCCESS) {
+        std::fprintf(stderr, "cryptingtool-cli: bench failed: %s\n", status_name(status));
+        return 1;
+    }
+    std::fputs(&report_text[0], stdout);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_args(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+
+    CryptoBridgeContext* context = crypto_bridge_context_create();
+    if (!context) {
+        std::fprintf(stderr, "cryptingtool-cli: %s\n", status_name(CRYPTO_STATUS_MEMORY_ERROR));
+        return 1;
+    }
+    const bool configured =
+        crypto_bridge_context_set_option(context, CRYPTO_OPTION_THREADS, options.threads) == 0 &&
+        crypto_bridge_context_set_option(context, CRYPTO_OPTION_COMPRESSION,
+                                         options.compress ? CRYPTO_COMPRESSION_DEFLATE
+                                                          : CRYPTO_COMPRESSION_NONE) == 0 &&
+        crypto_bridge_context_set_option(context, CRYPTO_OPTION_MAC, options.mac) == 0 &&
+        crypto_bridge_context_set_option(context, CRYPTO_OPTION_MEMORY_BUDGET,
+                                         options.memory_budget) == 0;
+
+    int result = 2;
+    if (!configured) {
+        std::fprintf(stderr, "cryptingtool-cli: invalid option value\n");
+    } else if (options.command == "encrypt" || options.command == "decrypt" ||
+               options.command == "verify") {
+        result = run_stream(options, context);
+    } else if (options.command == "hash") {
+        result = run_hash(options, context);
+    } else if (options.command == "bench") {
+        result = run_bench(options, context);
+    } else {
+        usage();
+    }
+    crypto_bridge_context_destroy(context);
+    return result;
+}